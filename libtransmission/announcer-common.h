@@ -9,13 +9,19 @@
 #error only the libtransmission announcer module should #include this header.
 #endif
 
+#include <algorithm> // std::max(), std::min()
 #include <array>
 #include <chrono>
+#include <cstddef> // size_t
 #include <cstdint> // uint64_t
+#include <ctime> // time_t
 #include <functional>
+#include <map>
 #include <optional>
+#include <queue>
 #include <string>
 #include <string_view>
+#include <utility> // std::pair
 #include <vector>
 
 #include "transmission.h"
@@ -164,6 +170,158 @@ auto inline constexpr TR_MULTISCRAPE_MAX = 60;
 auto inline constexpr TR_ANNOUNCE_TIMEOUT_SEC = std::chrono::seconds{ 45 };
 auto inline constexpr TR_SCRAPE_TIMEOUT_SEC = std::chrono::seconds{ 30 };
 
+/**
+ * How many announces and scrapes we let ourselves have in flight
+ * to a single tracker at once.
+ *
+ * The limit grows by one after each limit's worth of timely responses
+ * and is halved whenever a request times out or can't connect, so
+ * each tracker settles at about as much concurrency as it can handle.
+ */
+class tr_tracker_budget
+{
+public:
+    static auto constexpr InitialLimit = size_t{ 8U };
+    static auto constexpr MinLimit = size_t{ 1U };
+    static auto constexpr MaxLimit = size_t{ 64U };
+
+    [[nodiscard]] constexpr bool canSend() const noexcept
+    {
+        return in_flight_ < limit_;
+    }
+
+    [[nodiscard]] constexpr auto inFlight() const noexcept
+    {
+        return in_flight_;
+    }
+
+    [[nodiscard]] constexpr auto limit() const noexcept
+    {
+        return limit_;
+    }
+
+    constexpr void onSent() noexcept
+    {
+        ++in_flight_;
+    }
+
+    constexpr void onDone(bool tracker_kept_up) noexcept
+    {
+        if (in_flight_ > 0U)
+        {
+            --in_flight_;
+        }
+
+        if (!tracker_kept_up)
+        {
+            limit_ = std::max(MinLimit, limit_ / 2U);
+            n_kept_up_ = 0U;
+        }
+        else if (++n_kept_up_ >= limit_)
+        {
+            limit_ = std::min(MaxLimit, limit_ + 1U);
+            n_kept_up_ = 0U;
+        }
+    }
+
+private:
+    size_t in_flight_ = 0U;
+    size_t limit_ = InitialLimit;
+    size_t n_kept_up_ = 0U;
+};
+
+/**
+ * When each tier next needs to announce or scrape, as a min-heap so that
+ * upkeep only looks at the tiers that are due.
+ *
+ * A tier has at most one live entry per kind. Scheduling the same time
+ * again is a no-op, so a tier that keeps getting rescheduled while its
+ * tracker is busy doesn't pile up entries. Entries that were replaced by
+ * a different time are stale, and are skipped when they come due.
+ */
+class tr_tier_timers
+{
+public:
+    using Key = std::pair<tr_torrent_id_t, int>; // torrent id, tier id
+
+    enum class Kind : size_t
+    {
+        Announce,
+        Scrape
+    };
+
+    void schedule(Key const& key, Kind kind, time_t due)
+    {
+        auto& live = live_[key][static_cast<size_t>(kind)];
+        if (live == due)
+        {
+            return;
+        }
+
+        live = due;
+        heap_.push({ due, key, kind });
+    }
+
+    // @return the tiers whose scheduled times have come, in key order, each listed once.
+    // Their entries are used up, so schedule them again for their next times.
+    [[nodiscard]] std::vector<Key> popDue(time_t now)
+    {
+        auto due = std::vector<Key>{};
+
+        while (!std::empty(heap_) && heap_.top().due <= now)
+        {
+            auto const entry = heap_.top();
+            heap_.pop();
+
+            auto const iter = live_.find(entry.key);
+            if (iter == std::end(live_))
+            {
+                continue;
+            }
+
+            auto& live = iter->second;
+            if (auto& time = live[static_cast<size_t>(entry.kind)]; time == entry.due)
+            {
+                time = 0;
+                due.push_back(entry.key);
+            }
+
+            if (live == std::array<time_t, 2>{})
+            {
+                live_.erase(iter);
+            }
+        }
+
+        std::sort(std::begin(due), std::end(due));
+        due.erase(std::unique(std::begin(due), std::end(due)), std::end(due));
+        return due;
+    }
+
+    // @return how many entries are queued, including stale ones
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(heap_);
+    }
+
+private:
+    struct Entry
+    {
+        time_t due;
+        Key key;
+        Kind kind;
+
+        [[nodiscard]] constexpr bool operator>(Entry const& that) const noexcept
+        {
+            return due > that.due;
+        }
+    };
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> heap_;
+
+    // the due time of each tier's live entries, or 0 if it has none of that kind
+    std::map<Key, std::array<time_t, 2>> live_;
+};
+
 struct tr_scrape_request
 {
     /* the scrape URL */
@@ -177,6 +335,10 @@ struct tr_scrape_request
 
     /* how many hashes to use in the info_hash field */
     int info_hash_count = 0;
+
+    /* the most info hashes that this tracker currently accepts in one scrape.
+     * Scrapes that get sent together stay under the smallest of these. */
+    int multiscrape_max = TR_MULTISCRAPE_MAX;
 };
 
 struct tr_scrape_response_row
@@ -210,6 +372,10 @@ struct tr_scrape_response
     /* how many info hashes are in the 'rows' field */
     int row_count;
 
+    /* how many info hashes were in the scrape that got this response.
+     * More than row_count if this request was sent along with others. */
+    int n_hashes_sent = 0;
+
     /* the individual torrents' scrape results */
     std::array<tr_scrape_response_row, TR_MULTISCRAPE_MAX> rows;
 
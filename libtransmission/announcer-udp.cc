@@ -3,7 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm> // for std::find_if()
+#include <algorithm> // for std::any_of(), std::find_if(), std::max(), std::min()
 #include <cerrno> // for errno, EAFNOSUPPORT
 #include <climits> // for CHAR_BIT
 #include <cstring> // for memset()
@@ -52,6 +52,10 @@ using tau_transaction_t = uint32_t;
 
 constexpr auto TauConnectionTtlSecs = time_t{ 45 };
 
+// "Up to about 74 torrents can be scraped at once." -- BEP 15
+constexpr auto MaxScrapeHashesPerPacket = size_t{ 74 };
+static_assert(TR_MULTISCRAPE_MAX <= MaxScrapeHashesPerPacket);
+
 auto tau_transaction_new()
 {
     return tr_rand_obj<tau_transaction_t>();
@@ -71,7 +75,8 @@ enum tau_action_t
 struct tau_scrape_request
 {
     tau_scrape_request(tr_scrape_request const& in, tr_scrape_response_func on_response)
-        : on_response_{ std::move(on_response) }
+        : max_hashes_per_packet{ std::min(static_cast<size_t>(std::max(in.multiscrape_max, 1)), MaxScrapeHashesPerPacket) }
+        , on_response_{ std::move(on_response) }
     {
         this->response.scrape_url = in.scrape_url;
         this->response.row_count = in.info_hash_count;
@@ -82,16 +87,6 @@ struct tau_scrape_request
             this->response.rows[i].downloads = -1;
             this->response.rows[i].info_hash = in.info_hash[i];
         }
-
-        // build the payload
-        auto buf = libtransmission::Buffer{};
-        buf.add_uint32(TAU_ACTION_SCRAPE);
-        buf.add_uint32(transaction_id);
-        for (int i = 0; i < in.info_hash_count; ++i)
-        {
-            buf.add(in.info_hash[i]);
-        }
-        this->payload.insert(std::end(this->payload), std::begin(buf), std::end(buf));
     }
 
     [[nodiscard]] auto has_callback() const noexcept
@@ -99,6 +94,11 @@ struct tau_scrape_request
         return !!on_response_;
     }
 
+    [[nodiscard]] constexpr auto hashCount() const noexcept
+    {
+        return static_cast<size_t>(response.row_count);
+    }
+
     void requestFinished() const
     {
         if (on_response_)
@@ -115,27 +115,105 @@ struct tau_scrape_request
         requestFinished();
     }
 
-    void onResponse(tau_action_t action, libtransmission::Buffer& buf)
+    // consume this request's rows from the front of a scrape response
+    void onResponse(libtransmission::Buffer& buf)
     {
         response.did_connect = true;
         response.did_timeout = false;
 
-        if (action == TAU_ACTION_SCRAPE)
+        for (int i = 0; i < response.row_count; ++i)
         {
-            for (int i = 0; i < response.row_count; ++i)
+            if (std::size(buf) < sizeof(uint32_t) * 3)
             {
-                if (std::size(buf) < sizeof(uint32_t) * 3)
-                {
-                    break;
-                }
-
-                auto& row = response.rows[i];
-                row.seeders = buf.to_uint32();
-                row.downloads = buf.to_uint32();
-                row.leechers = buf.to_uint32();
+                break;
             }
 
-            requestFinished();
+            auto& row = response.rows[i];
+            row.seeders = buf.to_uint32();
+            row.downloads = buf.to_uint32();
+            row.leechers = buf.to_uint32();
+        }
+
+        requestFinished();
+    }
+
+    [[nodiscard]] constexpr auto expiresAt() const noexcept
+    {
+        return created_at_ + TR_SCRAPE_TIMEOUT_SEC.count();
+    }
+
+    tr_scrape_response response = {};
+
+    // the most hashes that the tracker will take in one packet
+    size_t const max_hashes_per_packet;
+
+private:
+    time_t const created_at_ = tr_time();
+
+    tr_scrape_response_func on_response_;
+};
+
+/**
+ * Scrapes to the same tracker, packed into a single packet.
+ *
+ * The tracker answers with one row per info hash in the order they were
+ * sent, so each request takes its rows from the front of the response.
+ */
+struct tau_scrape_batch
+{
+    tau_scrape_batch()
+    {
+        auto buf = libtransmission::Buffer{};
+        buf.add_uint32(TAU_ACTION_SCRAPE);
+        buf.add_uint32(transaction_id);
+        payload.insert(std::end(payload), std::begin(buf), std::end(buf));
+    }
+
+    [[nodiscard]] bool fits(tau_scrape_request const& req) const noexcept
+    {
+        return sent_at == 0 && n_hashes_ + req.hashCount() <= std::min(max_hashes_, req.max_hashes_per_packet);
+    }
+
+    void add(tau_scrape_request&& req)
+    {
+        TR_ASSERT(sent_at == 0);
+
+        for (size_t i = 0, n = req.hashCount(); i < n; ++i)
+        {
+            auto const& info_hash = req.response.rows[i].info_hash;
+            auto const* const begin = reinterpret_cast<std::byte const*>(std::data(info_hash));
+            payload.insert(std::end(payload), begin, begin + std::size(info_hash));
+        }
+
+        n_hashes_ += req.hashCount();
+        max_hashes_ = std::min(max_hashes_, req.max_hashes_per_packet);
+        expires_at_ = std::empty(requests_) ? req.expiresAt() : std::min(expires_at_, req.expiresAt());
+        requests_.emplace_back(std::move(req));
+    }
+
+    [[nodiscard]] bool has_callback() const noexcept
+    {
+        return std::any_of(std::begin(requests_), std::end(requests_), [](auto const& req) { return req.has_callback(); });
+    }
+
+    void fail(bool did_connect, bool did_timeout, std::string_view errmsg)
+    {
+        for (auto& req : requests_)
+        {
+            req.response.n_hashes_sent = static_cast<int>(n_hashes_);
+            req.fail(did_connect, did_timeout, errmsg);
+        }
+    }
+
+    void onResponse(tau_action_t action, libtransmission::Buffer& buf)
+    {
+        if (action == TAU_ACTION_SCRAPE)
+        {
+            for (auto& req : requests_)
+            {
+                req.response.n_hashes_sent = static_cast<int>(n_hashes_);
+                req.onResponse(buf);
+            }
         }
         else
         {
@@ -146,7 +224,7 @@ struct tau_scrape_request
 
     [[nodiscard]] constexpr auto expiresAt() const noexcept
     {
-        return created_at_ + TR_SCRAPE_TIMEOUT_SEC.count();
+        return expires_at_;
     }
 
     std::vector<std::byte> payload;
@@ -154,12 +232,11 @@ struct tau_scrape_request
     time_t sent_at = 0;
     tau_transaction_t const transaction_id = tau_transaction_new();
 
-    tr_scrape_response response = {};
-
 private:
-    time_t const created_at_ = tr_time();
-
-    tr_scrape_response_func on_response_;
+    std::vector<tau_scrape_request> requests_;
+    size_t n_hashes_ = 0;
+    size_t max_hashes_ = MaxScrapeHashesPerPacket;
+    time_t expires_at_ = 0;
 };
 
 // --- ANNOUNCE
@@ -332,6 +409,27 @@ struct tau_tracker
         this->upkeep();
     }
 
+    // Pack the scrapes queued since the last upkeep into as few packets as
+    // possible. Scrapes that are already waiting to be sent can take more.
+    void flush_scrapes()
+    {
+        for (auto& req : pending_scrapes)
+        {
+            auto it = std::find_if(
+                std::begin(this->scrapes),
+                std::end(this->scrapes),
+                [&req](auto const& batch) { return batch.fits(req); });
+            if (it == std::end(this->scrapes))
+            {
+                it = this->scrapes.emplace(it);
+            }
+
+            it->add(std::move(req));
+        }
+
+        pending_scrapes.clear();
+    }
+
     void upkeep(bool timeout_reqs = true)
     {
         time_t const now = tr_time();
@@ -438,11 +536,16 @@ private:
 
     [[nodiscard]] bool isIdle() const noexcept
     {
-        return std::empty(announces) && std::empty(scrapes) && !addr_pending_dns_;
+        return std::empty(announces) && std::empty(scrapes) && std::empty(pending_scrapes) && !addr_pending_dns_;
     }
 
     void failAll(bool did_connect, bool did_timeout, std::string_view errmsg)
     {
+        for (auto& req : this->pending_scrapes)
+        {
+            req.fail(did_connect, did_timeout, errmsg);
+        }
+
         for (auto& req : this->scrapes)
         {
             req.fail(did_connect, did_timeout, errmsg);
@@ -453,6 +556,7 @@ private:
             req.fail(did_connect, did_timeout, errmsg);
         }
 
+        this->pending_scrapes.clear();
         this->scrapes.clear();
         this->announces.clear();
     }
@@ -555,7 +659,10 @@ public:
     tau_transaction_t connection_transaction_id = {};
 
     std::list<tau_announce_request> announces;
-    std::list<tau_scrape_request> scrapes;
+    std::list<tau_scrape_batch> scrapes;
+
+    // scrapes that arrived since the last upkeep, waiting to be batched
+    std::vector<tau_scrape_request> pending_scrapes;
 
 private:
     Mediator& mediator_;
@@ -602,7 +709,9 @@ public:
             return;
         }
 
-        tracker->scrapes.emplace_back(request, std::move(on_response));
+        // don't send it right away: other scrapes to this tracker
+        // may arrive before the next upkeep and share its packet
+        tracker->pending_scrapes.emplace_back(request, std::move(on_response));
         tracker->upkeep(false);
     }
 
@@ -610,6 +719,7 @@ public:
     {
         for (auto& tracker : trackers_)
         {
+            tracker.flush_scrapes();
             tracker.upkeep();
         }
     }
@@ -673,7 +783,7 @@ public:
                 if (it != std::end(reqs))
                 {
                     logtrace(tracker.key, fmt::format("{} is a scrape request!", transaction_id));
-                    auto req = *it;
+                    auto req = std::move(*it);
                     it = reqs.erase(it);
                     req.onResponse(action_id, buf);
                     return true;
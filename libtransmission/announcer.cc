@@ -51,9 +51,9 @@ auto constexpr DefaultScrapeIntervalSec = int{ 60 * 30 };
 /* the value of the 'numwant' argument passed in tracker requests. */
 auto constexpr Numwant = int{ 80 };
 
-/* how often to announce & scrape */
-auto constexpr MaxAnnouncesPerUpkeep = int{ 20 };
-auto constexpr MaxScrapesPerUpkeep = int{ 20 };
+/* the most announces & scrapes to have in flight across all trackers.
+ * Each tracker also has its own limit; see tr_tracker_budget. */
+auto constexpr MaxRequestsInFlight = size_t{ 256U };
 
 /* how many infohashes to remove when we get a scrape-too-long error */
 auto constexpr TrMultiscrapeStep = int{ 5 };
@@ -119,6 +119,8 @@ struct tr_scrape_info
     }
 };
 
+struct tr_tier;
+
 /**
  * "global" (per-tr_session) fields
  */
@@ -159,6 +161,37 @@ public:
 
     void upkeep();
 
+    // Call this when a tier's announce or scrape time changes, or when it
+    // finishes a request, so that upkeep() looks at it again when it's due.
+    void scheduleTier(tr_tier const& tier);
+
+    // @return the tiers whose scheduled times have come, each listed once
+    [[nodiscard]] std::vector<tr_tier*> popDueTiers(time_t now);
+
+    [[nodiscard]] bool canSendTo(tr_interned_string const& host) const
+    {
+        if (n_requests_in_flight_ >= MaxRequestsInFlight)
+        {
+            return false;
+        }
+
+        auto const iter = budgets_.find(host);
+        return iter == std::end(budgets_) || iter->second.canSend();
+    }
+
+    void onRequestSent(tr_interned_string const& host)
+    {
+        ++n_requests_in_flight_;
+        budgets_[host].onSent();
+    }
+
+    void onRequestDone(tr_interned_string const& host, bool tracker_kept_up)
+    {
+        TR_ASSERT(n_requests_in_flight_ > 0U);
+        --n_requests_in_flight_;
+        budgets_[host].onDone(tracker_kept_up);
+    }
+
     void onAnnounceDone(int tier_id, tr_announce_event event, bool is_running_on_success, tr_announce_response const& response);
     void onScrapeDone(tr_scrape_response const& response);
 
@@ -245,6 +278,13 @@ private:
 
     std::map<tr_interned_string, tr_scrape_info> scrape_info_;
 
+    tr_tier_timers tier_timers_;
+
+    // keyed by tracker host
+    std::map<tr_interned_string, tr_tracker_budget> budgets_;
+
+    size_t n_requests_in_flight_ = 0;
+
     std::unique_ptr<libtransmission::Timer> const upkeep_timer_;
 
     std::set<tr_announce_request, StopsCompare> stops_;
@@ -338,8 +378,12 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
 /** @brief A group of trackers in a single tier, as per the multitracker spec */
 struct tr_tier
 {
-    tr_tier(tr_announcer_impl* announcer, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
-        : tor{ tor_in }
+    tr_tier(
+        tr_announcer_impl* announcer_in,
+        tr_torrent* tor_in,
+        std::vector<tr_announce_list::tracker_info const*> const& infos)
+        : announcer{ announcer_in }
+        , tor{ tor_in }
     {
         trackers.reserve(std::size(infos));
         for (auto const* info : infos)
@@ -465,6 +509,7 @@ struct tr_tier
     void scheduleNextScrape(time_t interval_secs)
     {
         this->scrapeAt = getNextScrapeTime(tor->session, this, interval_secs);
+        announcer->scheduleTier(*this);
     }
 
     std::deque<tr_announce_event> announce_events;
@@ -480,6 +525,8 @@ struct tr_tier
 
     std::optional<size_t> current_tracker_index_;
 
+    tr_announcer_impl* const announcer;
+
     tr_torrent* const tor;
 
     time_t scrapeAt = 0;
@@ -833,6 +880,8 @@ void tier_announce_event_push(tr_tier* tier, tr_announce_event e, time_t announc
 
     tr_logAddTrace_tier_announce_queue(tier);
     tr_logAddTraceTier(tier, fmt::format("announcing in {} seconds", difftime(announce_at, tr_time())));
+
+    tier->announcer->scheduleTier(*tier);
 }
 
 auto tier_announce_event_pull(tr_tier* tier)
@@ -1146,6 +1195,9 @@ void tr_announcer_impl::onAnnounceDone(
             tier_announce_event_push(tier, TR_ANNOUNCE_EVENT_NONE, now + i);
         }
     }
+
+    // events may have been queued while we were announcing
+    scheduleTier(*tier);
 }
 
 void tr_announcer_impl::startTorrent(tr_torrent* tor)
@@ -1276,7 +1328,7 @@ void checkMultiscrapeMax(tr_announcer_impl* announcer, tr_scrape_response const&
     // error. So if N parallel multiscrapes all have the same `max`
     // and error out, lower the value once for that batch, not N times.
     int& multiscrape_max = scrape_info->multiscrape_max;
-    if (multiscrape_max < response.row_count)
+    if (multiscrape_max < std::max(response.row_count, response.n_hashes_sent))
     {
         return;
     }
@@ -1389,6 +1441,9 @@ void tr_announcer_impl::onScrapeDone(tr_scrape_response const& response)
                 publishPeerCounts(tier, row.seeders, row.leechers);
             }
         }
+
+        // an announce may have been waiting for this scrape to finish
+        scheduleTier(*tier);
     }
 
     checkMultiscrapeMax(this, response);
@@ -1399,8 +1454,8 @@ namespace
 void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tiers)
 {
     auto const now = tr_time();
-    auto requests = std::array<tr_scrape_request, MaxScrapesPerUpkeep>{};
-    auto request_count = size_t{};
+    auto requests = std::vector<tr_scrape_request>{};
+    auto hosts = std::vector<tr_interned_string>{};
 
     // batch as many info_hashes into a request as we can
     for (auto* tier : tiers)
@@ -1422,7 +1477,7 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
         bool found = false;
 
         /* if there's a request with this scrape URL and a free slot, use it */
-        for (size_t j = 0; !found && j < request_count; ++j)
+        for (size_t j = 0, n = std::size(requests); !found && j < n; ++j)
         {
             auto* const req = &requests[j];
 
@@ -1443,11 +1498,12 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             found = true;
         }
 
-        /* otherwise, if there's room for another request, build a new one */
-        if (!found && request_count < MaxScrapesPerUpkeep)
+        /* otherwise, if the tracker has room for another request, build a new one */
+        if (!found && announcer->canSendTo(current_tracker->host))
         {
-            auto* const req = &requests[request_count];
+            auto* const req = &requests.emplace_back();
             req->scrape_url = scrape_info->scrape_url;
+            req->multiscrape_max = scrape_info->multiscrape_max;
             tier->buildLogName(req->log_name, sizeof(req->log_name));
 
             req->info_hash[req->info_hash_count] = tier->tor->infoHash();
@@ -1455,19 +1511,28 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
 
-            ++request_count;
+            hosts.emplace_back(current_tracker->host);
+            announcer->onRequestSent(current_tracker->host);
+            found = true;
+        }
+
+        /* otherwise, try again when the tracker has caught up */
+        if (!found)
+        {
+            announcer->scheduleTier(*tier);
         }
     }
 
     /* send the requests we just built */
-    for (size_t i = 0; i < request_count; ++i)
+    for (size_t i = 0, n = std::size(requests); i < n; ++i)
     {
         announcer->scrape(
             requests[i],
-            [session = announcer->session, announcer](tr_scrape_response const& response)
+            [session = announcer->session, announcer, host = hosts[i]](tr_scrape_response const& response)
             {
                 if (session->announcer_)
                 {
+                    announcer->onRequestDone(host, response.did_connect && !response.did_timeout);
                     announcer->onScrapeDone(response);
                 }
             });
@@ -1528,6 +1593,7 @@ void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
     tr_torrent* tor = tier->tor;
     auto const event = tier_announce_event_pull(tier);
     auto const req = create_announce_request(announcer, tor, tier, event);
+    auto const host = tier->currentTracker()->host;
 
     tier->isAnnouncing = true;
     tier->lastAnnounceStartTime = now;
@@ -1535,12 +1601,15 @@ void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
     auto tier_id = tier->id;
     auto is_running_on_success = tor->isRunning;
 
+    announcer->onRequestSent(host);
     announcer->announce(
         req,
-        [session = announcer->session, announcer, tier_id, event, is_running_on_success](tr_announce_response const& response)
+        [session = announcer->session, announcer, host, tier_id, event, is_running_on_success](
+            tr_announce_response const& response)
         {
             if (session->announcer_)
             {
+                announcer->onRequestDone(host, response.did_connect && !response.did_timeout);
                 announcer->onAnnounceDone(tier_id, event, is_running_on_success, response);
             }
         });
@@ -1550,22 +1619,20 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
 {
     auto const now = tr_time();
 
-    /* build a list of tiers that need to be announced */
+    /* build a list of tiers that need to be announced.
+     * Tiers that are busy now get rescheduled when they finish. */
     auto announce_me = std::vector<tr_tier*>{};
     auto scrape_me = std::vector<tr_tier*>{};
-    for (auto* const tor : announcer->session->torrents())
+    for (auto* const tier : announcer->popDueTiers(now))
     {
-        for (auto& tier : tor->torrent_announcer->tiers)
+        if (tier->needsToAnnounce(now))
         {
-            if (tier.needsToAnnounce(now))
-            {
-                announce_me.push_back(&tier);
-            }
+            announce_me.push_back(tier);
+        }
 
-            if (tier.needsToScrape(now))
-            {
-                scrape_me.push_back(&tier);
-            }
+        if (tier->needsToScrape(now))
+        {
+            scrape_me.push_back(tier);
         }
     }
 
@@ -1575,20 +1642,22 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
      * us which swarms are interesting and should be announced next. */
     multiscrape(announcer, scrape_me);
 
-    /* Second, announce what we can. If there aren't enough slots
-     * available, use compareAnnounceTiers to prioritize. */
-    if (announce_me.size() > MaxAnnouncesPerUpkeep)
-    {
-        std::partial_sort(
-            std::begin(announce_me),
-            std::begin(announce_me) + MaxAnnouncesPerUpkeep,
-            std::end(announce_me),
-            [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
-        announce_me.resize(MaxAnnouncesPerUpkeep);
-    }
+    /* Second, announce what we can. If a tracker doesn't have enough
+     * slots available, use compareAnnounceTiers to prioritize. */
+    std::sort(
+        std::begin(announce_me),
+        std::end(announce_me),
+        [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
 
-    for (auto*& tier : announce_me)
+    for (auto* const tier : announce_me)
     {
+        auto const* const tracker = tier->currentTracker();
+        if (tracker != nullptr && !announcer->canSendTo(tracker->host))
+        {
+            announcer->scheduleTier(*tier);
+            continue;
+        }
+
         tr_logAddTraceTier(tier, "Announcing to tracker");
         tierAnnounce(announcer, tier);
     }
@@ -1596,6 +1665,39 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
 } // namespace upkeep_helpers
 } // namespace
 
+void tr_announcer_impl::scheduleTier(tr_tier const& tier)
+{
+    auto const key = tr_tier_timers::Key{ tier.tor->id(), tier.id };
+
+    if (tier.announceAt != 0)
+    {
+        tier_timers_.schedule(key, tr_tier_timers::Kind::Announce, tier.announceAt);
+    }
+
+    if (tier.scrapeAt != 0)
+    {
+        tier_timers_.schedule(key, tr_tier_timers::Kind::Scrape, tier.scrapeAt);
+    }
+}
+
+std::vector<tr_tier*> tr_announcer_impl::popDueTiers(time_t now)
+{
+    auto due = std::vector<tr_tier*>{};
+
+    for (auto const& [tor_id, tier_id] : tier_timers_.popDue(now))
+    {
+        if (auto* const tor = session->torrents().get(tor_id); tor != nullptr && tor->torrent_announcer != nullptr)
+        {
+            if (auto* const tier = tor->torrent_announcer->getTier(tier_id); tier != nullptr)
+            {
+                due.push_back(tier);
+            }
+        }
+    }
+
+    return due;
+}
+
 void tr_announcer_impl::upkeep()
 {
     using namespace upkeep_helpers;
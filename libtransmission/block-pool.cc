@@ -0,0 +1,128 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "block-pool.h"
+
+tr_block_pool::Buf& tr_block_pool::Buf::operator=(Buf&& that) noexcept
+{
+    if (this != &that)
+    {
+        release();
+        pool_ = std::move(that.pool_);
+        data_ = std::move(that.data_);
+        size_ = std::exchange(that.size_, 0U);
+        size_class_ = that.size_class_;
+    }
+
+    return *this;
+}
+
+tr_block_pool::Buf::~Buf()
+{
+    release();
+}
+
+void tr_block_pool::Buf::release() noexcept
+{
+    if (pool_ && data_ && size_class_ < NumClasses)
+    {
+        pool_->put(size_class_, std::move(data_));
+    }
+
+    data_.reset();
+    pool_.reset();
+    size_ = 0U;
+}
+
+// ---
+
+std::shared_ptr<tr_block_pool> tr_block_pool::create(size_t max_pooled_bytes)
+{
+    return std::shared_ptr<tr_block_pool>{ new tr_block_pool{ max_pooled_bytes } };
+}
+
+size_t tr_block_pool::sizeClass(size_t size) noexcept
+{
+    auto size_class = size_t{};
+    while (size_class < NumClasses && classSize(size_class) < size)
+    {
+        ++size_class;
+    }
+
+    return size_class;
+}
+
+tr_block_pool::Buf tr_block_pool::get(size_t size)
+{
+    auto const size_class = sizeClass(size);
+
+    {
+        auto const lock = std::unique_lock{ mutex_ };
+
+        if (size_class < NumClasses && !std::empty(free_[size_class]))
+        {
+            auto& free = free_[size_class];
+            auto data = std::move(free.back());
+            free.pop_back();
+            stats_.pooled_bytes -= classSize(size_class);
+            ++stats_.reuses;
+            return { shared_from_this(), std::move(data), size, size_class };
+        }
+
+        ++stats_.allocations;
+    }
+
+    auto const alloc_size = size_class < NumClasses ? classSize(size_class) : size;
+    // not make_unique(), which would zero the buffer
+    return { shared_from_this(), std::unique_ptr<uint8_t[]>{ new uint8_t[alloc_size] }, size, size_class };
+}
+
+void tr_block_pool::put(size_t size_class, std::unique_ptr<uint8_t[]> data)
+{
+    auto const lock = std::unique_lock{ mutex_ };
+
+    if (stats_.pooled_bytes + classSize(size_class) > max_pooled_bytes_)
+    {
+        ++stats_.discards;
+        return;
+    }
+
+    free_[size_class].emplace_back(std::move(data));
+    stats_.pooled_bytes += classSize(size_class);
+}
+
+void tr_block_pool::setMaxPooledBytes(size_t max_pooled_bytes)
+{
+    auto const lock = std::unique_lock{ mutex_ };
+    max_pooled_bytes_ = max_pooled_bytes;
+    trim();
+}
+
+void tr_block_pool::trim()
+{
+    for (auto size_class = NumClasses; size_class > 0U && stats_.pooled_bytes > max_pooled_bytes_; --size_class)
+    {
+        auto& free = free_[size_class - 1U];
+        while (!std::empty(free) && stats_.pooled_bytes > max_pooled_bytes_)
+        {
+            free.pop_back();
+            stats_.pooled_bytes -= classSize(size_class - 1U);
+        }
+    }
+}
+
+tr_block_pool::Stats tr_block_pool::stats() const
+{
+    auto const lock = std::unique_lock{ mutex_ };
+    auto ret = stats_;
+    ret.limit = max_pooled_bytes_;
+    return ret;
+}
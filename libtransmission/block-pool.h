@@ -0,0 +1,118 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint8_t, uint64_t
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A pool of buffers for incoming block data, so that the buffers can be
+// recycled instead of being allocated and freed for every block.
+// Requested sizes are rounded up to a power of two between 1 KiB and
+// 16 KiB; larger buffers are not pooled. Thread-safe, since webseed
+// blocks are received outside of the session thread.
+class tr_block_pool : public std::enable_shared_from_this<tr_block_pool>
+{
+public:
+    // A buffer borrowed from the pool. It's returned when destroyed.
+    class Buf
+    {
+    public:
+        Buf() = default;
+        Buf(Buf&&) noexcept = default;
+        Buf(Buf const&) = delete;
+        Buf& operator=(Buf&& that) noexcept;
+        Buf& operator=(Buf const&) = delete;
+        ~Buf();
+
+        [[nodiscard]] uint8_t* data() noexcept
+        {
+            return data_.get();
+        }
+
+        [[nodiscard]] uint8_t const* data() const noexcept
+        {
+            return data_.get();
+        }
+
+        [[nodiscard]] constexpr size_t size() const noexcept
+        {
+            return size_;
+        }
+
+    private:
+        friend class tr_block_pool;
+
+        Buf(std::shared_ptr<tr_block_pool> pool, std::unique_ptr<uint8_t[]> data, size_t size, size_t size_class) noexcept
+            : pool_{ std::move(pool) }
+            , data_{ std::move(data) }
+            , size_{ size }
+            , size_class_{ size_class }
+        {
+        }
+
+        void release() noexcept;
+
+        std::shared_ptr<tr_block_pool> pool_;
+        std::unique_ptr<uint8_t[]> data_;
+        size_t size_ = 0;
+        size_t size_class_ = 0;
+    };
+
+    struct Stats
+    {
+        size_t pooled_bytes = 0; // free buffers waiting to be reused
+        size_t limit = 0;
+        uint64_t allocations = 0;
+        uint64_t reuses = 0;
+        uint64_t discards = 0; // buffers freed because the pool was full
+    };
+
+    static auto constexpr DefaultMaxPooledBytes = size_t{ 4U * 1024U * 1024U };
+
+    [[nodiscard]] static std::shared_ptr<tr_block_pool> create(size_t max_pooled_bytes = DefaultMaxPooledBytes);
+
+    // @return a buffer of `size` bytes. Its contents are unspecified.
+    [[nodiscard]] Buf get(size_t size);
+
+    void setMaxPooledBytes(size_t max_pooled_bytes);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    static auto constexpr SmallestClassSize = size_t{ 1024U };
+    static auto constexpr NumClasses = size_t{ 5U }; // 1 KiB .. 16 KiB
+
+    explicit tr_block_pool(size_t max_pooled_bytes) noexcept
+        : max_pooled_bytes_{ max_pooled_bytes }
+    {
+    }
+
+    [[nodiscard]] static constexpr size_t classSize(size_t size_class) noexcept
+    {
+        return SmallestClassSize << size_class;
+    }
+
+    // @return the smallest class that fits `size`, or NumClasses if none does
+    [[nodiscard]] static size_t sizeClass(size_t size) noexcept;
+
+    void put(size_t size_class, std::unique_ptr<uint8_t[]> data);
+
+    // Free pooled buffers, largest first, until they fit in the limit.
+    void trim();
+
+    mutable std::mutex mutex_;
+    std::array<std::vector<std::unique_ptr<uint8_t[]>>, NumClasses> free_;
+    size_t max_pooled_bytes_;
+    Stats stats_;
+};
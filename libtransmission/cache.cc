@@ -4,11 +4,15 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdlib> // std::lldiv()
+#include <deque>
 #include <iterator> // std::distance(), std::next(), std::prev()
 #include <limits> // std::numeric_limits<size_t>::max()
 #include <memory>
-#include <numeric> // std::accumulate()
+#include <optional>
+#include <string>
 #include <utility> // std::make_pair()
 #include <vector>
 
@@ -16,19 +20,23 @@
 
 #include "transmission.h"
 #include "cache.h"
+#include "crypto-utils.h"
+#include "file.h" // tr_sys_iovec
 #include "inout.h"
 #include "log.h"
 #include "torrent.h"
 #include "torrents.h"
 #include "tr-assert.h"
-#include "utils.h" // tr_time(), tr_formatter
+#include "tr-buffer.h"
+#include "utils.h" // tr_formatter
+#include "write-behind.h"
 
 Cache::Key Cache::makeKey(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
 {
     return std::make_pair(torrent->id(), loc.block);
 }
 
-std::pair<Cache::CIter, Cache::CIter> Cache::findContiguous(CIter const begin, CIter const end, CIter const iter) noexcept
+std::pair<Cache::Iter, Cache::Iter> Cache::findContiguous(Iter const begin, Iter const end, Iter const iter) noexcept
 {
     if (iter == end)
     {
@@ -36,7 +44,7 @@ std::pair<Cache::CIter, Cache::CIter> Cache::findContiguous(CIter const begin, C
     }
 
     auto span_begin = iter;
-    for (auto key = iter->key;;)
+    for (auto key = iter->first;;)
     {
         if (span_begin == begin)
         {
@@ -45,14 +53,16 @@ std::pair<Cache::CIter, Cache::CIter> Cache::findContiguous(CIter const begin, C
 
         --key.second;
         auto const prev = std::prev(span_begin);
-        if (prev->key != key)
+        if (prev->first != key)
         {
             break;
         }
+
+        span_begin = prev;
     }
 
     auto span_end = std::next(iter);
-    for (auto key = iter->key;;)
+    for (auto key = iter->first;;)
     {
         if (span_end == end)
         {
@@ -60,44 +70,35 @@ std::pair<Cache::CIter, Cache::CIter> Cache::findContiguous(CIter const begin, C
         }
 
         ++key.second;
-        if (span_end->key != key)
+        if (span_end->first != key)
         {
             break;
         }
+
+        ++span_end;
     }
 
     return std::make_pair(span_begin, span_end);
 }
 
-int Cache::writeContiguous(CIter const begin, CIter const end) const
+int Cache::writeContiguous(CIter const begin, CIter const end)
 {
-    // The most common case without an extra data copy.
-    auto const* towrite = begin->buf.get();
-
-    // Contiguous area to join more than one block, if any.
-    auto buf = std::vector<uint8_t>{};
-
-    if (end - begin > 1)
+    // gather the blocks straight from the arena instead of joining them into a temporary buffer
+    auto bufs = std::vector<tr_sys_iovec>{};
+    bufs.reserve(std::distance(begin, end));
+    auto buflen = size_t{};
+    for (auto iter = begin; iter != end; ++iter)
     {
-        // Yes, there are.
-        auto const buflen = std::accumulate(
-            begin,
-            end,
-            size_t{},
-            [](size_t sum, auto const& block) { return sum + std::size(*block.buf); });
-        buf.reserve(buflen);
-        for (auto iter = begin; iter != end; ++iter)
-        {
-            TR_ASSERT(begin->key.first == iter->key.first);
-            TR_ASSERT(begin->key.second + std::distance(begin, iter) == iter->key.second);
-            buf.insert(std::end(buf), std::begin(*iter->buf), std::end(*iter->buf));
-        }
-        TR_ASSERT(std::size(buf) == buflen);
-        towrite = &buf;
+        TR_ASSERT(begin->first.first == iter->first.first);
+        TR_ASSERT(begin->first.second + std::size(bufs) == iter->first.second);
+
+        auto const& block = iter->second;
+        bufs.push_back({ arena_->data(block.slot), block.length });
+        buflen += block.length;
     }
 
     // save it
-    auto const& [torrent_id, block] = begin->key;
+    auto const& [torrent_id, block] = begin->first;
     auto* const tor = torrents_.get(torrent_id);
     if (tor == nullptr)
     {
@@ -105,14 +106,42 @@ int Cache::writeContiguous(CIter const begin, CIter const end) const
     }
 
     auto const loc = tor->blockLoc(block);
+    auto const started_at = std::chrono::steady_clock::now();
 
-    if (auto const err = tr_ioWrite(tor, loc, std::size(*towrite), std::data(*towrite)); err != 0)
+    if (!write_behind_)
     {
-        return err;
+        auto const err = tr_ioWrite(tor, loc, std::data(bufs), std::size(bufs));
+        recordFlushLatency(std::chrono::steady_clock::now() - started_at);
+        if (err != 0)
+        {
+            return err;
+        }
+    }
+    else
+    {
+        auto task = tr_write_behind::Task{};
+        if (auto const err = tr_ioPrepareWrite(tor, loc, std::data(bufs), std::size(bufs), *write_behind_, task); err != 0)
+        {
+            return err;
+        }
+
+        // keep the slots alive, and readable, until the write is done
+        task.id = next_write_id_++;
+        auto& in_flight = writes_in_flight_[task.id];
+        in_flight.started_at = started_at;
+        for (auto iter = begin; iter != end; ++iter)
+        {
+            auto const& [key, cache_block] = *iter;
+            arena_->ref(cache_block.slot);
+            in_flight.blocks.emplace_back(key, cache_block.slot);
+            blocks_being_written_.insert_or_assign(key, cache_block.slot);
+        }
+
+        write_behind_->add(std::move(task));
     }
 
-    ++disk_writes_;
-    disk_write_bytes_ += std::size(*towrite);
+    ++stats_.disk_writes;
+    stats_.disk_write_bytes += buflen;
     return {};
 }
 
@@ -128,7 +157,14 @@ int Cache::setLimit(int64_t new_limit)
 
     tr_logAddDebug(fmt::format("Maximum cache size set to {} ({} blocks)", tr_formatter_mem_B(max_bytes_), max_blocks_));
 
-    return cacheTrim();
+    if (write_behind_)
+    {
+        write_behind_->setMaxQueuedBytes(std::max(max_bytes_, tr_write_behind::DefaultMaxQueuedBytes));
+    }
+
+    auto const err = cacheTrim();
+    arena_->releaseUnusedSlabs();
+    return err;
 }
 
 Cache::Cache(tr_torrents& torrents, int64_t max_bytes)
@@ -140,67 +176,347 @@ Cache::Cache(tr_torrents& torrents, int64_t max_bytes)
 
 // ---
 
-int Cache::writeBlock(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>> writeme)
+size_t Cache::Arena::acquire()
+{
+    if (std::empty(free_slots_))
+    {
+        // reuse a released slab's index if there is one
+        auto const slab_iter = std::find(std::begin(slabs_), std::end(slabs_), nullptr);
+        auto const slab = static_cast<size_t>(std::distance(std::begin(slabs_), slab_iter));
+        if (slab_iter == std::end(slabs_))
+        {
+            slabs_.emplace_back();
+            slab_use_counts_.emplace_back();
+            refcounts_.resize(std::size(refcounts_) + SlotsPerSlab);
+        }
+
+        slabs_[slab] = std::make_unique<uint8_t[]>(SlotsPerSlab * tr_block_info::BlockSize);
+
+        // push in reverse order so that the slab is used from the front
+        for (size_t i = SlotsPerSlab; i > 0U; --i)
+        {
+            free_slots_.emplace_back(slab * SlotsPerSlab + i - 1U);
+        }
+    }
+
+    auto const slot = free_slots_.back();
+    free_slots_.pop_back();
+    refcounts_[slot] = 1U;
+    ++slab_use_counts_[slot / SlotsPerSlab];
+    return slot;
+}
+
+void Cache::Arena::unref(size_t slot)
+{
+    TR_ASSERT(refcounts_[slot] > 0U);
+
+    if (--refcounts_[slot] == 0U)
+    {
+        --slab_use_counts_[slot / SlotsPerSlab];
+        free_slots_.emplace_back(slot);
+    }
+}
+
+void Cache::Arena::releaseUnusedSlabs()
+{
+    auto const is_unused = [this](size_t slab)
+    {
+        return slabs_[slab] && slab_use_counts_[slab] == 0U;
+    };
+
+    auto const old_free_count = std::size(free_slots_);
+    free_slots_.erase(
+        std::remove_if(
+            std::begin(free_slots_),
+            std::end(free_slots_),
+            [&is_unused](size_t slot) { return is_unused(slot / SlotsPerSlab); }),
+        std::end(free_slots_));
+
+    if (std::size(free_slots_) == old_free_count)
+    {
+        return;
+    }
+
+    for (size_t slab = 0, n = std::size(slabs_); slab < n; ++slab)
+    {
+        if (is_unused(slab))
+        {
+            slabs_[slab].reset();
+        }
+    }
+}
+
+size_t Cache::Arena::allocatedBytes() const noexcept
+{
+    auto const n_slabs = std::count_if(std::begin(slabs_), std::end(slabs_), [](auto const& slab) { return !!slab; });
+    return static_cast<size_t>(n_slabs) * SlotsPerSlab * tr_block_info::BlockSize;
+}
+
+// ---
+
+void Cache::linkNewest(BlockNode* node) noexcept
+{
+    auto& block = node->second;
+    block.older = newest_;
+    block.newer = nullptr;
+
+    if (newest_ != nullptr)
+    {
+        newest_->second.newer = node;
+    }
+    else
+    {
+        oldest_ = node;
+    }
+
+    newest_ = node;
+}
+
+void Cache::unlink(BlockNode* node) noexcept
+{
+    auto& block = node->second;
+
+    if (block.older != nullptr)
+    {
+        block.older->second.newer = block.newer;
+    }
+    else
+    {
+        oldest_ = block.newer;
+    }
+
+    if (block.newer != nullptr)
+    {
+        block.newer->second.older = block.older;
+    }
+    else
+    {
+        newest_ = block.older;
+    }
+
+    block.older = block.newer = nullptr;
+}
+
+// ---
+
+int Cache::writeBlock(tr_torrent_id_t tor_id, tr_block_index_t block, tr_block_pool::Buf writeme)
 {
-    auto const key = Key{ tor_id, block };
-    auto iter = std::lower_bound(std::begin(blocks_), std::end(blocks_), key, CompareCacheBlockByKey{});
-    if (iter == std::end(blocks_) || iter->key != key)
+    auto const length = std::size(writeme);
+    TR_ASSERT(length <= tr_block_info::BlockSize);
+
+    auto [iter, inserted] = blocks_.try_emplace(Key{ tor_id, block });
+    auto* const node = &*iter;
+    auto& cache_block = node->second;
+
+    if (!inserted)
     {
-        iter = blocks_.emplace(iter);
-        iter->key = key;
+        // Don't overwrite the old slot in place;
+        // it might still be referenced by a Buffer.
+        unlink(node);
+        arena_->unref(cache_block.slot);
     }
 
-    iter->time_added = tr_time();
+    // the read-ahead copy of the block, if any, is stale now
+    eraseReadAhead(Key{ tor_id, block }, Key{ tor_id, block + 1 });
+
+    cache_block.slot = arena_->acquire();
+    cache_block.length = static_cast<uint32_t>(length);
+    std::copy_n(std::data(writeme), length, arena_->data(cache_block.slot));
+    linkNewest(node);
 
-    iter->buf = std::move(writeme);
+    ++stats_.blocks_written;
 
-    ++cache_writes_;
-    cache_write_bytes_ += std::size(*iter->buf);
+    // hash the block while it's still in the cache
+    updatePieceHashes(tor_id, block);
 
     return cacheTrim();
 }
 
-Cache::CIter Cache::getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
+std::optional<size_t> Cache::getSlot(Key const& key) const noexcept
 {
-    if (auto const [begin, end] = std::equal_range(
-            std::begin(blocks_),
-            std::end(blocks_),
-            makeKey(torrent, loc),
-            CompareCacheBlockByKey{});
-        begin < end)
+    if (auto const iter = blocks_.find(key); iter != std::end(blocks_))
+    {
+        return iter->second.slot;
+    }
+
+    if (auto const iter = blocks_being_written_.find(key); iter != std::end(blocks_being_written_))
+    {
+        return iter->second;
+    }
+
+    if (auto const iter = read_ahead_.find(key); iter != std::end(read_ahead_))
     {
-        return begin;
+        return iter->second.slot;
     }
 
-    return std::end(blocks_);
+    return {};
+}
+
+std::optional<size_t> Cache::getSlotForRead(Key const& key) noexcept
+{
+    if (auto const iter = read_ahead_.find(key); iter != std::end(read_ahead_) && !iter->second.used)
+    {
+        iter->second.used = true;
+        ++stats_.read_ahead_blocks_used;
+    }
+
+    auto const slot = getSlot(key);
+    ++(slot ? stats_.read_hits : stats_.read_misses);
+    return slot;
 }
 
 int Cache::readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, uint8_t* setme)
 {
-    if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
+    if (auto const slot = getSlot(makeKey(torrent, loc)); slot)
     {
-        std::copy_n(std::begin(*iter->buf), len, setme);
+        std::copy_n(arena_->data(*slot), len, setme);
         return {};
     }
 
     return tr_ioRead(torrent, loc, len, setme);
 }
 
+int Cache::readBlock(
+    tr_torrent* torrent,
+    tr_block_info::Location loc,
+    uint32_t len,
+    libtransmission::Buffer& out,
+    bool allow_file_ref)
+{
+    if (auto const found = getSlotForRead(makeKey(torrent, loc)); found)
+    {
+        // keep the slot alive until `out` is done with it,
+        // even if it gets flushed from the cache before then
+        using SlotRef = std::pair<std::shared_ptr<Arena>, size_t>;
+        auto const slot = *found;
+        arena_->ref(slot);
+        out.add_reference(
+            arena_->data(slot),
+            len,
+            [](void const* /*data*/, size_t /*datalen*/, void* vref)
+            {
+                auto* const ref = static_cast<SlotRef*>(vref);
+                ref->first->unref(ref->second);
+                delete ref;
+            },
+            new SlotRef{ arena_, slot });
+        return {};
+    }
+
+    return tr_ioRead(torrent, loc, len, out, allow_file_ref);
+}
+
 int Cache::prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len)
 {
-    if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
+    if (getSlot(makeKey(torrent, loc)))
     {
         return {}; // already have it
     }
 
+    // Peers almost always ask for a piece's blocks in order, so one
+    // large sequential read now saves many small random reads later.
+    if (read_ahead_bytes_ != 0U && max_blocks_ >= 2U && torrent->hasPiece(loc.piece))
+    {
+        return readAhead(torrent, loc.block);
+    }
+
     return tr_ioPrefetch(torrent, loc, len);
 }
 
+int Cache::readAhead(tr_torrent* torrent, tr_block_index_t block)
+{
+    auto const tor_id = torrent->id();
+
+    // Read the uncached blocks from `block` up to the end of its piece,
+    // but leave at least half of the cache for blocks being downloaded.
+    auto const max_blocks = std::min(read_ahead_bytes_ / tr_block_info::BlockSize, max_blocks_ / 2U);
+    auto const end_block = std::min(
+        torrent->blockSpanForPiece(torrent->blockLoc(block).piece).end,
+        static_cast<tr_block_index_t>(block + std::max(max_blocks, size_t{ 1U })));
+
+    auto slots = std::vector<size_t>{};
+    auto bufs = std::vector<tr_sys_iovec>{};
+    for (auto walk = block; walk < end_block && !getSlot(Key{ tor_id, walk }); ++walk)
+    {
+        auto const slot = slots.emplace_back(arena_->acquire());
+        bufs.push_back({ arena_->data(slot), torrent->blockSize(walk) });
+    }
+
+    if (auto const err = tr_ioRead(torrent, torrent->blockLoc(block), std::data(bufs), std::size(bufs)); err != 0)
+    {
+        for (auto const slot : slots)
+        {
+            arena_->unref(slot);
+        }
+
+        return err;
+    }
+
+    for (size_t i = 0, n = std::size(slots); i < n; ++i)
+    {
+        auto const key = Key{ tor_id, static_cast<tr_block_index_t>(block + i) };
+        auto const sequence = next_read_ahead_sequence_++;
+        read_ahead_.try_emplace(key, ReadAheadBlock{ slots[i], sequence });
+        read_ahead_order_.emplace_back(key, sequence);
+    }
+
+    stats_.read_ahead_blocks += std::size(slots);
+
+    return cacheTrim();
+}
+
+void Cache::eraseReadAhead(Key const& begin, Key const& end)
+{
+    auto const range_begin = read_ahead_.lower_bound(begin);
+    auto const range_end = read_ahead_.lower_bound(end);
+
+    for (auto iter = range_begin; iter != range_end; ++iter)
+    {
+        arena_->unref(iter->second.slot);
+    }
+
+    read_ahead_.erase(range_begin, range_end);
+
+    // forget about stale entries once nothing else is left to evict
+    if (std::empty(read_ahead_))
+    {
+        read_ahead_order_.clear();
+    }
+}
+
+void Cache::evictOldestReadAhead()
+{
+    while (!std::empty(read_ahead_order_))
+    {
+        auto const [key, sequence] = read_ahead_order_.front();
+        read_ahead_order_.pop_front();
+
+        // skip entries for blocks that were already erased
+        if (auto const iter = read_ahead_.find(key); iter != std::end(read_ahead_) && iter->second.sequence == sequence)
+        {
+            arena_->unref(iter->second.slot);
+            read_ahead_.erase(iter);
+            return;
+        }
+    }
+}
+
 // ---
 
-int Cache::flushSpan(CIter const begin, CIter const end)
+void Cache::erase(Iter const begin, Iter const end)
+{
+    for (auto iter = begin; iter != end; ++iter)
+    {
+        unlink(&*iter);
+        arena_->unref(iter->second.slot);
+    }
+
+    blocks_.erase(begin, end);
+}
+
+int Cache::flushSpan(Iter const begin, Iter const end)
 {
-    for (auto walk = begin; walk < end;)
+    for (auto walk = begin; walk != end;)
     {
         auto const [contig_begin, contig_end] = findContiguous(begin, end, walk);
 
@@ -212,43 +528,53 @@ int Cache::flushSpan(CIter const begin, CIter const end)
         walk = contig_end;
     }
 
-    blocks_.erase(begin, end);
+    erase(begin, end);
     return {};
 }
 
 int Cache::flushFile(tr_torrent const* torrent, tr_file_index_t file)
 {
-    auto const compare = CompareCacheBlockByKey{};
     auto const tor_id = torrent->id();
     auto const [block_begin, block_end] = tr_torGetFileBlockSpan(torrent, file);
 
-    return flushSpan(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_begin), compare),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_end), compare));
+    auto const err = flushSpan(blocks_.lower_bound(Key{ tor_id, block_begin }), blocks_.lower_bound(Key{ tor_id, block_end }));
+    eraseReadAhead(Key{ tor_id, block_begin }, Key{ tor_id, block_end });
+    waitForWrites(tor_id);
+    return err;
 }
 
 int Cache::flushTorrent(tr_torrent const* torrent)
 {
-    auto const compare = CompareCacheBlockByKey{};
     auto const tor_id = torrent->id();
 
-    return flushSpan(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, 0), compare),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id + 1, 0), compare));
+    // the torrent's files are being closed, so stop tracking its pieces;
+    // any that complete later will be read back from disk
+    piece_hashes_.erase(
+        piece_hashes_.lower_bound(std::make_pair(tor_id, 0)),
+        piece_hashes_.lower_bound(std::make_pair(tor_id + 1, 0)));
+
+    auto const err = flushSpan(blocks_.lower_bound(Key{ tor_id, 0 }), blocks_.lower_bound(Key{ tor_id + 1, 0 }));
+    eraseReadAhead(Key{ tor_id, 0 }, Key{ tor_id + 1, 0 });
+    waitForWrites(tor_id);
+    return err;
 }
 
-int Cache::flushOldest()
+void Cache::waitForWrites(tr_torrent_id_t tor_id)
 {
-    auto const oldest = std::min_element(
-        std::begin(blocks_),
-        std::end(blocks_),
-        [](auto const& a, auto const& b) { return a.time_added < b.time_added; });
+    if (write_behind_)
+    {
+        write_behind_->wait(tor_id);
+    }
+}
 
-    if (oldest == std::end(blocks_)) // nothing to flush
+int Cache::flushOldest()
+{
+    if (oldest_ == nullptr) // nothing to flush
     {
         return 0;
     }
 
+    auto const oldest = blocks_.find(oldest_->first);
     auto const [begin, end] = findContiguous(std::begin(blocks_), std::end(blocks_), oldest);
 
     if (auto const err = writeContiguous(begin, end); err != 0)
@@ -256,14 +582,27 @@ int Cache::flushOldest()
         return err;
     }
 
-    blocks_.erase(begin, end);
+    erase(begin, end);
     return 0;
 }
 
 int Cache::cacheTrim()
 {
+    // read-ahead blocks are cheaper to drop than written blocks are to flush
+    while (!std::empty(read_ahead_order_) && std::size(blocks_) + std::size(read_ahead_) > max_blocks_)
+    {
+        evictOldestReadAhead();
+    }
+
     while (std::size(blocks_) > max_blocks_)
     {
+        // If the disk isn't keeping up, keep the blocks here instead of
+        // blocking the session thread. onWriteDone() trims again later.
+        if (write_behind_ && write_behind_->isFull())
+        {
+            break;
+        }
+
         if (auto const err = flushOldest(); err != 0)
         {
             return err;
@@ -272,3 +611,212 @@ int Cache::cacheTrim()
 
     return 0;
 }
+
+// ---
+
+void Cache::hashBlock(
+    tr_torrent const* torrent,
+    tr_piece_index_t piece,
+    tr_block_index_t block,
+    uint8_t const* data,
+    PieceHash& piece_hash)
+{
+    auto const [begin_byte, end_byte] = torrent->blockInfo().byteSpanForPiece(piece);
+    auto const block_loc = torrent->blockLoc(block);
+    auto const block_len = torrent->blockSize(block);
+
+    auto const* begin = data;
+    auto const* end = data + block_len;
+
+    // handle edge case where blocks aren't on piece boundaries:
+    if (block_loc.byte < begin_byte) // `block` may begin before `piece` does
+    {
+        begin += begin_byte - block_loc.byte;
+    }
+    if (block_loc.byte + block_len > end_byte) // `block` may end after `piece` does
+    {
+        end -= block_loc.byte + block_len - end_byte;
+    }
+
+    piece_hash.sha->add(begin, end - begin);
+    piece_hash.n_bytes += end - begin;
+}
+
+void Cache::updatePieceHashes(tr_torrent_id_t tor_id, tr_block_index_t block)
+{
+    // v2-only torrents are checked against merkle trees, not SHA1 hashes
+    auto const* const tor = torrents_.get(tor_id);
+    if (tor == nullptr || !tor->hasV1Metadata())
+    {
+        return;
+    }
+
+    auto const block_loc = tor->blockLoc(block);
+    auto const last_piece = tor->byteLoc(block_loc.byte + tor->blockSize(block) - 1).piece;
+    for (auto piece = block_loc.piece; piece <= last_piece; ++piece)
+    {
+        auto const [begin_block, end_block] = tor->blockSpanForPiece(piece);
+        auto const key = PieceKey{ tor_id, piece };
+
+        auto iter = piece_hashes_.find(key);
+        if (iter == std::end(piece_hashes_))
+        {
+            if (tor->hasPiece(piece))
+            {
+                continue;
+            }
+
+            iter = piece_hashes_.try_emplace(key, PieceHash{ tr_sha1::create(), begin_block }).first;
+        }
+
+        auto& piece_hash = iter->second;
+
+        // If a block we already hashed was overwritten, the running
+        // checksum no longer matches the piece. Start over from disk.
+        if (block < piece_hash.next_block)
+        {
+            piece_hashes_.erase(iter);
+            continue;
+        }
+
+        // hash as many of the next blocks as we have in order
+        for (; piece_hash.next_block < end_block; ++piece_hash.next_block)
+        {
+            auto const slot = getSlot(Key{ tor_id, piece_hash.next_block });
+            if (!slot)
+            {
+                break;
+            }
+
+            hashBlock(tor, piece, piece_hash.next_block, arena_->data(*slot), piece_hash);
+        }
+    }
+}
+
+std::optional<tr_sha1_digest_t> Cache::finishPieceHash(tr_torrent* torrent, tr_piece_index_t piece)
+{
+    auto node = piece_hashes_.extract(PieceKey{ torrent->id(), piece });
+    if (!node)
+    {
+        return {};
+    }
+
+    auto& piece_hash = node.mapped();
+    auto const end_block = torrent->blockSpanForPiece(piece).end;
+    auto buffer = std::array<uint8_t, tr_block_info::BlockSize>{};
+
+    // hash any blocks that were flushed before their turn came
+    for (; piece_hash.next_block < end_block; ++piece_hash.next_block)
+    {
+        auto const block = piece_hash.next_block;
+        auto const block_loc = torrent->blockLoc(block);
+        if (auto const err = readBlock(torrent, block_loc, torrent->blockSize(block), std::data(buffer)); err != 0)
+        {
+            return {};
+        }
+
+        hashBlock(torrent, piece, block, std::data(buffer), piece_hash);
+    }
+
+    TR_ASSERT(torrent->pieceSize(piece) == piece_hash.n_bytes);
+    return piece_hash.sha->finish();
+}
+
+// ---
+
+void Cache::enableWriteBehind(tr_write_behind::callback_func callback)
+{
+    write_behind_ = std::make_unique<tr_write_behind>(std::move(callback));
+    write_behind_->setMaxQueuedBytes(std::max(max_bytes_, tr_write_behind::DefaultMaxQueuedBytes));
+}
+
+void Cache::onWriteDone(uint64_t task_id, tr_torrent_id_t tor_id, int err, std::string const& errmsg)
+{
+    auto node = writes_in_flight_.extract(task_id);
+    if (!node)
+    {
+        return;
+    }
+
+    recordFlushLatency(std::chrono::steady_clock::now() - node.mapped().started_at);
+
+    for (auto const& [key, slot] : node.mapped().blocks)
+    {
+        // the block may have been rewritten and flushed again since then
+        if (auto const iter = blocks_being_written_.find(key); iter != std::end(blocks_being_written_) && iter->second == slot)
+        {
+            blocks_being_written_.erase(iter);
+        }
+
+        arena_->unref(slot);
+    }
+
+    // flush any blocks that were held back while the queue was full.
+    // If that fails, the next writeBlock() will run into it and report it.
+    (void)cacheTrim();
+
+    if (err == 0)
+    {
+        return;
+    }
+
+    if (auto* const tor = torrents_.get(tor_id); tor != nullptr && tor->error != TR_STAT_LOCAL_ERROR)
+    {
+        tr_logAddErrorTor(tor, errmsg);
+        tor->setLocalError(errmsg);
+        tr_torrentStop(tor);
+    }
+}
+
+// ---
+
+void Cache::recordFlushLatency(std::chrono::steady_clock::duration latency) noexcept
+{
+    auto const msec = std::chrono::duration_cast<std::chrono::milliseconds>(latency).count();
+
+    auto bucket = size_t{};
+    while (bucket + 1U < FlushLatencyBuckets && msec >= (int64_t{ 1 } << bucket))
+    {
+        ++bucket;
+    }
+
+    ++stats_.flush_latency_histogram[bucket];
+}
+
+Cache::Stats Cache::stats() const
+{
+    auto ret = stats_;
+    ret.bytes_allocated = arena_->allocatedBytes();
+    ret.bytes_cached = (std::size(blocks_) + std::size(read_ahead_)) * tr_block_info::BlockSize;
+    ret.bytes_being_written = std::size(blocks_being_written_) * tr_block_info::BlockSize;
+    return ret;
+}
+
+std::vector<std::pair<tr_torrent_id_t, size_t>> Cache::bytesPerTorrent() const
+{
+    auto n_blocks = std::map<tr_torrent_id_t, size_t>{};
+
+    for (auto const& [key, block] : blocks_)
+    {
+        ++n_blocks[key.first];
+    }
+
+    for (auto const& [key, block] : read_ahead_)
+    {
+        ++n_blocks[key.first];
+    }
+
+    for (auto const& [key, slot] : blocks_being_written_)
+    {
+        ++n_blocks[key.first];
+    }
+
+    auto ret = std::vector<std::pair<tr_torrent_id_t, size_t>>{};
+    ret.reserve(std::size(n_blocks));
+    for (auto const& [tor_id, n] : n_blocks)
+    {
+        ret.emplace_back(tor_id, n * tr_block_info::BlockSize);
+    }
+
+    return ret;
+}
@@ -9,16 +9,29 @@
 #error only libtransmission should #include this header.
 #endif
 
-#include <cstdint> // for size_t
+#include <array>
+#include <chrono>
+#include <cstddef> // for size_t
 #include <cstdint> // for intX_t, uintX_t
-#include <ctime>
-#include <memory> // for std::unique_ptr
+#include <deque>
+#include <map>
+#include <memory> // for std::shared_ptr, std::unique_ptr
+#include <optional>
+#include <string>
 #include <utility> // for std::pair
 #include <vector>
 
 #include "transmission.h"
 
 #include "block-info.h"
+#include "block-pool.h"
+#include "crypto-utils.h" // for tr_sha1
+#include "write-behind.h"
+
+namespace libtransmission
+{
+class Buffer;
+} // namespace libtransmission
 
 class tr_torrents;
 struct tr_torrent;
@@ -35,48 +48,173 @@ public:
         return max_bytes_;
     }
 
+    // Copy the block into the cache. `writeme` goes back to its pool afterwards.
     // @return any error code from cacheTrim()
-    int writeBlock(tr_torrent_id_t tor, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>> writeme);
+    int writeBlock(tr_torrent_id_t tor, tr_block_index_t block, tr_block_pool::Buf writeme);
 
+    // Copy the block into `setme`, e.g. to check a piece.
+    // Unlike reads for peers, these don't count in stats().
     int readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, uint8_t* setme);
+
+    // Append the block to `out` without copying it if possible:
+    // cached blocks are added by reference, and if `allow_file_ref`
+    // is true, uncached ones are added as references to their files.
+    // This is how blocks are read for peers, so it updates the read stats.
+    // @return 0 on success, or an errno value on failure.
+    int readBlock(
+        tr_torrent* torrent,
+        tr_block_info::Location loc,
+        uint32_t len,
+        libtransmission::Buffer& out,
+        bool allow_file_ref);
+
+    // If read-ahead is enabled, read the rest of the block's piece (up
+    // to the read-ahead window) into the cache with one sequential read.
+    // Otherwise, just hint to the OS that the block will be needed soon.
     int prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len);
     int flushTorrent(tr_torrent const* torrent);
+
+    // Set how much of a piece prefetchBlock() reads at once. 0 disables read-ahead.
+    // The read blocks the session thread, so it's off unless the user opts in.
+    void setReadAheadBytes(size_t bytes) noexcept
+    {
+        read_ahead_bytes_ = bytes;
+    }
+
     int flushFile(tr_torrent const* torrent, tr_file_index_t file);
 
-private:
-    using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
+    // Finish the piece's checksum that was computed incrementally
+    // as its blocks were passed to writeBlock(). Any blocks that
+    // couldn't be hashed in order are read from the cache or disk.
+    // @return the checksum, or std::nullopt if the piece wasn't being
+    // tracked and the caller needs to hash it from scratch.
+    [[nodiscard]] std::optional<tr_sha1_digest_t> finishPieceHash(tr_torrent* torrent, tr_piece_index_t piece);
 
-    struct CacheBlock
+    // Write flushed blocks on a background thread instead of blocking
+    // the caller. `callback` is called from that thread when a write is
+    // done, and should arrange for onWriteDone() to be called in the
+    // session thread. flushTorrent() and flushFile() still wait for
+    // the torrent's writes to finish. While the writer's queue is full,
+    // blocks stay in the cache even if that puts it over its limit.
+    void enableWriteBehind(tr_write_behind::callback_func callback);
+
+    void onWriteDone(uint64_t task_id, tr_torrent_id_t tor_id, int err, std::string const& errmsg);
+
+    // Bucket `i` counts the flushes that took less than 2^i milliseconds,
+    // except for the last bucket, which counts the rest.
+    static auto constexpr FlushLatencyBuckets = size_t{ 12U };
+
+    struct Stats
     {
-        Key key;
-        std::unique_ptr<std::vector<uint8_t>> buf;
-        time_t time_added = {};
+        // memory
+        size_t bytes_allocated = 0; // slabs held by the cache, whether in use or not
+        size_t bytes_cached = 0; // blocks waiting to be flushed, and blocks read ahead
+        size_t bytes_being_written = 0; // blocks flushed to write-behind but not on disk yet
+
+        // reads for peers
+        uint64_t read_hits = 0;
+        uint64_t read_misses = 0;
+        uint64_t read_ahead_blocks = 0; // blocks read into the cache ahead of time
+        uint64_t read_ahead_blocks_used = 0; // ...and later read back from the cache at least once
+
+        // writes; blocks_written / disk_writes is how well writes are coalesced
+        uint64_t blocks_written = 0;
+        uint64_t disk_writes = 0;
+        uint64_t disk_write_bytes = 0;
+        std::array<uint64_t, FlushLatencyBuckets> flush_latency_histogram = {};
     };
 
-    using Blocks = std::vector<CacheBlock>;
-    using CIter = Blocks::const_iterator;
+    [[nodiscard]] Stats stats() const;
+
+    // @return how much cache memory each torrent's blocks are using, in torrent id order
+    [[nodiscard]] std::vector<std::pair<tr_torrent_id_t, size_t>> bytesPerTorrent() const;
+
+private:
+    using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
+    using PieceKey = std::pair<tr_torrent_id_t, tr_piece_index_t>;
 
-    struct CompareCacheBlockByKey
+    // Fixed-size block buffers carved out of larger slabs, so that
+    // caching a block doesn't cost a heap allocation. Slots are
+    // refcounted because readBlock() can lend them to Buffers that
+    // outlive the blocks' time in the cache.
+    class Arena
     {
-        [[nodiscard]] constexpr bool operator()(Key const& key, CacheBlock const& block)
+    public:
+        static auto constexpr SlotsPerSlab = size_t{ 64U }; // 1 MiB
+
+        // @return a slot with a refcount of 1
+        [[nodiscard]] size_t acquire();
+
+        void ref(size_t slot) noexcept
         {
-            return key < block.key;
+            ++refcounts_[slot];
         }
-        [[nodiscard]] constexpr bool operator()(CacheBlock const& block, Key const& key)
+
+        void unref(size_t slot);
+
+        [[nodiscard]] uint8_t* data(size_t slot) const noexcept
         {
-            return block.key < key;
+            return slabs_[slot / SlotsPerSlab].get() + (slot % SlotsPerSlab) * tr_block_info::BlockSize;
         }
+
+        // Free the memory of any slabs with no slots in use.
+        void releaseUnusedSlabs();
+
+        [[nodiscard]] size_t allocatedBytes() const noexcept;
+
+    private:
+        std::vector<std::unique_ptr<uint8_t[]>> slabs_;
+        std::vector<size_t> slab_use_counts_;
+        std::vector<uint32_t> refcounts_;
+        std::vector<size_t> free_slots_;
+    };
+
+    struct CacheBlock
+    {
+        size_t slot = {};
+        uint32_t length = {};
+
+        // intrusive list of blocks, in the order they were written
+        std::pair<Key const, CacheBlock>* older = nullptr;
+        std::pair<Key const, CacheBlock>* newer = nullptr;
+    };
+
+    using Blocks = std::map<Key, CacheBlock>;
+    using BlockNode = Blocks::value_type;
+    using Iter = Blocks::iterator;
+    using CIter = Blocks::const_iterator;
+
+    // A block that was read from disk ahead of time. Unlike the blocks
+    // in `blocks_`, these match what's on disk and are never written.
+    struct ReadAheadBlock
+    {
+        size_t slot = {};
+        uint64_t sequence = {};
+        bool used = false;
+    };
+
+    // Streaming checksum of a piece that's being downloaded.
+    // Blocks are hashed in order; out-of-order blocks wait in
+    // `blocks_` until the blocks in front of them arrive.
+    struct PieceHash
+    {
+        std::unique_ptr<tr_sha1> sha;
+        tr_block_index_t next_block = {};
+        uint64_t n_bytes = {};
     };
 
     [[nodiscard]] static Key makeKey(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
 
-    [[nodiscard]] static std::pair<CIter, CIter> findContiguous(CIter const begin, CIter const end, CIter const iter) noexcept;
+    [[nodiscard]] static std::pair<Iter, Iter> findContiguous(Iter const begin, Iter const end, Iter const iter) noexcept;
+
+    // @return any error code from tr_ioWrite() or tr_ioPrepareWrite()
+    [[nodiscard]] int writeContiguous(CIter const begin, CIter const end);
 
-    // @return any error code from tr_ioWrite()
-    [[nodiscard]] int writeContiguous(CIter const begin, CIter const end) const;
+    // Remove blocks from the cache without writing them.
+    void erase(Iter const begin, Iter const end);
 
     // @return any error code from writeContiguous()
-    [[nodiscard]] int flushSpan(CIter const begin, CIter const end);
+    [[nodiscard]] int flushSpan(Iter const begin, Iter const end);
 
     // @return any error code from writeContiguous()
     [[nodiscard]] int flushOldest();
@@ -86,16 +224,64 @@ private:
 
     [[nodiscard]] static size_t getMaxBlocks(int64_t max_bytes) noexcept;
 
-    [[nodiscard]] CIter getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
+    void recordFlushLatency(std::chrono::steady_clock::duration latency) noexcept;
+
+    // @return the slot holding the block's data, if it's in the cache or being written
+    [[nodiscard]] std::optional<size_t> getSlot(Key const& key) const noexcept;
+
+    // Like getSlot(), but also updates the read stats.
+    [[nodiscard]] std::optional<size_t> getSlotForRead(Key const& key) noexcept;
+
+    // @return any error code from tr_ioRead()
+    [[nodiscard]] int readAhead(tr_torrent* torrent, tr_block_index_t block);
+
+    void eraseReadAhead(Key const& begin, Key const& end);
+    void evictOldestReadAhead();
+
+    void waitForWrites(tr_torrent_id_t tor_id);
+
+    void linkNewest(BlockNode* node) noexcept;
+    void unlink(BlockNode* node) noexcept;
+
+    static void hashBlock(
+        tr_torrent const* torrent,
+        tr_piece_index_t piece,
+        tr_block_index_t block,
+        uint8_t const* data,
+        PieceHash& piece_hash);
+
+    void updatePieceHashes(tr_torrent_id_t tor_id, tr_block_index_t block);
 
     tr_torrents& torrents_;
 
+    std::shared_ptr<Arena> arena_ = std::make_shared<Arena>();
     Blocks blocks_ = {};
+    BlockNode* oldest_ = nullptr;
+    BlockNode* newest_ = nullptr;
+    std::map<PieceKey, PieceHash> piece_hashes_;
     size_t max_blocks_ = 0;
     size_t max_bytes_ = 0;
 
-    mutable size_t disk_writes_ = 0;
-    mutable size_t disk_write_bytes_ = 0;
-    mutable size_t cache_writes_ = 0;
-    mutable size_t cache_write_bytes_ = 0;
+    std::map<Key, ReadAheadBlock> read_ahead_;
+    std::deque<std::pair<Key, uint64_t>> read_ahead_order_; // oldest first; may hold stale entries
+    uint64_t next_read_ahead_sequence_ = 1;
+    size_t read_ahead_bytes_ = 0;
+
+    // the counters in `stats()`
+    Stats stats_;
+
+    // Blocks that have been flushed to write_behind_ but may not be on
+    // disk yet, and the slots holding their data. Reads check here too.
+    struct WriteInFlight
+    {
+        std::vector<std::pair<Key, size_t>> blocks;
+        std::chrono::steady_clock::time_point started_at;
+    };
+
+    std::map<Key, size_t> blocks_being_written_;
+    std::map<uint64_t, WriteInFlight> writes_in_flight_;
+    uint64_t next_write_id_ = 1;
+
+    // declared last so that its queued writes finish before the slots are freed
+    std::unique_ptr<tr_write_behind> write_behind_;
 };
@@ -18,6 +18,7 @@
 #include "tr-assert.h"
 #include "utils.h"
 
+#define TR_CRYPTO_POWM_FALLBACK
 #define TR_CRYPTO_X509_FALLBACK
 #include "crypto-utils-fallback.cc" // NOLINT(bugprone-suspicious-include)
 
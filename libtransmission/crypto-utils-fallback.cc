@@ -36,3 +36,21 @@ void tr_x509_cert_free(tr_x509_cert_t /*handle*/)
 }
 
 #endif /* TR_CRYPTO_X509_FALLBACK */
+
+// ---
+
+#ifdef TR_CRYPTO_POWM_FALLBACK
+
+bool tr_powm(
+    void const* /*base*/,
+    size_t /*base_length*/,
+    void const* /*exponent*/,
+    size_t /*exponent_length*/,
+    void const* /*modulus*/,
+    size_t /*modulus_length*/,
+    void* /*result*/)
+{
+    return false;
+}
+
+#endif /* TR_CRYPTO_POWM_FALLBACK */
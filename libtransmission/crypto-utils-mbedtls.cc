@@ -7,6 +7,7 @@
 #include <mutex>
 
 #include <mbedtls/base64.h>
+#include <mbedtls/bignum.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/error.h>
 #include <mbedtls/sha1.h>
@@ -19,6 +20,7 @@
 #include "crypto-utils.h"
 #include "log.h"
 #include "tr-assert.h"
+#include "tr-sha-hw.h"
 #include "utils.h"
 
 #define TR_CRYPTO_X509_FALLBACK
@@ -209,16 +211,60 @@ private:
 
 std::unique_ptr<tr_sha1> tr_sha1::create()
 {
+    // prefer the CPU's SHA instructions, which this library doesn't use
+    if (auto sha = tr_sha_hw::create_sha1(); sha)
+    {
+        return sha;
+    }
+
     return std::make_unique<Sha1Impl>();
 }
 
 std::unique_ptr<tr_sha256> tr_sha256::create()
 {
+    if (auto sha = tr_sha_hw::create_sha256(); sha)
+    {
+        return sha;
+    }
+
     return std::make_unique<Sha256Impl>();
 }
 
 // ---
 
+bool tr_powm(
+    void const* base,
+    size_t base_length,
+    void const* exponent,
+    size_t exponent_length,
+    void const* modulus,
+    size_t modulus_length,
+    void* result)
+{
+    auto b = mbedtls_mpi{};
+    auto e = mbedtls_mpi{};
+    auto m = mbedtls_mpi{};
+    auto r = mbedtls_mpi{};
+    mbedtls_mpi_init(&b);
+    mbedtls_mpi_init(&e);
+    mbedtls_mpi_init(&m);
+    mbedtls_mpi_init(&r);
+
+    auto const ok = check_result(mbedtls_mpi_read_binary(&b, static_cast<unsigned char const*>(base), base_length)) &&
+        check_result(mbedtls_mpi_read_binary(&e, static_cast<unsigned char const*>(exponent), exponent_length)) &&
+        check_result(mbedtls_mpi_read_binary(&m, static_cast<unsigned char const*>(modulus), modulus_length)) &&
+        check_result(mbedtls_mpi_exp_mod(&r, &b, &e, &m, nullptr)) &&
+        check_result(mbedtls_mpi_write_binary(&r, static_cast<unsigned char*>(result), modulus_length));
+
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&m);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&b);
+    return ok;
+}
+
+// ---
+
 bool tr_rand_buffer_crypto(void* buffer, size_t length)
 {
     if (length == 0)
@@ -8,8 +8,10 @@
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #endif
 
+#include <cstring> // memset()
 #include <memory>
 
+#include <openssl/bn.h>
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
@@ -252,6 +254,54 @@ void tr_x509_cert_free(tr_x509_cert_t handle)
     X509_free(static_cast<X509*>(handle));
 }
 
+// --- bignum
+
+bool tr_powm(
+    void const* base,
+    size_t base_length,
+    void const* exponent,
+    size_t exponent_length,
+    void const* modulus,
+    size_t modulus_length,
+    void* result)
+{
+    using bn_ptr = std::unique_ptr<BIGNUM, decltype(&BN_free)>;
+    auto const import_bn = [](void const* bin, size_t len)
+    {
+        return bn_ptr{ BN_bin2bn(static_cast<unsigned char const*>(bin), static_cast<int>(len), nullptr), BN_free };
+    };
+
+    auto const ctx = std::unique_ptr<BN_CTX, decltype(&BN_CTX_free)>{ BN_CTX_new(), BN_CTX_free };
+    auto const b = import_bn(base, base_length);
+    auto const e = import_bn(exponent, exponent_length);
+    auto const m = import_bn(modulus, modulus_length);
+    auto const r = bn_ptr{ BN_new(), BN_free };
+    if (!ctx || !b || !e || !m || !r)
+    {
+        log_error();
+        return false;
+    }
+
+    // the exponent is a private key, so don't leak it through timing
+    BN_set_flags(e.get(), BN_FLG_CONSTTIME);
+
+    if (!check_result(BN_mod_exp(r.get(), b.get(), e.get(), m.get(), ctx.get())))
+    {
+        return false;
+    }
+
+    auto const n_bytes = static_cast<size_t>(BN_num_bytes(r.get()));
+    if (n_bytes > modulus_length)
+    {
+        return false;
+    }
+
+    auto* const out = static_cast<unsigned char*>(result);
+    std::memset(out, 0, modulus_length - n_bytes);
+    BN_bn2bin(r.get(), out + modulus_length - n_bytes);
+    return true;
+}
+
 // --- rand
 
 bool tr_rand_buffer_crypto(void* buffer, size_t length)
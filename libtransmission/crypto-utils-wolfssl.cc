@@ -19,6 +19,7 @@
 #include "crypto-utils.h"
 #include "log.h"
 #include "tr-assert.h"
+#include "tr-sha-hw.h"
 #include "utils.h"
 
 #if LIBWOLFSSL_VERSION_HEX >= 0x04000000 // 4.0.0
@@ -27,6 +28,7 @@ using TR_WC_RNG = WC_RNG;
 using TR_WC_RNG = RNG;
 #endif
 
+#define TR_CRYPTO_POWM_FALLBACK
 #define TR_CRYPTO_X509_FALLBACK
 #include "crypto-utils-fallback.cc" // NOLINT(bugprone-suspicious-include)
 
@@ -163,11 +165,22 @@ private:
 
 std::unique_ptr<tr_sha1> tr_sha1::create()
 {
+    // prefer the CPU's SHA instructions, which this library doesn't use
+    if (auto sha = tr_sha_hw::create_sha1(); sha)
+    {
+        return sha;
+    }
+
     return std::make_unique<Sha1Impl>();
 }
 
 std::unique_ptr<tr_sha256> tr_sha256::create()
 {
+    if (auto sha = tr_sha_hw::create_sha256(); sha)
+    {
+        return sha;
+    }
+
     return std::make_unique<Sha256Impl>();
 }
 
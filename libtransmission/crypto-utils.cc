@@ -25,6 +25,7 @@ extern "C"
 #include "transmission.h"
 #include "crypto-utils.h"
 #include "tr-assert.h"
+#include "tr-sha-hw.h"
 #include "utils.h"
 
 using namespace std::literals;
@@ -58,6 +59,28 @@ std::string tr_salt(std::string_view plaintext, std::string_view salt)
 } // namespace ssha1_impl
 } // namespace
 
+std::vector<tr_sha1_digest_t> tr_sha1::hash_many(std::vector<std::string_view> const& inputs)
+{
+    auto digests = std::vector<tr_sha1_digest_t>(std::size(inputs));
+
+    if (!tr_sha_hw::sha1_many(std::data(inputs), std::size(inputs), std::data(digests)))
+    {
+        auto sha = tr_sha1::create();
+        std::transform(
+            std::begin(inputs),
+            std::end(inputs),
+            std::begin(digests),
+            [&sha](std::string_view input)
+            {
+                sha->clear();
+                sha->add(std::data(input), std::size(input));
+                return sha->finish();
+            });
+    }
+
+    return digests;
+}
+
 std::string tr_ssha1(std::string_view plaintext)
 {
     using namespace ssha1_impl;
@@ -15,6 +15,7 @@
 #include <random> // for std::uniform_int_distribution<T>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "transmission.h" // tr_sha1_digest_t
 
@@ -40,6 +41,10 @@ public:
         (context->add(std::data(args), std::size(args)), ...);
         return context->finish();
     }
+
+    // Hash several independent inputs, e.g. a batch of pieces.
+    // Uses the CPU's SHA instructions directly if it has them.
+    [[nodiscard]] static std::vector<tr_sha1_digest_t> hash_many(std::vector<std::string_view> const& inputs);
 };
 
 class tr_sha256
@@ -88,6 +93,22 @@ tr_x509_cert_t tr_x509_cert_new(void const* der, size_t der_length);
  */
 void tr_x509_cert_free(tr_x509_cert_t handle);
 
+/**
+ * @brief Compute `base` ^ `exponent` mod `modulus` with the crypto library's bignums.
+ *
+ * The numbers are unsigned and big-endian. `result` is zero-padded to `modulus_length` bytes.
+ * @return false if the crypto library has no bignum support. Callers should
+ *         then fall back to their own implementation.
+ */
+[[nodiscard]] bool tr_powm(
+    void const* base,
+    size_t base_length,
+    void const* exponent,
+    size_t exponent_length,
+    void const* modulus,
+    size_t modulus_length,
+    void* result);
+
 /**
  * @brief Fill a buffer with random bytes.
  */
@@ -22,6 +22,7 @@
 #include <sys/file.h> /* flock() */
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h> /* preadv(), pwritev() */
 #include <unistd.h> /* lseek(), write(), ftruncate(), pread(), pwrite(), pathconf(), etc */
 
 #ifdef HAVE_XFS_XFS_H
@@ -189,6 +190,7 @@ std::optional<tr_sys_path_info> tr_sys_path_get_info(std::string_view path, int
 
     info.size = static_cast<uint64_t>(sb.st_size);
     info.last_modified_at = sb.st_mtime;
+    info.device = static_cast<uint64_t>(sb.st_dev);
 
     return info;
 }
@@ -642,6 +644,20 @@ bool tr_sys_file_close(tr_sys_file_t handle, tr_error** error)
     return ret;
 }
 
+tr_sys_file_t tr_sys_file_dup(tr_sys_file_t handle, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+
+    tr_sys_file_t const ret = dup(handle);
+
+    if (ret == TR_BAD_SYS_FILE)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+}
+
 bool tr_sys_file_read(tr_sys_file_t handle, void* buffer, uint64_t size, uint64_t* bytes_read, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -713,6 +729,83 @@ bool tr_sys_file_read_at(
     return ret;
 }
 
+bool tr_sys_file_read_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(bufs != nullptr || n_bufs == 0);
+    /* seek requires signed offset, so it should be in mod range */
+    TR_ASSERT(offset < UINT64_MAX / 2);
+
+#ifdef HAVE_PREADV
+
+    auto iov = std::array<struct iovec, 64>{};
+    n_bufs = std::min(n_bufs, std::size(iov));
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        iov[i].iov_base = bufs[i].base;
+        iov[i].iov_len = bufs[i].len;
+    }
+
+    auto const my_bytes_read = preadv(handle, std::data(iov), static_cast<int>(n_bufs), offset);
+
+    if (my_bytes_read == -1)
+    {
+        tr_error_set_from_errno(error, errno);
+        return false;
+    }
+
+    if (my_bytes_read == 0)
+    {
+        return false;
+    }
+
+    if (bytes_read != nullptr)
+    {
+        *bytes_read = my_bytes_read;
+    }
+
+    return true;
+
+#else
+
+    // no preadv(), so read the buffers one at a time
+    auto total = uint64_t{};
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        auto n_read = uint64_t{};
+        if (!tr_sys_file_read_at(handle, bufs[i].base, bufs[i].len, offset + total, &n_read, error))
+        {
+            if (total == 0 || (error != nullptr && *error != nullptr))
+            {
+                return false;
+            }
+
+            break; // hit EOF after reading some of the buffers
+        }
+
+        total += n_read;
+        if (n_read < bufs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_read != nullptr)
+    {
+        *bytes_read = total;
+    }
+
+    return true;
+
+#endif
+}
+
 bool tr_sys_file_write(tr_sys_file_t handle, void const* buffer, uint64_t size, uint64_t* bytes_written, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -784,6 +877,73 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(bufs != nullptr || n_bufs == 0);
+    /* seek requires signed offset, so it should be in mod range */
+    TR_ASSERT(offset < UINT64_MAX / 2);
+
+#ifdef HAVE_PWRITEV
+
+    auto iov = std::array<struct iovec, 64>{};
+    n_bufs = std::min(n_bufs, std::size(iov));
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        iov[i].iov_base = bufs[i].base;
+        iov[i].iov_len = bufs[i].len;
+    }
+
+    auto const my_bytes_written = pwritev(handle, std::data(iov), static_cast<int>(n_bufs), offset);
+
+    if (my_bytes_written == -1)
+    {
+        tr_error_set_from_errno(error, errno);
+        return false;
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = my_bytes_written;
+    }
+
+    return true;
+
+#else
+
+    // no pwritev(), so write the buffers one at a time
+    auto total = uint64_t{};
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(handle, bufs[i].base, bufs[i].len, offset + total, &n_written, error))
+        {
+            return false;
+        }
+
+        total += n_written;
+        if (n_written < bufs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return true;
+
+#endif
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
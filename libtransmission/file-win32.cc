@@ -392,11 +392,13 @@ static std::optional<tr_sys_path_info> tr_sys_file_get_info_(tr_sys_file_t handl
     auto attributes = BY_HANDLE_FILE_INFORMATION{};
     if (GetFileInformationByHandle(handle, &attributes))
     {
-        return stat_to_sys_path_info(
+        auto info = stat_to_sys_path_info(
             attributes.dwFileAttributes,
             attributes.nFileSizeLow,
             attributes.nFileSizeHigh,
             attributes.ftLastWriteTime);
+        info.device = attributes.dwVolumeSerialNumber;
+        return info;
     }
 
     set_system_error(error, GetLastError());
@@ -944,6 +946,22 @@ bool tr_sys_file_close(tr_sys_file_t handle, tr_error** error)
     return ret;
 }
 
+tr_sys_file_t tr_sys_file_dup(tr_sys_file_t handle, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+
+    auto ret = TR_BAD_SYS_FILE;
+    auto* const process = GetCurrentProcess();
+
+    if (!DuplicateHandle(process, handle, process, &ret, 0, FALSE, DUPLICATE_SAME_ACCESS))
+    {
+        set_system_error(error, GetLastError());
+        ret = TR_BAD_SYS_FILE;
+    }
+
+    return ret;
+}
+
 bool tr_sys_file_read(tr_sys_file_t handle, void* buffer, uint64_t size, uint64_t* bytes_read, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1018,6 +1036,42 @@ bool tr_sys_file_read_at(
     return ret;
 }
 
+bool tr_sys_file_read_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(bufs != nullptr || n_bufs == 0);
+
+    // ReadFileScatter() needs unbuffered, page-aligned I/O, so read the buffers one at a time
+    auto total = uint64_t{};
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        auto n_read = uint64_t{};
+        if (!tr_sys_file_read_at(handle, bufs[i].base, bufs[i].len, offset + total, &n_read, error))
+        {
+            return false;
+        }
+
+        total += n_read;
+        if (n_read < bufs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_read != nullptr)
+    {
+        *bytes_read = total;
+    }
+
+    return true;
+}
+
 bool tr_sys_file_write(tr_sys_file_t handle, void const* buffer, uint64_t size, uint64_t* bytes_written, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1092,6 +1146,42 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(bufs != nullptr || n_bufs == 0);
+
+    // WriteFileGather() needs unbuffered, page-aligned I/O, so write the buffers one at a time
+    auto total = uint64_t{};
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(handle, bufs[i].base, bufs[i].len, offset + total, &n_written, error))
+        {
+            return false;
+        }
+
+        total += n_written;
+        if (n_written < bufs[i].len)
+        {
+            break;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return true;
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -99,11 +99,18 @@ enum tr_sys_path_type_t
     TR_SYS_PATH_IS_OTHER
 };
 
+struct tr_sys_iovec
+{
+    void* base = nullptr;
+    size_t len = 0;
+};
+
 struct tr_sys_path_info
 {
     tr_sys_path_type_t type = {};
     uint64_t size = {};
     time_t last_modified_at = {};
+    uint64_t device = {}; // id of the device the path is on, if known
 
     [[nodiscard]] constexpr auto isFile() const noexcept
     {
@@ -348,6 +355,22 @@ tr_sys_file_t tr_sys_file_open_temp(char* path_template, struct tr_error** error
  */
 bool tr_sys_file_close(tr_sys_file_t handle, struct tr_error** error = nullptr);
 
+/**
+ * @brief Portability wrapper for `dup()`.
+ *
+ * The new descriptor refers to the same open file, but has to be closed
+ * separately. This lets another thread keep using the file after the
+ * original descriptor is closed.
+ *
+ * @param[in]  handle Valid file descriptor.
+ * @param[out] error  Pointer to error object. Optional, pass `nullptr` if you
+ *                    are not interested in error details.
+ *
+ * @return Duplicated file descriptor on success, `TR_BAD_SYS_FILE` otherwise
+ *         (with `error` set accordingly).
+ */
+tr_sys_file_t tr_sys_file_dup(tr_sys_file_t handle, struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `read()`.
  *
@@ -391,6 +414,29 @@ bool tr_sys_file_read_at(
     uint64_t* bytes_read,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like `preadv()`, except that the position is undefined afterwards.
+ *        Not thread-safe.
+ *
+ * @param[in]  handle     Valid file descriptor.
+ * @param[in]  bufs       Buffers to store read data to, in order.
+ * @param[in]  n_bufs     Number of buffers.
+ * @param[in]  offset     File offset in bytes to start reading from.
+ * @param[out] bytes_read Number of bytes actually read. Optional, pass `nullptr`
+ *                        if you are not interested.
+ * @param[out] error      Pointer to error object. Optional, pass `nullptr` if
+ *                        you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_read_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `write()`.
  *
@@ -434,6 +480,29 @@ bool tr_sys_file_write_at(
     uint64_t* bytes_written,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like `pwritev()`, except that the position is undefined afterwards.
+ *        Not thread-safe.
+ *
+ * @param[in]  handle        Valid file descriptor.
+ * @param[in]  bufs          Buffers to get data being written from, in order.
+ * @param[in]  n_bufs        Number of buffers.
+ * @param[in]  offset        File offset in bytes to start writing from.
+ * @param[out] bytes_written Number of bytes actually written. Optional, pass
+ *                           `nullptr` if you are not interested.
+ * @param[out] error         Pointer to error object. Optional, pass `nullptr`
+ *                          if you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_write_at_v(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `fsync()`.
  *
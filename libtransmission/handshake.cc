@@ -44,6 +44,10 @@ bool tr_handshake::build_handshake_message(tr_peerIo* io, uint8_t* buf) const
     auto flags = tr_bitfield{ HandshakeFlagsBits };
     flags.set(LtepFlag);
     flags.set(FextFlag);
+    if (info->is_v2)
+    {
+        flags.set(V2Flag);
+    }
     if (mediator_->allows_dht())
     {
         flags.set(DhtFlag);
@@ -85,6 +89,7 @@ tr_handshake::ParseResult tr_handshake::parse_handshake(tr_peerIo* peer_io)
     peer_io->set_supports_dht(flags.test(DhtFlag));
     peer_io->set_supports_ltep(flags.test(LtepFlag));
     peer_io->set_supports_fext(flags.test(FextFlag));
+    peer_io->set_supports_v2(flags.test(V2Flag));
 
     // torrent hash
     auto info_hash = tr_sha1_digest_t{};
@@ -367,6 +372,7 @@ ReadState tr_handshake::read_handshake(tr_peerIo* peer_io)
     peer_io->set_supports_dht(flags.test(DhtFlag));
     peer_io->set_supports_ltep(flags.test(LtepFlag));
     peer_io->set_supports_fext(flags.test(FextFlag));
+    peer_io->set_supports_v2(flags.test(V2Flag));
 
     /* torrent hash */
     auto hash = tr_sha1_digest_t{};
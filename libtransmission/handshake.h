@@ -16,9 +16,9 @@
 #include <cstddef> // for std::byte, size_t
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <optional>
 #include <string_view>
+#include <utility> // for std::exchange()
 
 #include "transmission.h"
 
@@ -52,6 +52,7 @@ public:
             tr_peer_id_t client_peer_id;
             tr_torrent_id_t id;
             bool is_done;
+            bool is_v2 = false; // has BitTorrent v2 metadata
         };
 
         virtual ~Mediator() = default;
@@ -68,6 +69,12 @@ public:
             return DH::randomPrivateKey();
         }
 
+        // @return a pool of precomputed keys, or nullptr to make them on demand
+        [[nodiscard]] virtual tr_message_stream_encryption::DHPool* dh_pool()
+        {
+            return nullptr;
+        }
+
         virtual void set_utp_failed(tr_sha1_digest_t const& info_hash, tr_address const&) = 0;
     };
 
@@ -210,6 +217,8 @@ private:
     // https://www.bittorrent.org/beps/bep_0004.html
     // https://wiki.theory.org/BitTorrentSpecification#Reserved_Bytes
     static auto constexpr LtepFlag = size_t{ 43U };
+    // https://www.bittorrent.org/beps/bep_0052.html
+    static auto constexpr V2Flag = size_t{ 59U };
     static auto constexpr FextFlag = size_t{ 61U };
     static auto constexpr DhtFlag = size_t{ 63U };
 
@@ -251,37 +260,19 @@ private:
 
     ///
 
-    static constexpr auto DhPoolMaxSize = size_t{ 32 };
-    static inline auto dh_pool_size_ = size_t{};
-    static inline auto dh_pool_ = std::array<tr_message_stream_encryption::DH, DhPoolMaxSize>{};
-    static inline auto dh_pool_mutex_ = std::mutex{};
-
     [[nodiscard]] static DH get_dh(Mediator* mediator)
     {
-        auto lock = std::unique_lock(dh_pool_mutex_);
-
-        if (dh_pool_size_ > 0U)
+        if (auto* const pool = mediator->dh_pool(); pool != nullptr)
         {
-            auto dh = DH{};
-            std::swap(dh, dh_pool_[dh_pool_size_ - 1U]);
-            --dh_pool_size_;
-            return dh;
+            if (auto dh = pool->take(); dh)
+            {
+                return std::move(*dh);
+            }
         }
 
         return DH{ mediator->private_key() };
     }
 
-    static void add_dh(DH&& dh)
-    {
-        auto lock = std::unique_lock(dh_pool_mutex_);
-
-        if (dh_pool_size_ < std::size(dh_pool_))
-        {
-            dh_pool_[dh_pool_size_] = std::move(dh);
-            ++dh_pool_size_;
-        }
-    }
-
     void maybe_recycle_dh()
     {
         // keys are expensive to make, so recycle iff the peer was unreachable
@@ -291,9 +282,10 @@ private:
             return;
         }
 
-        auto dh = DH{};
-        std::swap(dh_, dh);
-        add_dh(std::move(dh));
+        if (auto* const pool = mediator_->dh_pool(); pool != nullptr)
+        {
+            pool->recycle(std::exchange(dh_, DH{}));
+        }
     }
 
     ///
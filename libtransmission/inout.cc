@@ -6,21 +6,26 @@
 #include <algorithm>
 #include <array>
 #include <cerrno>
+#include <numeric> // std::accumulate()
 #include <optional>
+#include <vector>
 
 #include <fmt/core.h>
 
 #include "transmission.h"
 
-#include "cache.h" /* tr_cacheReadBlock() */
+#include "cache.h" /* Cache::readBlock(), Cache::finishPieceHash() */
 #include "crypto-utils.h"
 #include "error.h"
 #include "file.h"
 #include "inout.h"
 #include "log.h"
+#include "merkle.h"
 #include "torrent.h"
 #include "tr-assert.h"
+#include "tr-buffer.h"
 #include "utils.h"
+#include "write-behind.h"
 
 using namespace std::literals;
 
@@ -93,29 +98,15 @@ bool getFilename(tr_pathbuf& setme, tr_torrent const* tor, tr_file_index_t file_
     return true;
 }
 
-void readOrWriteBytes(
+std::optional<tr_sys_file_t> getFile(
     tr_session* session,
     tr_torrent* tor,
     IoMode io_mode,
     tr_file_index_t file_index,
-    uint64_t file_offset,
-    uint8_t* buf,
-    size_t buflen,
+    uint64_t file_size,
     tr_error** error)
 {
-    TR_ASSERT(file_index < tor->fileCount());
-
     bool const do_write = io_mode == IoMode::Write;
-    auto const file_size = tor->fileSize(file_index);
-    TR_ASSERT(file_size == 0 || file_offset < file_size);
-    TR_ASSERT(file_offset + buflen <= file_size);
-
-    if (file_size == 0)
-    {
-        return;
-    }
-
-    // --- Find the fd
 
     auto fd = session->openFiles().get(tor->id(), file_index, do_write);
     auto filename = tr_pathbuf{};
@@ -128,7 +119,7 @@ void readOrWriteBytes(
             fmt::arg("error", tr_strerror(err)),
             fmt::arg("error_code", err));
         tr_error_set(error, err, msg);
-        return;
+        return {};
     }
 
     if (!fd) // not in the cache, so open or create it now
@@ -154,6 +145,38 @@ void readOrWriteBytes(
             fmt::arg("error_code", err));
         tr_error_set(error, err, msg);
         tr_logAddErrorTor(tor, msg);
+        return {};
+    }
+
+    return fd;
+}
+
+void readOrWriteBytes(
+    tr_session* session,
+    tr_torrent* tor,
+    IoMode io_mode,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    uint8_t* buf,
+    size_t buflen,
+    tr_error** error)
+{
+    TR_ASSERT(file_index < tor->fileCount());
+
+    auto const file_size = tor->fileSize(file_index);
+    TR_ASSERT(file_size == 0 || file_offset < file_size);
+    TR_ASSERT(file_offset + buflen <= file_size);
+
+    if (file_size == 0)
+    {
+        return;
+    }
+
+    // --- Find the fd
+
+    auto const fd = getFile(session, tor, io_mode, file_index, file_size, error);
+    if (!fd)
+    {
         return;
     }
 
@@ -238,15 +261,178 @@ int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location lo
     return 0;
 }
 
+void writeBytesV(
+    tr_torrent* tor,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    std::vector<tr_sys_iovec>& bufs,
+    tr_error** error)
+{
+    auto const fd = getFile(tor->session, tor, IoMode::Write, file_index, tor->fileSize(file_index), error);
+    if (!fd)
+    {
+        return;
+    }
+
+    if (tr_error* my_error = nullptr; !tr_write_behind::writeAll(*fd, file_offset, bufs, &my_error) && my_error != nullptr)
+    {
+        tr_logAddErrorTor(
+            tor,
+            fmt::format(
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", tor->fileSubpath(file_index)),
+                fmt::arg("error", my_error->message),
+                fmt::arg("error_code", my_error->code)));
+        tr_error_propagate(error, &my_error);
+    }
+}
+
+void readBytesV(
+    tr_torrent* tor,
+    tr_file_index_t file_index,
+    uint64_t file_offset,
+    std::vector<tr_sys_iovec>& bufs,
+    tr_error** error)
+{
+    auto const fd = getFile(tor->session, tor, IoMode::Read, file_index, tor->fileSize(file_index), error);
+    if (!fd)
+    {
+        return;
+    }
+
+    while (!std::empty(bufs))
+    {
+        auto n_read = uint64_t{};
+        tr_error* my_error = nullptr;
+
+        if (!tr_sys_file_read_at_v(*fd, std::data(bufs), std::size(bufs), file_offset, &n_read, &my_error) || n_read == 0)
+        {
+            if (my_error == nullptr) // the file is shorter than the torrent says it is
+            {
+                tr_error_set_from_errno(&my_error, EIO);
+            }
+
+            tr_logAddErrorTor(
+                tor,
+                fmt::format(
+                    _("Couldn't read '{path}': {error} ({error_code})"),
+                    fmt::arg("path", tor->fileSubpath(file_index)),
+                    fmt::arg("error", my_error->message),
+                    fmt::arg("error_code", my_error->code)));
+            tr_error_propagate(error, &my_error);
+            return;
+        }
+
+        file_offset += n_read;
+
+        // drop the buffers that were filled
+        auto iter = std::begin(bufs);
+        for (; iter != std::end(bufs) && n_read >= iter->len; ++iter)
+        {
+            n_read -= iter->len;
+        }
+
+        if (iter != std::end(bufs))
+        {
+            iter->base = static_cast<uint8_t*>(iter->base) + n_read;
+            iter->len -= n_read;
+        }
+
+        bufs.erase(std::begin(bufs), iter);
+    }
+}
+
+// Split `bufs` at the torrent's file boundaries and call
+// `func(file_index, file_offset, file_bufs, error)` for each file.
+// @return 0 on success, or an errno value on failure.
+template<typename Func>
+int forEachFileBufs(
+    tr_torrent* tor,
+    IoMode io_mode,
+    tr_block_info::Location loc,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    Func&& func)
+{
+    if (loc.piece >= tor->pieceCount())
+    {
+        return EINVAL;
+    }
+
+    auto buflen = std::accumulate(
+        bufs,
+        bufs + n_bufs,
+        uint64_t{},
+        [](uint64_t sum, auto const& buf) { return sum + buf.len; });
+    auto buf_offset = size_t{};
+    auto file_bufs = std::vector<tr_sys_iovec>{};
+    file_bufs.reserve(n_bufs);
+
+    auto [file_index, file_offset] = tor->fileOffset(loc);
+
+    while (buflen != 0)
+    {
+        uint64_t const bytes_this_pass = std::min(buflen, uint64_t{ tor->fileSize(file_index) - file_offset });
+
+        // gather the buffers that go into this file
+        file_bufs.clear();
+        for (auto left = bytes_this_pass; left > 0;)
+        {
+            auto const n = std::min(left, uint64_t{ bufs->len - buf_offset });
+            file_bufs.push_back({ static_cast<uint8_t*>(bufs->base) + buf_offset, static_cast<size_t>(n) });
+            left -= n;
+            buf_offset += n;
+
+            if (buf_offset == bufs->len)
+            {
+                ++bufs;
+                buf_offset = 0;
+            }
+        }
+
+        tr_error* error = nullptr;
+        if (bytes_this_pass != 0)
+        {
+            func(file_index, file_offset, file_bufs, &error);
+        }
+
+        if (error != nullptr)
+        {
+            if (io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
+            {
+                tor->setLocalError(error->message);
+                tr_torrentStop(tor);
+            }
+
+            auto const error_code = error->code;
+            tr_error_clear(&error);
+            return error_code;
+        }
+
+        buflen -= bytes_this_pass;
+        ++file_index;
+        file_offset = 0;
+    }
+
+    return 0;
+}
+
 std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_t piece)
 {
     TR_ASSERT(tor != nullptr);
     TR_ASSERT(piece < tor->pieceCount());
 
+    auto& cache = tor->session->cache;
+
+    // if the piece was hashed as its blocks arrived, we're nearly done
+    if (auto hash = cache->finishPieceHash(tor, piece); hash)
+    {
+        return hash;
+    }
+
     auto sha = tr_sha1::create();
     auto buffer = std::array<uint8_t, tr_block_info::BlockSize>{};
 
-    auto& cache = tor->session->cache;
     auto const [begin_byte, end_byte] = tor->blockInfo().byteSpanForPiece(piece);
     auto const [begin_block, end_block] = tor->blockSpanForPiece(piece);
     auto n_bytes_checked = size_t{};
@@ -280,6 +466,86 @@ std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_
     return sha->finish();
 }
 
+// BitTorrent v2 pieces start on a block boundary, so their
+// blocks line up with the leaves of their file's merkle tree.
+std::optional<tr_sha256_digest_t> recalculateHashV2(
+    tr_torrent* tor,
+    tr_piece_index_t piece,
+    tr_torrent_metainfo::V2Piece const& v2_piece)
+{
+    auto& cache = tor->session->cache;
+    auto merkle = tr_merkle::Hasher{};
+    auto buffer = std::array<uint8_t, tr_block_info::BlockSize>{};
+
+    auto block = tor->blockSpanForPiece(piece).begin;
+    for (auto left = v2_piece.n_bytes; left > 0U; ++block)
+    {
+        auto const len = static_cast<uint32_t>(std::min(left, uint64_t{ tor->blockSize(block) }));
+        if (auto const success = cache->readBlock(tor, tor->blockLoc(block), len, std::data(buffer)) == 0; !success)
+        {
+            return {};
+        }
+
+        merkle.add(std::data(buffer), len);
+        left -= len;
+    }
+
+    return merkle.finish(v2_piece.width);
+}
+
+#ifndef _WIN32
+
+// Add references to the files' bytes instead of reading them into memory.
+// The open-files pool may close its fds at any time, so reference the
+// ref-counted segment it keeps for each open file instead of the fd itself.
+int addFileRefs(tr_torrent* tor, tr_block_info::Location loc, size_t len, libtransmission::Buffer& out)
+{
+    if (loc.piece >= tor->pieceCount())
+    {
+        return EINVAL;
+    }
+
+    auto refs = libtransmission::Buffer{};
+    auto [file_index, file_offset] = tor->fileOffset(loc);
+
+    while (len != 0)
+    {
+        auto const file_size = tor->fileSize(file_index);
+        uint64_t const bytes_this_pass = std::min(uint64_t{ len }, uint64_t{ file_size - file_offset });
+
+        if (bytes_this_pass != 0)
+        {
+            tr_error* error = nullptr;
+            evbuffer_file_segment* segment = nullptr;
+            if (getFile(tor->session, tor, IoMode::Read, file_index, file_size, &error))
+            {
+                segment = tor->session->openFiles().fileSegment(tor->id(), file_index, file_size, &error);
+            }
+
+            if (segment == nullptr)
+            {
+                auto const error_code = error != nullptr ? error->code : EIO;
+                tr_error_clear(&error);
+                return error_code;
+            }
+
+            if (!refs.add_file_segment(segment, file_offset, bytes_this_pass))
+            {
+                return EIO;
+            }
+        }
+
+        len -= bytes_this_pass;
+        ++file_index;
+        file_offset = 0;
+    }
+
+    out.add(refs);
+    return 0;
+}
+
+#endif
+
 } // namespace
 
 int tr_ioRead(tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t* setme)
@@ -287,6 +553,43 @@ int tr_ioRead(tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t*
     return readOrWritePiece(tor, IoMode::Read, loc, setme, len);
 }
 
+int tr_ioRead(tr_torrent* tor, tr_block_info::Location loc, size_t len, libtransmission::Buffer& out, bool as_file_ref)
+{
+#ifndef _WIN32
+    if (as_file_ref)
+    {
+        return addFileRefs(tor, loc, len, out);
+    }
+#endif
+
+    // read straight into the buffer's memory instead of copying it there
+    auto* const buf = out.reserve_space(len);
+    if (buf == nullptr)
+    {
+        return ENOMEM;
+    }
+
+    auto const err = tr_ioRead(tor, loc, len, reinterpret_cast<uint8_t*>(buf));
+    if (err == 0)
+    {
+        out.commit_space(buf, len);
+    }
+
+    return err;
+}
+
+int tr_ioRead(tr_torrent* tor, tr_block_info::Location loc, tr_sys_iovec const* bufs, size_t n_bufs)
+{
+    return forEachFileBufs(
+        tor,
+        IoMode::Read,
+        loc,
+        bufs,
+        n_bufs,
+        [tor](tr_file_index_t file_index, uint64_t file_offset, std::vector<tr_sys_iovec>& file_bufs, tr_error** error)
+        { readBytesV(tor, file_index, file_offset, file_bufs, error); });
+}
+
 int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location loc, size_t len)
 {
     return readOrWritePiece(tor, IoMode::Prefetch, loc, nullptr, len);
@@ -297,8 +600,85 @@ int tr_ioWrite(tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t
     return readOrWritePiece(tor, IoMode::Write, loc, const_cast<uint8_t*>(writeme), len);
 }
 
+int tr_ioWrite(tr_torrent* tor, tr_block_info::Location loc, tr_sys_iovec const* bufs, size_t n_bufs)
+{
+    return forEachFileBufs(
+        tor,
+        IoMode::Write,
+        loc,
+        bufs,
+        n_bufs,
+        [tor](tr_file_index_t file_index, uint64_t file_offset, std::vector<tr_sys_iovec>& file_bufs, tr_error** error)
+        { writeBytesV(tor, file_index, file_offset, file_bufs, error); });
+}
+
+int tr_ioPrepareWrite(
+    tr_torrent* tor,
+    tr_block_info::Location loc,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    tr_write_behind& writer,
+    tr_write_behind::Task& setme)
+{
+    auto const tor_id = tor->id();
+    setme.tor_id = tor_id;
+    setme.spans.clear();
+
+    auto const err = forEachFileBufs(
+        tor,
+        IoMode::Write,
+        loc,
+        bufs,
+        n_bufs,
+        [tor, tor_id, &writer, &setme](
+            tr_file_index_t file_index,
+            uint64_t file_offset,
+            std::vector<tr_sys_iovec>& file_bufs,
+            tr_error** error)
+        {
+            auto file = writer.findFile(tor_id, file_index);
+            if (!file)
+            {
+                auto const fd = getFile(tor->session, tor, IoMode::Write, file_index, tor->fileSize(file_index), error);
+                if (!fd)
+                {
+                    return;
+                }
+
+                // the open-files pool may close its fd before the write happens
+                auto const dup_fd = tr_sys_file_dup(*fd, error);
+                if (dup_fd == TR_BAD_SYS_FILE)
+                {
+                    return;
+                }
+
+                file = writer.addFile(tor_id, file_index, dup_fd, tor->fileSubpath(file_index));
+            }
+
+            auto span = tr_write_behind::Task::Span{};
+            span.file_index = file_index;
+            span.file = std::move(file);
+            span.offset = file_offset;
+            span.bufs = file_bufs;
+            setme.spans.emplace_back(std::move(span));
+        });
+
+    if (err != 0)
+    {
+        setme.spans.clear();
+    }
+
+    return err;
+}
+
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
 {
+    if (!tor->hasV1Metadata())
+    {
+        auto const v2_piece = tor->v2Piece(piece);
+        return v2_piece && recalculateHashV2(tor, piece, *v2_piece) == v2_piece->hash;
+    }
+
     auto const hash = recalculateHash(tor, piece);
     return hash && *hash == tor->pieceHash(piece);
 }
@@ -9,11 +9,18 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // size_t
 #include <cstdint> // uint8_t, uint32_t
 
 #include "transmission.h"
 
 #include "block-info.h"
+#include "write-behind.h"
+
+namespace libtransmission
+{
+class Buffer;
+} // namespace libtransmission
 
 struct tr_torrent;
 
@@ -28,6 +35,26 @@ struct tr_torrent;
  */
 [[nodiscard]] int tr_ioRead(struct tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t* setme);
 
+/**
+ * Appends the block specified by the piece index, offset, and length to `out`.
+ * If `as_file_ref` is true and the platform supports it, the file's bytes are
+ * referenced instead of being read into memory; see Buffer::add_file_segment().
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioRead(
+    struct tr_torrent* tor,
+    tr_block_info::Location loc,
+    size_t len,
+    libtransmission::Buffer& out,
+    bool as_file_ref);
+
+/**
+ * Reads into `bufs`, in order, starting at the specified location.
+ * Files are read with one vectored call each instead of block by block.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioRead(struct tr_torrent* tor, tr_block_info::Location loc, tr_sys_iovec const* bufs, size_t n_bufs);
+
 int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location loc, size_t len);
 
 /**
@@ -36,6 +63,27 @@ int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location loc, size_t len);
  */
 [[nodiscard]] int tr_ioWrite(struct tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t const* writeme);
 
+/**
+ * Writes `bufs`, in order, starting at the specified location.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioWrite(struct tr_torrent* tor, tr_block_info::Location loc, tr_sys_iovec const* bufs, size_t n_bufs);
+
+/**
+ * Opens (or creates) the files that `bufs` will be written into, starting
+ * at the specified location, and fills `setme` so that the write can be
+ * done later by `writer`. Files that `writer` already has writes queued
+ * for reuse the same file descriptor.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioPrepareWrite(
+    struct tr_torrent* tor,
+    tr_block_info::Location loc,
+    tr_sys_iovec const* bufs,
+    size_t n_bufs,
+    tr_write_behind& writer,
+    tr_write_behind::Task& setme);
+
 /**
  * @brief Test to see if the piece matches its metainfo's SHA1 checksum.
  */
@@ -0,0 +1,247 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cerrno>
+#include <climits> // IOV_MAX
+#include <cstring> // memset()
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h> // struct iovec
+#include <unistd.h>
+
+#include "transmission.h"
+
+#include "io-uring.h"
+#include "tr-assert.h"
+
+namespace
+{
+
+int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+template<typename T>
+[[nodiscard]] T* offsetPtr(void* base, size_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+} // namespace
+
+std::unique_ptr<tr_io_uring> tr_io_uring::create(unsigned queue_depth)
+{
+    auto params = io_uring_params{};
+    auto const ring_fd = io_uring_setup(queue_depth, &params);
+    if (ring_fd < 0)
+    {
+        return {};
+    }
+
+    auto ring = std::unique_ptr<tr_io_uring>{ new tr_io_uring{} };
+    ring->ring_fd_ = ring_fd;
+
+    ring->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        ring->sq_ring_size_ = ring->cq_ring_size_ = std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+    }
+
+    auto const map = [ring_fd](size_t size, off_t offset) -> void*
+    {
+        auto* const ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    };
+
+    ring->sq_ring_ = map(ring->sq_ring_size_, IORING_OFF_SQ_RING);
+    if (ring->sq_ring_ == nullptr)
+    {
+        return {};
+    }
+
+    ring->cq_ring_ = single_mmap ? ring->sq_ring_ : map(ring->cq_ring_size_, IORING_OFF_CQ_RING);
+    if (ring->cq_ring_ == nullptr)
+    {
+        return {};
+    }
+
+    ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes_ = static_cast<io_uring_sqe*>(map(ring->sqes_size_, IORING_OFF_SQES));
+    if (ring->sqes_ == nullptr)
+    {
+        return {};
+    }
+
+    ring->sq_head_ = offsetPtr<unsigned>(ring->sq_ring_, params.sq_off.head);
+    ring->sq_tail_ = offsetPtr<unsigned>(ring->sq_ring_, params.sq_off.tail);
+    ring->sq_mask_ = *offsetPtr<unsigned>(ring->sq_ring_, params.sq_off.ring_mask);
+    ring->sq_array_ = offsetPtr<unsigned>(ring->sq_ring_, params.sq_off.array);
+    ring->sq_entries_ = params.sq_entries;
+
+    ring->cq_head_ = offsetPtr<unsigned>(ring->cq_ring_, params.cq_off.head);
+    ring->cq_tail_ = offsetPtr<unsigned>(ring->cq_ring_, params.cq_off.tail);
+    ring->cq_mask_ = *offsetPtr<unsigned>(ring->cq_ring_, params.cq_off.ring_mask);
+    ring->cqes_ = offsetPtr<io_uring_cqe>(ring->cq_ring_, params.cq_off.cqes);
+
+    return ring;
+}
+
+tr_io_uring::~tr_io_uring()
+{
+    if (sqes_ != nullptr)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+    {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+
+    if (sq_ring_ != nullptr)
+    {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+
+    if (ring_fd_ != -1)
+    {
+        close(ring_fd_);
+    }
+}
+
+bool tr_io_uring::writev(Write* writes, size_t n_writes)
+{
+    // the ring holds at most `sq_entries_` requests at a time
+    for (size_t i = 0; i < n_writes; i += sq_entries_)
+    {
+        if (!submitAndWait(writes + i, std::min(n_writes - i, size_t{ sq_entries_ })))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool tr_io_uring::submitAndWait(Write* writes, size_t n_writes)
+{
+    TR_ASSERT(n_writes <= sq_entries_);
+
+    // IORING_OP_WRITEV takes `struct iovec`s, so convert ours.
+    // Each write is capped at IOV_MAX buffers; the rest of it
+    // is reported as a short write.
+    auto n_iovs = size_t{};
+    for (size_t i = 0; i < n_writes; ++i)
+    {
+        n_iovs += std::min(writes[i].n_bufs, size_t{ IOV_MAX });
+    }
+
+    auto iovs = std::vector<iovec>{};
+    iovs.reserve(n_iovs);
+
+    // fill in the submission queue entries
+    auto tail = *sq_tail_; // only we write to the tail
+    for (size_t i = 0; i < n_writes; ++i)
+    {
+        auto& write = writes[i];
+        auto* const iov = std::data(iovs) + std::size(iovs);
+        auto const n_bufs = std::min(write.n_bufs, size_t{ IOV_MAX });
+        for (size_t j = 0; j < n_bufs; ++j)
+        {
+            iovs.push_back({ write.bufs[j].base, write.bufs[j].len });
+        }
+
+        auto const idx = tail & sq_mask_;
+        auto* const sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->flags = write.after_earlier_writes ? IOSQE_IO_DRAIN : 0U;
+        sqe->fd = write.fd;
+        sqe->off = write.offset;
+        sqe->addr = reinterpret_cast<uintptr_t>(iov);
+        sqe->len = static_cast<unsigned>(n_bufs);
+        sqe->user_data = i;
+        sq_array_[idx] = idx;
+        ++tail;
+    }
+
+    // publish the entries before telling the kernel about them
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    auto n_to_submit = static_cast<unsigned>(n_writes);
+    auto n_done = size_t{};
+    while (n_done < n_writes)
+    {
+        auto const n_to_wait = static_cast<unsigned>(n_writes - n_done);
+        auto const n_submitted = io_uring_enter(ring_fd_, n_to_submit, n_to_wait, IORING_ENTER_GETEVENTS);
+        if (n_submitted < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                continue;
+            }
+
+            // The kernel may still be working on the entries it took, and they
+            // point into `iovs` and the callers' buffers, so don't return until
+            // they're done. Take back the entries that it hasn't taken yet.
+            __atomic_store_n(sq_tail_, __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+            waitForCompletions(writes, n_writes, n_writes - n_to_submit - n_done);
+            return false;
+        }
+
+        n_to_submit -= std::min(n_to_submit, static_cast<unsigned>(n_submitted));
+        n_done += reapCompletions(writes, n_writes);
+    }
+
+    return true;
+}
+
+// @return how many completions were reaped
+size_t tr_io_uring::reapCompletions(Write* writes, [[maybe_unused]] size_t n_writes)
+{
+    auto n_reaped = size_t{};
+
+    auto head = __atomic_load_n(cq_head_, __ATOMIC_RELAXED);
+    auto const cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != cq_tail; ++head)
+    {
+        auto const& cqe = cqes_[head & cq_mask_];
+        TR_ASSERT(cqe.user_data < n_writes);
+        writes[cqe.user_data].result = cqe.res;
+        ++n_reaped;
+    }
+
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return n_reaped;
+}
+
+void tr_io_uring::waitForCompletions(Write* writes, size_t n_writes, size_t n_in_flight)
+{
+    while (n_in_flight > 0U)
+    {
+        // the kernel posts completions to the ring even if entering it
+        // keeps failing, so fall back to polling the ring
+        if (io_uring_enter(ring_fd_, 0U, static_cast<unsigned>(n_in_flight), IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            std::this_thread::yield();
+        }
+
+        n_in_flight -= std::min(n_in_flight, reapCompletions(writes, n_writes));
+    }
+}
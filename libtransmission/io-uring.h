@@ -0,0 +1,90 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#ifndef WITH_IO_URING
+#error io_uring support is disabled
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // int64_t, uint64_t
+#include <memory>
+
+#include "file.h" // tr_sys_file_t, tr_sys_iovec
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+// A minimal io_uring ring for submitting many vectored writes
+// with one syscall and letting the kernel run them in parallel.
+// Written against the kernel interface directly so that we
+// don't need liburing. Not thread-safe.
+class tr_io_uring
+{
+public:
+    struct Write
+    {
+        tr_sys_file_t fd = TR_BAD_SYS_FILE;
+        uint64_t offset = 0;
+        tr_sys_iovec const* bufs = nullptr;
+        size_t n_bufs = 0;
+
+        // don't start this write until the earlier ones have finished,
+        // e.g. because it overlaps one of them
+        bool after_earlier_writes = false;
+
+        // set by writev(): the number of bytes written, or -errno.
+        // Like pwritev(), a write may be short.
+        int64_t result = 0;
+    };
+
+    static auto constexpr DefaultQueueDepth = unsigned{ 64U };
+
+    // @return the new ring, or nullptr if the kernel doesn't
+    // support io_uring or isn't letting us use it.
+    [[nodiscard]] static std::unique_ptr<tr_io_uring> create(unsigned queue_depth = DefaultQueueDepth);
+
+    ~tr_io_uring();
+
+    tr_io_uring(tr_io_uring const&) = delete;
+    tr_io_uring& operator=(tr_io_uring const&) = delete;
+
+    // Submit the writes and wait for all of them to complete.
+    // @return false if the ring itself failed, in which case
+    // the writes' results are unreliable and should be redone.
+    [[nodiscard]] bool writev(Write* writes, size_t n_writes);
+
+private:
+    tr_io_uring() = default;
+
+    [[nodiscard]] bool submitAndWait(Write* writes, size_t n_writes);
+    size_t reapCompletions(Write* writes, size_t n_writes);
+    void waitForCompletions(Write* writes, size_t n_writes, size_t n_in_flight);
+
+    int ring_fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
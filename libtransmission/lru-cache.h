@@ -5,39 +5,56 @@
 
 #pragma once
 
-#include <algorithm>
-#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <list>
+#include <unordered_map>
 #include <utility>
 
-// A fixed-size cache that erases least-recently-used items to make room for new ones.
-template<typename Key, typename Val, std::size_t N>
+// A cache that erases least-recently-used items to make room for new ones.
+// Lookups, insertions, and erasures by key are O(1).
+template<typename Key, typename Val, typename Hash = std::hash<Key>>
 class tr_lru_cache
 {
 public:
-    [[nodiscard]] constexpr Val* get(Key const& key) noexcept
+    explicit tr_lru_cache(std::size_t capacity)
+        : capacity_{ capacity }
     {
-        if (auto const found = find(key); found != nullptr)
+    }
+
+    [[nodiscard]] Val* get(Key const& key) noexcept
+    {
+        if (auto const found = index_.find(key); found != std::end(index_))
         {
-            found->sequence_ = next_sequence_++;
-            return &found->val_;
+            // mark it as the most recently used
+            entries_.splice(std::begin(entries_), entries_, found->second);
+            return &found->second->val_;
         }
 
         return nullptr;
     }
 
-    [[nodiscard]] constexpr bool contains(Key const& key) const noexcept
+    [[nodiscard]] bool contains(Key const& key) const noexcept
     {
-        return !!find(key);
+        return index_.count(key) != 0U;
     }
 
     Val& add(Key&& key)
     {
-        auto& entry = getFreeSlot();
+        erase(key);
+
+        if (capacity_ > 0U)
+        {
+            while (std::size(entries_) >= capacity_)
+            {
+                evictOldest();
+            }
+        }
+
+        auto& entry = entries_.emplace_front();
         entry.key_ = std::move(key);
-        entry.sequence_ = next_sequence_++;
+        index_.emplace(entry.key_, std::begin(entries_));
 
         key = {};
         return entry.val_;
@@ -45,31 +62,62 @@ public:
 
     void erase(Key const& key)
     {
-        if (auto* const found = find(key); found != nullptr)
+        if (auto const found = index_.find(key); found != std::end(index_))
         {
-            this->erase(*found);
+            erase(found->second);
         }
     }
 
     void erase_if(std::function<bool(Key const&, Val const&)> test)
     {
-        for (auto& entry : entries_)
+        for (auto iter = std::begin(entries_); iter != std::end(entries_);)
         {
-            if (entry.sequence_ != InvalidSeq && test(entry.key_, entry.val_))
+            auto const next = std::next(iter);
+
+            if (test(iter->key_, iter->val_))
             {
-                erase(entry);
+                erase(iter);
             }
+
+            iter = next;
         }
     }
 
     void clear()
     {
-        for (auto& entry : entries_)
+        while (!std::empty(entries_))
+        {
+            erase(std::begin(entries_));
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return std::size(entries_);
+    }
+
+    [[nodiscard]] constexpr std::size_t capacity() const noexcept
+    {
+        return capacity_;
+    }
+
+    // Change the capacity, evicting the oldest items if needed.
+    void setCapacity(std::size_t capacity)
+    {
+        capacity_ = capacity;
+
+        while (std::size(entries_) > capacity_)
         {
-            erase(entry);
+            evictOldest();
         }
     }
 
+    // @return how many items have been erased to make room for new ones
+    [[nodiscard]] constexpr uint64_t evictions() const noexcept
+    {
+        return n_evictions_;
+    }
+
     using PreEraseCallback = std::function<void(Key const&, Val&)>;
 
     void setPreErase(PreEraseCallback&& func)
@@ -85,58 +133,26 @@ private:
     {
         Key key_ = {};
         Val val_ = {};
-        uint64_t sequence_ = InvalidSeq;
     };
 
-    void erase(Entry& entry)
-    {
-        if (entry.sequence_ != InvalidSeq)
-        {
-            pre_erase_cb_(entry.key_, entry.val_);
-        }
-
-        entry.key_ = {};
-        entry.val_ = {};
-        entry.sequence_ = InvalidSeq;
-    }
+    using Entries = std::list<Entry>;
 
-    [[nodiscard]] constexpr Entry* find(Key const& key) noexcept
+    void erase(typename Entries::iterator iter)
     {
-        for (auto& entry : entries_)
-        {
-            if (entry.sequence_ != InvalidSeq && entry.key_ == key)
-            {
-                return &entry;
-            }
-        }
-
-        return nullptr;
-    }
-
-    [[nodiscard]] constexpr Entry const* find(Key const& key) const noexcept
-    {
-        for (auto const& entry : entries_)
-        {
-            if (entry.sequence_ != InvalidSeq && entry.key_ == key)
-            {
-                return &entry;
-            }
-        }
-
-        return nullptr;
+        pre_erase_cb_(iter->key_, iter->val_);
+        index_.erase(iter->key_);
+        entries_.erase(iter);
     }
 
-    Entry& getFreeSlot()
+    void evictOldest()
     {
-        auto const iter = std::min_element(
-            std::begin(entries_),
-            std::end(entries_),
-            [](auto const& a, auto const& b) { return a.sequence_ < b.sequence_; });
-        this->erase(*iter);
-        return *iter;
+        erase(std::prev(std::end(entries_)));
+        ++n_evictions_;
     }
 
-    std::array<Entry, N> entries_;
-    uint64_t next_sequence_ = 1;
-    static uint64_t constexpr InvalidSeq = 0;
+    // most recently used first
+    Entries entries_;
+    std::unordered_map<Key, typename Entries::iterator, Hash> index_;
+    std::size_t capacity_;
+    uint64_t n_evictions_ = 0;
 };
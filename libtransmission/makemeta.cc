@@ -4,7 +4,10 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
-#include <cerrno> // for ENOENT
+#include <cerrno> // for ENOENT, EIO, ECANCELED
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -141,6 +144,86 @@ tr_torrent_files findFiles(std::string_view const top, std::string_view const su
     return files;
 }
 
+namespace make_checksums_helpers
+{
+
+// Read the files in chunks of about this size, rounded to whole pieces
+auto constexpr ChunkSize = uint32_t{ 4U * 1024U * 1024U };
+
+struct Chunk
+{
+    std::vector<char> buf;
+    tr_piece_index_t first_piece = 0;
+    tr_piece_index_t n_pieces = 0;
+};
+
+// Hands chunks from the reader to the hashers and back again.
+// Chunks are recycled so that memory use is capped at `n_chunks` chunks.
+class ChunkQueue
+{
+public:
+    explicit ChunkQueue(size_t n_chunks)
+        : free_(n_chunks)
+    {
+    }
+
+    // Blocks until a chunk is free to read into.
+    [[nodiscard]] Chunk popFree()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        cv_.wait(lock, [this]() { return !std::empty(free_); });
+        auto chunk = std::move(free_.back());
+        free_.pop_back();
+        return chunk;
+    }
+
+    void pushFree(Chunk&& chunk)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        free_.emplace_back(std::move(chunk));
+        cv_.notify_all();
+    }
+
+    // Blocks until a chunk is ready to hash.
+    // Returns nullopt once the queue is closed and drained.
+    [[nodiscard]] std::optional<Chunk> popFull()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        cv_.wait(lock, [this]() { return closed_ || !std::empty(full_); });
+        if (std::empty(full_))
+        {
+            return {};
+        }
+
+        auto chunk = std::move(full_.front());
+        full_.pop_front();
+        return chunk;
+    }
+
+    void pushFull(Chunk&& chunk)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        full_.emplace_back(std::move(chunk));
+        cv_.notify_all();
+    }
+
+    void close()
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        closed_ = true;
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Chunk> free_;
+    std::deque<Chunk> full_;
+    bool closed_ = false;
+};
+
+} // namespace make_checksums_helpers
+
 } // namespace
 
 tr_metainfo_builder::tr_metainfo_builder(std::string_view single_file_or_parent_directory)
@@ -171,6 +254,8 @@ bool tr_metainfo_builder::setPieceSize(uint32_t piece_size) noexcept
 
 bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
 {
+    using namespace make_checksums_helpers;
+
     checksum_piece_ = 0;
     cancel_ = false;
 
@@ -181,86 +266,157 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
     }
 
     auto hashes = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * pieceCount());
-    auto* walk = std::data(hashes);
-    auto sha = tr_sha1::create();
 
-    auto file_index = tr_file_index_t{ 0U };
-    auto piece_index = tr_piece_index_t{ 0U };
-    auto total_remain = totalSize();
-    auto off = uint64_t{ 0U };
+    // One reader (this thread) fills chunks of whole pieces and
+    // `n_hashers` threads hash them, each writing its pieces' hashes
+    // straight into `hashes`.
+    auto const pieces_per_chunk = std::max(tr_piece_index_t{ 1U }, tr_piece_index_t{ ChunkSize / pieceSize() });
+    auto const n_chunks = (pieceCount() + pieces_per_chunk - 1U) / pieces_per_chunk;
+    auto n_hashers = checksum_threads_ != 0U ? checksum_threads_ : size_t{ std::thread::hardware_concurrency() };
+    n_hashers = std::clamp(n_hashers, size_t{ 1U }, size_t{ n_chunks });
 
-    auto buf = std::vector<char>(pieceSize());
+    auto queue = ChunkQueue{ n_hashers + 1U };
 
-    auto const parent = tr_sys_path_dirname(top_);
-    auto fd = tr_sys_file_open(
-        tr_pathbuf{ parent, '/', path(file_index) },
-        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-        0,
-        error);
-    if (fd == TR_BAD_SYS_FILE)
+    auto const hash_chunks = [this, &queue, &hashes]()
     {
-        return false;
-    }
+        auto batch = std::vector<std::string_view>{};
 
-    while (!cancel_ && (total_remain > 0U))
-    {
-        checksum_piece_ = piece_index;
+        while (auto chunk = queue.popFull())
+        {
+            if (!cancel_)
+            {
+                batch.clear();
+                auto const* walk = std::data(chunk->buf);
+                for (tr_piece_index_t i = 0; i < chunk->n_pieces; ++i)
+                {
+                    auto const len = block_info_.pieceSize(chunk->first_piece + i);
+                    batch.emplace_back(walk, len);
+                    walk += len;
+                }
 
-        TR_ASSERT(piece_index < pieceCount());
+                auto* out = std::data(hashes) + std::size(tr_sha1_digest_t{}) * chunk->first_piece;
+                for (auto const& digest : tr_sha1::hash_many(batch))
+                {
+                    out = std::copy(std::begin(digest), std::end(digest), out);
+                }
 
-        uint32_t const piece_size = block_info_.pieceSize(piece_index);
-        buf.resize(piece_size);
-        auto* bufptr = std::data(buf);
+                checksum_piece_ += chunk->n_pieces;
+            }
 
-        auto left_in_piece = piece_size;
-        while (left_in_piece > 0U)
+            queue.pushFree(std::move(*chunk));
+        }
+    };
+
+    auto const read_chunks = [this, &queue, pieces_per_chunk, error]()
+    {
+        auto file_index = tr_file_index_t{ 0U };
+        auto piece_index = tr_piece_index_t{ 0U };
+        auto total_remain = totalSize();
+        auto off = uint64_t{ 0U };
+
+        auto const parent = tr_sys_path_dirname(top_);
+        auto fd = tr_sys_file_open(
+            tr_pathbuf{ parent, '/', path(file_index) },
+            TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+            0,
+            error);
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            return false;
+        }
+
+        while (!cancel_ && (total_remain > 0U))
         {
-            auto const n_this_pass = std::min(fileSize(file_index) - off, uint64_t{ left_in_piece });
-            auto n_read = uint64_t{};
+            auto chunk = queue.popFree();
+            chunk.first_piece = piece_index;
+            chunk.n_pieces = std::min(pieces_per_chunk, pieceCount() - piece_index);
 
-            (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error);
-            bufptr += n_read;
-            off += n_read;
-            left_in_piece -= n_read;
+            auto chunk_size = uint64_t{};
+            for (tr_piece_index_t i = 0; i < chunk.n_pieces; ++i)
+            {
+                chunk_size += block_info_.pieceSize(piece_index + i);
+            }
+            chunk.buf.resize(chunk_size);
+            auto* bufptr = std::data(chunk.buf);
 
-            if (off == fileSize(file_index))
+            auto left_in_chunk = chunk_size;
+            while (left_in_chunk > 0U)
             {
-                off = 0;
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
+                auto const n_this_pass = std::min(fileSize(file_index) - off, left_in_chunk);
+                auto n_read = uint64_t{};
 
-                if (++file_index < fileCount())
+                if (!tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error))
                 {
-                    fd = tr_sys_file_open(
-                        tr_pathbuf{ parent, '/', path(file_index) },
-                        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-                        0,
-                        error);
-                    if (fd == TR_BAD_SYS_FILE)
+                    tr_sys_file_close(fd);
+                    return false;
+                }
+
+                bufptr += n_read;
+                off += n_read;
+                left_in_chunk -= n_read;
+
+                if (off == fileSize(file_index))
+                {
+                    off = 0;
+                    tr_sys_file_close(fd);
+                    fd = TR_BAD_SYS_FILE;
+
+                    if (++file_index < fileCount())
                     {
-                        return false;
+                        fd = tr_sys_file_open(
+                            tr_pathbuf{ parent, '/', path(file_index) },
+                            TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+                            0,
+                            error);
+                        if (fd == TR_BAD_SYS_FILE)
+                        {
+                            return false;
+                        }
                     }
                 }
+                else if (n_read == 0U)
+                {
+                    // the file is shorter than when we scanned it
+                    tr_sys_file_close(fd);
+                    tr_error_set_from_errno(error, EIO);
+                    return false;
+                }
             }
+
+            TR_ASSERT(left_in_chunk == 0U);
+            total_remain -= chunk_size;
+            piece_index += chunk.n_pieces;
+            queue.pushFull(std::move(chunk));
+        }
+
+        TR_ASSERT(cancel_ || total_remain == 0U);
+
+        if (fd != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd);
         }
 
-        TR_ASSERT(bufptr - std::data(buf) == (int)piece_size);
-        TR_ASSERT(left_in_piece == 0);
-        sha->add(std::data(buf), std::size(buf));
-        auto const digest = sha->finish();
-        walk = std::copy(std::begin(digest), std::end(digest), walk);
-        sha->clear();
+        return true;
+    };
 
-        total_remain -= piece_size;
-        ++piece_index;
+    auto hashers = std::vector<std::thread>{};
+    hashers.reserve(n_hashers);
+    for (size_t i = 0; i < n_hashers; ++i)
+    {
+        hashers.emplace_back(hash_chunks);
     }
 
-    TR_ASSERT(cancel_ || size_t(walk - std::data(hashes)) == std::size(hashes));
-    TR_ASSERT(cancel_ || total_remain == 0U);
+    auto const ok = read_chunks();
 
-    if (fd != TR_BAD_SYS_FILE)
+    queue.close();
+    for (auto& hasher : hashers)
     {
-        tr_sys_file_close(fd);
+        hasher.join();
+    }
+
+    if (!ok)
+    {
+        return false;
     }
 
     if (cancel_)
@@ -269,6 +425,7 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
         return false;
     }
 
+    TR_ASSERT(checksum_piece_ == pieceCount());
     piece_hashes_ = std::move(hashes);
     return true;
 }
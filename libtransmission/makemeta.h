@@ -6,6 +6,7 @@
 #pragma once
 
 #include <algorithm> // std::move
+#include <atomic>
 #include <cstddef> // std::byte
 #include <cstdint>
 #include <future>
@@ -50,18 +51,26 @@ public:
     }
 
     // Returns the status of a `makeChecksums()` call:
-    // The current piece being tested and the total number of pieces in the torrent.
-    [[nodiscard]] constexpr std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
+    // The number of pieces hashed so far and the total number of pieces in the torrent.
+    [[nodiscard]] std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
     {
-        return std::make_pair(checksum_piece_, block_info_.pieceCount());
+        return std::make_pair(checksum_piece_.load(), block_info_.pieceCount());
     }
 
-    // Tell the `makeChecksums()` worker thread to cleanly exit ASAP.
-    constexpr void cancelChecksums() noexcept
+    // Tell the `makeChecksums()` worker threads to cleanly exit ASAP.
+    void cancelChecksums() noexcept
     {
         cancel_ = true;
     }
 
+    // How many threads `makeChecksums()` hashes pieces with.
+    // One thread reads the files; the rest hash what it has read.
+    // 0, the default, means one hashing thread per CPU core.
+    constexpr void setChecksumThreads(size_t n_threads) noexcept
+    {
+        checksum_threads_ = n_threads;
+    }
+
     // generate the metainfo
     [[nodiscard]] std::string benc(tr_error** error = nullptr) const;
 
@@ -123,6 +132,11 @@ public:
         return comment_;
     }
 
+    [[nodiscard]] constexpr auto checksumThreads() const noexcept
+    {
+        return checksum_threads_;
+    }
+
     [[nodiscard]] TR_CONSTEXPR20 auto fileCount() const noexcept
     {
         return files_.fileCount();
@@ -235,9 +249,10 @@ private:
     std::string comment_;
     std::string source_;
 
-    tr_piece_index_t checksum_piece_ = 0;
+    size_t checksum_threads_ = 0;
+    std::atomic<tr_piece_index_t> checksum_piece_ = 0;
 
     bool is_private_ = false;
     bool anonymize_ = false;
-    bool cancel_ = false;
+    std::atomic<bool> cancel_ = false;
 };
@@ -0,0 +1,192 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "merkle.h"
+#include "tr-assert.h"
+
+namespace tr_merkle
+{
+
+namespace
+{
+
+// deep enough for a 2^64 byte file
+auto constexpr MaxHeight = size_t{ 64U };
+
+[[nodiscard]] auto makePadHashes()
+{
+    auto hashes = std::array<hash_t, MaxHeight + 1U>{};
+    hashes[0] = hash_t{}; // a leaf of zeroes, not the hash of one
+    for (size_t i = 1; i < std::size(hashes); ++i)
+    {
+        hashes[i] = parentHash(hashes[i - 1], hashes[i - 1]);
+    }
+    return hashes;
+}
+
+} // namespace
+
+hash_t blockHash(void const* data, size_t data_length)
+{
+    TR_ASSERT(data_length <= BlockSize);
+
+    auto sha = tr_sha256::create();
+    sha->add(data, data_length);
+    return sha->finish();
+}
+
+hash_t parentHash(hash_t const& left, hash_t const& right)
+{
+    return tr_sha256::digest(left, right);
+}
+
+hash_t const& padHash(size_t height)
+{
+    static auto const hashes = makePadHashes();
+
+    TR_ASSERT(height < std::size(hashes));
+    return hashes[std::min(height, MaxHeight)];
+}
+
+std::vector<hash_t> parentLayer(std::vector<hash_t> const& layer, size_t height)
+{
+    auto const n = std::size(layer);
+    auto parents = std::vector<hash_t>{};
+    parents.reserve((n + 1U) / 2U);
+
+    for (size_t i = 0; i < n; i += 2U)
+    {
+        parents.emplace_back(parentHash(layer[i], i + 1U < n ? layer[i + 1U] : padHash(height)));
+    }
+
+    return parents;
+}
+
+hash_t root(std::vector<hash_t> layer, size_t width, size_t height)
+{
+    TR_ASSERT(width == ceilPow2(width));
+    TR_ASSERT(std::size(layer) <= width);
+
+    if (std::empty(layer))
+    {
+        return padHash(height + log2(width));
+    }
+
+    for (; width > 1U; width /= 2U, ++height)
+    {
+        layer = parentLayer(layer, height);
+    }
+
+    return layer.front();
+}
+
+std::vector<std::vector<hash_t>> layers(std::vector<hash_t> layer, size_t width, size_t height)
+{
+    TR_ASSERT(width == ceilPow2(width));
+    TR_ASSERT(std::size(layer) <= width);
+
+    if (std::empty(layer))
+    {
+        layer.emplace_back(padHash(height));
+    }
+
+    auto ret = std::vector<std::vector<hash_t>>{};
+    ret.reserve(log2(width) + 1U);
+    ret.emplace_back(std::move(layer));
+
+    for (; width > 1U; width /= 2U, ++height)
+    {
+        ret.emplace_back(parentLayer(ret.back(), height));
+    }
+
+    return ret;
+}
+
+std::vector<hash_t> uncles(
+    std::vector<std::vector<hash_t>> const& tree,
+    size_t height,
+    size_t level,
+    size_t index,
+    size_t n_layers)
+{
+    auto ret = std::vector<hash_t>{};
+
+    for (; level + 1U < std::size(tree) && std::size(ret) < n_layers; ++level, index /= 2U)
+    {
+        auto const& layer = tree[level];
+        auto const sibling = index ^ 1U;
+        ret.emplace_back(sibling < std::size(layer) ? layer[sibling] : padHash(height + level));
+    }
+
+    return ret;
+}
+
+// ---
+
+Hasher::Hasher()
+    : sha_{ tr_sha256::create() }
+{
+}
+
+void Hasher::add(void const* data, size_t data_length)
+{
+    auto const* walk = static_cast<std::byte const*>(data);
+
+    while (data_length > 0U)
+    {
+        auto const n_this_pass = std::min(size_t{ BlockSize - n_block_bytes_ }, data_length);
+        sha_->add(walk, n_this_pass);
+        walk += n_this_pass;
+        data_length -= n_this_pass;
+        n_block_bytes_ += n_this_pass;
+
+        if (n_block_bytes_ == BlockSize)
+        {
+            finishBlock();
+        }
+    }
+}
+
+hash_t Hasher::finish(size_t width)
+{
+    if (n_block_bytes_ > 0U)
+    {
+        finishBlock();
+    }
+
+    if (width == 0U)
+    {
+        width = ceilPow2(std::size(leaves_));
+    }
+
+    auto const ret = root(std::move(leaves_), width);
+    clear();
+    return ret;
+}
+
+void Hasher::finishBlock()
+{
+    leaves_.emplace_back(sha_->finish());
+    sha_->clear();
+    n_block_bytes_ = 0U;
+}
+
+void Hasher::clear()
+{
+    sha_->clear();
+    leaves_.clear();
+    n_block_bytes_ = 0U;
+}
+
+} // namespace tr_merkle
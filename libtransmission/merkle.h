@@ -0,0 +1,125 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <memory>
+#include <vector>
+
+#include "transmission.h" // tr_sha256_digest_t
+
+#include "crypto-utils.h" // tr_sha256
+
+/**
+ * Merkle trees as used by BitTorrent v2.
+ * http://bittorrent.org/beps/bep_0052.html
+ *
+ * Each file has its own tree of SHA-256 hashes. The leaves are the
+ * hashes of the file's 16 KiB blocks, and the tree is padded out to a
+ * power of two with leaves that are all zeroes. The torrent's "piece
+ * layers" are the nodes that cover one piece each.
+ */
+namespace tr_merkle
+{
+
+using hash_t = tr_sha256_digest_t;
+
+auto constexpr BlockSize = uint32_t{ 16U * 1024U };
+
+[[nodiscard]] constexpr size_t ceilPow2(size_t n) noexcept
+{
+    auto ret = size_t{ 1U };
+    while (ret < n)
+    {
+        ret <<= 1U;
+    }
+    return ret;
+}
+
+// @return the log2 of `pow2`, which must be a power of two
+[[nodiscard]] constexpr size_t log2(size_t pow2) noexcept
+{
+    auto ret = size_t{ 0U };
+    while (pow2 > 1U)
+    {
+        pow2 >>= 1U;
+        ++ret;
+    }
+    return ret;
+}
+
+// @return how many leaves are needed for `n_bytes` of a file
+[[nodiscard]] constexpr size_t leafCount(uint64_t n_bytes) noexcept
+{
+    return static_cast<size_t>((n_bytes + BlockSize - 1U) / BlockSize);
+}
+
+[[nodiscard]] hash_t blockHash(void const* data, size_t data_length);
+
+[[nodiscard]] hash_t parentHash(hash_t const& left, hash_t const& right);
+
+// @return the root of a subtree whose leaves are all padding,
+// `height` layers above the leaves
+[[nodiscard]] hash_t const& padHash(size_t height);
+
+// @return the next layer up from `layer`, whose nodes are `height` layers
+// above the leaves. Missing right-hand siblings are padding.
+[[nodiscard]] std::vector<hash_t> parentLayer(std::vector<hash_t> const& layer, size_t height);
+
+// @return the root of a tree whose layer at `height` is `layer`,
+// padded out to `width` nodes. `width` must be a power of two.
+[[nodiscard]] hash_t root(std::vector<hash_t> layer, size_t width, size_t height = 0U);
+
+// @return `layer` and every layer above it, up to and including the root.
+// `layer` is `height` layers above the leaves and has `width` nodes when padded.
+[[nodiscard]] std::vector<std::vector<hash_t>> layers(std::vector<hash_t> layer, size_t width, size_t height = 0U);
+
+// @return the uncle hashes that prove the node at `index` of `tree[level]`,
+// bottom-up, for at most `n_layers` layers or until the root is reached.
+// `tree` is what layers() returns for a layer `height` layers above the leaves.
+// The hashes are looked up, not computed, so this is cheap to call often.
+[[nodiscard]] std::vector<hash_t> uncles(
+    std::vector<std::vector<hash_t>> const& tree,
+    size_t height,
+    size_t level,
+    size_t index,
+    size_t n_layers);
+
+// Hashes a stream of bytes into leaves and then into a root.
+class Hasher
+{
+public:
+    Hasher();
+
+    void add(void const* data, size_t data_length);
+
+    // @return the root of the leaves added so far, padded out to
+    // `width` leaves, or to the next power of two if `width` is 0.
+    // Resets the hasher for reuse.
+    [[nodiscard]] hash_t finish(size_t width = 0U);
+
+    void clear();
+
+    // @return the hashes of the whole blocks added so far
+    [[nodiscard]] constexpr auto const& leaves() const noexcept
+    {
+        return leaves_;
+    }
+
+private:
+    void finishBlock();
+
+    std::unique_ptr<tr_sha256> sha_;
+    std::vector<hash_t> leaves_;
+    uint32_t n_block_bytes_ = 0;
+};
+
+} // namespace tr_merkle
@@ -5,10 +5,17 @@
 
 #include <algorithm>
 #include <array>
+#include <cstddef> // size_t
 #include <cstdint> // uint8_t, uint64_t
 #include <string_view>
 #include <utility>
 
+#ifndef _WIN32
+#include <sys/resource.h> // getrlimit()
+#endif
+
+#include <event2/buffer.h>
+
 #include <fmt/core.h>
 
 #include "transmission.h"
@@ -122,6 +129,7 @@ std::optional<tr_sys_file_t> tr_open_files::get(tr_torrent_id_t tor_id, tr_file_
             return {};
         }
 
+        ++n_hits_;
         return found->fd_;
     }
 
@@ -142,12 +150,15 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     {
         if (!writable || found->writable_)
         {
+            ++n_hits_;
             return found->fd_;
         }
 
         pool_.erase(key); // close so we can re-open as writable
     }
 
+    ++n_misses_;
+
     // create subfolders, if any
     auto const filename = tr_pathbuf{ filename_in };
     tr_error* error = nullptr;
@@ -247,6 +258,73 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     return fd;
 }
 
+size_t tr_open_files::autoMaxOpenFiles(size_t peer_limit) noexcept
+{
+#ifdef _WIN32
+    // Windows handles aren't limited the way POSIX descriptors are
+    (void)peer_limit;
+    return size_t{ 512U };
+#else
+    static auto constexpr MinOpenFiles = DefaultMaxOpenFiles;
+    static auto constexpr MaxOpenFiles = size_t{ 4096U };
+
+    // descriptors to leave for listening sockets, the DHT, RPC, logs, etc.
+    static auto constexpr Reserved = size_t{ 128U };
+
+    auto rlim = rlimit{};
+    if (getrlimit(RLIMIT_NOFILE, &rlim) != 0 || rlim.rlim_cur == RLIM_INFINITY)
+    {
+        return MaxOpenFiles;
+    }
+
+    auto const soft_limit = static_cast<size_t>(rlim.rlim_cur);
+    auto const used = peer_limit + Reserved;
+    return soft_limit > used ? std::clamp((soft_limit - used) / FdsPerOpenFile, MinOpenFiles, MaxOpenFiles) : MinOpenFiles;
+#endif
+}
+
+#ifndef _WIN32
+
+evbuffer_file_segment* tr_open_files::fileSegment(
+    tr_torrent_id_t tor_id,
+    tr_file_index_t file_num,
+    uint64_t file_size,
+    tr_error** error)
+{
+    auto* const found = pool_.get(makeKey(tor_id, file_num));
+    if (found == nullptr)
+    {
+        tr_error_set_from_errno(error, EBADF);
+        return nullptr;
+    }
+
+    if (found->segment_ == nullptr)
+    {
+        auto const dup_fd = tr_sys_file_dup(found->fd_, error);
+        if (dup_fd == TR_BAD_SYS_FILE)
+        {
+            return nullptr;
+        }
+
+        found->segment_ = evbuffer_file_segment_new(dup_fd, 0, static_cast<ev_off_t>(file_size), EVBUF_FS_CLOSE_ON_FREE);
+        if (found->segment_ == nullptr)
+        {
+            tr_sys_file_close(dup_fd);
+            tr_error_set_from_errno(error, EIO);
+            return nullptr;
+        }
+    }
+
+    return found->segment_;
+}
+
+#endif
+
+void tr_open_files::setMaxOpenFiles(size_t max_open_files)
+{
+    pool_.setCapacity(std::max(max_open_files, size_t{ 1U }));
+}
+
 void tr_open_files::closeAll()
 {
     pool_.clear();
@@ -264,6 +342,12 @@ void tr_open_files::closeFile(tr_torrent_id_t tor_id, tr_file_index_t file_num)
 
 tr_open_files::Val::~Val()
 {
+    // buffers that still reference the segment keep its fd open until they drain
+    if (segment_ != nullptr)
+    {
+        evbuffer_file_segment_free(segment_);
+    }
+
     if (isOpen(fd_))
     {
         tr_sys_file_close(fd_);
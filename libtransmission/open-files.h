@@ -11,6 +11,7 @@
 
 #include <cstddef> // for size_t
 #include <cstdint> // for uintX_t
+#include <functional> // for std::hash
 #include <optional>
 #include <string_view>
 #include <utility>
@@ -20,12 +21,48 @@
 #include "file.h" // tr_sys_file_t
 #include "lru-cache.h"
 
+struct evbuffer_file_segment;
 struct tr_session;
 
 // A pool of open files that are cached while reading / writing torrents' data
 class tr_open_files
 {
 public:
+    struct Stats
+    {
+        size_t open = 0;
+        size_t limit = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    static constexpr size_t DefaultMaxOpenFiles = 32;
+
+    explicit tr_open_files(size_t max_open_files = DefaultMaxOpenFiles)
+        : pool_{ max_open_files }
+    {
+    }
+
+    // Each pooled file can hold a second descriptor for fileSegment().
+    static constexpr size_t FdsPerOpenFile = 2;
+
+    // Pick a pool size that leaves enough of the process' file
+    // descriptor limit for `peer_limit` peer sockets and everything else.
+    [[nodiscard]] static size_t autoMaxOpenFiles(size_t peer_limit) noexcept;
+
+    void setMaxOpenFiles(size_t max_open_files);
+
+    [[nodiscard]] constexpr size_t maxOpenFiles() const noexcept
+    {
+        return pool_.capacity();
+    }
+
+    [[nodiscard]] Stats stats() const noexcept
+    {
+        return { pool_.size(), pool_.capacity(), n_hits_, n_misses_, pool_.evictions() };
+    }
+
     [[nodiscard]] std::optional<tr_sys_file_t> get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable);
 
     [[nodiscard]] std::optional<tr_sys_file_t> get(
@@ -36,6 +73,19 @@ public:
         tr_preallocation_mode allocation,
         uint64_t file_size);
 
+#ifndef _WIN32
+    // Get a ref-counted libevent segment covering an already-open file, so that
+    // blocks can be sent from it with sendfile() without each one needing its own
+    // descriptor. The segment owns a dup of the pooled fd, so buffers that still
+    // reference it stay valid after the file is evicted from the pool.
+    // Returns nullptr if the file isn't open or if the segment can't be made.
+    [[nodiscard]] evbuffer_file_segment* fileSegment(
+        tr_torrent_id_t tor_id,
+        tr_file_index_t file_num,
+        uint64_t file_size,
+        tr_error** error = nullptr);
+#endif
+
     void closeAll();
     void closeTorrent(tr_torrent_id_t tor_id);
     void closeFile(tr_torrent_id_t tor_id, tr_file_index_t file_num);
@@ -48,6 +98,14 @@ private:
         return std::make_pair(tor_id, file_num);
     }
 
+    struct KeyHash
+    {
+        [[nodiscard]] size_t operator()(Key const& key) const noexcept
+        {
+            return std::hash<uint64_t>{}((static_cast<uint64_t>(static_cast<uint32_t>(key.first)) << 32U) | key.second);
+        }
+    };
+
     struct Val
     {
         Val() noexcept = default;
@@ -61,14 +119,18 @@ private:
         {
             std::swap(this->fd_, that.fd_);
             std::swap(this->writable_, that.writable_);
+            std::swap(this->segment_, that.segment_);
             return *this;
         }
         ~Val();
 
         tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
         bool writable_ = false;
+        evbuffer_file_segment* segment_ = nullptr;
     };
 
-    static constexpr size_t MaxOpenFiles = 32;
-    tr_lru_cache<Key, Val, MaxOpenFiles> pool_;
+    tr_lru_cache<Key, Val, KeyHash> pool_;
+
+    uint64_t n_hits_ = 0;
+    uint64_t n_misses_ = 0;
 };
@@ -576,22 +576,46 @@ size_t tr_peerIo::get_write_buffer_space(uint64_t now) const noexcept
 
 void tr_peerIo::write(libtransmission::Buffer& buf, bool is_piece_data)
 {
-    auto [bytes, len] = buf.pullup();
-    encrypt(len, bytes);
-    outbuf_info_.emplace_back(std::size(buf), is_piece_data);
-    outbuf_.add(buf);
+    auto const n_bytes = std::size(buf);
+
+    // `buf` may hold references to memory that's shared, e.g. with the
+    // cache, so encrypt its bytes on their way into `outbuf_` instead of
+    // in place. This also avoids a pullup() to make them contiguous.
+    if (is_encrypted())
+    {
+        if (!outbuf_.add_transformed(
+                buf,
+                n_bytes,
+                [this](std::byte const* in, std::byte* out, size_t len) { encrypt(len, in, out); }))
+        {
+            return;
+        }
+    }
+    else
+    {
+        outbuf_.add(buf);
+    }
+
+    outbuf_info_.emplace_back(n_bytes, is_piece_data);
 }
 
 void tr_peerIo::write_bytes(void const* bytes, size_t n_bytes, bool is_piece_data)
 {
-    auto const old_size = std::size(outbuf_);
-
-    outbuf_.reserve(old_size + n_bytes);
-    outbuf_.add(bytes, n_bytes);
+    if (is_encrypted())
+    {
+        auto* const out = outbuf_.reserve_space(n_bytes);
+        if (out == nullptr)
+        {
+            return;
+        }
 
-    for (auto iter = std::begin(outbuf_) + old_size, end = std::end(outbuf_); iter != end; ++iter)
+        encrypt(n_bytes, bytes, out);
+        outbuf_.commit_space(out, n_bytes);
+    }
+    else
     {
-        encrypt(1, &*iter);
+        outbuf_.reserve(std::size(outbuf_) + n_bytes);
+        outbuf_.add(bytes, n_bytes);
     }
 
     outbuf_info_.emplace_back(n_bytes, is_piece_data);
@@ -183,6 +183,19 @@ public:
 
     ///
 
+    // whether the peer understands BitTorrent v2's hash messages
+    [[nodiscard]] constexpr auto supports_v2() const noexcept
+    {
+        return v2_supported_;
+    }
+
+    constexpr void set_supports_v2(bool flag) noexcept
+    {
+        v2_supported_ = flag;
+    }
+
+    ///
+
     [[nodiscard]] constexpr auto const& bandwidth() const noexcept
     {
         return bandwidth_;
@@ -256,6 +269,13 @@ public:
         return filter_.is_active();
     }
 
+    // Whether piece data can be sent with Buffer::add_file_segment() references:
+    // only when the bytes go straight to a TCP socket without being encrypted.
+    [[nodiscard]] constexpr auto supports_file_refs() const noexcept
+    {
+        return socket_.is_tcp() && !is_encrypted();
+    }
+
     void decrypt_init(bool is_incoming, DH const& dh, tr_sha1_digest_t const& info_hash)
     {
         filter_.decryptInit(is_incoming, dh, info_hash);
@@ -298,6 +318,11 @@ private:
         filter_.encrypt(buflen, buf);
     }
 
+    void encrypt(size_t buflen, void const* in, void* out)
+    {
+        filter_.encrypt(buflen, in, out);
+    }
+
     void on_utp_state_change(int new_state);
     void on_utp_error(int errcode);
 
@@ -358,4 +383,5 @@ private:
     bool dht_supported_ = false;
     bool extended_protocol_supported_ = false;
     bool fast_extension_supported_ = false;
+    bool v2_supported_ = false;
 };
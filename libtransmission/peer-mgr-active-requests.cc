@@ -3,12 +3,11 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
 #include <memory>
 #include <utility>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
@@ -19,86 +18,328 @@
 namespace
 {
 
-struct peer_at
+using request_index_t = uint32_t;
+auto constexpr NoRequest = ~request_index_t{};
+
+// The head of a linked list of requests, and its length.
+struct RequestList
+{
+    request_index_t head = NoRequest;
+    uint32_t count = 0;
+};
+
+/**
+ * A map from block indices or peers to their list of requests.
+ *
+ * It uses open addressing with linear probing in a single array and
+ * backward-shift deletion, so lookups touch one or two cache lines and
+ * nothing is allocated once the table is big enough.
+ */
+template<typename Key>
+class FlatListMap
 {
-    tr_peer* peer;
-    time_t when;
+public:
+    [[nodiscard]] RequestList const* find(Key key) const noexcept
+    {
+        if (std::empty(slots_))
+        {
+            return nullptr;
+        }
+
+        for (auto pos = home(key);; pos = next(pos))
+        {
+            auto const& slot = slots_[pos];
+
+            if (!slot.used)
+            {
+                return nullptr;
+            }
+
+            if (slot.key == key)
+            {
+                return &slot.list;
+            }
+        }
+    }
+
+    [[nodiscard]] RequestList* find(Key key) noexcept
+    {
+        return const_cast<RequestList*>(std::as_const(*this).find(key));
+    }
 
-    peer_at(tr_peer* p, time_t w)
-        : peer{ p }
-        , when{ w }
+    // @return the list for `key`, creating an empty one if needed
+    [[nodiscard]] RequestList& get(Key key)
     {
+        if ((size_ + 1U) * 2U > std::size(slots_))
+        {
+            grow();
+        }
+
+        auto pos = home(key);
+        for (; slots_[pos].used; pos = next(pos))
+        {
+            if (slots_[pos].key == key)
+            {
+                return slots_[pos].list;
+            }
+        }
+
+        ++size_;
+        auto& slot = slots_[pos];
+        slot.key = key;
+        slot.list = {};
+        slot.used = true;
+        return slot.list;
     }
 
-    [[nodiscard]] int compare(peer_at const& that) const // <=>
+    void erase(Key key) noexcept
     {
-        if (peer != that.peer)
+        if (std::empty(slots_))
+        {
+            return;
+        }
+
+        auto hole = home(key);
+        for (;; hole = next(hole))
+        {
+            if (!slots_[hole].used)
+            {
+                return;
+            }
+
+            if (slots_[hole].key == key)
+            {
+                break;
+            }
+        }
+
+        // shift later entries of the probe sequence back into the hole
+        // so that lookups never need to skip over tombstones
+        for (auto pos = next(hole); slots_[pos].used; pos = next(pos))
         {
-            return peer < that.peer ? -1 : 1;
+            auto const want = home(slots_[pos].key);
+            if (((pos - want) & mask()) >= ((pos - hole) & mask()))
+            {
+                slots_[hole] = slots_[pos];
+                hole = pos;
+            }
         }
 
-        return 0;
+        slots_[hole].used = false;
+        --size_;
     }
 
-    bool operator==(peer_at const& that) const
+private:
+    struct Slot
+    {
+        Key key = {};
+        RequestList list = {};
+        bool used = false;
+    };
+
+    [[nodiscard]] size_t mask() const noexcept
     {
-        return compare(that) == 0;
+        return std::size(slots_) - 1U;
     }
-};
 
-struct PeerAtHash
-{
-    std::size_t operator()(peer_at const& pa) const noexcept
+    [[nodiscard]] size_t next(size_t pos) const noexcept
     {
-        return std::hash<tr_peer*>{}(pa.peer);
+        return (pos + 1U) & mask();
+    }
+
+    [[nodiscard]] size_t home(Key key) const noexcept
+    {
+        // Fibonacci hashing: block indices are sequential and
+        // pointers are aligned, so spread them out before masking
+        auto const bits = static_cast<uint64_t>(toInteger(key));
+        return static_cast<size_t>((bits * UINT64_C(0x9E3779B97F4A7C15)) >> 32U) & mask();
+    }
+
+    [[nodiscard]] static uint64_t toInteger(tr_block_index_t block) noexcept
+    {
+        return block;
+    }
+
+    [[nodiscard]] static uint64_t toInteger(tr_peer const* peer) noexcept
+    {
+        return reinterpret_cast<uintptr_t>(peer);
+    }
+
+    void grow()
+    {
+        auto old_slots = std::vector<Slot>(std::empty(slots_) ? 16U : std::size(slots_) * 2U);
+        std::swap(slots_, old_slots);
+        size_ = 0;
+
+        for (auto const& slot : old_slots)
+        {
+            if (slot.used)
+            {
+                get(slot.key) = slot.list;
+            }
+        }
     }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
 };
 
 } // namespace
 
+/**
+ * Each request is a node in two doubly-linked lists: the requests for
+ * its block and the requests to its peer. The nodes live in one array
+ * and are recycled through a free list, so adding and removing requests
+ * doesn't allocate, and removing a peer only visits that peer's requests.
+ */
 class ActiveRequests::Impl
 {
 public:
-    size_t size() const
+    struct Request
+    {
+        tr_block_index_t block = {};
+        tr_peer* peer = nullptr;
+        time_t when = {};
+        request_index_t block_prev = NoRequest;
+        request_index_t block_next = NoRequest;
+        request_index_t peer_prev = NoRequest;
+        request_index_t peer_next = NoRequest;
+        bool used = false;
+    };
+
+    [[nodiscard]] request_index_t find(tr_block_index_t block, tr_peer const* peer) const noexcept
+    {
+        if (auto const* const list = blocks_.find(block); list != nullptr)
+        {
+            for (auto idx = list->head; idx != NoRequest; idx = requests_[idx].block_next)
+            {
+                if (requests_[idx].peer == peer)
+                {
+                    return idx;
+                }
+            }
+        }
+
+        return NoRequest;
+    }
+
+    void add(tr_block_index_t block, tr_peer* peer, time_t when)
     {
-        return size_;
+        auto idx = NoRequest;
+        if (std::empty(free_))
+        {
+            idx = static_cast<request_index_t>(std::size(requests_));
+            requests_.emplace_back();
+        }
+        else
+        {
+            idx = free_.back();
+            free_.pop_back();
+        }
+
+        auto& req = requests_[idx];
+        req.block = block;
+        req.peer = peer;
+        req.when = when;
+        req.used = true;
+
+        auto& block_list = blocks_.get(block);
+        req.block_prev = NoRequest;
+        req.block_next = block_list.head;
+        if (block_list.head != NoRequest)
+        {
+            requests_[block_list.head].block_prev = idx;
+        }
+        block_list.head = idx;
+        ++block_list.count;
+
+        auto& peer_list = peers_.get(peer);
+        req.peer_prev = NoRequest;
+        req.peer_next = peer_list.head;
+        if (peer_list.head != NoRequest)
+        {
+            requests_[peer_list.head].peer_prev = idx;
+        }
+        peer_list.head = idx;
+        ++peer_list.count;
+
+        ++size_;
     }
 
-    size_t count(tr_peer const* peer) const
+    void erase(request_index_t idx)
     {
-        auto const it = count_.find(peer);
-        return it != std::end(count_) ? it->second : size_t{};
+        auto& req = requests_[idx];
+        TR_ASSERT(req.used);
+
+        unlinkFromBlock(req);
+        unlinkFromPeer(req);
+
+        req.used = false;
+        free_.push_back(idx);
+        --size_;
     }
 
-    void incCount(tr_peer const* peer)
+    [[nodiscard]] static size_t countOf(RequestList const* list) noexcept
     {
-        ++count_[peer];
-        ++size_;
+        return list != nullptr ? list->count : 0U;
     }
 
-    void decCount(tr_peer const* peer)
+    FlatListMap<tr_block_index_t> blocks_;
+    FlatListMap<tr_peer const*> peers_;
+    std::vector<Request> requests_;
+    std::vector<request_index_t> free_;
+    size_t size_ = 0;
+
+private:
+    void unlinkFromBlock(Request const& req)
     {
-        auto it = count_.find(peer);
-        TR_ASSERT(it != std::end(count_));
-        TR_ASSERT(it->second > 0);
-        TR_ASSERT(size_ > 0);
+        auto* const list = blocks_.find(req.block);
+        TR_ASSERT(list != nullptr);
 
-        if (it != std::end(count_))
+        if (req.block_prev != NoRequest)
         {
-            if (--it->second == 0)
-            {
-                count_.erase(it);
-            }
-            --size_;
+            requests_[req.block_prev].block_next = req.block_next;
+        }
+        else
+        {
+            list->head = req.block_next;
+        }
+
+        if (req.block_next != NoRequest)
+        {
+            requests_[req.block_next].block_prev = req.block_prev;
+        }
+
+        if (--list->count == 0U)
+        {
+            blocks_.erase(req.block);
         }
     }
 
-    std::unordered_map<tr_peer const*, size_t> count_;
+    void unlinkFromPeer(Request const& req)
+    {
+        auto* const list = peers_.find(req.peer);
+        TR_ASSERT(list != nullptr);
 
-    std::unordered_map<tr_block_index_t, std::unordered_set<peer_at, PeerAtHash>> blocks_;
+        if (req.peer_prev != NoRequest)
+        {
+            requests_[req.peer_prev].peer_next = req.peer_next;
+        }
+        else
+        {
+            list->head = req.peer_next;
+        }
 
-private:
-    size_t size_ = 0;
+        if (req.peer_next != NoRequest)
+        {
+            requests_[req.peer_next].peer_prev = req.peer_prev;
+        }
+
+        if (--list->count == 0U)
+        {
+            peers_.erase(req.peer);
+        }
+    }
 };
 
 ActiveRequests::ActiveRequests()
@@ -110,54 +351,46 @@ ActiveRequests::~ActiveRequests() = default;
 
 bool ActiveRequests::add(tr_block_index_t block, tr_peer* peer, time_t when)
 {
-    bool const added = impl_->blocks_[block].emplace(peer, when).second;
-
-    if (added)
+    if (impl_->find(block, peer) != NoRequest)
     {
-        impl_->incCount(peer);
+        return false;
     }
 
-    return added;
+    impl_->add(block, peer, when);
+    return true;
 }
 
 // remove a request to `peer` for `block`
 bool ActiveRequests::remove(tr_block_index_t block, tr_peer const* peer)
 {
-    auto const it = impl_->blocks_.find(block);
-    auto const key = peer_at{ const_cast<tr_peer*>(peer), 0 };
-    auto const removed = it != std::end(impl_->blocks_) && it->second.erase(key) != 0;
-
-    if (removed)
+    auto const idx = impl_->find(block, peer);
+    if (idx == NoRequest)
     {
-        impl_->decCount(peer);
-
-        if (std::empty(it->second))
-        {
-            impl_->blocks_.erase(it);
-        }
+        return false;
     }
 
-    return removed;
+    impl_->erase(idx);
+    return true;
 }
 
 // remove requests to `peer` and return the associated blocks
 std::vector<tr_block_index_t> ActiveRequests::remove(tr_peer const* peer)
 {
     auto removed = std::vector<tr_block_index_t>{};
-    removed.reserve(impl_->blocks_.size());
 
-    auto const key = peer_at{ const_cast<tr_peer*>(peer), 0 };
-    for (auto const& [block, peers_at] : impl_->blocks_)
+    auto const* const list = impl_->peers_.find(peer);
+    if (list == nullptr)
     {
-        if (peers_at.count(key) != 0U)
-        {
-            removed.push_back(block);
-        }
+        return removed;
     }
 
-    for (auto block : removed)
+    removed.reserve(list->count);
+    for (auto idx = list->head; idx != NoRequest;)
     {
-        remove(block, peer);
+        auto const next = impl_->requests_[idx].peer_next;
+        removed.push_back(impl_->requests_[idx].block);
+        impl_->erase(idx); // NB: may erase `list` too
+        idx = next;
     }
 
     return removed;
@@ -168,21 +401,19 @@ std::vector<tr_peer*> ActiveRequests::remove(tr_block_index_t block)
 {
     auto removed = std::vector<tr_peer*>{};
 
-    if (auto it = impl_->blocks_.find(block); it != std::end(impl_->blocks_))
+    auto const* const list = impl_->blocks_.find(block);
+    if (list == nullptr)
     {
-        auto const n = std::size(it->second);
-        removed.resize(n);
-        std::transform(
-            std::begin(it->second),
-            std::end(it->second),
-            std::begin(removed),
-            [](auto const& sent) { return sent.peer; });
-        impl_->blocks_.erase(block);
+        return removed;
     }
 
-    for (auto const* const peer : removed)
+    removed.reserve(list->count);
+    for (auto idx = list->head; idx != NoRequest;)
     {
-        impl_->decCount(peer);
+        auto const next = impl_->requests_[idx].block_next;
+        removed.push_back(impl_->requests_[idx].peer);
+        impl_->erase(idx); // NB: may erase `list` too
+        idx = next;
     }
 
     return removed;
@@ -191,42 +422,38 @@ std::vector<tr_peer*> ActiveRequests::remove(tr_block_index_t block)
 // return true if there's an active request to `peer` for `block`
 bool ActiveRequests::has(tr_block_index_t block, tr_peer const* peer) const
 {
-    auto const it = impl_->blocks_.find(block);
-    return it != std::end(impl_->blocks_) && (it->second.count(peer_at{ const_cast<tr_peer*>(peer), 0 }) != 0U);
+    return impl_->find(block, peer) != NoRequest;
 }
 
 // count how many peers we're asking for `block`
 size_t ActiveRequests::count(tr_block_index_t block) const
 {
-    return std::size(impl_->blocks_[block]);
+    return Impl::countOf(std::as_const(impl_->blocks_).find(block));
 }
 
 // count how many active block requests we have to `peer`
 size_t ActiveRequests::count(tr_peer const* peer) const
 {
-    return impl_->count(peer);
+    return Impl::countOf(std::as_const(impl_->peers_).find(peer));
 }
 
 // return the total number of active requests
 size_t ActiveRequests::size() const
 {
-    return impl_->size();
+    return impl_->size_;
 }
 
 // returns the active requests sent before `when`
 std::vector<std::pair<tr_block_index_t, tr_peer*>> ActiveRequests::sentBefore(time_t when) const
 {
     auto sent_before = std::vector<std::pair<tr_block_index_t, tr_peer*>>{};
-    sent_before.reserve(std::size(impl_->blocks_));
+    sent_before.reserve(impl_->size_);
 
-    for (auto const& [block, peers_at] : impl_->blocks_)
+    for (auto const& req : impl_->requests_)
     {
-        for (auto const& sent : peers_at)
+        if (req.used && req.when < when)
         {
-            if (sent.when < when)
-            {
-                sent_before.emplace_back(block, sent.peer);
-            }
+            sent_before.emplace_back(req.block, req.peer);
         }
     }
 
@@ -0,0 +1,123 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstdint> // uint32_t, uint64_t
+#include <ctime> // time_t
+#include <functional> // std::greater
+#include <queue>
+#include <vector>
+
+#include "tr-assert.h"
+
+/**
+ * A swarm's atoms that we might want to make outgoing connections to.
+ *
+ * Atoms wait in a timer heap until their reconnect interval has passed,
+ * then move to a heap that keeps them best-first, so the reconnect pulse
+ * only looks at the atoms it's about to connect to. Entries aren't updated
+ * in place: queueing an atom again makes its older entries stale, and
+ * stale entries are skipped when they reach the top.
+ *
+ * `Atom` needs a `uint32_t candidate_ticket` that only this queue changes.
+ */
+template<typename Atom>
+class CandidateQueue
+{
+public:
+    void schedule(Atom& atom, time_t due)
+    {
+        waiting_.push({ static_cast<uint64_t>(due), ++atom.candidate_ticket, &atom });
+    }
+
+    // move the atoms that are due by `now` to the ready heap.
+    // `score` returns an atom's rank; smaller is better.
+    template<typename ScoreFunc>
+    void promote(time_t now, ScoreFunc const& score)
+    {
+        while (!std::empty(waiting_) && waiting_.top().key <= static_cast<uint64_t>(now))
+        {
+            auto const entry = waiting_.top();
+            waiting_.pop();
+
+            if (!entry.isStale())
+            {
+                ready_.push({ score(*entry.atom), entry.ticket, entry.atom });
+            }
+        }
+    }
+
+    // @return the best ready atom, or nullptr if none are ready.
+    // An atom's score can change while it waits in the ready heap,
+    // so the top atom is rescored and put back if its score changed.
+    // `score` must not be salted, or the same atom could keep moving.
+    template<typename ScoreFunc>
+    [[nodiscard]] Atom* top(ScoreFunc const& score)
+    {
+        while (!std::empty(ready_))
+        {
+            auto entry = ready_.top();
+            if (entry.isStale())
+            {
+                ready_.pop();
+                continue;
+            }
+
+            if (auto const key = score(*entry.atom); key != entry.key)
+            {
+                ready_.pop();
+                entry.key = key;
+                ready_.push(entry);
+                continue;
+            }
+
+            return entry.atom;
+        }
+
+        return nullptr;
+    }
+
+    // remove the atom returned by top()
+    void pop()
+    {
+        TR_ASSERT(!std::empty(ready_));
+        ready_.pop();
+    }
+
+    void clear()
+    {
+        waiting_ = {};
+        ready_ = {};
+    }
+
+private:
+    struct Entry
+    {
+        [[nodiscard]] bool isStale() const noexcept
+        {
+            return ticket != atom->candidate_ticket;
+        }
+
+        // smaller is sooner: a due time in `waiting_`, or a score in `ready_`
+        [[nodiscard]] bool operator>(Entry const& that) const noexcept
+        {
+            return key > that.key;
+        }
+
+        uint64_t key;
+        uint32_t ticket;
+        Atom* atom;
+    };
+
+    using MinHeap = std::priority_queue<Entry, std::vector<Entry>, std::greater<>>;
+
+    MinHeap waiting_;
+    MinHeap ready_;
+};
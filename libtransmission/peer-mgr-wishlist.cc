@@ -5,8 +5,9 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <set>
-#include <utility>
 #include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
@@ -20,129 +21,159 @@
 namespace
 {
 
-struct Candidate
+std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
 {
-    tr_piece_index_t piece;
-    size_t n_blocks_missing;
-    tr_priority_t priority;
-    uint8_t salt;
-
-    Candidate(tr_piece_index_t piece_in, size_t missing_in, tr_priority_t priority_in, uint8_t salt_in)
-        : piece{ piece_in }
-        , n_blocks_missing{ missing_in }
-        , priority{ priority_in }
-        , salt{ salt_in }
+    if (n_blocks == 0)
     {
+        return {};
     }
 
-    [[nodiscard]] int compare(Candidate const& that) const // <=>
+    auto spans = std::vector<tr_block_span_t>{};
+    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
+    for (size_t i = 1; i < n_blocks; ++i)
     {
-        // prefer pieces closer to completion
-        if (n_blocks_missing != that.n_blocks_missing)
+        if (cur.end == sorted_blocks[i])
         {
-            return n_blocks_missing < that.n_blocks_missing ? -1 : 1;
+            ++cur.end;
         }
-
-        // prefer higher priority
-        if (priority != that.priority)
+        else
         {
-            return priority > that.priority ? -1 : 1;
+            spans.push_back(cur);
+            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
         }
+    }
+    spans.push_back(cur);
 
-        if (salt != that.salt)
-        {
-            return salt < that.salt ? -1 : 1;
-        }
+    return spans;
+}
+
+} // namespace
 
-        return 0;
+int Wishlist::Candidate::compare(Candidate const& that) const noexcept
+{
+    // prefer pieces closer to completion
+    if (n_blocks_missing != that.n_blocks_missing)
+    {
+        return n_blocks_missing < that.n_blocks_missing ? -1 : 1;
     }
 
-    bool operator<(Candidate const& that) const // less than
+    // prefer higher priority
+    if (priority != that.priority)
     {
-        return compare(that) < 0;
+        return priority > that.priority ? -1 : 1;
     }
-};
 
-std::vector<Candidate> getCandidates(Wishlist::Mediator const& mediator)
-{
-    // count up the pieces that we still want
-    auto wanted_pieces = std::vector<std::pair<tr_piece_index_t, size_t>>{};
-    auto const n_pieces = mediator.countAllPieces();
-    wanted_pieces.reserve(n_pieces);
-    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    // prefer rarer pieces
+    if (replication != that.replication)
     {
-        if (!mediator.clientCanRequestPiece(i))
-        {
-            continue;
-        }
+        return replication < that.replication ? -1 : 1;
+    }
 
-        size_t const n_missing = mediator.countMissingBlocks(i);
-        if (n_missing == 0)
-        {
-            continue;
-        }
+    if (salt != that.salt)
+    {
+        return salt < that.salt ? -1 : 1;
+    }
+
+    if (piece != that.piece)
+    {
+        return piece < that.piece ? -1 : 1;
+    }
 
-        wanted_pieces.emplace_back(i, n_missing);
+    return 0;
+}
+
+void Wishlist::pieceChanged(tr_piece_index_t piece)
+{
+    if (needs_rebuild_)
+    {
+        return;
     }
 
-    // transform them into candidates
-    auto salter = tr_salt_shaker{};
-    auto const n = std::size(wanted_pieces);
-    auto candidates = std::vector<Candidate>{};
-    candidates.reserve(n);
-    for (size_t i = 0; i < n; ++i)
+    // if most of the pieces changed, it's cheaper to start over
+    if (piece >= std::size(piece_candidates_) || std::size(dirty_pieces_) >= std::size(piece_candidates_) / 2U)
     {
-        auto const [piece, n_missing] = wanted_pieces[i];
-        candidates.emplace_back(piece, n_missing, mediator.priority(piece), salter());
+        invalidate();
+        return;
     }
 
-    return candidates;
+    dirty_pieces_.push_back(piece);
 }
 
-std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
+void Wishlist::updateCandidate(tr_piece_index_t piece, uint8_t salt)
 {
-    if (n_blocks == 0)
+    auto& iter = piece_candidates_[piece];
+
+    if (iter != std::end(candidates_))
     {
-        return {};
+        candidates_.erase(iter);
+        iter = std::end(candidates_);
     }
 
-    auto spans = std::vector<tr_block_span_t>{};
-    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
-    for (size_t i = 1; i < n_blocks; ++i)
+    if (!mediator_.clientWantsPiece(piece))
     {
-        if (cur.end == sorted_blocks[i])
-        {
-            ++cur.end;
-        }
-        else
-        {
-            spans.push_back(cur);
-            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
-        }
+        return;
     }
-    spans.push_back(cur);
 
-    return spans;
+    if (auto const n_missing = mediator_.countMissingBlocks(piece); n_missing != 0U)
+    {
+        iter = candidates_
+                   .emplace(piece, n_missing, mediator_.priority(piece), mediator_.countPieceReplication(piece), salt)
+                   .first;
+    }
 }
 
-} // namespace
+void Wishlist::rebuild()
+{
+    auto const n_pieces = mediator_.countAllPieces();
+
+    candidates_.clear();
+    piece_candidates_.assign(n_pieces, std::end(candidates_));
+    dirty_pieces_.clear();
+    needs_rebuild_ = false;
+
+    for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+    {
+        updateCandidate(piece, salter_());
+    }
+}
+
+void Wishlist::refresh()
+{
+    if (needs_rebuild_ || mediator_.countAllPieces() != std::size(piece_candidates_))
+    {
+        rebuild();
+        return;
+    }
 
-std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
+    // a popular piece can be announced by many peers at once
+    std::sort(std::begin(dirty_pieces_), std::end(dirty_pieces_));
+    dirty_pieces_.erase(std::unique(std::begin(dirty_pieces_), std::end(dirty_pieces_)), std::end(dirty_pieces_));
+
+    for (auto const piece : dirty_pieces_)
+    {
+        // keep the piece's salt so that it doesn't jump around among its peers
+        auto const& iter = piece_candidates_[piece];
+        updateCandidate(piece, iter != std::end(candidates_) ? iter->salt : salter_());
+    }
+
+    dirty_pieces_.clear();
+}
+
+std::vector<tr_block_span_t> Wishlist::next(
+    size_t n_wanted_blocks,
+    std::function<bool(tr_piece_index_t)> const& peer_has_piece,
+    std::function<bool(tr_block_index_t)> const& has_active_request_to_peer)
 {
     if (n_wanted_blocks == 0)
     {
         return {};
     }
 
-    // We usually won't need all the candidates until endgame, so don't
-    // waste cycles sorting all of them here. partial sort is enough.
-    auto candidates = getCandidates(mediator_);
-    auto constexpr MaxSortedPieces = size_t{ 30 };
-    auto const middle = std::min(std::size(candidates), MaxSortedPieces);
-    std::partial_sort(std::begin(candidates), std::begin(candidates) + middle, std::end(candidates));
+    refresh();
 
+    auto const max_peers = mediator_.isEndgame() ? size_t{ 2U } : size_t{ 1U };
     auto blocks = std::set<tr_block_index_t>{};
-    for (auto const& candidate : candidates)
+    for (auto const& candidate : candidates_)
     {
         // do we have enough?
         if (std::size(blocks) >= n_wanted_blocks)
@@ -150,19 +181,23 @@ std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
             break;
         }
 
+        if (!peer_has_piece(candidate.piece))
+        {
+            continue;
+        }
+
         // walk the blocks in this piece
         auto const [begin, end] = mediator_.blockSpan(candidate.piece);
         for (tr_block_index_t block = begin; block < end && std::size(blocks) < n_wanted_blocks; ++block)
         {
             // don't request blocks we've already got
-            if (!mediator_.clientCanRequestBlock(block))
+            if (mediator_.clientHasBlock(block) || has_active_request_to_peer(block))
             {
                 continue;
             }
 
             // don't request from too many peers
-            size_t const n_peers = mediator_.countActiveRequests(block);
-            if (size_t const max_peers = mediator_.isEndgame() ? 2 : 1; n_peers >= max_peers)
+            if (mediator_.countActiveRequests(block) >= max_peers)
             {
                 continue;
             }
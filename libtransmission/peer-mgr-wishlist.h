@@ -10,39 +10,111 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <functional>
+#include <set>
 #include <vector>
 
 #include "transmission.h"
 
+#include "crypto-utils.h" // for tr_salt_shaker
 #include "torrent.h"
 
 /**
  * Figures out what blocks we want to request next.
+ *
+ * The pieces that we want are kept sorted across calls to next().
+ * Tell the wishlist when a piece changes with pieceChanged(), or
+ * when many do with invalidate(), and it will catch up lazily.
  */
 class Wishlist
 {
 public:
     struct Mediator
     {
-        [[nodiscard]] virtual bool clientCanRequestBlock(tr_block_index_t block) const = 0;
-        [[nodiscard]] virtual bool clientCanRequestPiece(tr_piece_index_t piece) const = 0;
+        [[nodiscard]] virtual bool clientHasBlock(tr_block_index_t block) const = 0;
+        [[nodiscard]] virtual bool clientWantsPiece(tr_piece_index_t piece) const = 0;
         [[nodiscard]] virtual bool isEndgame() const = 0;
         [[nodiscard]] virtual size_t countActiveRequests(tr_block_index_t block) const = 0;
         [[nodiscard]] virtual size_t countMissingBlocks(tr_piece_index_t piece) const = 0;
         [[nodiscard]] virtual tr_block_span_t blockSpan(tr_piece_index_t) const = 0;
         [[nodiscard]] virtual tr_piece_index_t countAllPieces() const = 0;
         [[nodiscard]] virtual tr_priority_t priority(tr_piece_index_t) const = 0;
+
+        // how many peers have the piece, not counting seeds
+        [[nodiscard]] virtual size_t countPieceReplication(tr_piece_index_t) const = 0;
+
         virtual ~Mediator() = default;
     };
 
-    constexpr explicit Wishlist(Mediator const& mediator)
+    explicit Wishlist(Mediator const& mediator)
         : mediator_{ mediator }
     {
     }
 
     // the next blocks that we should request from a peer
-    [[nodiscard]] std::vector<tr_block_span_t> next(size_t n_wanted_blocks);
+    [[nodiscard]] std::vector<tr_block_span_t> next(
+        size_t n_wanted_blocks,
+        std::function<bool(tr_piece_index_t)> const& peer_has_piece,
+        std::function<bool(tr_block_index_t)> const& has_active_request_to_peer);
+
+    // a piece's blocks, priority, or wantedness changed
+    void pieceChanged(tr_piece_index_t piece);
+
+    // too much changed to track piece-by-piece, e.g. file priorities
+    void invalidate() noexcept
+    {
+        needs_rebuild_ = true;
+        dirty_pieces_.clear();
+    }
 
 private:
+    struct Candidate
+    {
+        Candidate(
+            tr_piece_index_t piece_in,
+            size_t missing_in,
+            tr_priority_t priority_in,
+            size_t replication_in,
+            uint8_t salt_in)
+            : piece{ piece_in }
+            , n_blocks_missing{ missing_in }
+            , replication{ replication_in }
+            , priority{ priority_in }
+            , salt{ salt_in }
+        {
+        }
+
+        [[nodiscard]] int compare(Candidate const& that) const noexcept; // <=>
+
+        bool operator<(Candidate const& that) const noexcept // less than
+        {
+            return compare(that) < 0;
+        }
+
+        tr_piece_index_t piece;
+        size_t n_blocks_missing;
+        size_t replication;
+        tr_priority_t priority;
+        uint8_t salt;
+    };
+
+    using Candidates = std::set<Candidate>;
+
+    void refresh();
+    void rebuild();
+    void updateCandidate(tr_piece_index_t piece, uint8_t salt);
+
     Mediator const& mediator_;
+
+    // the pieces we want, best first
+    Candidates candidates_;
+
+    // each piece's entry in `candidates_`, or `std::end(candidates_)`
+    std::vector<Candidates::iterator> piece_candidates_;
+
+    std::vector<tr_piece_index_t> dirty_pieces_;
+    bool needs_rebuild_ = true;
+
+    tr_salt_shaker<uint8_t> salter_;
 };
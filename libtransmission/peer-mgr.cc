@@ -14,6 +14,7 @@
 #include <deque>
 #include <map>
 #include <iterator> // std::back_inserter
+#include <limits>
 #include <memory>
 #include <optional>
 #include <tuple> // std::tie
@@ -37,6 +38,7 @@
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr-active-requests.h"
+#include "peer-mgr-candidates.h"
 #include "peer-mgr-wishlist.h"
 #include "peer-mgr.h"
 #include "peer-msgs.h"
@@ -78,6 +80,7 @@ private:
         info.client_peer_id = tor->peer_id();
         info.id = tor->id();
         info.is_done = tor->isDone();
+        info.is_v2 = tor->hasV2Metadata();
         return info;
     }
 
@@ -129,8 +132,19 @@ public:
         return len;
     }
 
+    [[nodiscard]] tr_message_stream_encryption::DHPool* dh_pool() override
+    {
+        return &dh_pool_;
+    }
+
+    [[nodiscard]] auto dh_pool_stats() const
+    {
+        return dh_pool_.stats();
+    }
+
 private:
     tr_session& session_;
+    tr_message_stream_encryption::DHPool dh_pool_;
 };
 
 /**
@@ -288,6 +302,10 @@ struct peer_atom
     uint8_t flags = {}; /* these match the added_f flags */
     uint8_t flags2 = {}; /* flags that aren't defined in added_f */
 
+    // bumped each time the atom is queued in a CandidateQueue,
+    // so that its older entries in the queue can be told apart
+    uint32_t candidate_ticket = {};
+
     bool utp_failed = false; /* We recently failed to connect over µTP */
     bool is_connected = false;
 
@@ -319,6 +337,7 @@ public:
         , tor{ tor_in }
     {
         rebuildWebseeds();
+        rebuildReplication();
     }
 
     tr_swarm(tr_swarm&&) = delete;
@@ -397,12 +416,16 @@ public:
             peers.erase(iter);
         }
 
+        removeReplication(peer);
+
         --stats.peer_count;
         --stats.peer_from_count[atom->fromFirst];
 
         TR_ASSERT(stats.peer_count == peerCount());
 
         delete peer;
+
+        scheduleCandidate(*atom);
     }
 
     void removeAllPeers()
@@ -507,6 +530,7 @@ public:
         if (atom == nullptr)
         {
             atom = &pool.emplace_back(addr, port, flags, from);
+            scheduleCandidate(*atom);
         }
         else
         {
@@ -519,6 +543,29 @@ public:
         return atom;
     }
 
+    // consider `atom` for an outgoing connection once its reconnect interval has passed
+    void scheduleCandidate(peer_atom& atom)
+    {
+        candidates.schedule(atom, atom.time + atom.getReconnectIntervalSecs(tr_time()));
+    }
+
+    // Requeue every atom that isn't in use. This picks up changes that
+    // didn't requeue the atoms they affect, e.g. blocklist updates.
+    void rebuildCandidates(time_t now)
+    {
+        candidates.clear();
+
+        for (auto& atom : pool)
+        {
+            if (!peer_is_in_use(atom))
+            {
+                scheduleCandidate(atom);
+            }
+        }
+
+        candidates_rebuild_at = now + CandidatesRebuildIntervalSecs;
+    }
+
     void mark_atom_as_seed(peer_atom& atom)
     {
         tr_logAddTraceSwarm(this, fmt::format("marking peer {} as a seed", atom.display_name()));
@@ -526,6 +573,162 @@ public:
         markAllSeedsFlagDirty();
     }
 
+    // the swarm-wide half of what the wishlist needs to know;
+    // the per-peer half is passed to Wishlist::next()
+    class WishlistMediator final : public Wishlist::Mediator
+    {
+    public:
+        explicit WishlistMediator(tr_swarm const& swarm)
+            : swarm_{ swarm }
+        {
+        }
+
+        [[nodiscard]] bool clientHasBlock(tr_block_index_t block) const override
+        {
+            return swarm_.tor->hasBlock(block);
+        }
+
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->pieceIsWanted(piece);
+        }
+
+        [[nodiscard]] bool isEndgame() const override
+        {
+            return swarm_.isEndgame();
+        }
+
+        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
+        {
+            return swarm_.active_requests.count(block);
+        }
+
+        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->countMissingBlocksInPiece(piece);
+        }
+
+        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->blockSpanForPiece(piece);
+        }
+
+        [[nodiscard]] tr_piece_index_t countAllPieces() const override
+        {
+            return swarm_.tor->hasMetainfo() ? swarm_.tor->pieceCount() : 0U;
+        }
+
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->piecePriority(piece);
+        }
+
+        [[nodiscard]] size_t countPieceReplication(tr_piece_index_t piece) const override
+        {
+            return swarm_.piece_replication[piece];
+        }
+
+    private:
+        tr_swarm const& swarm_;
+    };
+
+    // @return how many connected peers have `piece`
+    [[nodiscard]] size_t countPieceReplication(tr_piece_index_t piece) const
+    {
+        auto const n_seeds = std::size(replication_seeds);
+        return piece < std::size(piece_replication) ? n_seeds + piece_replication[piece] : n_seeds;
+    }
+
+    void rebuildReplication()
+    {
+        piece_replication.assign(tor->hasMetainfo() ? tor->pieceCount() : 0U, 0U);
+        replication_seeds.clear();
+
+        for (auto const* const peer : peers)
+        {
+            addReplication(peer, peer->has());
+        }
+
+        wishlist.invalidate();
+    }
+
+    void addReplication(tr_peer const* peer, tr_bitfield const& have)
+    {
+        // until we have the metainfo, we don't know how many pieces there are.
+        // rebuildReplication() counts everyone once we do.
+        if (!tor->hasMetainfo())
+        {
+            return;
+        }
+
+        if (have.hasAll())
+        {
+            replication_seeds.emplace_back(peer);
+            return;
+        }
+
+        if (have.hasNone())
+        {
+            return;
+        }
+
+        for (tr_piece_index_t piece = 0, n = std::size(piece_replication); piece < n; ++piece)
+        {
+            if (have.test(piece))
+            {
+                incrementReplication(piece);
+            }
+        }
+    }
+
+    void incrementReplication(tr_piece_index_t piece)
+    {
+        // saturate rather than wrap if a peer's messages get miscounted
+        if (auto& count = piece_replication[piece]; count < std::numeric_limits<uint16_t>::max())
+        {
+            ++count;
+        }
+
+        wishlist.pieceChanged(piece);
+    }
+
+    void removeReplication(tr_peer const* peer)
+    {
+        if (auto iter = std::find(std::begin(replication_seeds), std::end(replication_seeds), peer);
+            iter != std::end(replication_seeds))
+        {
+            *iter = replication_seeds.back();
+            replication_seeds.pop_back();
+            return;
+        }
+
+        auto const& have = peer->has();
+        if (have.hasNone())
+        {
+            return;
+        }
+
+        for (tr_piece_index_t piece = 0, n = std::size(piece_replication); piece < n; ++piece)
+        {
+            if (have.test(piece) && piece_replication[piece] > 0U)
+            {
+                --piece_replication[piece];
+                wishlist.pieceChanged(piece);
+            }
+        }
+    }
+
+    // tell the wishlist about the pieces that `block` belongs to
+    void blockChanged(tr_block_index_t block)
+    {
+        auto const loc = tor->blockLoc(block);
+        auto const last_piece = tor->byteLoc(loc.byte + tor->blockSize(block) - 1U).piece;
+        for (auto piece = loc.piece; piece <= last_piece; ++piece)
+        {
+            wishlist.pieceChanged(piece);
+        }
+    }
+
     static void peerCallbackFunc(tr_peer* peer, tr_peer_event const& event, void* vs)
     {
         TR_ASSERT(peer != nullptr);
@@ -572,11 +775,21 @@ public:
             }
 
         case tr_peer_event::Type::ClientGotHave:
+            if (event.pieceIndex < std::size(s->piece_replication))
+            {
+                s->incrementReplication(event.pieceIndex);
+            }
+
+            break;
+
+        // tr_peerMsgs only passes these along if they're the peer's first word
+        // on its pieces, so there's nothing earlier from this peer to uncount
         case tr_peer_event::Type::ClientGotHaveAll:
-        case tr_peer_event::Type::ClientGotHaveNone:
         case tr_peer_event::Type::ClientGotBitfield:
-            /* TODO: if we don't need these, should these events be removed? */
-            /* noop */
+            s->addReplication(peer, peer->has());
+            break;
+
+        case tr_peer_event::Type::ClientGotHaveNone:
             break;
 
         case tr_peer_event::Type::ClientGotRej:
@@ -607,6 +820,7 @@ public:
                 s->cancelAllRequestsForBlock(loc.block, peer);
                 peer->blocks_sent_to_client.add(tr_time(), 1);
                 tr_torrentGotBlock(tor, loc.block);
+                s->blockChanged(loc.block);
                 break;
             }
 
@@ -644,6 +858,16 @@ public:
 
     ActiveRequests active_requests;
 
+    // depends-on: active_requests
+    WishlistMediator wishlist_mediator{ *this };
+    Wishlist wishlist{ wishlist_mediator };
+
+    // how many peers have each piece, not counting seeds.
+    // Seeds have every piece, so they're just kept in `replication_seeds`.
+    // uint16_t is enough because tr_torrent's peer limit is a uint16_t.
+    std::vector<uint16_t> piece_replication;
+    std::vector<tr_peer const*> replication_seeds;
+
     // depends-on: active_requests
     std::vector<std::unique_ptr<tr_peer>> webseeds;
 
@@ -655,6 +879,10 @@ public:
     // invalidating those pointers
     std::deque<peer_atom> pool;
 
+    // the atoms in `pool` that we might connect to
+    CandidateQueue<peer_atom> candidates;
+    time_t candidates_rebuild_at = 0;
+
     tr_peerMsgs* optimistic = nullptr; /* the optimistic peer, or nullptr if none */
 
     time_t lastCancel = 0;
@@ -676,6 +904,9 @@ private:
     // how long we'll let requests we've made linger before we cancel them
     static auto constexpr RequestTtlSecs = int{ 90 };
 
+    // how often to requeue all of the pool's atoms in `candidates`
+    static auto constexpr CandidatesRebuildIntervalSecs = time_t{ 60 };
+
     mutable std::optional<bool> pool_is_all_seeds_;
 
     bool is_endgame_ = false;
@@ -791,6 +1022,11 @@ void tr_peerMgrFree(tr_peerMgr* manager)
     delete manager;
 }
 
+tr_message_stream_encryption::DHPool::Stats tr_peerMgrDHPoolStats(tr_peerMgr const* manager)
+{
+    return manager->handshake_mediator_.dh_pool_stats();
+}
+
 // ---
 
 void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr)
@@ -803,6 +1039,9 @@ void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr)
         {
             atom.setBlocklistedDirty();
         }
+
+        // atoms that were dropped for being blocklisted may be candidates now
+        tor->swarm->candidates_rebuild_at = 0;
     }
 }
 
@@ -834,9 +1073,10 @@ void tr_peerMgrSetUtpFailed(tr_torrent* tor, tr_address const& addr, bool failed
  *    This is used for cancelling requests that have been waiting
  *    for too long and avoiding duplicate requests.
  *
- * 2. tr_swarm::pieces, an array of "struct weighted_piece" which lists the
- *    pieces that we want to request. It's used to decide which blocks to
- *    return next when tr_peerMgrGetBlockRequests() is called.
+ * 2. tr_swarm::wishlist, which keeps the pieces that we want to request
+ *    sorted by how badly we want them. It's used to decide which blocks to
+ *    return next when tr_peerMgrGetNextRequests() is called, and is kept
+ *    up-to-date as blocks arrive and as priorities change.
  */
 
 // --- struct block_request
@@ -854,72 +1094,12 @@ void tr_peerMgrClientSentRequests(tr_torrent* torrent, tr_peer* peer, tr_block_s
 
 std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_peer const* peer, size_t numwant)
 {
-    class MediatorImpl final : public Wishlist::Mediator
-    {
-    public:
-        MediatorImpl(tr_torrent const* torrent_in, tr_peer const* peer_in)
-            : torrent_{ torrent_in }
-            , swarm_{ torrent_in->swarm }
-            , peer_{ peer_in }
-        {
-        }
-
-        MediatorImpl(MediatorImpl&&) = delete;
-        MediatorImpl(MediatorImpl const&) = delete;
-        MediatorImpl& operator=(MediatorImpl&&) = delete;
-        MediatorImpl& operator=(MediatorImpl const&) = delete;
-
-        ~MediatorImpl() override = default;
-
-        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
-        {
-            return !torrent_->hasBlock(block) && !swarm_->active_requests.has(block, peer_);
-        }
-
-        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
-        {
-            return torrent_->pieceIsWanted(piece) && peer_->hasPiece(piece);
-        }
-
-        [[nodiscard]] bool isEndgame() const override
-        {
-            return swarm_->isEndgame();
-        }
-
-        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
-        {
-            return swarm_->active_requests.count(block);
-        }
-
-        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
-        {
-            return torrent_->countMissingBlocksInPiece(piece);
-        }
-
-        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
-        {
-            return torrent_->blockSpanForPiece(piece);
-        }
-
-        [[nodiscard]] tr_piece_index_t countAllPieces() const override
-        {
-            return torrent_->pieceCount();
-        }
-
-        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
-        {
-            return torrent_->piecePriority(piece);
-        }
-
-    private:
-        tr_torrent const* const torrent_;
-        tr_swarm const* const swarm_;
-        tr_peer const* const peer_;
-    };
-
-    torrent->swarm->updateEndgame();
-    auto const mediator = MediatorImpl{ torrent, peer };
-    return Wishlist{ mediator }.next(numwant);
+    auto* const swarm = torrent->swarm;
+    swarm->updateEndgame();
+    return swarm->wishlist.next(
+        numwant,
+        [peer](tr_piece_index_t piece) { return peer->hasPiece(piece); },
+        [swarm, peer](tr_block_index_t block) { return swarm->active_requests.has(block, peer); });
 }
 
 // --- Piece List Manipulation / Accessors
@@ -965,6 +1145,7 @@ void tr_peerMgrPieceCompleted(tr_torrent* tor, tr_piece_index_t p)
     }
 
     // bookkeeping
+    tor->swarm->wishlist.pieceChanged(p);
     tor->set_needs_completeness_check();
 }
 
@@ -1041,6 +1222,8 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, str
                             atom->num_fails));
                     atom->flags2 |= MyflagUnreachable;
                 }
+
+                s->scheduleCandidate(*atom);
             }
         }
     }
@@ -1233,6 +1416,9 @@ void tr_peerMgrGotBadPiece(tr_torrent* tor, tr_piece_index_t piece_index)
     }
 
     tr_announcerAddBytes(tor, TR_ANN_CORRUPT, byte_count);
+
+    // the piece's blocks are about to be discarded
+    swarm->wishlist.pieceChanged(piece_index);
 }
 
 namespace
@@ -1369,6 +1555,10 @@ void tr_peerMgrStartTorrent(tr_torrent* tor)
 
     swarm->is_running = true;
 
+    // the torrent may have been verified while stopped
+    swarm->wishlist.invalidate();
+    swarm->candidates_rebuild_at = 0;
+
     swarm->manager->rechokeSoon();
 }
 
@@ -1417,6 +1607,9 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
         }
     }
 
+    /* now we know what pieces there are to want and who has them */
+    swarm->rebuildReplication();
+
     /* update the bittorrent peers' willingness... */
     for (auto* peer : swarm->peers)
     {
@@ -1425,6 +1618,15 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
     }
 }
 
+void tr_peerMgrOnWantedChanged(tr_torrent* tor)
+{
+    // NB: priorities can be set before the swarm exists
+    if (tor->swarm != nullptr)
+    {
+        tor->swarm->wishlist.invalidate();
+    }
+}
+
 int8_t tr_peerMgrPieceAvailability(tr_torrent const* tor, tr_piece_index_t piece)
 {
     if (!tor->hasMetainfo())
@@ -1437,8 +1639,7 @@ int8_t tr_peerMgrPieceAvailability(tr_torrent const* tor, tr_piece_index_t piece
         return -1;
     }
 
-    auto const& peers = tor->swarm->peers;
-    return std::count_if(std::begin(peers), std::end(peers), [piece](auto const* peer) { return peer->hasPiece(piece); });
+    return static_cast<int8_t>(std::min(tor->swarm->countPieceReplication(piece), size_t{ INT8_MAX }));
 }
 
 void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned int n_tabs)
@@ -2365,7 +2566,42 @@ struct peer_candidate
     return score;
 }
 
-/** @return an array of all the atoms we might want to connect to */
+// The score that orders a swarm's CandidateQueue. It's unsalted so that
+// it only changes when the atom or its torrent does.
+[[nodiscard]] uint64_t getQueuedCandidateScore(tr_torrent const* tor, peer_atom const& atom)
+{
+    return getPeerCandidateScore(tor, atom, 0U);
+}
+
+// @return the best atom in `tor`'s candidate queue that we'd connect to now
+[[nodiscard]] peer_atom* getNextSwarmCandidate(tr_torrent const* tor, time_t const now)
+{
+    auto& queue = tor->swarm->candidates;
+    auto const score = [tor](peer_atom const& atom)
+    {
+        return getQueuedCandidateScore(tor, atom);
+    };
+
+    for (;;)
+    {
+        auto* const atom = queue.top(score);
+        if (atom == nullptr || isPeerCandidate(tor, *atom, now))
+        {
+            return atom;
+        }
+
+        queue.pop();
+
+        // If it's just waiting out its reconnect interval, check back then.
+        // Otherwise it's dropped until it gets requeued by a state change.
+        if (auto const due = atom->time + atom->getReconnectIntervalSecs(now); due > now)
+        {
+            queue.schedule(*atom, due);
+        }
+    }
+}
+
+/** @return the best `max` atoms we might want to connect to */
 [[nodiscard]] std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t max)
 {
     auto const now = tr_time();
@@ -2377,10 +2613,13 @@ struct peer_candidate
         return {};
     }
 
-    auto candidates = std::vector<peer_candidate>{};
-    candidates.reserve(peer_atom::atom_count());
+    // each swarm's best candidate, kept in a min-heap by score
+    auto heads = std::vector<peer_candidate>{};
+    auto const heap_compare = [](auto const& a, auto const& b)
+    {
+        return a.score > b.score;
+    };
 
-    /* populate the candidate array */
     auto salter = tr_salt_shaker{};
     for (auto* const tor : session->torrents())
     {
@@ -2411,24 +2650,38 @@ struct peer_candidate
             continue;
         }
 
-        for (auto& atom : swarm->pool)
+        if (swarm->candidates_rebuild_at <= now)
         {
-            if (isPeerCandidate(tor, atom, now))
-            {
-                candidates.push_back({ getPeerCandidateScore(tor, atom, salter()), tor, &atom });
-            }
+            swarm->rebuildCandidates(now);
+        }
+
+        swarm->candidates.promote(now, [tor](peer_atom const& atom) { return getQueuedCandidateScore(tor, atom); });
+
+        if (auto* const atom = getNextSwarmCandidate(tor, now); atom != nullptr)
+        {
+            heads.push_back({ getPeerCandidateScore(tor, *atom, salter()), tor, atom });
         }
     }
 
-    // only keep the best `max` candidates
-    if (std::size(candidates) > max)
+    // merge the swarms' queues, taking only as many atoms as we need
+    auto candidates = std::vector<peer_candidate>{};
+    candidates.reserve(max);
+    std::make_heap(std::begin(heads), std::end(heads), heap_compare);
+
+    while (std::size(candidates) < max && !std::empty(heads))
     {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + max,
-            std::end(candidates),
-            [](auto const& a, auto const& b) { return a.score < b.score; });
-        candidates.resize(max);
+        std::pop_heap(std::begin(heads), std::end(heads), heap_compare);
+        auto const best = heads.back();
+        heads.pop_back();
+
+        candidates.push_back(best);
+        best.tor->swarm->candidates.pop();
+
+        if (auto* const atom = getNextSwarmCandidate(best.tor, now); atom != nullptr)
+        {
+            heads.push_back({ getPeerCandidateScore(best.tor, *atom, salter()), best.tor, atom });
+            std::push_heap(std::begin(heads), std::end(heads), heap_compare);
+        }
     }
 
     return candidates;
@@ -2453,6 +2706,8 @@ void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, peer_atom& atom)
 
     if (tr_peer_socket::limit_reached(session) || (!utp && !session->allowsTCP()))
     {
+        // it's been taken out of the queue, so put it back for later
+        s->scheduleCandidate(atom);
         return;
     }
 
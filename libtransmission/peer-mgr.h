@@ -21,6 +21,7 @@
 
 #include "net.h" /* tr_address */
 #include "peer-common.h"
+#include "peer-mse.h" // tr_message_stream_encryption::DHPool
 #include "peer-socket.h"
 
 /**
@@ -163,6 +164,8 @@ constexpr bool tr_isPex(tr_pex const* pex)
 
 void tr_peerMgrFree(tr_peerMgr* manager);
 
+[[nodiscard]] tr_message_stream_encryption::DHPool::Stats tr_peerMgrDHPoolStats(tr_peerMgr const* manager);
+
 void tr_peerMgrSetUtpSupported(tr_torrent* tor, tr_address const& addr);
 
 void tr_peerMgrSetUtpFailed(tr_torrent* tor, tr_address const& addr, bool failed);
@@ -210,6 +213,9 @@ void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned
 
 void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor);
 
+// which pieces the torrent wants, or their priorities, changed
+void tr_peerMgrOnWantedChanged(tr_torrent* tor);
+
 void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr);
 
 [[nodiscard]] struct tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, size_t* setme_count);
@@ -4,7 +4,13 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <condition_variable>
+#include <cstddef>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
 
 #include <math/wide_integer/uintwide_t.h>
 
@@ -56,10 +62,8 @@ auto export_bits(UIntWide i)
 }
 
 // NOLINTBEGIN(readability-identifier-naming)
-auto WIDE_INTEGER_CONSTEXPR const generator = wi::key_t{ "2" };
-auto WIDE_INTEGER_CONSTEXPR const prime = wi::key_t{
-    "0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563"
-};
+auto WIDE_INTEGER_CONSTEXPR const generator = wi::key_t{ tr_message_stream_encryption::DH::Generator };
+auto WIDE_INTEGER_CONSTEXPR const prime = wi::key_t{ tr_message_stream_encryption::DH::Prime };
 // NOLINTEND(readability-identifier-naming)
 
 } // namespace wi
@@ -75,18 +79,42 @@ namespace tr_message_stream_encryption
     return tr_rand_obj<DH::private_key_bigend_t>();
 }
 
-[[nodiscard]] auto generatePublicKey(DH::private_key_bigend_t const& private_key) noexcept
+namespace
+{
+// @return base ^ exponent mod prime, computed with the crypto library's
+// bignums if it has them, since they are several times faster
+[[nodiscard]] DH::key_bigend_t powm(DH::key_bigend_t const& base, DH::private_key_bigend_t const& exponent)
 {
-    auto const private_key_wi = wi::import_bits<wi::private_key_t>(private_key);
-    auto const public_key_wi = math::wide_integer::powm(wi::generator, private_key_wi, wi::prime);
-    return wi::export_bits(public_key_wi);
+    static auto const prime_bigend = wi::export_bits(wi::prime);
+
+    auto result = DH::key_bigend_t{};
+    if (tr_powm(
+            std::data(base),
+            std::size(base),
+            std::data(exponent),
+            std::size(exponent),
+            std::data(prime_bigend),
+            std::size(prime_bigend),
+            std::data(result)))
+    {
+        return result;
+    }
+
+    auto const result_wi = math::wide_integer::powm(
+        wi::import_bits<wi::key_t>(base),
+        wi::import_bits<wi::private_key_t>(exponent),
+        wi::prime);
+    return wi::export_bits(result_wi);
 }
+} // namespace
 
 DH::key_bigend_t DH::publicKey() noexcept
 {
+    static auto const generator_bigend = wi::export_bits(wi::generator);
+
     if (public_key_ == key_bigend_t{})
     {
-        public_key_ = generatePublicKey(private_key_);
+        public_key_ = powm(generator_bigend, private_key_);
     }
 
     return public_key_;
@@ -94,11 +122,88 @@ DH::key_bigend_t DH::publicKey() noexcept
 
 void DH::setPeerPublicKey(key_bigend_t const& peer_public_key)
 {
-    auto const secret = math::wide_integer::powm(
-        wi::import_bits<wi::key_t>(peer_public_key),
-        wi::import_bits<wi::private_key_t>(private_key_),
-        wi::prime);
-    secret_ = wi::export_bits(secret);
+    secret_ = powm(peer_public_key, private_key_);
+}
+
+// --- DHPool
+
+DHPool::DHPool(size_t size)
+    : size_{ size }
+    , generator_thread_{ &DHPool::generatorThreadFunc, this }
+{
+}
+
+DHPool::~DHPool()
+{
+    {
+        auto const lock = std::unique_lock{ mutex_ };
+        stopping_ = true;
+        cv_.notify_all();
+    }
+
+    generator_thread_.join();
+}
+
+std::optional<DH> DHPool::take()
+{
+    auto const lock = std::unique_lock{ mutex_ };
+
+    if (std::empty(ready_))
+    {
+        ++stats_.misses;
+        return {};
+    }
+
+    auto dh = std::move(ready_.back());
+    ready_.pop_back();
+    ++stats_.hits;
+    cv_.notify_one(); // make a replacement
+    return dh;
+}
+
+void DHPool::recycle(DH&& dh)
+{
+    auto const lock = std::unique_lock{ mutex_ };
+
+    if (std::size(ready_) < size_)
+    {
+        ready_.emplace_back(std::move(dh));
+        ++stats_.recycled;
+    }
+}
+
+DHPool::Stats DHPool::stats() const
+{
+    auto const lock = std::unique_lock{ mutex_ };
+    auto ret = stats_;
+    ret.ready = std::size(ready_);
+    return ret;
+}
+
+void DHPool::generatorThreadFunc()
+{
+    for (;;)
+    {
+        {
+            auto lock = std::unique_lock{ mutex_ };
+            cv_.wait(lock, [this]() { return stopping_ || std::size(ready_) < size_; });
+            if (stopping_)
+            {
+                return;
+            }
+        }
+
+        // the expensive part, done without holding the lock
+        auto dh = DH{};
+        [[maybe_unused]] auto const public_key = dh.publicKey();
+
+        auto const lock = std::unique_lock{ mutex_ };
+        if (std::size(ready_) < size_)
+        {
+            ready_.emplace_back(std::move(dh));
+            ++stats_.generated;
+        }
+    }
 }
 
 // --- Filter
@@ -11,9 +11,16 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <algorithm> // std::copy_n()
 #include <array>
+#include <condition_variable>
 #include <cstddef> // size_t, std::byte
+#include <cstdint> // uint8_t, uint64_t
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 
 #include "tr-macros.h" // tr_sha1_digest_t
 #include "tr-arc4.h"
@@ -41,6 +48,12 @@ public:
     // [the public keys] are 768bits long[.]"
     static auto constexpr KeySize = size_t{ 96 };
 
+    // MSE spec: "Prime P is a 768 bit safe prime [...] Generator G is 2",
+    // written the way bignum libraries parse them
+    static auto constexpr Prime =
+        "0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563";
+    static auto constexpr Generator = "2";
+
     // big-endian byte arrays holding the keys and shared secret.
     // MSE spec: "The entire handshake is in big-endian."
     using private_key_bigend_t = std::array<std::byte, PrivateKeySize>;
@@ -73,6 +86,54 @@ private:
     key_bigend_t secret_ = {};
 };
 
+/**
+ * A supply of DH keypairs whose public keys were computed ahead of time
+ * on a background thread, so that starting an encrypted handshake
+ * doesn't have to wait for a 768-bit modular exponentiation.
+ */
+class DHPool
+{
+public:
+    struct Stats
+    {
+        size_t ready = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t generated = 0;
+        uint64_t recycled = 0;
+    };
+
+    static auto constexpr DefaultSize = size_t{ 64U };
+
+    explicit DHPool(size_t size = DefaultSize);
+    ~DHPool();
+
+    DHPool(DHPool const&) = delete;
+    DHPool& operator=(DHPool const&) = delete;
+
+    // Returns a keypair whose public key is ready,
+    // or std::nullopt if the pool is empty.
+    [[nodiscard]] std::optional<DH> take();
+
+    // Put back a keypair that was never used for a handshake.
+    void recycle(DH&& dh);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    void generatorThreadFunc();
+
+    size_t const size_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<DH> ready_;
+    Stats stats_;
+    bool stopping_ = false;
+
+    std::thread generator_thread_;
+};
+
 // --- arc4 encryption for both incoming and outgoing stream
 class Filter
 {
@@ -99,6 +160,19 @@ public:
         }
     }
 
+    // Encrypt `buf_len` bytes of `in` into `out`, which may not overlap.
+    void encrypt(size_t buf_len, void const* in, void* out)
+    {
+        if (enc_active_)
+        {
+            enc_key_.process(in, out, buf_len);
+        }
+        else
+        {
+            std::copy_n(static_cast<uint8_t const*>(in), buf_len, static_cast<uint8_t*>(out));
+        }
+    }
+
     [[nodiscard]] constexpr auto is_active() const noexcept
     {
         return dec_active_ || enc_active_;
@@ -13,6 +13,7 @@
 #include <memory> // std::unique_ptr
 #include <optional>
 #include <queue>
+#include <set>
 #include <utility>
 #include <vector>
 
@@ -21,11 +22,13 @@
 #include "transmission.h"
 
 #include "bitfield.h"
+#include "block-pool.h"
 #include "cache.h"
 #include "completion.h"
 #include "crypto-utils.h"
 #include "file.h"
 #include "log.h"
+#include "merkle.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
 #include "peer-msgs.h"
@@ -79,6 +82,11 @@ auto constexpr FextAllowedFast = uint8_t{ 17 };
 // see also LtepMessageIds below
 auto constexpr Ltep = uint8_t{ 20 };
 
+// http://bittorrent.org/beps/bep_0052.html
+auto constexpr HashRequest = uint8_t{ 21 };
+auto constexpr Hashes = uint8_t{ 22 };
+auto constexpr HashReject = uint8_t{ 23 };
+
 [[nodiscard]] constexpr std::string_view debug_name(uint8_t type) noexcept
 {
     switch (type)
@@ -99,6 +107,12 @@ auto constexpr Ltep = uint8_t{ 20 };
         return "fext-reject"sv;
     case FextSuggest:
         return "fext-suggest"sv;
+    case HashReject:
+        return "hash-reject"sv;
+    case HashRequest:
+        return "hash-request"sv;
+    case Hashes:
+        return "hashes"sv;
     case Have:
         return "have"sv;
     case Interested:
@@ -178,6 +192,9 @@ auto constexpr PrefetchMax = size_t{ 18 };
 // meet our bandwidth goals for the next N seconds
 auto constexpr RequestBufSecs = int{ 10 };
 
+// the most leaf hashes we'll ask for or serve in one BEP 52 hash request
+auto constexpr MaxHashRequestLength = size_t{ 512 };
+
 // ---
 
 auto constexpr MaxPexPeerCount = size_t{ 50 };
@@ -223,13 +240,13 @@ struct tr_incoming
 
     struct incoming_piece_data
     {
-        explicit incoming_piece_data(uint32_t block_size)
-            : buf{ std::make_unique<std::vector<uint8_t>>(block_size) }
+        incoming_piece_data(tr_block_pool& pool, uint32_t block_size)
+            : buf{ pool.get(block_size) }
             , have{ block_size }
         {
         }
 
-        std::unique_ptr<std::vector<uint8_t>> buf;
+        tr_block_pool::Buf buf;
         tr_bitfield have;
     };
 
@@ -508,6 +525,7 @@ public:
 
     void on_piece_completed(tr_piece_index_t piece) override
     {
+        hashes_requested_.erase(piece);
         protocolSendHave(this, piece);
 
         // since we have more pieces now, we might not be interested in this peer
@@ -544,6 +562,16 @@ public:
 
         for (auto const *span = block_spans, *span_end = span + n_spans; span != span_end; ++span)
         {
+            if (span->begin < span->end)
+            {
+                auto const first_piece = torrent->blockLoc(span->begin).piece;
+                auto const last_piece = torrent->blockLoc(span->end - 1).piece;
+                for (auto piece = first_piece; piece <= last_piece; ++piece)
+                {
+                    maybeRequestBlockHashes(piece);
+                }
+            }
+
             for (auto [block, block_end] = *span; block < block_end; ++block)
             {
                 // Note that requests can't cross over a piece boundary.
@@ -640,6 +668,38 @@ private:
         pokeBatchPeriod(ImmediatePriorityIntervalSecs);
     }
 
+    // BEP 52: ask v2 peers for the leaf hashes of the pieces we're
+    // requesting, so that each block can be checked when it arrives
+    void maybeRequestBlockHashes(tr_piece_index_t piece)
+    {
+        if (!io->supports_v2() || !torrent->hasV2Metadata() || torrent->hasBlockHashes(piece) ||
+            hashes_requested_.count(piece) != 0U)
+        {
+            return;
+        }
+
+        auto const v2_piece = torrent->v2Piece(piece);
+        if (!v2_piece || v2_piece->width < 2U || v2_piece->width > MaxHashRequestLength)
+        {
+            return;
+        }
+
+        hashes_requested_.insert(piece);
+
+        auto& out = outMessages;
+        out.add_uint32(sizeof(uint8_t) + std::size(v2_piece->file->root) + 4 * sizeof(uint32_t));
+        out.add_uint8(BtPeerMsgs::HashRequest);
+        out.add(v2_piece->file->root);
+        out.add_uint32(0U); // base layer: the leaves
+        out.add_uint32(v2_piece->first_leaf);
+        out.add_uint32(v2_piece->width);
+        out.add_uint32(0U); // proof layers: none; we already trust the piece layer
+
+        logtrace(this, fmt::format(FMT_STRING("requesting leaf hashes for piece {:d}"), piece));
+        dbgOutMessageLen();
+        pokeBatchPeriod(ImmediatePriorityIntervalSecs);
+    }
+
     [[nodiscard]] bool calculate_active(tr_direction direction) const
     {
         if (direction == TR_CLIENT_TO_PEER)
@@ -689,6 +749,10 @@ public:
     bool clientSentLtepHandshake = false;
     bool peerSentLtepHandshake = false;
 
+    // whether the peer has told us about any of its pieces yet.
+    // A bitfield, have-all or have-none is only allowed before that.
+    bool peerSentHaveInfo = false;
+
     size_t desired_request_count = 0;
 
     /* how long the outMessages batch should be allowed to grow before
@@ -719,10 +783,16 @@ public:
         }
 
         bool prefetched = false;
+        bool check_queued = false;
     };
 
     std::vector<QueuedPeerRequest> peer_requested_;
 
+    // pieces whose leaf hashes we've asked this peer for. Pieces stay here
+    // after a hash reject so that we don't ask again; they're removed when
+    // the hashes arrive or the piece completes.
+    std::set<tr_piece_index_t> hashes_requested_;
+
     std::vector<tr_pex> pex;
     std::vector<tr_pex> pex6;
 
@@ -1334,6 +1404,165 @@ void peerMadeRequest(tr_peerMsgsImpl* msgs, struct peer_request const* req)
     }
 }
 
+// ---
+
+// http://bittorrent.org/beps/bep_0052.html#hash-request
+struct hash_request
+{
+    tr_sha256_digest_t root = {};
+    uint32_t base_layer = 0;
+    uint32_t index = 0;
+    uint32_t length = 0;
+    uint32_t proof_layers = 0;
+};
+
+// @return the parsed request, or nullopt if it doesn't fit in its file's merkle tree
+[[nodiscard]] std::optional<hash_request> parseHashRequest(tr_torrent const* tor, libtransmission::Buffer& payload)
+{
+    auto req = hash_request{};
+    payload.to_buf(std::data(req.root), std::size(req.root));
+    req.base_layer = payload.to_uint32();
+    req.index = payload.to_uint32();
+    req.length = payload.to_uint32();
+    req.proof_layers = payload.to_uint32();
+
+    // unknown roots are rejected or ignored later, like any other request we can't serve
+    auto const* const file = tor->findV2File(req.root);
+    if (file == nullptr)
+    {
+        return req;
+    }
+
+    // these come straight from the peer, so bound them by the file's tree
+    // before anything gets sized from them
+    auto const tree_width = tr_merkle::ceilPow2(std::max(size_t{ 1U }, tr_merkle::leafCount(tor->fileSize(file->file))));
+    auto const tree_height = tr_merkle::log2(tree_width);
+    if (req.base_layer > tree_height || req.length > std::max(size_t{ 1U }, tree_width >> req.base_layer) ||
+        req.proof_layers > tree_height + 1U)
+    {
+        return {};
+    }
+
+    return req;
+}
+
+void protocolSendHashRequestReply(
+    tr_peerMsgsImpl* msgs,
+    uint8_t id,
+    hash_request const& req,
+    std::vector<tr_sha256_digest_t> const& hashes)
+{
+    auto& out = msgs->outMessages;
+
+    out.add_uint32(sizeof(uint8_t) + std::size(req.root) + 4 * sizeof(uint32_t) + std::size(hashes) * std::size(req.root));
+    out.add_uint8(id);
+    out.add(req.root);
+    out.add_uint32(req.base_layer);
+    out.add_uint32(req.index);
+    out.add_uint32(req.length);
+    out.add_uint32(req.proof_layers);
+    for (auto const& hash : hashes)
+    {
+        out.add(hash);
+    }
+
+    msgs->dbgOutMessageLen();
+    msgs->pokeBatchPeriod(HighPriorityIntervalSecs);
+}
+
+// We can serve hashes from the piece layers that came with the .torrent.
+// @return the requested hashes followed by their proof, or nullopt if we can't serve the request
+[[nodiscard]] std::optional<std::vector<tr_sha256_digest_t>> getRequestedHashes(
+    tr_torrent const* tor,
+    hash_request const& req)
+{
+    auto const* const file = tor->findV2File(req.root);
+    if (file == nullptr || std::empty(file->layers))
+    {
+        return {};
+    }
+
+    auto const& layer = file->layers.front();
+    auto const height = tr_merkle::log2(tor->pieceSize() / tr_merkle::BlockSize);
+    auto const width = size_t{ 1U } << (std::size(file->layers) - 1U);
+    if (req.base_layer != height || req.length == 0U || req.length > MaxHashRequestLength ||
+        req.length != tr_merkle::ceilPow2(req.length) || req.index % req.length != 0U || req.index >= width)
+    {
+        return {};
+    }
+
+    auto hashes = std::vector<tr_sha256_digest_t>{};
+    hashes.reserve(req.length + req.proof_layers);
+    for (size_t i = req.index, end = size_t{ req.index } + req.length; i < end; ++i)
+    {
+        hashes.emplace_back(i < std::size(layer) ? layer[i] : tr_merkle::padHash(height));
+    }
+
+    // the proof starts above the subtree that the requested hashes cover
+    auto const proof = tr_merkle::uncles(
+        file->layers,
+        height,
+        tr_merkle::log2(req.length),
+        req.index / req.length,
+        req.proof_layers);
+    hashes.insert(std::end(hashes), std::begin(proof), std::end(proof));
+    return hashes;
+}
+
+void peerMadeHashRequest(tr_peerMsgsImpl* msgs, hash_request const& req)
+{
+    if (auto const hashes = getRequestedHashes(msgs->torrent, req); hashes)
+    {
+        logtrace(msgs, fmt::format(FMT_STRING("sending {:d} hashes"), std::size(*hashes)));
+        protocolSendHashRequestReply(msgs, BtPeerMsgs::Hashes, req, *hashes);
+    }
+    else
+    {
+        logtrace(msgs, "rejecting hash request");
+        protocolSendHashRequestReply(msgs, BtPeerMsgs::HashReject, req, {});
+    }
+}
+
+void clientGotHashes(tr_peerMsgsImpl* msgs, hash_request const& req, libtransmission::Buffer& payload)
+{
+    auto* const tor = msgs->torrent;
+
+    // we only ask for the leaves of a single piece
+    auto const* const file = tor->findV2File(req.root);
+    if (file == nullptr || req.base_layer != 0U || req.length == 0U ||
+        std::size(payload) < req.length * std::size(req.root))
+    {
+        logdbg(msgs, "got unrequested hashes");
+        return;
+    }
+
+    auto const leaves_per_piece = tor->pieceSize() / tr_merkle::BlockSize;
+    auto const piece = static_cast<tr_piece_index_t>(file->first_piece + req.index / leaves_per_piece);
+    msgs->hashes_requested_.erase(piece);
+    auto const v2_piece = tor->v2Piece(piece);
+    if (!v2_piece || v2_piece->file != file || v2_piece->first_leaf != req.index || v2_piece->width != req.length ||
+        tor->hasPiece(piece) || tor->hasBlockHashes(piece))
+    {
+        logdbg(msgs, "got unrequested hashes");
+        return;
+    }
+
+    auto hashes = std::vector<tr_sha256_digest_t>(req.length);
+    for (auto& hash : hashes)
+    {
+        payload.to_buf(std::data(hash), std::size(hash));
+    }
+
+    if (tr_merkle::root(hashes, req.length) != v2_piece->hash)
+    {
+        logdbg(msgs, fmt::format(FMT_STRING("got bad leaf hashes for piece {:d}"), piece));
+        return;
+    }
+
+    logtrace(msgs, fmt::format(FMT_STRING("got leaf hashes for piece {:d}"), piece));
+    tor->setBlockHashes(piece, std::move(hashes));
+}
+
 bool messageLengthIsCorrect(tr_peerMsgsImpl const* msg, uint8_t id, uint32_t len)
 {
     switch (id)
@@ -1377,6 +1606,13 @@ bool messageLengthIsCorrect(tr_peerMsgsImpl const* msg, uint8_t id, uint32_t len
     case BtPeerMsgs::Port:
         return len == 3;
 
+    case BtPeerMsgs::HashRequest:
+    case BtPeerMsgs::HashReject:
+        return len == 49;
+
+    case BtPeerMsgs::Hashes:
+        return len >= 49 && (len - 49) % std::tuple_size_v<tr_sha256_digest_t> == 0;
+
     case BtPeerMsgs::Ltep:
         return len >= 2;
 
@@ -1385,7 +1621,7 @@ bool messageLengthIsCorrect(tr_peerMsgsImpl const* msg, uint8_t id, uint32_t len
     }
 }
 
-int clientGotBlock(tr_peerMsgsImpl* msgs, std::unique_ptr<std::vector<uint8_t>> block_data, tr_block_index_t block);
+int clientGotBlock(tr_peerMsgsImpl* msgs, tr_block_pool::Buf block_data, tr_block_index_t block);
 
 ReadResult read_piece_data(tr_peerMsgsImpl* msgs, libtransmission::Buffer& payload)
 {
@@ -1411,8 +1647,8 @@ ReadResult read_piece_data(tr_peerMsgsImpl* msgs, libtransmission::Buffer& paylo
     }
 
     auto& blocks = msgs->incoming.blocks;
-    auto& incoming_block = blocks.try_emplace(block, block_size).first->second;
-    payload.to_buf(std::data(*incoming_block.buf) + loc.block_offset, len);
+    auto& incoming_block = blocks.try_emplace(block, msgs->session->blockPool(), block_size).first->second;
+    payload.to_buf(std::data(incoming_block.buf) + loc.block_offset, len);
     msgs->publish(tr_peer_event::GotPieceData(len));
     incoming_block.have.setSpan(loc.block_offset, loc.block_offset + len);
     logtrace(msgs, fmt::format("got {:d} bytes for req {:d}:{:d}->{:d}", len, piece, offset, len));
@@ -1500,6 +1736,8 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, libtransmissi
             return { READ_ERR, {} };
         }
 
+        msgs->peerSentHaveInfo = true;
+
         /* a peer can send the same HAVE message twice... */
         if (!msgs->have_.test(ui32))
         {
@@ -1513,6 +1751,15 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, libtransmissi
     case BtPeerMsgs::Bitfield:
         {
             logtrace(msgs, "got a bitfield");
+
+            // BEP 3: "'bitfield' is only ever sent as the first message."
+            // The swarm counts each peer's pieces once, so ignore repeats.
+            if (std::exchange(msgs->peerSentHaveInfo, true))
+            {
+                logdbg(msgs, "ignoring a bitfield that wasn't the peer's first word on its pieces");
+                break;
+            }
+
             auto const [buf, buflen] = payload.pullup();
             msgs->have_ = tr_bitfield{ msgs->torrent->hasMetainfo() ? msgs->torrent->pieceCount() : buflen * 8 };
             msgs->have_.setRaw(reinterpret_cast<uint8_t const*>(buf), buflen);
@@ -1615,7 +1862,11 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, libtransmissi
     case BtPeerMsgs::FextHaveAll:
         logtrace(msgs, "Got a BtPeerMsgs::FextHaveAll");
 
-        if (fext)
+        if (fext && std::exchange(msgs->peerSentHaveInfo, true))
+        {
+            logdbg(msgs, "ignoring a have-all that wasn't the peer's first word on its pieces");
+        }
+        else if (fext)
         {
             msgs->have_.setHasAll();
             msgs->publish(tr_peer_event::GotHaveAll());
@@ -1632,7 +1883,11 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, libtransmissi
     case BtPeerMsgs::FextHaveNone:
         logtrace(msgs, "Got a BtPeerMsgs::FextHaveNone");
 
-        if (fext)
+        if (fext && std::exchange(msgs->peerSentHaveInfo, true))
+        {
+            logdbg(msgs, "ignoring a have-none that wasn't the peer's first word on its pieces");
+        }
+        else if (fext)
         {
             msgs->have_.setHasNone();
             msgs->publish(tr_peer_event::GotHaveNone());
@@ -1672,6 +1927,43 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, libtransmissi
         parseLtep(msgs, payload);
         break;
 
+    case BtPeerMsgs::HashRequest:
+    case BtPeerMsgs::Hashes:
+        {
+            logtrace(msgs, fmt::format(FMT_STRING("Got a BtPeerMsgs::{:s}"), BtPeerMsgs::debug_name(id)));
+
+            // BEP 52 messages are only for peers that set the v2 reserved bit
+            if (!msgs->io->supports_v2())
+            {
+                logdbg(msgs, "ignoring hash message from a peer that didn't negotiate v2");
+                break;
+            }
+
+            auto const req = parseHashRequest(msgs->torrent, payload);
+            if (!req)
+            {
+                logdbg(msgs, "peer sent a hash message that doesn't fit any of our files' trees");
+                msgs->publish(tr_peer_event::GotError(ERANGE));
+                return { READ_ERR, {} };
+            }
+
+            if (id == BtPeerMsgs::HashRequest)
+            {
+                peerMadeHashRequest(msgs, *req);
+            }
+            else
+            {
+                clientGotHashes(msgs, *req, payload);
+            }
+
+            break;
+        }
+
+    case BtPeerMsgs::HashReject:
+        // we'll check the whole piece when it's done instead
+        logtrace(msgs, "Got a BtPeerMsgs::HashReject");
+        break;
+
     default:
         logtrace(msgs, fmt::format(FMT_STRING("peer sent us an UNKNOWN: {:d}"), static_cast<int>(id)));
         break;
@@ -1681,22 +1973,16 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, libtransmissi
 }
 
 /* returns 0 on success, or an errno on failure */
-int clientGotBlock(tr_peerMsgsImpl* msgs, std::unique_ptr<std::vector<uint8_t>> block_data, tr_block_index_t const block)
+int clientGotBlock(tr_peerMsgsImpl* msgs, tr_block_pool::Buf block_data, tr_block_index_t const block)
 {
     TR_ASSERT(msgs != nullptr);
 
     tr_torrent const* const tor = msgs->torrent;
     auto const n_expected = msgs->torrent->blockSize(block);
 
-    if (!block_data)
+    if (std::size(block_data) != msgs->torrent->blockSize(block))
     {
-        logdbg(msgs, fmt::format("wrong block size: expected {:d}, got {:d}", n_expected, 0));
-        return EMSGSIZE;
-    }
-
-    if (std::size(*block_data) != msgs->torrent->blockSize(block))
-    {
-        logdbg(msgs, fmt::format("wrong block size: expected {:d}, got {:d}", n_expected, std::size(*block_data)));
+        logdbg(msgs, fmt::format("wrong block size: expected {:d}, got {:d}", n_expected, std::size(block_data)));
         return EMSGSIZE;
     }
 
@@ -1715,6 +2001,12 @@ int clientGotBlock(tr_peerMsgsImpl* msgs, std::unique_ptr<std::vector<uint8_t>>
         return 0;
     }
 
+    if (auto const ok = tor->checkBlock(block, std::data(block_data)); ok && !*ok)
+    {
+        logdbg(msgs, fmt::format(FMT_STRING("block {:d} doesn't match its hash"), block));
+        return EBADMSG;
+    }
+
     // NB: if writeBlock() fails the torrent may be paused.
     // If this happens, `msgs` will be a dangling pointer and must no longer be used.
     if (auto const err = msgs->session->cache->writeBlock(tor->id(), block, std::move(block_data)); err != 0)
@@ -1897,6 +2189,42 @@ void updateBlockRequests(tr_peerMsgsImpl* msgs)
     }
 }
 
+// Find the next request that can be served without blocking on a piece check.
+// If a request's piece needs to be checked first, the check is handed to a
+// background thread and the request waits in the queue until it's done.
+// Pieces that already failed a check aren't checked again; their requests
+// are returned right away so that they can be rejected.
+[[nodiscard]] bool popNextRequest(tr_peerMsgsImpl* msgs, peer_request& setme)
+{
+    auto* const tor = msgs->torrent;
+    auto& requests = msgs->peer_requested_;
+
+    for (auto iter = std::begin(requests), end = std::end(requests); iter != end; ++iter)
+    {
+        auto& req = *iter;
+
+        if (msgs->isValidRequest(req) && tor->hasPiece(req.index) && !tor->isPieceChecked(req.index))
+        {
+            if (!req.check_queued && !tor->didPieceCheckFail(req.index))
+            {
+                tor->checkPieceInBackground(req.index);
+                req.check_queued = true;
+            }
+
+            if (tor->isPieceCheckPending(req.index))
+            {
+                continue;
+            }
+        }
+
+        setme = req;
+        requests.erase(iter);
+        return true;
+    }
+
+    return false;
+}
+
 size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
 {
     size_t bytes_written = 0;
@@ -1981,39 +2309,29 @@ size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
 
     // --- Data Blocks
 
-    if (msgs->io->get_write_buffer_space(now) >= tr_block_info::BlockSize && !std::empty(msgs->peer_requested_))
+    if (msgs->io->get_write_buffer_space(now) >= tr_block_info::BlockSize && popNextRequest(msgs, req))
     {
-        req = msgs->peer_requested_.front();
-        msgs->peer_requested_.erase(std::begin(msgs->peer_requested_));
-
         if (msgs->isValidRequest(req) && msgs->torrent->hasPiece(req.index))
         {
             uint32_t const msglen = 4 + 1 + 4 + 4 + req.length;
 
             auto out = libtransmission::Buffer{};
-            out.reserve(msglen);
 
             out.add_uint32(sizeof(uint8_t) + 2 * sizeof(uint32_t) + req.length);
             out.add_uint8(BtPeerMsgs::Piece);
             out.add_uint32(req.index);
             out.add_uint32(req.offset);
-            auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
             bool err = msgs->session->cache->readBlock(
                            msgs->torrent,
                            msgs->torrent->pieceLoc(req.index, req.offset),
                            req.length,
-                           std::data(buf)) != 0;
-            out.add(std::data(buf), req.length);
+                           out,
+                           msgs->io->supports_file_refs()) != 0;
 
-            /* check the piece if it needs checking... */
+            // popNextRequest() only returns an unchecked piece if its check failed
             if (!err)
             {
-                err = !msgs->torrent->ensurePieceIsChecked(req.index);
-                if (err)
-                {
-                    msgs->torrent->setLocalError(
-                        fmt::format(FMT_STRING("Please Verify Local Data! Piece #{:d} is corrupt."), req.index));
-                }
+                err = !msgs->torrent->isPieceChecked(req.index);
             }
 
             if (err)
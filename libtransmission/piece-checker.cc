@@ -0,0 +1,182 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint>
+#include <functional> // std::not_fn()
+#include <iterator> // std::back_inserter()
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "file.h"
+#include "merkle.h"
+#include "piece-checker.h"
+
+namespace
+{
+
+auto constexpr BufferSize = size_t{ 1024U * 256U };
+
+} // namespace
+
+bool tr_piece_checker::checkPiece(Task const& task, std::vector<uint8_t>& buffer)
+{
+    auto sha = tr_sha1::create();
+    auto merkle = tr_merkle::Hasher{};
+
+    for (auto const& span : task.spans)
+    {
+        if (std::empty(span.filename))
+        {
+            return false;
+        }
+
+        auto const fd = tr_sys_file_open(span.filename.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            return false;
+        }
+
+        auto ok = true;
+        for (uint64_t pos = 0; ok && pos < span.length;)
+        {
+            auto const bytes_this_pass = std::min(uint64_t{ std::size(buffer) }, span.length - pos);
+            auto n_read = uint64_t{};
+            ok = tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, span.offset + pos, &n_read) && n_read > 0;
+            if (ok)
+            {
+                if (task.v2)
+                {
+                    merkle.add(std::data(buffer), n_read);
+                }
+                else
+                {
+                    sha->add(std::data(buffer), n_read);
+                }
+                pos += n_read;
+            }
+        }
+
+        tr_sys_file_close(fd);
+
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    if (task.v2)
+    {
+        return merkle.finish(task.v2->width) == task.v2->expected;
+    }
+
+    return sha->finish() == task.expected;
+}
+
+void tr_piece_checker::workerThreadFunc()
+{
+    auto buffer = std::vector<uint8_t>(BufferSize);
+
+    for (;;)
+    {
+        auto task = Task{};
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+
+            if (stopping_ || std::empty(todo_) || n_threads_ > max_threads_)
+            {
+                --n_threads_;
+                idle_cv_.notify_all();
+                return;
+            }
+
+            task = std::move(todo_.front());
+            todo_.pop_front();
+            in_progress_.emplace_back(task.tor_id);
+        }
+
+        auto const pass = checkPiece(task, buffer);
+        callCallback(task.tor_id, task.piece, false, pass);
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+            in_progress_.erase(std::find(std::begin(in_progress_), std::end(in_progress_), task.tor_id));
+            idle_cv_.notify_all();
+        }
+    }
+}
+
+// Must be called with mutex_ held.
+void tr_piece_checker::maybeStartThread()
+{
+    if (stopping_ || n_threads_ >= max_threads_ || n_threads_ >= std::size(todo_) + std::size(in_progress_))
+    {
+        return;
+    }
+
+    ++n_threads_;
+    std::thread(&tr_piece_checker::workerThreadFunc, this).detach();
+}
+
+void tr_piece_checker::setThreadCount(size_t n_threads)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    max_threads_ = std::max(n_threads, size_t{ 1U });
+
+    for (size_t i = 0, n = std::size(todo_); i < n; ++i)
+    {
+        maybeStartThread();
+    }
+}
+
+void tr_piece_checker::add(Task&& task)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    todo_.emplace_back(std::move(task));
+    maybeStartThread();
+}
+
+void tr_piece_checker::remove(tr_torrent_id_t tor_id)
+{
+    auto removed = std::vector<Task>{};
+
+    {
+        auto lock = std::unique_lock(mutex_);
+
+        auto const is_match = [tor_id](auto const& task)
+        {
+            return task.tor_id == tor_id;
+        };
+        auto const iter = std::stable_partition(std::begin(todo_), std::end(todo_), std::not_fn(is_match));
+        std::move(iter, std::end(todo_), std::back_inserter(removed));
+        todo_.erase(iter, std::end(todo_));
+
+        idle_cv_.wait(
+            lock,
+            [this, tor_id]()
+            { return std::find(std::begin(in_progress_), std::end(in_progress_), tor_id) == std::end(in_progress_); });
+    }
+
+    for (auto const& task : removed)
+    {
+        callCallback(task.tor_id, task.piece, true, false);
+    }
+}
+
+tr_piece_checker::~tr_piece_checker()
+{
+    auto lock = std::unique_lock(mutex_);
+    stopping_ = true;
+    todo_.clear();
+    idle_cv_.wait(lock, [this]() { return n_threads_ == 0U; });
+}
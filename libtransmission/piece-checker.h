@@ -0,0 +1,105 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "transmission.h" // tr_piece_index_t, tr_sha1_digest_t, tr_sha256_digest_t, tr_torrent_id_t
+
+// Checks pieces' checksums on a pool of background threads
+// so that the session thread doesn't block on disk reads or hashing.
+//
+// Tasks are self-contained: they carry the filenames and offsets of
+// the piece's bytes, so the worker threads never touch a tr_torrent.
+class tr_piece_checker
+{
+public:
+    struct Task
+    {
+        struct Span
+        {
+            std::string filename; // empty if the file doesn't exist
+            uint64_t offset = 0;
+            uint64_t length = 0;
+        };
+
+        // BitTorrent v2 pieces are checked against their file's merkle tree
+        struct V2
+        {
+            tr_sha256_digest_t expected = {};
+            size_t width = 0; // leaves in the piece's subtree
+        };
+
+        tr_torrent_id_t tor_id = {};
+        tr_piece_index_t piece = {};
+        tr_sha1_digest_t expected = {};
+        std::optional<V2> v2;
+        std::vector<Span> spans;
+    };
+
+    // Called from a worker thread when a check is done, or from
+    // the caller's thread if the check was removed before it started.
+    using callback_func = std::function<void(tr_torrent_id_t tor_id, tr_piece_index_t piece, bool aborted, bool pass)>;
+
+    static auto constexpr DefaultThreadCount = size_t{ 2U };
+
+    explicit tr_piece_checker(size_t n_threads = DefaultThreadCount)
+        : max_threads_{ n_threads }
+    {
+    }
+
+    ~tr_piece_checker();
+
+    void addCallback(callback_func callback)
+    {
+        callbacks_.emplace_back(std::move(callback));
+    }
+
+    void setThreadCount(size_t n_threads);
+
+    void add(Task&& task);
+
+    // Abort any queued checks for this torrent and
+    // wait for the ones that are already running to finish.
+    void remove(tr_torrent_id_t tor_id);
+
+private:
+    void callCallback(tr_torrent_id_t tor_id, tr_piece_index_t piece, bool aborted, bool pass) const
+    {
+        for (auto const& callback : callbacks_)
+        {
+            callback(tor_id, piece, aborted, pass);
+        }
+    }
+
+    void maybeStartThread();
+    void workerThreadFunc();
+    [[nodiscard]] static bool checkPiece(Task const& task, std::vector<uint8_t>& buffer);
+
+    std::list<callback_func> callbacks_;
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+
+    std::deque<Task> todo_;
+    std::vector<tr_torrent_id_t> in_progress_;
+
+    size_t max_threads_ = DefaultThreadCount;
+    size_t n_threads_ = 0;
+    bool stopping_ = false;
+};
@@ -18,7 +18,7 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
+auto constexpr MyStatic = std::array<std::string_view, 448>{ ""sv,
                                                              "activeTorrentCount"sv,
                                                              "activity-date"sv,
                                                              "activityDate"sv,
@@ -29,6 +29,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "added6.f"sv,
                                                              "addedDate"sv,
                                                              "address"sv,
+                                                             "allocations"sv,
                                                              "alt-speed-down"sv,
                                                              "alt-speed-enabled"sv,
                                                              "alt-speed-time-begin"sv,
@@ -50,13 +51,21 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "bind-address-ipv4"sv,
                                                              "bind-address-ipv6"sv,
                                                              "bitfield"sv,
+                                                             "block-pool"sv,
+                                                             "block-pool-size-kb"sv,
                                                              "blocklist-date"sv,
                                                              "blocklist-enabled"sv,
                                                              "blocklist-size"sv,
                                                              "blocklist-updates-enabled"sv,
                                                              "blocklist-url"sv,
                                                              "blocks"sv,
+                                                             "blocks-written"sv,
+                                                             "bytes"sv,
+                                                             "bytes-allocated"sv,
+                                                             "bytes-being-written"sv,
+                                                             "bytes-cached"sv,
                                                              "bytesCompleted"sv,
+                                                             "cache"sv,
                                                              "cache-size-mb"sv,
                                                              "clientIsChoked"sv,
                                                              "clientIsInterested"sv,
@@ -66,6 +75,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "compact-view"sv,
                                                              "complete"sv,
                                                              "config-dir"sv,
+                                                             "connections-opened"sv,
                                                              "cookies"sv,
                                                              "corrupt"sv,
                                                              "corruptEver"sv,
@@ -83,7 +93,11 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "destination"sv,
                                                              "details-window-height"sv,
                                                              "details-window-width"sv,
+                                                             "dh-pool"sv,
                                                              "dht-enabled"sv,
+                                                             "discards"sv,
+                                                             "disk-write-bytes"sv,
+                                                             "disk-writes"sv,
                                                              "dnd"sv,
                                                              "done-date"sv,
                                                              "doneDate"sv,
@@ -112,6 +126,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "errorString"sv,
                                                              "eta"sv,
                                                              "etaIdle"sv,
+                                                             "evictions"sv,
                                                              "fields"sv,
                                                              "file-count"sv,
                                                              "fileStats"sv,
@@ -126,6 +141,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "filter-trackers"sv,
                                                              "flagStr"sv,
                                                              "flags"sv,
+                                                             "flush-latency-histogram"sv,
                                                              "format"sv,
                                                              "fromCache"sv,
                                                              "fromDht"sv,
@@ -134,6 +150,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "fromLtep"sv,
                                                              "fromPex"sv,
                                                              "fromTracker"sv,
+                                                             "generated"sv,
                                                              "group"sv,
                                                              "hasAnnounced"sv,
                                                              "hasScraped"sv,
@@ -141,6 +158,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "have"sv,
                                                              "haveUnchecked"sv,
                                                              "haveValid"sv,
+                                                             "hits"sv,
                                                              "honorsSessionLimits"sv,
                                                              "host"sv,
                                                              "id"sv,
@@ -180,6 +198,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "leecherCount"sv,
                                                              "leftUntilDone"sv,
                                                              "length"sv,
+                                                             "limit"sv,
                                                              "location"sv,
                                                              "lpd-enabled"sv,
                                                              "m"sv,
@@ -191,6 +210,8 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "main-window-x"sv,
                                                              "main-window-y"sv,
                                                              "manualAnnounceTime"sv,
+                                                             "max-open-files"sv,
+                                                             "max-packets-per-wakeup"sv,
                                                              "max-peers"sv,
                                                              "maxConnectedPeers"sv,
                                                              "memory-bytes"sv,
@@ -201,6 +222,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "metainfo"sv,
                                                              "method"sv,
                                                              "min_request_interval"sv,
+                                                             "misses"sv,
                                                              "move"sv,
                                                              "msg_type"sv,
                                                              "mtimes"sv,
@@ -210,8 +232,12 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "nextScrapeTime"sv,
                                                              "nodes"sv,
                                                              "nodes6"sv,
+                                                             "open"sv,
                                                              "open-dialog-dir"sv,
+                                                             "open-files"sv,
                                                              "p"sv,
+                                                             "packets-received"sv,
+                                                             "packets-sent"sv,
                                                              "path"sv,
                                                              "path.utf-8"sv,
                                                              "paused"sv,
@@ -239,10 +265,12 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "pex-enabled"sv,
                                                              "piece"sv,
                                                              "piece length"sv,
+                                                             "piece-check-threads"sv,
                                                              "pieceCount"sv,
                                                              "pieceSize"sv,
                                                              "pieces"sv,
                                                              "play-download-complete-sound"sv,
+                                                             "pooled-bytes"sv,
                                                              "port"sv,
                                                              "port-forwarding-enabled"sv,
                                                              "port-is-open"sv,
@@ -271,7 +299,14 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "ratio-limit"sv,
                                                              "ratio-limit-enabled"sv,
                                                              "ratio-mode"sv,
+                                                             "read-ahead-blocks"sv,
+                                                             "read-ahead-blocks-used"sv,
+                                                             "read-ahead-size-kb"sv,
                                                              "read-clipboard"sv,
+                                                             "read-hits"sv,
+                                                             "read-misses"sv,
+                                                             "ready"sv,
+                                                             "receive-calls"sv,
                                                              "recent-download-dir-1"sv,
                                                              "recent-download-dir-2"sv,
                                                              "recent-download-dir-3"sv,
@@ -281,6 +316,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "recent-relocate-dir-3"sv,
                                                              "recent-relocate-dir-4"sv,
                                                              "recheckProgress"sv,
+                                                             "recycled"sv,
                                                              "remote-session-enabled"sv,
                                                              "remote-session-host"sv,
                                                              "remote-session-https"sv,
@@ -291,7 +327,9 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "removed"sv,
                                                              "rename-partial-files"sv,
                                                              "reqq"sv,
+                                                             "requests-served"sv,
                                                              "result"sv,
+                                                             "reuses"sv,
                                                              "rpc-authentication-required"sv,
                                                              "rpc-bind-address"sv,
                                                              "rpc-enabled"sv,
@@ -329,6 +367,9 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "seedRatioMode"sv,
                                                              "seederCount"sv,
                                                              "seeding-time-seconds"sv,
+                                                             "send-calls"sv,
+                                                             "send-errors"sv,
+                                                             "send-would-block"sv,
                                                              "session-count"sv,
                                                              "session-id"sv,
                                                              "sessionCount"sv,
@@ -389,6 +430,7 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "trackers"sv,
                                                              "trash-can-enabled"sv,
                                                              "trash-original-torrent-files"sv,
+                                                             "udp"sv,
                                                              "umask"sv,
                                                              "units"sv,
                                                              "upload-slots-per-torrent"sv,
@@ -412,10 +454,15 @@ auto constexpr MyStatic = std::array<std::string_view, 401>{ ""sv,
                                                              "ut_recommend"sv,
                                                              "utp-enabled"sv,
                                                              "v"sv,
+                                                             "verify-bytes-per-second"sv,
+                                                             "verify-concurrent-torrents"sv,
+                                                             "verify-threads"sv,
                                                              "version"sv,
+                                                             "wakeups"sv,
                                                              "wanted"sv,
                                                              "watch-dir"sv,
                                                              "watch-dir-enabled"sv,
+                                                             "web"sv,
                                                              "webseeds"sv,
                                                              "webseedsSendingToUs"sv,
                                                              "yourip"sv };
@@ -32,6 +32,7 @@ enum
     TR_KEY_added6_f, /* pex */
     TR_KEY_addedDate, /* rpc */
     TR_KEY_address, /* rpc */
+    TR_KEY_allocations,
     TR_KEY_alt_speed_down, /* rpc, settings */
     TR_KEY_alt_speed_enabled, /* rpc, settings */
     TR_KEY_alt_speed_time_begin, /* rpc, settings */
@@ -53,13 +54,21 @@ enum
     TR_KEY_bind_address_ipv4,
     TR_KEY_bind_address_ipv6,
     TR_KEY_bitfield,
+    TR_KEY_block_pool,
+    TR_KEY_block_pool_size_kb,
     TR_KEY_blocklist_date,
     TR_KEY_blocklist_enabled,
     TR_KEY_blocklist_size,
     TR_KEY_blocklist_updates_enabled,
     TR_KEY_blocklist_url,
     TR_KEY_blocks,
+    TR_KEY_blocks_written,
+    TR_KEY_bytes,
+    TR_KEY_bytes_allocated,
+    TR_KEY_bytes_being_written,
+    TR_KEY_bytes_cached,
     TR_KEY_bytesCompleted,
+    TR_KEY_cache,
     TR_KEY_cache_size_mb,
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
@@ -69,6 +78,7 @@ enum
     TR_KEY_compact_view,
     TR_KEY_complete,
     TR_KEY_config_dir,
+    TR_KEY_connections_opened,
     TR_KEY_cookies,
     TR_KEY_corrupt,
     TR_KEY_corruptEver,
@@ -86,7 +96,11 @@ enum
     TR_KEY_destination,
     TR_KEY_details_window_height,
     TR_KEY_details_window_width,
+    TR_KEY_dh_pool,
     TR_KEY_dht_enabled,
+    TR_KEY_discards,
+    TR_KEY_disk_write_bytes,
+    TR_KEY_disk_writes,
     TR_KEY_dnd,
     TR_KEY_done_date,
     TR_KEY_doneDate,
@@ -115,6 +129,7 @@ enum
     TR_KEY_errorString,
     TR_KEY_eta,
     TR_KEY_etaIdle,
+    TR_KEY_evictions,
     TR_KEY_fields,
     TR_KEY_file_count,
     TR_KEY_fileStats,
@@ -129,6 +144,7 @@ enum
     TR_KEY_filter_trackers,
     TR_KEY_flagStr,
     TR_KEY_flags,
+    TR_KEY_flush_latency_histogram,
     TR_KEY_format,
     TR_KEY_fromCache,
     TR_KEY_fromDht,
@@ -137,6 +153,7 @@ enum
     TR_KEY_fromLtep,
     TR_KEY_fromPex,
     TR_KEY_fromTracker,
+    TR_KEY_generated,
     TR_KEY_group,
     TR_KEY_hasAnnounced,
     TR_KEY_hasScraped,
@@ -144,6 +161,7 @@ enum
     TR_KEY_have,
     TR_KEY_haveUnchecked,
     TR_KEY_haveValid,
+    TR_KEY_hits,
     TR_KEY_honorsSessionLimits,
     TR_KEY_host,
     TR_KEY_id,
@@ -183,6 +201,7 @@ enum
     TR_KEY_leecherCount,
     TR_KEY_leftUntilDone,
     TR_KEY_length,
+    TR_KEY_limit,
     TR_KEY_location,
     TR_KEY_lpd_enabled,
     TR_KEY_m,
@@ -194,6 +213,8 @@ enum
     TR_KEY_main_window_x,
     TR_KEY_main_window_y,
     TR_KEY_manualAnnounceTime,
+    TR_KEY_max_open_files,
+    TR_KEY_max_packets_per_wakeup,
     TR_KEY_max_peers,
     TR_KEY_maxConnectedPeers,
     TR_KEY_memory_bytes,
@@ -204,6 +225,7 @@ enum
     TR_KEY_metainfo,
     TR_KEY_method,
     TR_KEY_min_request_interval,
+    TR_KEY_misses,
     TR_KEY_move,
     TR_KEY_msg_type,
     TR_KEY_mtimes,
@@ -213,8 +235,12 @@ enum
     TR_KEY_nextScrapeTime,
     TR_KEY_nodes,
     TR_KEY_nodes6,
+    TR_KEY_open,
     TR_KEY_open_dialog_dir,
+    TR_KEY_open_files,
     TR_KEY_p,
+    TR_KEY_packets_received,
+    TR_KEY_packets_sent,
     TR_KEY_path,
     TR_KEY_path_utf_8,
     TR_KEY_paused,
@@ -242,10 +268,12 @@ enum
     TR_KEY_pex_enabled,
     TR_KEY_piece,
     TR_KEY_piece_length,
+    TR_KEY_piece_check_threads,
     TR_KEY_pieceCount,
     TR_KEY_pieceSize,
     TR_KEY_pieces,
     TR_KEY_play_download_complete_sound,
+    TR_KEY_pooled_bytes,
     TR_KEY_port,
     TR_KEY_port_forwarding_enabled,
     TR_KEY_port_is_open,
@@ -274,7 +302,14 @@ enum
     TR_KEY_ratio_limit,
     TR_KEY_ratio_limit_enabled,
     TR_KEY_ratio_mode,
+    TR_KEY_read_ahead_blocks,
+    TR_KEY_read_ahead_blocks_used,
+    TR_KEY_read_ahead_size_kb,
     TR_KEY_read_clipboard,
+    TR_KEY_read_hits,
+    TR_KEY_read_misses,
+    TR_KEY_ready,
+    TR_KEY_receive_calls,
     TR_KEY_recent_download_dir_1,
     TR_KEY_recent_download_dir_2,
     TR_KEY_recent_download_dir_3,
@@ -284,6 +319,7 @@ enum
     TR_KEY_recent_relocate_dir_3,
     TR_KEY_recent_relocate_dir_4,
     TR_KEY_recheckProgress,
+    TR_KEY_recycled,
     TR_KEY_remote_session_enabled,
     TR_KEY_remote_session_host,
     TR_KEY_remote_session_https,
@@ -294,7 +330,9 @@ enum
     TR_KEY_removed,
     TR_KEY_rename_partial_files,
     TR_KEY_reqq,
+    TR_KEY_requests_served,
     TR_KEY_result,
+    TR_KEY_reuses,
     TR_KEY_rpc_authentication_required,
     TR_KEY_rpc_bind_address,
     TR_KEY_rpc_enabled,
@@ -332,6 +370,9 @@ enum
     TR_KEY_seedRatioMode,
     TR_KEY_seederCount,
     TR_KEY_seeding_time_seconds,
+    TR_KEY_send_calls,
+    TR_KEY_send_errors,
+    TR_KEY_send_would_block,
     TR_KEY_session_count,
     TR_KEY_session_id,
     TR_KEY_sessionCount,
@@ -392,6 +433,7 @@ enum
     TR_KEY_trackers,
     TR_KEY_trash_can_enabled,
     TR_KEY_trash_original_torrent_files,
+    TR_KEY_udp,
     TR_KEY_umask,
     TR_KEY_units,
     TR_KEY_upload_slots_per_torrent,
@@ -415,10 +457,15 @@ enum
     TR_KEY_ut_recommend,
     TR_KEY_utp_enabled,
     TR_KEY_v,
+    TR_KEY_verify_bytes_per_second,
+    TR_KEY_verify_concurrent_torrents,
+    TR_KEY_verify_threads,
     TR_KEY_version,
+    TR_KEY_wakeups,
     TR_KEY_wanted,
     TR_KEY_watch_dir,
     TR_KEY_watch_dir_enabled,
+    TR_KEY_web,
     TR_KEY_webseeds,
     TR_KEY_webseedsSendingToUs,
     TR_KEY_yourip,
@@ -22,6 +22,7 @@
 #include "transmission.h"
 
 #include "announcer.h"
+#include "cache.h"
 #include "completion.h"
 #include "crypto-utils.h"
 #include "error.h"
@@ -47,9 +48,9 @@ using namespace std::literals;
 namespace
 {
 auto constexpr RecentlyActiveSeconds = time_t{ 60 };
-auto constexpr RpcVersion = int64_t{ 17 };
+auto constexpr RpcVersion = int64_t{ 18 };
 auto constexpr RpcVersionMin = int64_t{ 14 };
-auto constexpr RpcVersionSemver = "5.3.0"sv;
+auto constexpr RpcVersionSemver = "5.4.0"sv;
 
 enum class TrFormat
 {
@@ -2091,6 +2092,76 @@ char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_varian
     tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
     tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
 
+    auto const open_files = session->openFiles().stats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_open_files, 5);
+    tr_variantDictAddInt(d, TR_KEY_open, open_files.open);
+    tr_variantDictAddInt(d, TR_KEY_limit, open_files.limit);
+    tr_variantDictAddInt(d, TR_KEY_hits, open_files.hits);
+    tr_variantDictAddInt(d, TR_KEY_misses, open_files.misses);
+    tr_variantDictAddInt(d, TR_KEY_evictions, open_files.evictions);
+
+    auto const& cache = *session->cache;
+    auto const cache_stats = cache.stats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_cache, 13);
+    tr_variantDictAddInt(d, TR_KEY_limit, cache.getLimit());
+    tr_variantDictAddInt(d, TR_KEY_bytes_allocated, cache_stats.bytes_allocated);
+    tr_variantDictAddInt(d, TR_KEY_bytes_cached, cache_stats.bytes_cached);
+    tr_variantDictAddInt(d, TR_KEY_bytes_being_written, cache_stats.bytes_being_written);
+    tr_variantDictAddInt(d, TR_KEY_read_hits, cache_stats.read_hits);
+    tr_variantDictAddInt(d, TR_KEY_read_misses, cache_stats.read_misses);
+    tr_variantDictAddInt(d, TR_KEY_read_ahead_blocks, cache_stats.read_ahead_blocks);
+    tr_variantDictAddInt(d, TR_KEY_read_ahead_blocks_used, cache_stats.read_ahead_blocks_used);
+    tr_variantDictAddInt(d, TR_KEY_blocks_written, cache_stats.blocks_written);
+    tr_variantDictAddInt(d, TR_KEY_disk_writes, cache_stats.disk_writes);
+    tr_variantDictAddInt(d, TR_KEY_disk_write_bytes, cache_stats.disk_write_bytes);
+
+    auto* const histogram = tr_variantDictAddList(d, TR_KEY_flush_latency_histogram, std::size(cache_stats.flush_latency_histogram));
+    for (auto const n : cache_stats.flush_latency_histogram)
+    {
+        tr_variantListAddInt(histogram, n);
+    }
+
+    auto const bytes_per_torrent = cache.bytesPerTorrent();
+    auto* const torrents_list = tr_variantDictAddList(d, TR_KEY_torrents, std::size(bytes_per_torrent));
+    for (auto const& [tor_id, bytes] : bytes_per_torrent)
+    {
+        auto* const entry = tr_variantListAddDict(torrents_list, 2);
+        tr_variantDictAddInt(entry, TR_KEY_id, tor_id);
+        tr_variantDictAddInt(entry, TR_KEY_bytes, bytes);
+    }
+
+    auto const block_pool = session->blockPool().stats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_block_pool, 5);
+    tr_variantDictAddInt(d, TR_KEY_pooled_bytes, block_pool.pooled_bytes);
+    tr_variantDictAddInt(d, TR_KEY_limit, block_pool.limit);
+    tr_variantDictAddInt(d, TR_KEY_allocations, block_pool.allocations);
+    tr_variantDictAddInt(d, TR_KEY_reuses, block_pool.reuses);
+    tr_variantDictAddInt(d, TR_KEY_discards, block_pool.discards);
+
+    auto const dh_pool = session->dhPoolStats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_dh_pool, 5);
+    tr_variantDictAddInt(d, TR_KEY_ready, dh_pool.ready);
+    tr_variantDictAddInt(d, TR_KEY_hits, dh_pool.hits);
+    tr_variantDictAddInt(d, TR_KEY_misses, dh_pool.misses);
+    tr_variantDictAddInt(d, TR_KEY_generated, dh_pool.generated);
+    tr_variantDictAddInt(d, TR_KEY_recycled, dh_pool.recycled);
+
+    auto const udp_stats = session->udpStats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_udp, 8);
+    tr_variantDictAddInt(d, TR_KEY_wakeups, udp_stats.wakeups);
+    tr_variantDictAddInt(d, TR_KEY_packets_received, udp_stats.packets_received);
+    tr_variantDictAddInt(d, TR_KEY_receive_calls, udp_stats.receive_calls);
+    tr_variantDictAddInt(d, TR_KEY_max_packets_per_wakeup, udp_stats.max_packets_per_wakeup);
+    tr_variantDictAddInt(d, TR_KEY_packets_sent, udp_stats.packets_sent);
+    tr_variantDictAddInt(d, TR_KEY_send_calls, udp_stats.send_calls);
+    tr_variantDictAddInt(d, TR_KEY_send_would_block, udp_stats.send_would_block);
+    tr_variantDictAddInt(d, TR_KEY_send_errors, udp_stats.send_errors);
+
+    auto const web_stats = session->webStats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_web, 2);
+    tr_variantDictAddInt(d, TR_KEY_requests_served, web_stats.requests_served);
+    tr_variantDictAddInt(d, TR_KEY_connections_opened, web_stats.connections_opened);
+
     return nullptr;
 }
 
@@ -21,6 +21,7 @@ struct tr_variant;
     V(TR_KEY_announce_ip_enabled, announce_ip_enabled, bool, false, "") \
     V(TR_KEY_bind_address_ipv4, bind_address_ipv4, std::string, "0.0.0.0", "") \
     V(TR_KEY_bind_address_ipv6, bind_address_ipv6, std::string, "::", "") \
+    V(TR_KEY_block_pool_size_kb, block_pool_size_kb, size_t, 4096U, "") \
     V(TR_KEY_blocklist_enabled, blocklist_enabled, bool, false, "") \
     V(TR_KEY_blocklist_url, blocklist_url, std::string, "http://www.example.com/blocklist", "") \
     V(TR_KEY_cache_size_mb, cache_size_mb, size_t, 4U, "") \
@@ -35,6 +36,7 @@ struct tr_variant;
     V(TR_KEY_incomplete_dir, incomplete_dir, std::string, tr_getDefaultDownloadDir(), "") \
     V(TR_KEY_incomplete_dir_enabled, incomplete_dir_enabled, bool, false, "") \
     V(TR_KEY_lpd_enabled, lpd_enabled, bool, true, "") \
+    V(TR_KEY_max_open_files, max_open_files, size_t, 0U, "") \
     V(TR_KEY_message_level, log_level, tr_log_level, TR_LOG_INFO, "") \
     V(TR_KEY_peer_congestion_algorithm, peer_congestion_algorithm, std::string, "", "") \
     V(TR_KEY_peer_limit_global, peer_limit_global, size_t, TR_DEFAULT_PEER_LIMIT_GLOBAL, "") \
@@ -45,6 +47,7 @@ struct tr_variant;
     V(TR_KEY_peer_port_random_on_start, peer_port_random_on_start, bool, false, "") \
     V(TR_KEY_peer_socket_tos, peer_socket_tos, tr_tos_t, 0x04, "") \
     V(TR_KEY_pex_enabled, pex_enabled, bool, true, "") \
+    V(TR_KEY_piece_check_threads, piece_check_threads, size_t, 2U, "") \
     V(TR_KEY_port_forwarding_enabled, port_forwarding_enabled, bool, true, "") \
     V(TR_KEY_preallocation, preallocation_mode, tr_preallocation_mode, TR_PREALLOCATE_SPARSE, "") \
     V(TR_KEY_prefetch_enabled, is_prefetch_enabled, bool, true, "") \
@@ -52,6 +55,7 @@ struct tr_variant;
     V(TR_KEY_queue_stalled_minutes, queue_stalled_minutes, size_t, 30U, "") \
     V(TR_KEY_ratio_limit, ratio_limit, double, 2.0, "") \
     V(TR_KEY_ratio_limit_enabled, ratio_limit_enabled, bool, false, "") \
+    V(TR_KEY_read_ahead_size_kb, read_ahead_size_kb, size_t, 0U, "") \
     V(TR_KEY_rename_partial_files, is_incomplete_file_naming_enabled, bool, false, "") \
     V(TR_KEY_scrape_paused_torrents_enabled, should_scrape_paused_torrents, bool, true, "") \
     V(TR_KEY_script_torrent_added_enabled, script_torrent_added_enabled, bool, false, "") \
@@ -72,7 +76,10 @@ struct tr_variant;
     V(TR_KEY_umask, umask, tr_mode_t, 022, "") \
     V(TR_KEY_upload_slots_per_torrent, upload_slots_per_torrent, size_t, 8U, "") \
     V(TR_KEY_utp_enabled, utp_enabled, bool, true, "") \
-    V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "")
+    V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "") \
+    V(TR_KEY_verify_bytes_per_second, verify_bytes_per_second, size_t, 0U, "") \
+    V(TR_KEY_verify_concurrent_torrents, verify_concurrent_torrents, size_t, 1U, "") \
+    V(TR_KEY_verify_threads, verify_threads, size_t, 1U, "")
 
 struct tr_session_settings
 {
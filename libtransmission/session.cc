@@ -46,6 +46,7 @@
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
+#include "piece-checker.h"
 #include "port-forwarding.h"
 #include "rpc-server.h"
 #include "session-id.h"
@@ -701,16 +702,52 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
         tr_sessionSetCacheLimit_MB(this, val);
     }
 
+    if (force || new_settings.max_open_files != old_settings.max_open_files ||
+        new_settings.peer_limit_global != old_settings.peer_limit_global)
+    {
+        updateMaxOpenFiles();
+    }
+
+    if (auto const& val = new_settings.block_pool_size_kb; force || val != old_settings.block_pool_size_kb)
+    {
+        block_pool_->setMaxPooledBytes(val * 1024U);
+    }
+
+    if (auto const& val = new_settings.read_ahead_size_kb; force || val != old_settings.read_ahead_size_kb)
+    {
+        cache->setReadAheadBytes(val * 1024U);
+    }
+
     if (auto const& val = new_settings.default_trackers_str; force || val != old_settings.default_trackers_str)
     {
         setDefaultTrackers(val);
     }
 
+    if (auto const& val = new_settings.piece_check_threads; force || val != old_settings.piece_check_threads)
+    {
+        piece_checker_->setThreadCount(val);
+    }
+
     if (auto const& val = new_settings.utp_enabled; force || val != old_settings.utp_enabled)
     {
         tr_sessionSetUTPEnabled(this, val);
     }
 
+    if (auto const& val = new_settings.verify_threads; force || val != old_settings.verify_threads)
+    {
+        verifier_->setThreadsPerTorrent(val);
+    }
+
+    if (auto const& val = new_settings.verify_concurrent_torrents; force || val != old_settings.verify_concurrent_torrents)
+    {
+        verifier_->setMaxConcurrentTorrents(val);
+    }
+
+    if (auto const& val = new_settings.verify_bytes_per_second; force || val != old_settings.verify_bytes_per_second)
+    {
+        verifier_->setBytesPerSecondLimit(val);
+    }
+
     useBlocklist(new_settings.blocklist_enabled);
 
     auto local_peer_port = force && settings_.peer_port_random_on_start ? randomPort() : new_settings.peer_port;
@@ -1184,11 +1221,18 @@ void tr_sessionSetAltSpeedFunc(tr_session* session, tr_altSpeedFunc func, void*
 
 // ---
 
+void tr_session::updateMaxOpenFiles()
+{
+    auto const n = settings_.max_open_files;
+    open_files_.setMaxOpenFiles(n != 0U ? n : tr_open_files::autoMaxOpenFiles(settings_.peer_limit_global));
+}
+
 void tr_sessionSetPeerLimit(tr_session* session, uint16_t max_global_peers)
 {
     TR_ASSERT(session != nullptr);
 
     session->settings_.peer_limit_global = max_global_peers;
+    session->updateMaxOpenFiles();
 }
 
 uint16_t tr_sessionGetPeerLimit(tr_session const* session)
@@ -1250,6 +1294,7 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
     // close the low-hanging fruit that can be closed immediately w/o consequences
     utp_timer.reset();
     verifier_.reset();
+    piece_checker_.reset();
     save_timer_.reset();
     now_timer_.reset();
     rpc_server_.reset();
@@ -2060,6 +2105,11 @@ size_t tr_session::countQueueFreeSlots(tr_direction dir) const noexcept
 
 void tr_session::closeTorrentFiles(tr_torrent* tor) noexcept
 {
+    if (piece_checker_)
+    {
+        piece_checker_->remove(tor->id());
+    }
+
     this->cache->flushTorrent(tor);
     openFiles().closeTorrent(tor->id());
 }
@@ -2178,6 +2228,20 @@ tr_session::tr_session(std::string_view config_dir, tr_variant* settings_dict)
     save_timer_->startRepeating(SaveIntervalSecs);
 
     verifier_->addCallback(tr_torrentOnVerifyDone);
+    piece_checker_->addCallback([this](tr_torrent_id_t tor_id, tr_piece_index_t piece, bool aborted, bool pass)
+                                { tr_torrentOnPieceChecked(this, tor_id, piece, aborted, pass); });
+    cache->enableWriteBehind(
+        [this](uint64_t task_id, tr_torrent_id_t tor_id, int err, std::string const& errmsg)
+        {
+            runInSessionThread(
+                [this, task_id, tor_id, err, errmsg]()
+                {
+                    if (cache)
+                    {
+                        cache->onWriteDone(task_id, tor_id, err, errmsg);
+                    }
+                });
+        });
 }
 
 void tr_session::addIncoming(tr_peer_socket&& socket)
@@ -2191,3 +2255,8 @@ void tr_session::addTorrent(tr_torrent* tor)
 
     tr_peerMgrAddTorrent(peer_mgr_.get(), tor);
 }
+
+tr_message_stream_encryption::DHPool::Stats tr_session::dhPoolStats() const
+{
+    return peer_mgr_ ? tr_peerMgrDHPoolStats(peer_mgr_.get()) : tr_message_stream_encryption::DHPool::Stats{};
+}
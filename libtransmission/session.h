@@ -32,10 +32,13 @@
 #include "announcer.h"
 #include "bandwidth.h"
 #include "bitfield.h"
+#include "block-pool.h"
 #include "cache.h"
 #include "interned-string.h"
 #include "net.h" // tr_socket_t
 #include "open-files.h"
+#include "peer-mse.h" // tr_message_stream_encryption::DHPool
+#include "piece-checker.h"
 #include "port-forwarding.h"
 #include "quark.h"
 #include "session-alt-speeds.h"
@@ -75,6 +78,7 @@ namespace libtransmission::test
 {
 
 class SessionTest;
+class UdpTest;
 
 } // namespace libtransmission::test
 
@@ -278,10 +282,37 @@ private:
     class tr_udp_core
     {
     public:
+        struct Stats
+        {
+            uint64_t wakeups = 0; // times a socket was readable
+            uint64_t packets_received = 0;
+            uint64_t receive_calls = 0; // recvmmsg() or recvfrom() calls
+            uint64_t max_packets_per_wakeup = 0;
+            uint64_t packets_sent = 0;
+            uint64_t send_calls = 0; // sendmmsg() or sendto() calls
+            uint64_t send_would_block = 0; // packets dropped because the send buffer stayed full
+            uint64_t send_errors = 0; // packets dropped for any other reason
+        };
+
+        // how many datagrams to read, or to queue for sending, at once
+        static auto constexpr MaxBatchSize = size_t{ 32U };
+
         tr_udp_core(tr_session& session, tr_port udp_port);
         ~tr_udp_core();
 
-        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen) const;
+        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
+
+        // Like sendto(), but the packet is queued and sent along with
+        // any others queued in the same event loop iteration.
+        void sendtoBatched(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
+
+        // Send any queued packets now.
+        void flush();
+
+        [[nodiscard]] constexpr auto const& stats() const noexcept
+        {
+            return stats_;
+        }
 
         [[nodiscard]] constexpr auto socket4() const noexcept
         {
@@ -294,12 +325,55 @@ private:
         }
 
     private:
+        friend class libtransmission::test::UdpTest;
+
+        struct Received
+        {
+            std::array<unsigned char, 8192> buf = {};
+            size_t length = 0;
+            sockaddr_storage from = {};
+            socklen_t fromlen = 0;
+        };
+
+        struct QueuedPacket
+        {
+            size_t offset = 0; // in send_queue_bytes_
+            size_t length = 0;
+            sockaddr_storage to = {};
+            socklen_t tolen = 0;
+            bool retried = false; // already put back once because the socket would block
+        };
+
+        static void onReadable(evutil_socket_t sock, short type, void* vself);
+        static void onFlush(evutil_socket_t sock, short type, void* vself);
+
+        // @return how many datagrams were read into recv_bufs_
+        [[nodiscard]] size_t receive(tr_socket_t sock);
+        void dispatch(unsigned char* buf, size_t buflen, sockaddr* from, socklen_t fromlen);
+
+        [[nodiscard]] tr_socket_t socketFor(sockaddr const* to) const noexcept;
+
+        // @return how many of the packets were sent or dropped; the rest would block
+        [[nodiscard]] size_t flush(tr_socket_t sock, QueuedPacket const* packets, size_t n_packets);
+
+        // @return true if the error just means that the send buffer is full
+        bool onSendError(sockaddr const* to, int error_code);
+
         tr_port const udp_port_;
         tr_session& session_;
         tr_socket_t udp4_socket_ = TR_BAD_SOCKET;
         tr_socket_t udp6_socket_ = TR_BAD_SOCKET;
         libtransmission::evhelpers::event_unique_ptr udp4_event_;
         libtransmission::evhelpers::event_unique_ptr udp6_event_;
+        libtransmission::evhelpers::event_unique_ptr flush_event_;
+
+        // the datagrams read by the last receive() call
+        std::vector<Received> recv_bufs_ = std::vector<Received>(MaxBatchSize);
+
+        std::vector<unsigned char> send_queue_bytes_;
+        std::vector<QueuedPacket> send_queue_;
+
+        Stats stats_;
     };
 
 public:
@@ -507,6 +581,25 @@ public:
         return open_files_;
     }
 
+    [[nodiscard]] auto webStats() const
+    {
+        return web_ ? web_->stats() : tr_web::Stats{};
+    }
+
+    // buffers for blocks that are being downloaded
+    [[nodiscard]] auto& blockPool() noexcept
+    {
+        return *block_pool_;
+    }
+
+    [[nodiscard]] auto udpStats() const noexcept
+    {
+        return udp_core_ ? udp_core_->stats() : tr_udp_core::Stats{};
+    }
+
+    // keypairs made ahead of time for encrypted handshakes
+    [[nodiscard]] tr_message_stream_encryption::DHPool::Stats dhPoolStats() const;
+
     void closeTorrentFiles(tr_torrent* tor) noexcept;
     void closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept;
 
@@ -838,6 +931,14 @@ public:
         }
     }
 
+    void checkPieceInBackground(tr_piece_checker::Task&& task)
+    {
+        if (piece_checker_)
+        {
+            piece_checker_->add(std::move(task));
+        }
+    }
+
     void fetch(tr_web::FetchOptions&& options) const
     {
         if (web_)
@@ -898,6 +999,10 @@ private:
 
     void onAdvertisedPeerPortChanged();
 
+    // Size the open-file pool from `max-open-files`, or from
+    // the file descriptor limit if that's set to automatic.
+    void updateMaxOpenFiles();
+
     struct init_data;
     void initImpl(init_data&);
     void setSettings(tr_variant* settings_dict, bool force);
@@ -911,6 +1016,7 @@ private:
     static void onIncomingPeerConnection(tr_socket_t fd, void* vsession);
 
     friend class libtransmission::test::SessionTest;
+    friend class libtransmission::test::UdpTest;
     friend struct tr_bindinfo;
 
     friend bool tr_blocklistExists(tr_session const* session);
@@ -1062,6 +1168,8 @@ private:
 
     tr_open_files open_files_;
 
+    std::shared_ptr<tr_block_pool> block_pool_ = tr_block_pool::create();
+
     std::vector<libtransmission::Blocklist> blocklists_;
 
     /// other fields
@@ -1146,6 +1254,8 @@ private:
 
     std::unique_ptr<tr_verify_worker> verifier_ = std::make_unique<tr_verify_worker>();
 
+    std::unique_ptr<tr_piece_checker> piece_checker_ = std::make_unique<tr_piece_checker>();
+
 public:
     std::unique_ptr<libtransmission::Timer> utp_timer;
 };
@@ -21,6 +21,7 @@
 #include "error.h"
 #include "file.h"
 #include "log.h"
+#include "merkle.h"
 #include "quark.h"
 #include "torrent-metainfo.h"
 #include "tr-assert.h"
@@ -76,6 +77,19 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
     tr_pathbuf file_subpath_;
     std::string_view pieces_root_;
     int64_t file_length_ = 0;
+    bool file_is_pad_ = false;
+
+    // bittorrent v2
+    struct V2File
+    {
+        std::string subpath;
+        uint64_t size = 0;
+        std::string_view pieces_root;
+    };
+    std::vector<size_t> file_tree_subpath_lengths_;
+    std::vector<V2File> v2_files_;
+    std::vector<bool> v1_file_is_pad_;
+    std::vector<std::pair<std::string_view, std::string_view>> piece_layers_;
 
     enum class State
     {
@@ -101,11 +115,16 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
     {
         if (state_ == State::FileTree)
         {
-            if (!std::empty(file_subpath_))
+            // the "" key holds a file's properties; other keys are path components
+            file_tree_subpath_lengths_.emplace_back(std::size(file_subpath_));
+            if (auto const component = currentKey(); !std::empty(component))
             {
-                file_subpath_ += '/';
+                if (!std::empty(file_subpath_))
+                {
+                    file_subpath_ += '/';
+                }
+                tr_torrent_files::makeSubpathPortable(component, file_subpath_);
             }
-            tr_torrent_files::makeSubpathPortable(currentKey(), file_subpath_);
         }
         else if (pathIs(InfoKey))
         {
@@ -116,7 +135,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         {
             state_ = State::FileTree;
             file_subpath_.clear();
+            file_tree_subpath_lengths_.clear();
             file_length_ = 0;
+            pieces_root_ = {};
         }
         else if (pathIs(PieceLayersKey))
         {
@@ -142,9 +163,19 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
 
         if (state_ == State::FileTree) // bittorrent v2 format
         {
-            // v2, ignore for today
-            tr_logAddInfo("'file tree' is ignored");
-            state_ = State::UsePath;
+            if (pathIs(InfoKey, FileTreeKey))
+            {
+                state_ = State::UsePath;
+                return true;
+            }
+
+            if (std::empty(currentKey()))
+            {
+                addV2File();
+            }
+
+            file_subpath_.resize(file_tree_subpath_lengths_.back());
+            file_tree_subpath_lengths_.pop_back();
         }
         else if (state_ == State::Files) // bittorrent v1 format
         {
@@ -239,8 +270,6 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         }
         else if (pathIs(InfoKey, MetaVersionKey))
         {
-            // currently unused. TODO support for bittorrent v2
-            // TODO https://github.com/transmission/transmission/issues/458
             tm_.is_v2_ = value == 2;
         }
         else if (
@@ -286,10 +315,13 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         }
         else if (state_ == State::FileTree)
         {
-            if (current_key == AttrKey || current_key == PiecesRootKey)
+            if (current_key == PiecesRootKey)
+            {
+                pieces_root_ = value;
+            }
+            else if (current_key == AttrKey)
             {
-                // currently unused. TODO support for bittorrent v2
-                // TODO https://github.com/transmission/transmission/issues/458
+                // unused by Transmission
             }
             else
             {
@@ -308,8 +340,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
             }
             else if (current_key == AttrKey)
             {
-                // currently unused. TODO support for bittorrent v2
-                // TODO https://github.com/transmission/transmission/issues/458
+                // http://bittorrent.org/beps/bep_0047.html
+                // "p" marks the padding files that align hybrid torrents' files to pieces
+                file_is_pad_ = tr_strvContains(value, 'p');
             }
             else if (
                 pathIs(InfoKey, FilesKey, ""sv, Crc32Key) || //
@@ -377,10 +410,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
                 unhandled = true;
             }
         }
-        else if (pathStartsWith(PieceLayersKey))
+        else if (curdepth == 2 && key(1) == PieceLayersKey)
         {
-            // currently unused. TODO support for bittorrent v2
-            // TODO https://github.com/transmission/transmission/issues/458
+            piece_layers_.emplace_back(current_key, value);
         }
         else if (pathStartsWith(AnnounceListKey))
         {
@@ -468,11 +500,10 @@ private:
 
         if (file_length_ == 0)
         {
+            file_is_pad_ = false;
             return ok;
         }
 
-        // FIXME: Check to see if we already added this file. This is a safeguard
-        // for hybrid torrents with duplicate info between "file tree" and "files"
         if (std::empty(file_subpath_))
         {
             tr_error_set(context.error, EINVAL, fmt::format("invalid path [{:s}]", file_subpath_));
@@ -481,15 +512,56 @@ private:
         else
         {
             tm_.files_.add(file_subpath_, file_length_);
+            v1_file_is_pad_.emplace_back(file_is_pad_);
         }
 
         file_length_ = 0;
+        file_is_pad_ = false;
         pieces_root_ = {};
         // NB: let caller decide how to clear file_tree_.
         // if we're in "files" mode we clear it; if in "file tree" we pop it
         return ok;
     }
 
+    void addV2File()
+    {
+        // like v1 files, empty files are skipped
+        if (file_length_ > 0)
+        {
+            v2_files_.push_back({ std::string{ file_subpath_.sv() }, static_cast<uint64_t>(file_length_), pieces_root_ });
+        }
+
+        file_length_ = 0;
+        pieces_root_ = {};
+    }
+
+    // v2-only torrents have no v1 file list, so build one from the file tree.
+    // In v2, each file starts on a piece boundary; insert BEP 47 padding files
+    // between them so that the usual piece layout lines up with them.
+    void addFilesFromFileTree()
+    {
+        if (std::size(v2_files_) == 1U && !tr_strvContains(v2_files_.front().subpath, '/'))
+        {
+            // single-file torrent: same as a v1 torrent's "length"
+            length_ = v2_files_.front().size;
+            return;
+        }
+
+        for (size_t i = 0, n = std::size(v2_files_); i < n; ++i)
+        {
+            auto const& file = v2_files_[i];
+            tm_.files_.add(file.subpath, file.size);
+            v1_file_is_pad_.emplace_back(false);
+
+            if (auto const remainder = file.size % piece_size_; i + 1U < n && piece_size_ > 0 && remainder != 0U)
+            {
+                auto const pad_size = piece_size_ - remainder;
+                tm_.files_.add(fmt::format(".pad/{:d}", pad_size), pad_size);
+                v1_file_is_pad_.emplace_back(true);
+            }
+        }
+    }
+
     bool finishInfoDict(Context const& context)
     {
         if (std::empty(info_dict_begin_))
@@ -498,6 +570,11 @@ private:
             return false;
         }
 
+        if (std::empty(tm_.files_) && length_ == 0 && std::empty(tm_.pieces_))
+        {
+            addFilesFromFileTree();
+        }
+
         auto root = tr_pathbuf{};
         tr_torrent_files::makeSubpathPortable(tm_.name_, root);
         if (!std::empty(root))
@@ -514,6 +591,12 @@ private:
         auto const hash2 = tr_sha256::digest(info_dict_benc);
 
         tm_.info_hash_ = hash;
+        if (std::empty(tm_.pieces_) && tm_.is_v2_)
+        {
+            // BEP 52: v2-only torrents use their truncated v2 info hash
+            // wherever a 20-byte info hash is expected
+            std::copy_n(std::data(hash2), std::size(tm_.info_hash_), std::data(tm_.info_hash_));
+        }
         tm_.info_hash_str_ = tr_sha1_to_string(tm_.info_hash_);
         tm_.info_hash2_ = hash2;
         tm_.info_hash2_str_ = tr_sha256_to_string(tm_.info_hash2_);
@@ -557,6 +640,11 @@ private:
                 return false;
             }
 
+            if (!finishV2(context))
+            {
+                return false;
+            }
+
             tm_.block_info_.initSizes(tm_.files_.totalSize(), piece_size_);
             return true;
         }
@@ -566,6 +654,119 @@ private:
         return ok;
     }
 
+    // Match the file tree's files to the torrent's files and check their piece layers.
+    // Hybrid torrents can fall back to their v1 metadata if this fails; v2-only torrents can't.
+    bool finishV2(Context const& context)
+    {
+        if (std::empty(v2_files_))
+        {
+            return true;
+        }
+
+        auto const is_v2_only = std::empty(tm_.pieces_);
+        auto const fail = [this, &context, is_v2_only](std::string_view message)
+        {
+            tm_.v2_files_.clear();
+
+            if (is_v2_only)
+            {
+                tr_error_set(context.error, EINVAL, message);
+                return false;
+            }
+
+            tr_logAddWarn(fmt::format("ignoring v2 metadata: {:s}", message), tm_.name_);
+            return true;
+        };
+
+        auto const piece_size = static_cast<uint64_t>(piece_size_);
+        if (piece_size < tr_merkle::BlockSize || (piece_size & (piece_size - 1U)) != 0U)
+        {
+            return fail(fmt::format("invalid piece size: {}", piece_size));
+        }
+
+        auto v2_file = std::begin(v2_files_);
+        auto offset = uint64_t{ 0U };
+        for (tr_file_index_t i = 0, n = tm_.fileCount(); i < n; offset += tm_.fileSize(i), ++i)
+        {
+            if (i < std::size(v1_file_is_pad_) && v1_file_is_pad_[i])
+            {
+                continue;
+            }
+
+            if (v2_file == std::end(v2_files_) || v2_file->size != tm_.fileSize(i))
+            {
+                return fail("'files' and 'file tree' don't match"sv);
+            }
+
+            if (offset % piece_size != 0U)
+            {
+                return fail(fmt::format("file '{:s}' doesn't start on a piece boundary", v2_file->subpath));
+            }
+
+            if (std::size(v2_file->pieces_root) != sizeof(tr_sha256_digest_t))
+            {
+                return fail(fmt::format("file '{:s}' has no 'pieces root'", v2_file->subpath));
+            }
+
+            auto& file = tm_.v2_files_.emplace_back();
+            file.file = i;
+            file.first_piece = static_cast<tr_piece_index_t>(offset / piece_size);
+            std::copy_n(std::data(v2_file->pieces_root), sizeof(file.root), reinterpret_cast<char*>(std::data(file.root)));
+
+            if (v2_file->size > piece_size)
+            {
+                if (!addPieceLayer(file, v2_file->size) && is_v2_only)
+                {
+                    return fail(fmt::format("file '{:s}' has a missing or invalid piece layer", v2_file->subpath));
+                }
+            }
+
+            ++v2_file;
+        }
+
+        if (v2_file != std::end(v2_files_))
+        {
+            return fail("'files' and 'file tree' don't match"sv);
+        }
+
+        return true;
+    }
+
+    bool addPieceLayer(tr_torrent_metainfo::V2File& file, uint64_t file_size) const
+    {
+        auto const root_sv = std::string_view{ reinterpret_cast<char const*>(std::data(file.root)), std::size(file.root) };
+        auto const iter = std::find_if(
+            std::begin(piece_layers_),
+            std::end(piece_layers_),
+            [&root_sv](auto const& layer) { return layer.first == root_sv; });
+        if (iter == std::end(piece_layers_))
+        {
+            return false;
+        }
+
+        auto const piece_size = static_cast<uint64_t>(piece_size_);
+        auto const n_pieces = (file_size + piece_size - 1U) / piece_size;
+        auto const& layer_sv = iter->second;
+        if (std::size(layer_sv) != n_pieces * sizeof(tr_sha256_digest_t))
+        {
+            return false;
+        }
+
+        auto layer = std::vector<tr_sha256_digest_t>(n_pieces);
+        std::copy_n(std::data(layer_sv), std::size(layer_sv), reinterpret_cast<char*>(std::data(layer)));
+
+        auto const blocks_per_piece = piece_size / tr_merkle::BlockSize;
+        auto const width = tr_merkle::ceilPow2(tr_merkle::leafCount(file_size)) / blocks_per_piece;
+        auto layers = tr_merkle::layers(std::move(layer), width, tr_merkle::log2(blocks_per_piece));
+        if (layers.back().front() != file.root)
+        {
+            return false;
+        }
+
+        file.layers = std::move(layers);
+        return true;
+    }
+
     static constexpr std::string_view AcodecKey = "acodec"sv;
     static constexpr std::string_view AnnounceKey = "announce"sv;
     static constexpr std::string_view AnnounceListKey = "announce-list"sv;
@@ -665,6 +866,58 @@ bool tr_torrent_metainfo::parseBenc(std::string_view benc, tr_error** error)
     return true;
 }
 
+tr_torrent_metainfo::V2File const* tr_torrent_metainfo::findV2File(tr_sha256_digest_t const& root) const noexcept
+{
+    auto const iter = std::find_if(
+        std::begin(v2_files_),
+        std::end(v2_files_),
+        [&root](auto const& file) { return file.root == root; });
+    return iter != std::end(v2_files_) ? &*iter : nullptr;
+}
+
+std::optional<tr_torrent_metainfo::V2Piece> tr_torrent_metainfo::v2Piece(tr_piece_index_t piece) const
+{
+    auto const iter = std::upper_bound(
+        std::begin(v2_files_),
+        std::end(v2_files_),
+        piece,
+        [](tr_piece_index_t lhs, auto const& file) { return lhs < file.first_piece; });
+    if (iter == std::begin(v2_files_))
+    {
+        return {};
+    }
+
+    auto const& file = *std::prev(iter);
+    auto const file_size = fileSize(file.file);
+    auto const offset = uint64_t{ piece - file.first_piece } * pieceSize();
+    if (offset >= file_size)
+    {
+        return {};
+    }
+
+    auto ret = V2Piece{};
+    ret.file = &file;
+    ret.n_bytes = std::min(uint64_t{ pieceSize() }, file_size - offset);
+
+    if (file_size <= pieceSize())
+    {
+        ret.width = tr_merkle::ceilPow2(tr_merkle::leafCount(file_size));
+        ret.hash = file.root;
+        return ret;
+    }
+
+    auto const index = piece - file.first_piece;
+    if (std::empty(file.layers) || index >= std::size(file.layers.front()))
+    {
+        return {};
+    }
+
+    ret.width = pieceSize() / tr_merkle::BlockSize;
+    ret.first_leaf = index * ret.width;
+    ret.hash = file.layers.front()[index];
+    return ret;
+}
+
 bool tr_torrent_metainfo::parseTorrentFile(std::string_view filename, std::vector<char>* contents, tr_error** error)
 {
     auto local_contents = std::vector<char>{};
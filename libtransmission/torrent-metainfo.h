@@ -7,6 +7,7 @@
 
 #include <cstdint> // uint32_t, uint64_t
 #include <ctime>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -140,11 +141,52 @@ public:
         return !std::empty(pieces_);
     }
 
-    [[nodiscard]] constexpr bool hasV2Metadata() const noexcept
+    [[nodiscard]] TR_CONSTEXPR20 bool hasV2Metadata() const noexcept
     {
-        return is_v2_;
+        return !std::empty(v2_files_);
     }
 
+    // BITTORRENT V2
+    // http://bittorrent.org/beps/bep_0052.html
+
+    // A file's merkle tree
+    struct V2File
+    {
+        tr_file_index_t file = 0;
+        tr_piece_index_t first_piece = 0;
+        tr_sha256_digest_t root = {};
+
+        // the tree's layers from the one with one node per piece (the front)
+        // up to the root, kept so that peers' hash requests are just lookups.
+        // Empty if the file fits in one piece or if the .torrent had no layer.
+        std::vector<std::vector<tr_sha256_digest_t>> layers;
+    };
+
+    [[nodiscard]] constexpr auto const& v2Files() const noexcept
+    {
+        return v2_files_;
+    }
+
+    [[nodiscard]] V2File const* findV2File(tr_sha256_digest_t const& root) const noexcept;
+
+    // What to hash to check a piece against its file's merkle tree
+    struct V2Piece
+    {
+        V2File const* file = nullptr;
+
+        // hash the piece's first `n_bytes`; the rest is padding
+        uint64_t n_bytes = 0;
+
+        // the piece's leaves are [first_leaf, first_leaf + width) of the file's tree
+        size_t first_leaf = 0;
+        size_t width = 0;
+
+        // the root of the piece's subtree of `width` leaves
+        tr_sha256_digest_t hash = {};
+    };
+
+    [[nodiscard]] std::optional<V2Piece> v2Piece(tr_piece_index_t piece) const;
+
     [[nodiscard]] constexpr auto const& dateCreated() const noexcept
     {
         return date_created_;
@@ -227,6 +269,9 @@ private:
 
     std::vector<tr_sha1_digest_t> pieces_;
 
+    // sorted by first_piece
+    std::vector<V2File> v2_files_;
+
     std::string comment_;
     std::string creator_;
     std::string source_;
@@ -38,7 +38,9 @@
 #include "inout.h" /* tr_ioTestPiece() */
 #include "log.h"
 #include "magnet-metainfo.h"
+#include "merkle.h"
 #include "peer-mgr.h"
+#include "piece-checker.h"
 #include "resume.h"
 #include "session.h"
 #include "subprocess.h"
@@ -873,6 +875,9 @@ void torrentStop(tr_torrent* const tor)
     tr_peerMgrStopTorrent(tor);
     tor->session->announcer_->stopTorrent(tor);
 
+    // the peers that sent them are gone; ask again if we restart
+    tor->block_hashes_.clear();
+
     tor->session->closeTorrentFiles(tor);
 
     if (!tor->isDeleting)
@@ -989,6 +994,8 @@ void torrentInitFromInfoDict(tr_torrent* tor)
     tor->file_priorities_.reset(&tor->fpm_);
     tor->files_wanted_.reset(&tor->fpm_);
     tor->checked_pieces_ = tr_bitfield{ size_t(tor->pieceCount()) };
+    tor->pending_piece_checks_ = tr_bitfield{ size_t(tor->pieceCount()) };
+    tor->failed_piece_checks_ = tr_bitfield{ size_t(tor->pieceCount()) };
 }
 
 void on_metainfo_completed(tr_torrent* tor)
@@ -1944,6 +1951,21 @@ void tr_torrent::recheckCompleteness()
 
 // --- File DND
 
+void tr_torrent::setFilesWanted(tr_file_index_t const* files, size_t n_files, bool wanted, bool is_bootstrapping)
+{
+    auto const lock = unique_lock();
+
+    files_wanted_.set(files, n_files, wanted);
+    completion.invalidateSizeWhenDone();
+    tr_peerMgrOnWantedChanged(this);
+
+    if (!is_bootstrapping)
+    {
+        setDirty();
+        recheckCompleteness();
+    }
+}
+
 void tr_torrentSetFileDLs(tr_torrent* tor, tr_file_index_t const* files, tr_file_index_t n_files, bool wanted)
 {
     TR_ASSERT(tr_isTorrent(tor));
@@ -2316,6 +2338,7 @@ void onFileCompleted(tr_torrent* tor, tr_file_index_t i)
 
 void onPieceCompleted(tr_torrent* tor, tr_piece_index_t piece)
 {
+    tor->block_hashes_.erase(piece);
     tr_peerMgrPieceCompleted(tor, piece);
 
     // if this piece completes any file, invoke the fileCompleted func for it
@@ -2373,6 +2396,10 @@ void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block)
 
         if (tor->checkPiece(piece))
         {
+            // checkPiece() just hashed the piece's data on disk,
+            // so it needn't be checked again before it's uploaded
+            tor->checked_pieces_.set(piece, true);
+            tor->failed_piece_checks_.unset(piece);
             onPieceCompleted(tor, piece);
         }
         else
@@ -2645,6 +2672,13 @@ void tr_torrentRenamePath(
 
 // ---
 
+void tr_torrent::setFilePriorities(tr_file_index_t const* files, tr_file_index_t file_count, tr_priority_t priority)
+{
+    file_priorities_.set(files, file_count, priority);
+    tr_peerMgrOnWantedChanged(this);
+    setDirty();
+}
+
 void tr_torrentSetFilePriorities(
     tr_torrent* tor,
     tr_file_index_t const* files,
@@ -2691,6 +2725,113 @@ void tr_torrent::setBlocks(tr_bitfield blocks)
     return checked;
 }
 
+std::optional<bool> tr_torrent::checkBlock(tr_block_index_t block, uint8_t const* data) const
+{
+    auto const loc = blockLoc(block);
+    auto const iter = block_hashes_.find(loc.piece);
+    if (iter == std::end(block_hashes_))
+    {
+        return {};
+    }
+
+    // v2 pieces start on block boundaries, so this is the block's leaf
+    auto const v2_piece = v2Piece(loc.piece);
+    auto const& hashes = iter->second;
+    auto const leaf = block - blockSpanForPiece(loc.piece).begin;
+    auto const offset = uint64_t{ leaf } * tr_block_info::BlockSize;
+    if (!v2_piece || leaf >= std::size(hashes) || offset >= v2_piece->n_bytes)
+    {
+        return {};
+    }
+
+    // the file may end partway through the block
+    auto const len = std::min(uint64_t{ blockSize(block) }, v2_piece->n_bytes - offset);
+    return tr_merkle::blockHash(data, len) == hashes[leaf];
+}
+
+void tr_torrent::checkPieceInBackground(tr_piece_index_t piece)
+{
+    TR_ASSERT(session->amInSessionThread());
+    TR_ASSERT(piece < this->pieceCount());
+
+    if (isPieceChecked(piece) || isPieceCheckPending(piece))
+    {
+        return;
+    }
+
+    auto task = tr_piece_checker::Task{};
+    task.tor_id = id();
+    task.piece = piece;
+    auto n_bytes = uint64_t{ pieceSize(piece) };
+
+    if (hasV1Metadata())
+    {
+        task.expected = pieceHash(piece);
+    }
+    else if (auto const v2_piece = v2Piece(piece); v2_piece)
+    {
+        task.v2 = tr_piece_checker::Task::V2{ v2_piece->hash, v2_piece->width };
+        n_bytes = v2_piece->n_bytes;
+    }
+    else
+    {
+        onPieceChecked(piece, false, false);
+        return;
+    }
+
+    auto [file_index, file_offset] = fileOffset(pieceLoc(piece));
+    for (uint64_t left = n_bytes; left > 0U; ++file_index, file_offset = 0)
+    {
+        auto const len = std::min(left, fileSize(file_index) - file_offset);
+        if (len == 0U)
+        {
+            continue;
+        }
+
+        auto const found = findFile(file_index);
+        task.spans.push_back({ found ? std::string{ found->filename().sv() } : std::string{}, file_offset, len });
+        left -= len;
+    }
+
+    pending_piece_checks_.set(piece);
+    session->checkPieceInBackground(std::move(task));
+}
+
+void tr_torrent::onPieceChecked(tr_piece_index_t piece, bool aborted, bool pass)
+{
+    TR_ASSERT(session->amInSessionThread());
+
+    pending_piece_checks_.unset(piece);
+
+    if (aborted)
+    {
+        return;
+    }
+
+    tr_logAddTraceTor(this, fmt::format("[LAZY] tr_torrent.onPieceChecked tested piece {}, pass=={}", piece, pass));
+    this->markChanged();
+    this->setDirty();
+    checked_pieces_.set(piece, pass);
+    failed_piece_checks_.set(piece, !pass);
+
+    if (!pass)
+    {
+        setLocalError(fmt::format(FMT_STRING("Please Verify Local Data! Piece #{:d} is corrupt."), piece));
+    }
+}
+
+void tr_torrentOnPieceChecked(tr_session* session, tr_torrent_id_t tor_id, tr_piece_index_t piece, bool aborted, bool pass)
+{
+    session->runInSessionThread(
+        [session, tor_id, piece, aborted, pass]()
+        {
+            if (auto* const tor = tr_torrentFindFromId(session, tor_id); tor != nullptr && tor->hasMetainfo())
+            {
+                tor->onPieceChecked(piece, aborted, pass);
+            }
+        });
+}
+
 void tr_torrent::initCheckedPieces(tr_bitfield const& checked, time_t const* mtimes /*fileCount()*/)
 {
     TR_ASSERT(std::size(checked) == this->pieceCount());
@@ -11,6 +11,7 @@
 
 #include <cstddef> // size_t
 #include <ctime>
+#include <map>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -105,6 +106,47 @@ public:
         return metainfo_.pieceHash(i);
     }
 
+    [[nodiscard]] TR_CONSTEXPR20 bool hasV1Metadata() const noexcept
+    {
+        return metainfo_.hasV1Metadata();
+    }
+
+    [[nodiscard]] TR_CONSTEXPR20 bool hasV2Metadata() const noexcept
+    {
+        return metainfo_.hasV2Metadata();
+    }
+
+    // v2-only torrents have no SHA1 piece hashes;
+    // their pieces are checked against their files' merkle trees
+    [[nodiscard]] auto v2Piece(tr_piece_index_t piece) const
+    {
+        return metainfo_.v2Piece(piece);
+    }
+
+    [[nodiscard]] auto const* findV2File(tr_sha256_digest_t const& root) const noexcept
+    {
+        return metainfo_.findV2File(root);
+    }
+
+    // BitTorrent v2 leaf hashes of pieces that we're downloading.
+    // Peers send them in reply to hash requests; once they've been
+    // checked against the piece layer, each block can be checked as
+    // it arrives instead of waiting for the whole piece.
+
+    [[nodiscard]] bool hasBlockHashes(tr_piece_index_t piece) const
+    {
+        return block_hashes_.count(piece) != 0U;
+    }
+
+    void setBlockHashes(tr_piece_index_t piece, std::vector<tr_sha256_digest_t> hashes)
+    {
+        block_hashes_.insert_or_assign(piece, std::move(hashes));
+    }
+
+    // @return true if the block matches its leaf hash, false if it
+    // doesn't, or nullopt if there's no leaf hash to check it against
+    [[nodiscard]] std::optional<bool> checkBlock(tr_block_index_t block, uint8_t const* data) const;
+
     // these functions should become private when possible,
     // but more refactoring is needed before that can happen
     // because much of tr_torrent's impl is in the non-member C bindings
@@ -345,16 +387,11 @@ public:
         return file_priorities_.piecePriority(piece);
     }
 
-    void setFilePriorities(tr_file_index_t const* files, tr_file_index_t file_count, tr_priority_t priority)
-    {
-        file_priorities_.set(files, file_count, priority);
-        setDirty();
-    }
+    void setFilePriorities(tr_file_index_t const* files, tr_file_index_t file_count, tr_priority_t priority);
 
     void setFilePriority(tr_file_index_t file, tr_priority_t priority)
     {
-        file_priorities_.set(file, priority);
-        setDirty();
+        setFilePriorities(&file, 1U, priority);
     }
 
     /// LOCATION
@@ -536,6 +573,22 @@ public:
 
     [[nodiscard]] bool ensurePieceIsChecked(tr_piece_index_t piece);
 
+    // Like ensurePieceIsChecked(), but the piece is checked by a
+    // background thread. Use isPieceCheckPending() to see if it's done.
+    void checkPieceInBackground(tr_piece_index_t piece);
+
+    [[nodiscard]] TR_CONSTEXPR20 bool isPieceCheckPending(tr_piece_index_t piece) const
+    {
+        return pending_piece_checks_.test(piece);
+    }
+
+    [[nodiscard]] TR_CONSTEXPR20 bool didPieceCheckFail(tr_piece_index_t piece) const
+    {
+        return failed_piece_checks_.test(piece);
+    }
+
+    void onPieceChecked(tr_piece_index_t piece, bool aborted, bool pass);
+
     void initCheckedPieces(tr_bitfield const& checked, time_t const* mtimes /*fileCount()*/);
 
     ///
@@ -805,6 +858,16 @@ public:
     // it means that piece needs to be checked before its data is used.
     tr_bitfield checked_pieces_ = tr_bitfield{ 0 };
 
+    // pieces that have been handed to the session's tr_piece_checker
+    tr_bitfield pending_piece_checks_ = tr_bitfield{ 0 };
+
+    // pieces whose last background check failed. They aren't checked in the
+    // background again until they're re-downloaded or the torrent is verified.
+    tr_bitfield failed_piece_checks_ = tr_bitfield{ 0 };
+
+    // see hasBlockHashes()
+    std::map<tr_piece_index_t, std::vector<tr_sha256_digest_t>> block_hashes_;
+
     tr_file_piece_map fpm_ = tr_file_piece_map{ metainfo_ };
     tr_file_priorities file_priorities_{ &fpm_ };
     tr_files_wanted files_wanted_{ &fpm_ };
@@ -916,19 +979,7 @@ private:
         return true;
     }
 
-    void setFilesWanted(tr_file_index_t const* files, size_t n_files, bool wanted, bool is_bootstrapping)
-    {
-        auto const lock = unique_lock();
-
-        files_wanted_.set(files, n_files, wanted);
-        completion.invalidateSizeWhenDone();
-
-        if (!is_bootstrapping)
-        {
-            setDirty();
-            recheckCompleteness();
-        }
-    }
+    void setFilesWanted(tr_file_index_t const* files, size_t n_files, bool wanted, bool is_bootstrapping);
 
     /* If the initiator of the connection receives a handshake in which the
      * peer_id does not match the expected peerid, then the initiator is
@@ -973,6 +1024,8 @@ tr_torrent::labels_t const& tr_ctorGetLabels(tr_ctor const* ctor);
 
 void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted);
 
+void tr_torrentOnPieceChecked(tr_session* session, tr_torrent_id_t tor_id, tr_piece_index_t piece, bool aborted, bool pass);
+
 #define tr_logAddCriticalTor(tor, msg) tr_logAddCritical(msg, (tor)->name())
 #define tr_logAddErrorTor(tor, msg) tr_logAddError(msg, (tor)->name())
 #define tr_logAddWarnTor(tor, msg) tr_logAddWarn(msg, (tor)->name())
@@ -6,7 +6,8 @@
 
 #include <array>
 #include <cstddef> // size_t
-#include <cstdint> // uint8_t
+#include <cstdint> // uint8_t, uint64_t
+#include <cstring> // memcpy
 
 /**
  * This is a tiny and reusable implementation of alleged RC4 cipher.
@@ -37,7 +38,7 @@ public:
     {
         for (size_t i = 0; i < 256; ++i)
         {
-            s_[i] = static_cast<uint8_t>(i);
+            s_[i] = static_cast<uint32_t>(i);
         }
 
         for (size_t i = 0, j = 0; i < 256; ++i)
@@ -47,20 +48,56 @@ public:
         }
     }
 
-    constexpr void process(void const* src_data, void* dst_data, size_t data_length)
+    // src_data and dst_data may be the same buffer, but must not otherwise overlap
+    void process(void const* src_data, void* dst_data, size_t data_length) noexcept
     {
-        for (size_t i = 0; i < data_length; ++i)
+        auto const* src = static_cast<uint8_t const*>(src_data);
+        auto* dst = static_cast<uint8_t*>(dst_data);
+        auto i = i_;
+        auto j = j_;
+
+        // generate the keystream a word at a time so the XOR is done on words too
+        while (data_length >= KeystreamChunk)
+        {
+            auto keystream = std::array<uint8_t, KeystreamChunk>{};
+            for (auto& key : keystream)
+            {
+                key = arc4_next(i, j);
+            }
+
+            auto word = uint64_t{};
+            auto key_word = uint64_t{};
+            std::memcpy(&word, src, sizeof(word));
+            std::memcpy(&key_word, std::data(keystream), sizeof(key_word));
+            word ^= key_word;
+            std::memcpy(dst, &word, sizeof(word));
+
+            src += KeystreamChunk;
+            dst += KeystreamChunk;
+            data_length -= KeystreamChunk;
+        }
+
+        for (size_t k = 0; k < data_length; ++k)
         {
-            static_cast<uint8_t*>(dst_data)[i] = static_cast<uint8_t const*>(src_data)[i] ^ arc4_next();
+            dst[k] = src[k] ^ arc4_next(i, j);
         }
+
+        i_ = i;
+        j_ = j;
     }
 
     constexpr void discard(size_t length)
     {
+        auto i = i_;
+        auto j = j_;
+
         while (length-- > 0)
         {
-            arc4_next();
+            arc4_next(i, j);
         }
+
+        i_ = i;
+        j_ = j;
     }
 
 private:
@@ -71,17 +108,23 @@ private:
         s_[j] = tmp;
     }
 
-    constexpr uint8_t arc4_next()
+    constexpr uint8_t arc4_next(uint32_t& i, uint32_t& j)
     {
-        i_ += 1;
-        j_ += s_[i_];
+        i = (i + 1U) & 0xFFU;
+        auto const si = s_[i];
+        j = (j + si) & 0xFFU;
+        auto const sj = s_[j];
+        s_[i] = sj;
+        s_[j] = si;
 
-        arc4_swap(i_, j_);
-
-        return s_[static_cast<uint8_t>(s_[i_] + s_[j_])];
+        return static_cast<uint8_t>(s_[(si + sj) & 0xFFU]);
     }
 
-    std::array<uint8_t, 256> s_ = {};
-    uint8_t i_ = 0;
-    uint8_t j_ = 0;
+    static auto constexpr KeystreamChunk = sizeof(uint64_t);
+
+    // word-sized, not uint8_t, to avoid partial-register stalls and
+    // byte-masking in arc4_next(). Values are always < 256.
+    std::array<uint32_t, 256> s_ = {};
+    uint32_t i_ = 0;
+    uint32_t j_ = 0;
 };
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <algorithm> // for std::min()
+#include <array>
 #include <cstddef>
 #include <iterator>
 #include <limits>
@@ -255,6 +257,77 @@ public:
         return { reinterpret_cast<std::byte*>(evbuffer_pullup(buf_.get(), -1)), size() };
     }
 
+    // Call `func(std::byte* span, size_t span_len)` for each contiguous span
+    // of the `n_bytes` bytes that begin at `offset`, in order. This walks
+    // the buffer's segments once, so it's much cheaper than iterating over
+    // the bytes, and unlike pullup() it doesn't copy them.
+    // Spans added with add_reference() may be shared with other owners,
+    // so only modify spans in place if you know where they came from.
+    template<typename Func>
+    void for_each_span(size_t offset, size_t n_bytes, Func&& func)
+    {
+        auto ptr = evbuffer_ptr{};
+        if (evbuffer_ptr_set(buf_.get(), &ptr, offset, EVBUFFER_PTR_SET) != 0)
+        {
+            return;
+        }
+
+        auto iovs = std::array<evbuffer_iovec, 16>{};
+        while (n_bytes > 0U)
+        {
+            auto const n_iovs = evbuffer_peek(buf_.get(), static_cast<ev_ssize_t>(n_bytes), &ptr, std::data(iovs), std::size(iovs));
+            if (n_iovs <= 0)
+            {
+                return;
+            }
+
+            auto n_walked = size_t{};
+            for (size_t i = 0, n = std::min(static_cast<size_t>(n_iovs), std::size(iovs)); i < n && n_bytes > 0U; ++i)
+            {
+                auto const span_len = std::min(iovs[i].iov_len, n_bytes);
+                func(static_cast<std::byte*>(iovs[i].iov_base), span_len);
+                n_bytes -= span_len;
+                n_walked += span_len;
+            }
+
+            evbuffer_ptr_set(buf_.get(), &ptr, n_walked, EVBUFFER_PTR_ADD);
+        }
+    }
+
+    // Move the first `n_bytes` of `that` into this buffer, passing them
+    // through `func(std::byte const* in, std::byte* out, size_t len)` span
+    // by span, e.g. to encrypt them. `that`'s bytes aren't modified, so it
+    // can safely hold references to memory that's shared with others.
+    // @return false if there wasn't memory for them; `that` is unchanged then.
+    template<typename Func>
+    bool add_transformed(Buffer& that, size_t n_bytes, Func&& func)
+    {
+        n_bytes = std::min(n_bytes, std::size(that));
+        if (n_bytes == 0U)
+        {
+            return true;
+        }
+
+        auto* const out = reserve_space(n_bytes);
+        if (out == nullptr)
+        {
+            return false;
+        }
+
+        auto* walk = out;
+        that.for_each_span(
+            0U,
+            n_bytes,
+            [&func, &walk](std::byte const* span, size_t span_len)
+            {
+                func(span, walk, span_len);
+                walk += span_len;
+            });
+        commit_space(out, n_bytes);
+        that.drain(n_bytes);
+        return true;
+    }
+
     [[nodiscard]] auto pullup_sv()
     {
         auto const [buf, buflen] = pullup();
@@ -312,6 +385,51 @@ public:
         add(std::data(data), std::size(data));
     }
 
+    // Add `n_bytes` of `data` to the buffer without copying it.
+    // `cleanup` is called when the buffer no longer needs `data`.
+    void add_reference(void const* data, size_t n_bytes, evbuffer_ref_cleanup_cb cleanup, void* cleanup_arg)
+    {
+        evbuffer_add_reference(buf_.get(), data, n_bytes, cleanup, cleanup_arg);
+    }
+
+    // Add a range of a file to the buffer without reading it into memory.
+    // Where supported, the bytes go straight from the file to the socket
+    // with sendfile(), so only use this for data that will go to a socket
+    // unmodified: the results of pullup() or to_buf() are undefined here.
+    // The buffer holds a reference to `segment` until these bytes are drained.
+    bool add_file_segment(evbuffer_file_segment* segment, uint64_t offset, uint64_t n_bytes)
+    {
+        evbuffer_set_flags(buf_.get(), EVBUFFER_FLAG_DRAINS_TO_FD);
+        return evbuffer_add_file_segment(
+                   buf_.get(),
+                   segment,
+                   static_cast<ev_off_t>(offset),
+                   static_cast<ev_off_t>(n_bytes)) == 0;
+    }
+
+    // Get contiguous space for `n_bytes` at the end of the buffer so that
+    // they can be written in place, e.g. by a read() call. The bytes are
+    // not part of the buffer until they're committed with commit_space().
+    // @return the space, or nullptr if it couldn't be allocated
+    [[nodiscard]] std::byte* reserve_space(size_t n_bytes)
+    {
+        auto iov = evbuffer_iovec{};
+        if (evbuffer_reserve_space(buf_.get(), static_cast<ev_ssize_t>(n_bytes), &iov, 1) != 1 || iov.iov_len < n_bytes)
+        {
+            return nullptr;
+        }
+
+        return static_cast<std::byte*>(iov.iov_base);
+    }
+
+    void commit_space(std::byte* data, size_t n_bytes)
+    {
+        auto iov = evbuffer_iovec{};
+        iov.iov_base = data;
+        iov.iov_len = n_bytes;
+        evbuffer_commit_space(buf_.get(), &iov, 1);
+    }
+
     template<
         typename T,
         typename std::enable_if_t<
@@ -0,0 +1,607 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::copy_n(), std::min()
+#include <array>
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <memory>
+#include <string_view>
+#include <utility> // std::index_sequence
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TR_SHA_HW_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> // __cpuid(), __cpuidex()
+#else
+#include <cpuid.h> // __get_cpuid(), __get_cpuid_count()
+#endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define TR_SHA_HW_ARM
+#include <arm_neon.h>
+#endif
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "tr-sha-hw.h"
+
+namespace
+{
+
+using Sha1State = std::array<uint32_t, 5>;
+using Sha256State = std::array<uint32_t, 8>;
+
+#if defined(TR_SHA_HW_X86) || defined(TR_SHA_HW_ARM)
+
+auto constexpr BlockSize = size_t{ 64U };
+
+alignas(16) auto constexpr Sha256K = std::array<uint32_t, 64>{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#endif
+
+#if defined(TR_SHA_HW_X86)
+
+// --- x86: SHA extensions
+
+#ifdef _MSC_VER
+#define TR_SHA_HW_TARGET
+#else
+#define TR_SHA_HW_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+
+bool cpuHasShaInstructions() noexcept
+{
+    // CPUID.(EAX=07H, ECX=0):EBX.SHA[bit 29] and CPUID.01H:ECX.SSE4_1[bit 19]
+    auto constexpr ShaBit = 1U << 29U;
+    auto constexpr Sse41Bit = 1U << 19U;
+
+#ifdef _MSC_VER
+    auto regs = std::array<int, 4>{};
+    __cpuid(std::data(regs), 0);
+    if (regs[0] < 7)
+    {
+        return false;
+    }
+
+    __cpuidex(std::data(regs), 7, 0);
+    auto const ebx7 = static_cast<unsigned int>(regs[1]);
+    __cpuid(std::data(regs), 1);
+    auto const ecx1 = static_cast<unsigned int>(regs[2]);
+#else
+    unsigned int eax = 0;
+    unsigned int ebx7 = 0;
+    unsigned int ecx1 = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    if (__get_cpuid(0, &eax, &ebx7, &ecx, &edx) == 0 || eax < 7)
+    {
+        return false;
+    }
+
+    __get_cpuid_count(7, 0, &eax, &ebx7, &ecx, &edx);
+    __get_cpuid(1, &eax, &ecx, &ecx1, &edx);
+#endif
+
+    return (ebx7 & ShaBit) != 0U && (ecx1 & Sse41Bit) != 0U;
+}
+
+bool cpuHasSha1() noexcept
+{
+    return cpuHasShaInstructions();
+}
+
+bool cpuHasSha256() noexcept
+{
+    return cpuHasShaInstructions();
+}
+
+struct Sha1Lane
+{
+    uint8_t const* data;
+    __m128i abcd;
+    __m128i e;
+    __m128i abcd_save;
+    __m128i e_save;
+    // the last four quads of the message schedule
+    __m128i w[4]; // NOLINT(modernize-avoid-c-arrays)
+};
+
+// Rounds 4*I .. 4*I+3
+template<size_t I>
+TR_SHA_HW_TARGET inline void sha1Quad(Sha1Lane& lane, __m128i byteswap)
+{
+    auto& w = lane.w[I % 4];
+    if constexpr (I < 4)
+    {
+        w = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(lane.data + I * 16)), byteswap);
+    }
+    else
+    {
+        auto const& w3 = lane.w[(I + 1) % 4];
+        auto const& w2 = lane.w[(I + 2) % 4];
+        auto const& w1 = lane.w[(I + 3) % 4];
+        w = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(w, w3), w2), w1);
+    }
+
+    auto const e = I == 0 ? _mm_add_epi32(lane.e, w) : _mm_sha1nexte_epu32(lane.e, w);
+    lane.e = lane.abcd;
+    lane.abcd = _mm_sha1rnds4_epu32(lane.abcd, e, I / 5);
+}
+
+template<size_t... I>
+TR_SHA_HW_TARGET inline void sha1Quads(Sha1Lane& lane, __m128i byteswap, std::index_sequence<I...> /*unused*/)
+{
+    (sha1Quad<I>(lane, byteswap), ...);
+}
+
+TR_SHA_HW_TARGET void sha1Compress(Sha1State& state, uint8_t const* data, size_t n_blocks)
+{
+    auto const byteswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+    auto lane = Sha1Lane{};
+    lane.data = data;
+    lane.abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(std::data(state))), 0x1B);
+    lane.e = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; n_blocks > 0U; --n_blocks)
+    {
+        lane.abcd_save = lane.abcd;
+        lane.e_save = lane.e;
+
+        sha1Quads(lane, byteswap, std::make_index_sequence<20>{});
+
+        lane.e = _mm_sha1nexte_epu32(lane.e, lane.e_save);
+        lane.abcd = _mm_add_epi32(lane.abcd, lane.abcd_save);
+        lane.data += BlockSize;
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(std::data(state)), _mm_shuffle_epi32(lane.abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(lane.e, 3));
+}
+
+struct Sha256Lane
+{
+    uint8_t const* data;
+    __m128i abef;
+    __m128i cdgh;
+    __m128i abef_save;
+    __m128i cdgh_save;
+    // the last four quads of the message schedule
+    __m128i w[4]; // NOLINT(modernize-avoid-c-arrays)
+};
+
+// Rounds 4*I .. 4*I+3
+template<size_t I>
+TR_SHA_HW_TARGET inline void sha256Quad(Sha256Lane& lane, __m128i byteswap)
+{
+    auto& w = lane.w[I % 4];
+    if constexpr (I < 4)
+    {
+        w = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(lane.data + I * 16)), byteswap);
+    }
+    else
+    {
+        auto const& w3 = lane.w[(I + 1) % 4];
+        auto const& w2 = lane.w[(I + 2) % 4];
+        auto const& w1 = lane.w[(I + 3) % 4];
+        w = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w, w3), _mm_alignr_epi8(w1, w2, 4)), w1);
+    }
+
+    auto const msg = _mm_add_epi32(w, _mm_load_si128(reinterpret_cast<__m128i const*>(&Sha256K[I * 4])));
+    lane.cdgh = _mm_sha256rnds2_epu32(lane.cdgh, lane.abef, msg);
+    lane.abef = _mm_sha256rnds2_epu32(lane.abef, lane.cdgh, _mm_shuffle_epi32(msg, 0x0E));
+}
+
+template<size_t... I>
+TR_SHA_HW_TARGET inline void sha256Quads(Sha256Lane& lane, __m128i byteswap, std::index_sequence<I...> /*unused*/)
+{
+    (sha256Quad<I>(lane, byteswap), ...);
+}
+
+TR_SHA_HW_TARGET void sha256Compress(Sha256State& state, uint8_t const* data, size_t n_blocks)
+{
+    auto const byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+
+    auto lane = Sha256Lane{};
+    lane.data = data;
+    auto const dcba = _mm_loadu_si128(reinterpret_cast<__m128i const*>(std::data(state)));
+    auto const hgfe = _mm_loadu_si128(reinterpret_cast<__m128i const*>(std::data(state) + 4));
+    auto const cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    auto const efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    lane.abef = _mm_alignr_epi8(cdab, efgh, 8);
+    lane.cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (; n_blocks > 0U; --n_blocks)
+    {
+        lane.abef_save = lane.abef;
+        lane.cdgh_save = lane.cdgh;
+
+        sha256Quads(lane, byteswap, std::make_index_sequence<16>{});
+
+        lane.abef = _mm_add_epi32(lane.abef, lane.abef_save);
+        lane.cdgh = _mm_add_epi32(lane.cdgh, lane.cdgh_save);
+        lane.data += BlockSize;
+    }
+
+    auto const feba = _mm_shuffle_epi32(lane.abef, 0x1B);
+    auto const dchg = _mm_shuffle_epi32(lane.cdgh, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(std::data(state)), _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(std::data(state) + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#elif defined(TR_SHA_HW_ARM)
+
+// --- ARMv8: cryptography extensions
+
+bool cpuHasSha1() noexcept
+{
+    return true;
+}
+
+bool cpuHasSha256() noexcept
+{
+    return true;
+}
+
+struct Sha1Lane
+{
+    uint8_t const* data;
+    uint32x4_t abcd;
+    uint32_t e;
+    uint32x4_t abcd_save;
+    uint32_t e_save;
+    // the last four quads of the message schedule
+    uint32x4_t w[4]; // NOLINT(modernize-avoid-c-arrays)
+};
+
+// Rounds 4*I .. 4*I+3
+template<size_t I>
+inline void sha1Quad(Sha1Lane& lane)
+{
+    static auto constexpr K = std::array<uint32_t, 4>{ 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+    auto& w = lane.w[I % 4];
+    if constexpr (I < 4)
+    {
+        w = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(lane.data + I * 16)));
+    }
+    else
+    {
+        auto const& w3 = lane.w[(I + 1) % 4];
+        auto const& w2 = lane.w[(I + 2) % 4];
+        auto const& w1 = lane.w[(I + 3) % 4];
+        w = vsha1su1q_u32(vsha1su0q_u32(w, w3, w2), w1);
+    }
+
+    auto const wk = vaddq_u32(w, vdupq_n_u32(K[I / 5]));
+    auto const e = vsha1h_u32(vgetq_lane_u32(lane.abcd, 0));
+    if constexpr (I < 5)
+    {
+        lane.abcd = vsha1cq_u32(lane.abcd, lane.e, wk);
+    }
+    else if constexpr (I >= 10 && I < 15)
+    {
+        lane.abcd = vsha1mq_u32(lane.abcd, lane.e, wk);
+    }
+    else
+    {
+        lane.abcd = vsha1pq_u32(lane.abcd, lane.e, wk);
+    }
+    lane.e = e;
+}
+
+template<size_t... I>
+inline void sha1Quads(Sha1Lane& lane, std::index_sequence<I...> /*unused*/)
+{
+    (sha1Quad<I>(lane), ...);
+}
+
+void sha1Compress(Sha1State& state, uint8_t const* data, size_t n_blocks)
+{
+    auto lane = Sha1Lane{};
+    lane.data = data;
+    lane.abcd = vld1q_u32(std::data(state));
+    lane.e = state[4];
+
+    for (; n_blocks > 0U; --n_blocks)
+    {
+        lane.abcd_save = lane.abcd;
+        lane.e_save = lane.e;
+
+        sha1Quads(lane, std::make_index_sequence<20>{});
+
+        lane.e += lane.e_save;
+        lane.abcd = vaddq_u32(lane.abcd, lane.abcd_save);
+        lane.data += BlockSize;
+    }
+
+    vst1q_u32(std::data(state), lane.abcd);
+    state[4] = lane.e;
+}
+
+struct Sha256Lane
+{
+    uint8_t const* data;
+    uint32x4_t abcd;
+    uint32x4_t efgh;
+    uint32x4_t abcd_save;
+    uint32x4_t efgh_save;
+    // the last four quads of the message schedule
+    uint32x4_t w[4]; // NOLINT(modernize-avoid-c-arrays)
+};
+
+// Rounds 4*I .. 4*I+3
+template<size_t I>
+inline void sha256Quad(Sha256Lane& lane)
+{
+    auto& w = lane.w[I % 4];
+    if constexpr (I < 4)
+    {
+        w = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(lane.data + I * 16)));
+    }
+    else
+    {
+        auto const& w3 = lane.w[(I + 1) % 4];
+        auto const& w2 = lane.w[(I + 2) % 4];
+        auto const& w1 = lane.w[(I + 3) % 4];
+        w = vsha256su1q_u32(vsha256su0q_u32(w, w3), w2, w1);
+    }
+
+    auto const wk = vaddq_u32(w, vld1q_u32(&Sha256K[I * 4]));
+    auto const abcd = lane.abcd;
+    lane.abcd = vsha256hq_u32(lane.abcd, lane.efgh, wk);
+    lane.efgh = vsha256h2q_u32(lane.efgh, abcd, wk);
+}
+
+template<size_t... I>
+inline void sha256Quads(Sha256Lane& lane, std::index_sequence<I...> /*unused*/)
+{
+    (sha256Quad<I>(lane), ...);
+}
+
+void sha256Compress(Sha256State& state, uint8_t const* data, size_t n_blocks)
+{
+    auto lane = Sha256Lane{};
+    lane.data = data;
+    lane.abcd = vld1q_u32(std::data(state));
+    lane.efgh = vld1q_u32(std::data(state) + 4);
+
+    for (; n_blocks > 0U; --n_blocks)
+    {
+        lane.abcd_save = lane.abcd;
+        lane.efgh_save = lane.efgh;
+
+        sha256Quads(lane, std::make_index_sequence<16>{});
+
+        lane.abcd = vaddq_u32(lane.abcd, lane.abcd_save);
+        lane.efgh = vaddq_u32(lane.efgh, lane.efgh_save);
+        lane.data += BlockSize;
+    }
+
+    vst1q_u32(std::data(state), lane.abcd);
+    vst1q_u32(std::data(state) + 4, lane.efgh);
+}
+
+#endif
+
+#if defined(TR_SHA_HW_X86) || defined(TR_SHA_HW_ARM)
+
+// --- Merkle-Damgård construction, shared by SHA-1 and SHA-256
+
+struct Sha1Traits
+{
+    using State = Sha1State;
+    using Digest = tr_sha1_digest_t;
+
+    static auto constexpr Init = State{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    static void compress(State& state, uint8_t const* data, size_t n_blocks)
+    {
+        sha1Compress(state, data, n_blocks);
+    }
+};
+
+struct Sha256Traits
+{
+    using State = Sha256State;
+    using Digest = tr_sha256_digest_t;
+
+    static auto constexpr Init = State{
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    static void compress(State& state, uint8_t const* data, size_t n_blocks)
+    {
+        sha256Compress(state, data, n_blocks);
+    }
+};
+
+// Pad and hash the last, partial block of a message.
+template<typename Traits>
+[[nodiscard]] typename Traits::Digest finishHash(
+    typename Traits::State& state,
+    uint8_t const* tail,
+    size_t tail_length,
+    uint64_t total_length)
+{
+    auto blocks = std::array<uint8_t, BlockSize * 2U>{};
+    std::copy_n(tail, tail_length, std::data(blocks));
+    blocks[tail_length] = 0x80;
+
+    // the message length in bits goes in the last eight bytes, big-endian
+    auto const n_blocks = tail_length + 1U + sizeof(uint64_t) <= BlockSize ? 1U : 2U;
+    auto n_bits = total_length * 8U;
+    for (size_t i = n_blocks * BlockSize; i > n_blocks * BlockSize - sizeof(uint64_t); --i, n_bits >>= 8U)
+    {
+        blocks[i - 1U] = static_cast<uint8_t>(n_bits);
+    }
+
+    Traits::compress(state, std::data(blocks), n_blocks);
+
+    auto digest = typename Traits::Digest{};
+    for (size_t i = 0; i < std::size(digest); ++i)
+    {
+        digest[i] = std::byte(static_cast<uint8_t>(state[i / 4U] >> (24U - 8U * (i % 4U))));
+    }
+    return digest;
+}
+
+template<typename Traits, typename Base>
+class HwDigest final : public Base
+{
+public:
+    HwDigest()
+    {
+        clear();
+    }
+
+    void clear() override
+    {
+        state_ = Traits::Init;
+        length_ = 0U;
+        n_buffered_ = 0U;
+    }
+
+    void add(void const* data, size_t data_length) override
+    {
+        auto const* walk = static_cast<uint8_t const*>(data);
+        length_ += data_length;
+
+        // top off a partial block from the last call
+        if (n_buffered_ > 0U)
+        {
+            auto const n = std::min(data_length, BlockSize - n_buffered_);
+            std::copy_n(walk, n, std::data(buffer_) + n_buffered_);
+            n_buffered_ += n;
+            walk += n;
+            data_length -= n;
+
+            if (n_buffered_ < BlockSize)
+            {
+                return;
+            }
+
+            Traits::compress(state_, std::data(buffer_), 1U);
+            n_buffered_ = 0U;
+        }
+
+        if (auto const n_blocks = data_length / BlockSize; n_blocks > 0U)
+        {
+            Traits::compress(state_, walk, n_blocks);
+            walk += n_blocks * BlockSize;
+            data_length -= n_blocks * BlockSize;
+        }
+
+        std::copy_n(walk, data_length, std::data(buffer_));
+        n_buffered_ = data_length;
+    }
+
+    [[nodiscard]] typename Traits::Digest finish() override
+    {
+        auto const digest = finishHash<Traits>(state_, std::data(buffer_), n_buffered_, length_);
+        clear();
+        return digest;
+    }
+
+private:
+    typename Traits::State state_ = {};
+    std::array<uint8_t, BlockSize> buffer_ = {};
+    uint64_t length_ = 0U;
+    size_t n_buffered_ = 0U;
+};
+
+[[nodiscard]] tr_sha1_digest_t sha1(std::string_view input)
+{
+    auto const* const data = reinterpret_cast<uint8_t const*>(std::data(input));
+    auto const n_blocks = std::size(input) / BlockSize;
+    auto state = Sha1Traits::Init;
+    Sha1Traits::compress(state, data, n_blocks);
+    return finishHash<Sha1Traits>(state, data + n_blocks * BlockSize, std::size(input) % BlockSize, std::size(input));
+}
+
+#else
+
+// --- no SHA instructions on this architecture
+
+bool cpuHasSha1() noexcept
+{
+    return false;
+}
+
+bool cpuHasSha256() noexcept
+{
+    return false;
+}
+
+#endif
+
+} // namespace
+
+bool tr_sha_hw::has_sha1() noexcept
+{
+    static auto const has = cpuHasSha1();
+    return has;
+}
+
+bool tr_sha_hw::has_sha256() noexcept
+{
+    static auto const has = cpuHasSha256();
+    return has;
+}
+
+std::unique_ptr<tr_sha1> tr_sha_hw::create_sha1()
+{
+#if defined(TR_SHA_HW_X86) || defined(TR_SHA_HW_ARM)
+    if (has_sha1())
+    {
+        return std::make_unique<HwDigest<Sha1Traits, tr_sha1>>();
+    }
+#endif
+
+    return {};
+}
+
+std::unique_ptr<tr_sha256> tr_sha_hw::create_sha256()
+{
+#if defined(TR_SHA_HW_X86) || defined(TR_SHA_HW_ARM)
+    if (has_sha256())
+    {
+        return std::make_unique<HwDigest<Sha256Traits, tr_sha256>>();
+    }
+#endif
+
+    return {};
+}
+
+bool tr_sha_hw::sha1_many(
+    [[maybe_unused]] std::string_view const* inputs,
+    [[maybe_unused]] size_t n_inputs,
+    [[maybe_unused]] tr_sha1_digest_t* setme)
+{
+#if defined(TR_SHA_HW_X86) || defined(TR_SHA_HW_ARM)
+    if (has_sha1())
+    {
+        for (size_t i = 0; i < n_inputs; ++i)
+        {
+            setme[i] = sha1(inputs[i]);
+        }
+
+        return true;
+    }
+#endif
+
+    return false;
+}
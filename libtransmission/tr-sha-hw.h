@@ -0,0 +1,44 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <memory>
+#include <string_view>
+
+#include "transmission.h" // tr_sha1_digest_t, tr_sha256_digest_t
+
+#include "crypto-utils.h" // tr_sha1, tr_sha256
+
+/**
+ * SHA-1 and SHA-256 that use the CPU's own SHA instructions:
+ * the SHA extensions on x86 and the cryptography extensions on ARMv8.
+ *
+ * Crypto backends whose digests don't use these instructions can
+ * prefer these. On x86 the instructions are detected at runtime;
+ * on ARM they're used when the compiler targets them.
+ */
+namespace tr_sha_hw
+{
+
+[[nodiscard]] bool has_sha1() noexcept;
+[[nodiscard]] bool has_sha256() noexcept;
+
+// @return nullptr if the CPU has no SHA-1 instructions
+[[nodiscard]] std::unique_ptr<tr_sha1> create_sha1();
+
+// @return nullptr if the CPU has no SHA-256 instructions
+[[nodiscard]] std::unique_ptr<tr_sha256> create_sha256();
+
+// Hash `n_inputs` independent inputs into `setme`.
+// @return false if the CPU has no SHA-1 instructions
+[[nodiscard]] bool sha1_many(std::string_view const* inputs, size_t n_inputs, tr_sha1_digest_t* setme);
+
+} // namespace tr_sha_hw
@@ -2,10 +2,14 @@
 // It may be used under the MIT (SPDX: MIT) license.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::max(), std::min()
 #include <array>
 #include <cerrno>
+#include <cstddef>
 #include <cstdint>
-#include <cstring> /* memcmp(), memset() */
+#include <cstring> /* memcpy() */
+#include <string>
+#include <vector>
 
 #include <event2/event.h>
 
@@ -84,53 +88,8 @@ void set_socket_buffers(tr_socket_t fd, bool large)
     }
 }
 
-void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsession)
-{
-    TR_ASSERT(vsession != nullptr);
-    TR_ASSERT(type == EV_READ);
-
-    auto buf = std::array<unsigned char, 8192>{};
-    auto from = sockaddr_storage{};
-    auto fromlen = socklen_t{ sizeof(from) };
-    auto* const from_sa = reinterpret_cast<sockaddr*>(&from);
-
-    auto const rc = recvfrom(s, reinterpret_cast<char*>(std::data(buf)), std::size(buf) - 1, 0, from_sa, &fromlen);
-    if (rc <= 0)
-    {
-        return;
-    }
-
-    /* Since most packets we receive here are µTP, make quick inline
-       checks for the other protocols. The logic is as follows:
-       - all DHT packets start with 'd'
-       - all UDP tracker packets start with a 32-bit (!) "action", which
-         is between 0 and 3
-       - the above cannot be µTP packets, since these start with a 4-bit
-         version number (1). */
-    auto* const session = static_cast<tr_session*>(vsession);
-    if (buf[0] == 'd')
-    {
-        if (session->dht_)
-        {
-            buf[rc] = '\0'; // libdht requires zero-terminated messages
-            session->dht_->handleMessage(std::data(buf), rc, from_sa, fromlen);
-        }
-    }
-    else if (rc >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
-    {
-        if (!session->announcer_udp_->handleMessage(std::data(buf), rc))
-        {
-            tr_logAddTrace("Couldn't parse UDP tracker packet.");
-        }
-    }
-    else if (session->allowsUTP() && (session->utp_context != nullptr))
-    {
-        if (!tr_utpPacket(std::data(buf), rc, from_sa, fromlen, session))
-        {
-            tr_logAddTrace("Unexpected UDP packet");
-        }
-    }
-}
+// how long to let a full send buffer drain before retrying queued packets
+auto constexpr RetryInterval = timeval{ 0, 10000 };
 } // namespace
 
 // BEP-32 explains why we need to bind to one IPv6 address
@@ -144,6 +103,8 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
         return;
     }
 
+    flush_event_.reset(event_new(session_.eventBase(), TR_BAD_SOCKET, 0, onFlush, this));
+
     if (auto sock = socket(PF_INET, SOCK_DGRAM, 0); sock != TR_BAD_SOCKET)
     {
         auto optval = int{ 1 };
@@ -168,8 +129,9 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             tr_logAddInfo(fmt::format("Bound UDP IPv4 address {:s}", addr.display_name(udp_port_)));
             session_.setSocketTOS(sock, TR_AF_INET);
             set_socket_buffers(sock, session_.allowsUTP());
+            evutil_make_socket_nonblocking(sock);
             udp4_socket_ = sock;
-            udp4_event_.reset(event_new(session_.eventBase(), udp4_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp4_event_.reset(event_new(session_.eventBase(), udp4_socket_, EV_READ | EV_PERSIST, onReadable, this));
             event_add(udp4_event_.get(), nullptr);
         }
     }
@@ -202,8 +164,9 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             tr_logAddInfo(fmt::format("Bound UDP IPv6 address {:s}", addr.display_name(udp_port_)));
             session_.setSocketTOS(sock, TR_AF_INET6);
             set_socket_buffers(sock, session_.allowsUTP());
+            evutil_make_socket_nonblocking(sock);
             udp6_socket_ = sock;
-            udp6_event_.reset(event_new(session_.eventBase(), udp6_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp6_event_.reset(event_new(session_.eventBase(), udp6_socket_, EV_READ | EV_PERSIST, onReadable, this));
             event_add(udp6_event_.get(), nullptr);
 
 #ifdef IPV6_V6ONLY
@@ -218,6 +181,9 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
 
 tr_session::tr_udp_core::~tr_udp_core()
 {
+    flush();
+    flush_event_.reset();
+
     udp6_event_.reset();
 
     if (udp6_socket_ != TR_BAD_SOCKET)
@@ -235,22 +201,176 @@ tr_session::tr_udp_core::~tr_udp_core()
     }
 }
 
-void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen) const
+void tr_session::tr_udp_core::onReadable(evutil_socket_t sock, [[maybe_unused]] short type, void* vself)
 {
-    if (to->sa_family != AF_INET && to->sa_family != AF_INET6)
+    TR_ASSERT(vself != nullptr);
+    TR_ASSERT(type == EV_READ);
+
+    auto* const self = static_cast<tr_udp_core*>(vself);
+    ++self->stats_.wakeups;
+
+    // drain the socket, or at least take a big gulp of it
+    auto n_packets = size_t{};
+    for (;;)
     {
-        errno = EAFNOSUPPORT;
+        auto const n_read = self->receive(sock);
+        for (size_t i = 0; i < n_read; ++i)
+        {
+            auto& received = self->recv_bufs_[i];
+            self->dispatch(
+                std::data(received.buf),
+                received.length,
+                reinterpret_cast<sockaddr*>(&received.from),
+                received.fromlen);
+        }
+
+        n_packets += n_read;
+        if (n_read < std::size(self->recv_bufs_) || n_packets >= MaxBatchSize * 4U)
+        {
+            break;
+        }
     }
-    else if (auto const sock = to->sa_family == AF_INET ? udp4_socket_ : udp6_socket_; sock == TR_BAD_SOCKET)
+
+    self->stats_.packets_received += n_packets;
+    self->stats_.max_packets_per_wakeup = std::max(self->stats_.max_packets_per_wakeup, uint64_t{ n_packets });
+
+    // acknowledge everything that was just read, then send the acks and
+    // anything else that was queued while handling the packets
+    if (n_packets > 0U && self->session_.allowsUTP() && self->session_.utp_context != nullptr)
     {
-        // don't warn on bad sockets; the system may not support IPv6
-        return;
+        tr_utpIssueDeferredAcks(&self->session_);
     }
-    else if (::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) != -1)
+
+    self->flush();
+}
+
+size_t tr_session::tr_udp_core::receive(tr_socket_t sock)
+{
+#ifdef HAVE_RECVMMSG
+    auto msgs = std::array<mmsghdr, MaxBatchSize>{};
+    auto iovs = std::array<iovec, MaxBatchSize>{};
+    for (size_t i = 0; i < MaxBatchSize; ++i)
+    {
+        auto& received = recv_bufs_[i];
+        iovs[i].iov_base = std::data(received.buf);
+        iovs[i].iov_len = std::size(received.buf) - 1; // leave room for the DHT's zero terminator
+        msgs[i].msg_hdr.msg_name = &received.from;
+        msgs[i].msg_hdr.msg_namelen = sizeof(received.from);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    ++stats_.receive_calls;
+    auto const rc = recvmmsg(sock, std::data(msgs), MaxBatchSize, MSG_DONTWAIT, nullptr);
+    if (rc <= 0)
+    {
+        return {};
+    }
+
+    auto const n_read = static_cast<size_t>(rc);
+    for (size_t i = 0; i < n_read; ++i)
+    {
+        recv_bufs_[i].length = msgs[i].msg_len;
+        recv_bufs_[i].fromlen = msgs[i].msg_hdr.msg_namelen;
+    }
+
+    return n_read;
+#else
+    // the socket is nonblocking, so this stops when it's drained
+    auto n_read = size_t{};
+    for (; n_read < MaxBatchSize; ++n_read)
+    {
+        auto& received = recv_bufs_[n_read];
+        received.fromlen = sizeof(received.from);
+        ++stats_.receive_calls;
+        auto const rc = recvfrom(
+            sock,
+            reinterpret_cast<char*>(std::data(received.buf)),
+            std::size(received.buf) - 1, // leave room for the DHT's zero terminator
+            0,
+            reinterpret_cast<sockaddr*>(&received.from),
+            &received.fromlen);
+        if (rc <= 0)
+        {
+            break;
+        }
+
+        received.length = static_cast<size_t>(rc);
+    }
+
+    return n_read;
+#endif
+}
+
+void tr_session::tr_udp_core::dispatch(unsigned char* buf, size_t buflen, sockaddr* from, socklen_t fromlen)
+{
+    if (buflen == 0U)
     {
         return;
     }
 
+    /* Since most packets we receive here are µTP, make quick inline
+       checks for the other protocols. The logic is as follows:
+       - all DHT packets start with 'd'
+       - all UDP tracker packets start with a 32-bit (!) "action", which
+         is between 0 and 3
+       - the above cannot be µTP packets, since these start with a 4-bit
+         version number (1). */
+    if (buf[0] == 'd')
+    {
+        if (session_.dht_)
+        {
+            buf[buflen] = '\0'; // libdht requires zero-terminated messages
+            session_.dht_->handleMessage(buf, buflen, from, fromlen);
+        }
+    }
+    else if (buflen >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
+    {
+        if (!session_.announcer_udp_->handleMessage(buf, buflen))
+        {
+            tr_logAddTrace("Couldn't parse UDP tracker packet.");
+        }
+    }
+    else if (session_.allowsUTP() && (session_.utp_context != nullptr))
+    {
+        if (!tr_utpPacket(buf, buflen, from, fromlen, &session_))
+        {
+            tr_logAddTrace("Unexpected UDP packet");
+        }
+    }
+}
+
+// ---
+
+tr_socket_t tr_session::tr_udp_core::socketFor(sockaddr const* to) const noexcept
+{
+    switch (to->sa_family)
+    {
+    case AF_INET:
+        return udp4_socket_;
+
+    case AF_INET6:
+        return udp6_socket_;
+
+    default:
+        return TR_BAD_SOCKET;
+    }
+}
+
+bool tr_session::tr_udp_core::onSendError(sockaddr const* to, int error_code)
+{
+    // a full send buffer is routine under load, so just count it
+    if (error_code == EWOULDBLOCK
+#if EAGAIN != EWOULDBLOCK
+        || error_code == EAGAIN
+#endif
+    )
+    {
+        return true;
+    }
+
+    ++stats_.send_errors;
+
     auto display_name = std::string{};
     if (auto const addrport = tr_address::from_sockaddr(to); addrport)
     {
@@ -261,6 +381,196 @@ void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sock
     tr_logAddWarn(fmt::format(
         "Couldn't send to {address}: {errno} ({error})",
         fmt::arg("address", display_name),
-        fmt::arg("errno", errno),
-        fmt::arg("error", tr_strerror(errno))));
+        fmt::arg("errno", error_code),
+        fmt::arg("error", tr_strerror(error_code))));
+    return false;
+}
+
+void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen)
+{
+    if (to->sa_family != AF_INET && to->sa_family != AF_INET6)
+    {
+        onSendError(to, EAFNOSUPPORT);
+        return;
+    }
+
+    auto const sock = socketFor(to);
+    if (sock == TR_BAD_SOCKET)
+    {
+        // don't warn on bad sockets; the system may not support IPv6
+        return;
+    }
+
+    ++stats_.send_calls;
+    if (::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) == -1)
+    {
+        if (onSendError(to, sockerrno))
+        {
+            ++stats_.send_would_block;
+        }
+
+        return;
+    }
+
+    ++stats_.packets_sent;
+}
+
+void tr_session::tr_udp_core::sendtoBatched(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen)
+{
+    if (flush_event_ == nullptr || tolen > sizeof(sockaddr_storage))
+    {
+        sendto(buf, buflen, to, tolen);
+        return;
+    }
+
+    if (std::empty(send_queue_))
+    {
+        // send the queue when the event loop is done with the current callbacks
+        event_active(flush_event_.get(), EV_TIMEOUT, 0);
+    }
+
+    auto packet = QueuedPacket{};
+    packet.offset = std::size(send_queue_bytes_);
+    packet.length = buflen;
+    std::memcpy(&packet.to, to, tolen);
+    packet.tolen = tolen;
+    send_queue_.emplace_back(packet);
+
+    auto const* const bytes = static_cast<unsigned char const*>(buf);
+    send_queue_bytes_.insert(std::end(send_queue_bytes_), bytes, bytes + buflen);
+
+    if (std::size(send_queue_) >= MaxBatchSize)
+    {
+        flush();
+    }
+}
+
+void tr_session::tr_udp_core::onFlush(evutil_socket_t /*sock*/, short /*type*/, void* vself)
+{
+    static_cast<tr_udp_core*>(vself)->flush();
+}
+
+void tr_session::tr_udp_core::flush()
+{
+    // packets that would have blocked get one more try after a short wait.
+    // They stay where they are in send_queue_bytes_; the unsent ones are
+    // moved to the front of send_queue_, which is safe because that never
+    // overwrites a packet that hasn't been looked at yet.
+    auto n_retries = size_t{};
+
+    // send each run of packets that go to the same socket together
+    auto const* const end = std::data(send_queue_) + std::size(send_queue_);
+    for (auto const* begin = std::data(send_queue_); begin != end;)
+    {
+        auto const sock = socketFor(reinterpret_cast<sockaddr const*>(&begin->to));
+        auto const* run_end = begin + 1;
+        while (run_end != end && socketFor(reinterpret_cast<sockaddr const*>(&run_end->to)) == sock)
+        {
+            ++run_end;
+        }
+
+        if (sock != TR_BAD_SOCKET)
+        {
+            auto const n_flushed = flush(sock, begin, static_cast<size_t>(run_end - begin));
+            for (auto const* walk = begin + n_flushed; walk != run_end; ++walk)
+            {
+                if (walk->retried)
+                {
+                    ++stats_.send_would_block;
+                    continue;
+                }
+
+                auto& packet = send_queue_[n_retries++];
+                packet = *walk;
+                packet.retried = true;
+            }
+        }
+
+        begin = run_end;
+    }
+
+    send_queue_.resize(n_retries);
+
+    if (std::empty(send_queue_))
+    {
+        send_queue_bytes_.clear();
+        return;
+    }
+
+    // if most of the buffer is payloads that were already sent, drop them
+    // so that the buffer doesn't keep growing under a steady load
+    if (auto const n_dead = send_queue_.front().offset; n_dead > std::size(send_queue_bytes_) / 2U)
+    {
+        send_queue_bytes_.erase(std::begin(send_queue_bytes_), std::begin(send_queue_bytes_) + n_dead);
+        for (auto& packet : send_queue_)
+        {
+            packet.offset -= n_dead;
+        }
+    }
+
+    event_add(flush_event_.get(), &RetryInterval);
+}
+
+size_t tr_session::tr_udp_core::flush(tr_socket_t sock, QueuedPacket const* packets, size_t n_packets)
+{
+    auto n_flushed = size_t{ 0U };
+
+#ifdef HAVE_SENDMMSG
+    auto msgs = std::array<mmsghdr, MaxBatchSize>{};
+    auto iovs = std::array<iovec, MaxBatchSize>{};
+
+    while (n_flushed < n_packets)
+    {
+        auto const n_msgs = std::min(n_packets - n_flushed, MaxBatchSize);
+        for (size_t i = 0; i < n_msgs; ++i)
+        {
+            auto const& packet = packets[n_flushed + i];
+            iovs[i].iov_base = std::data(send_queue_bytes_) + packet.offset;
+            iovs[i].iov_len = packet.length;
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = const_cast<sockaddr_storage*>(&packet.to);
+            msgs[i].msg_hdr.msg_namelen = packet.tolen;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ++stats_.send_calls;
+        auto const rc = sendmmsg(sock, std::data(msgs), static_cast<unsigned int>(n_msgs), 0);
+
+        if (rc > 0)
+        {
+            n_flushed += static_cast<size_t>(rc);
+            stats_.packets_sent += static_cast<size_t>(rc);
+            continue;
+        }
+
+        // If the send buffer is full, the rest of the batch would block too.
+        // Otherwise, only the first packet failed: drop it and send the rest.
+        if (onSendError(reinterpret_cast<sockaddr const*>(&packets[n_flushed].to), sockerrno))
+        {
+            break;
+        }
+
+        ++n_flushed;
+    }
+#else
+    for (; n_flushed < n_packets; ++n_flushed)
+    {
+        auto const& packet = packets[n_flushed];
+        auto const* const to = reinterpret_cast<sockaddr const*>(&packet.to);
+
+        ++stats_.send_calls;
+        auto const* const buf = reinterpret_cast<char const*>(std::data(send_queue_bytes_) + packet.offset);
+        if (::sendto(sock, buf, packet.length, 0, to, packet.tolen) != -1)
+        {
+            ++stats_.packets_sent;
+        }
+        else if (onSendError(to, sockerrno))
+        {
+            break;
+        }
+    }
+#endif
+
+    return n_flushed;
 }
@@ -57,6 +57,10 @@ bool tr_utpPacket(
     return false;
 }
 
+void tr_utpIssueDeferredAcks(tr_session* /*ss*/)
+{
+}
+
 struct UTPSocket* utp_create_socket(struct_utp_context* /*ctx*/)
 {
     return nullptr;
@@ -111,7 +115,7 @@ void utp_send_to(
     struct sockaddr const* const to,
     socklen_t const tolen)
 {
-    ss->udp_core_->sendto(buf, buflen, to, tolen);
+    ss->udp_core_->sendtoBatched(buf, buflen, to, tolen);
 }
 
 uint64 utp_callback(utp_callback_arguments* args)
@@ -214,12 +218,12 @@ void tr_utpInit(tr_session* session)
 
 bool tr_utpPacket(unsigned char const* buf, size_t buflen, struct sockaddr const* from, socklen_t fromlen, tr_session* ss)
 {
-    auto const ret = utp_process_udp(ss->utp_context, buf, buflen, from, fromlen);
+    return utp_process_udp(ss->utp_context, buf, buflen, from, fromlen) != 0;
+}
 
-    /* utp_internal.cpp says "Should be called each time the UDP socket is drained" but it's tricky with libevent */
+void tr_utpIssueDeferredAcks(tr_session* ss)
+{
     utp_issue_deferred_acks(ss->utp_context);
-
-    return ret != 0;
 }
 
 void tr_utpClose(tr_session* session)
@@ -16,4 +16,8 @@ void tr_utpInit(tr_session* session);
 
 bool tr_utpPacket(unsigned char const* buf, size_t buflen, struct sockaddr const* from, socklen_t fromlen, tr_session* ss);
 
+// Call after a batch of packets has been passed to tr_utpPacket(),
+// i.e. each time the UDP socket is drained.
+void tr_utpIssueDeferredAcks(tr_session* ss);
+
 void tr_utpClose(tr_session*);
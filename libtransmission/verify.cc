@@ -4,6 +4,9 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // std::byte, size_t
 #include <ctime>
 #include <mutex>
 #include <optional>
@@ -19,9 +22,10 @@
 #include "crypto-utils.h"
 #include "file.h"
 #include "log.h"
+#include "merkle.h"
 #include "torrent.h"
 #include "tr-assert.h"
-#include "utils.h" // tr_time(), tr_wait()
+#include "utils.h" // tr_time()
 #include "verify.h"
 
 using namespace std::chrono_literals;
@@ -29,9 +33,9 @@ using namespace std::chrono_literals;
 namespace
 {
 
-auto constexpr SleepPerSecondDuringVerify = 100ms;
+auto constexpr BufferSize = size_t{ 1024U * 256U };
 
-}
+} // namespace
 
 int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
 {
@@ -58,103 +62,155 @@ int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
     return 0;
 }
 
-bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& stop_flag)
+void tr_verify_worker::Throttle::setLimit(uint64_t bytes_per_second)
 {
-    auto const begin = tr_time();
-
-    tr_sys_file_t fd = TR_BAD_SYS_FILE;
-    uint64_t file_pos = 0;
-    bool changed = false;
-    bool had_piece = false;
-    time_t last_slept_at = 0;
-    uint32_t piece_pos = 0;
-    tr_file_index_t file_index = 0;
-    tr_file_index_t prev_file_index = ~file_index;
-    tr_piece_index_t piece = 0;
-    auto buffer = std::vector<std::byte>(1024 * 256);
-    auto sha = tr_sha1::create();
+    auto const lock = std::lock_guard(mutex_);
+    limit_ = bytes_per_second;
+}
 
-    tr_logAddDebugTor(tor, "verifying torrent...");
+void tr_verify_worker::Throttle::consume(uint64_t n_bytes)
+{
+    auto lock = std::unique_lock(mutex_);
 
-    while (!stop_flag && piece < tor->pieceCount())
+    for (;;)
     {
-        auto const file_length = tor->fileSize(file_index);
+        if (limit_ == 0U)
+        {
+            return;
+        }
 
-        /* if we're starting a new piece... */
-        if (piece_pos == 0)
+        auto const now = std::chrono::steady_clock::now();
+        if (now - window_start_ >= 1s)
         {
-            had_piece = tor->hasPiece(piece);
+            window_start_ = now;
+            window_bytes_ = 0U;
         }
 
-        /* if we're starting a new file... */
-        if (file_pos == 0 && fd == TR_BAD_SYS_FILE && file_index != prev_file_index)
+        if (window_bytes_ < limit_)
         {
-            auto const found = tor->findFile(file_index);
-            fd = !found ? TR_BAD_SYS_FILE : tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
-            prev_file_index = file_index;
+            window_bytes_ += n_bytes;
+            return;
         }
 
-        /* figure out how much we can read this pass */
-        uint64_t left_in_piece = tor->pieceSize(piece) - piece_pos;
-        uint64_t left_in_file = file_length - file_pos;
-        uint64_t bytes_this_pass = std::min(left_in_file, left_in_piece);
-        bytes_this_pass = std::min(bytes_this_pass, uint64_t(std::size(buffer)));
+        // budget's spent; wait for the next window
+        auto const wait_until = window_start_ + 1s;
+        lock.unlock();
+        std::this_thread::sleep_until(wait_until);
+        lock.lock();
+    }
+}
 
-        /* read a bit */
-        if (fd != TR_BAD_SYS_FILE)
+// Verify the pieces in [begin, end).
+// Several of these may run in parallel on the same torrent, so
+// anything that changes the torrent is done under `torrent_mutex`.
+bool tr_verify_worker::verifyPieces(
+    tr_torrent* tor,
+    tr_piece_index_t begin,
+    tr_piece_index_t end,
+    std::atomic<bool> const& stop_flag,
+    Throttle& throttle,
+    std::mutex& torrent_mutex,
+    std::atomic<tr_piece_index_t>& n_pieces_done)
+{
+    tr_sys_file_t fd = TR_BAD_SYS_FILE;
+    tr_file_index_t fd_file_index = 0;
+    bool changed = false;
+    auto buffer = std::vector<std::byte>(BufferSize);
+    auto sha = tr_sha1::create();
+    auto merkle = tr_merkle::Hasher{};
+    auto const is_v2_only = !tor->hasV1Metadata();
+
+    for (tr_piece_index_t piece = begin; !stop_flag && piece < end; ++piece)
+    {
+        auto [file_index, file_pos] = tor->fileOffset(tor->pieceLoc(piece));
+        auto const v2_piece = is_v2_only ? tor->v2Piece(piece) : std::nullopt;
+        uint64_t left_in_piece = !is_v2_only ? tor->pieceSize(piece) : v2_piece ? v2_piece->n_bytes : 0U;
+
+        while (!stop_flag && left_in_piece > 0U)
         {
-            auto num_read = uint64_t{};
-            if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
+            /* if we're starting a new file... */
+            if (fd == TR_BAD_SYS_FILE || fd_file_index != file_index)
             {
-                bytes_this_pass = num_read;
-                sha->add(std::data(buffer), bytes_this_pass);
-                tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
+                if (fd != TR_BAD_SYS_FILE)
+                {
+                    tr_sys_file_close(fd);
+                }
+
+                auto const found = tor->findFile(file_index);
+                fd = !found ? TR_BAD_SYS_FILE :
+                              tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
+                fd_file_index = file_index;
             }
-        }
 
-        /* move our offsets */
-        left_in_piece -= bytes_this_pass;
-        left_in_file -= bytes_this_pass;
-        piece_pos += bytes_this_pass;
-        file_pos += bytes_this_pass;
+            /* figure out how much we can read this pass */
+            uint64_t const left_in_file = tor->fileSize(file_index) - file_pos;
+            uint64_t bytes_this_pass = std::min(left_in_file, left_in_piece);
+            bytes_this_pass = std::min(bytes_this_pass, uint64_t(std::size(buffer)));
 
-        /* if we're finishing a piece... */
-        if (left_in_piece == 0)
-        {
-            if (auto const has_piece = sha->finish() == tor->pieceHash(piece); has_piece || had_piece)
+            /* read a bit */
+            if (fd != TR_BAD_SYS_FILE && bytes_this_pass > 0U)
             {
-                tor->setHasPiece(piece, has_piece);
-                changed |= has_piece != had_piece;
+                throttle.consume(bytes_this_pass);
+
+                auto num_read = uint64_t{};
+                if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
+                {
+                    bytes_this_pass = num_read;
+                    if (is_v2_only)
+                    {
+                        merkle.add(std::data(buffer), bytes_this_pass);
+                    }
+                    else
+                    {
+                        sha->add(std::data(buffer), bytes_this_pass);
+                    }
+                    tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
+                }
             }
 
-            tor->checked_pieces_.set(piece, true);
-            tor->markChanged();
+            /* move our offsets */
+            left_in_piece -= bytes_this_pass;
+            file_pos += bytes_this_pass;
 
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (auto const now = tr_time(); last_slept_at != now)
+            /* if we're finishing a file... */
+            if (bytes_this_pass == left_in_file)
             {
-                last_slept_at = now;
-                tr_wait(SleepPerSecondDuringVerify);
+                ++file_index;
+                file_pos = 0;
             }
+        }
 
+        if (stop_flag)
+        {
+            break;
+        }
+
+        /* we've finished a piece */
+        auto has_piece = false;
+        if (!is_v2_only)
+        {
+            has_piece = sha->finish() == tor->pieceHash(piece);
             sha->clear();
-            ++piece;
-            tor->setVerifyProgress(piece / float(tor->pieceCount()));
-            piece_pos = 0;
+        }
+        else
+        {
+            has_piece = v2_piece && merkle.finish(v2_piece->width) == v2_piece->hash;
+            merkle.clear();
         }
 
-        /* if we're finishing a file... */
-        if (left_in_file == 0)
         {
-            if (fd != TR_BAD_SYS_FILE)
+            auto const lock = std::lock_guard(torrent_mutex);
+
+            if (auto const had_piece = tor->hasPiece(piece); has_piece || had_piece)
             {
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
+                tor->setHasPiece(piece, has_piece);
+                changed |= has_piece != had_piece;
             }
 
-            ++file_index;
-            file_pos = 0;
+            tor->checked_pieces_.set(piece, true);
+            tor->failed_piece_checks_.unset(piece);
+            tor->markChanged();
+            tor->setVerifyProgress(++n_pieces_done / float(tor->pieceCount()));
         }
     }
 
@@ -164,6 +220,51 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& s
         tr_sys_file_close(fd);
     }
 
+    return changed;
+}
+
+bool tr_verify_worker::verifyTorrent(tr_torrent* tor, size_t n_threads, std::atomic<bool> const& stop_flag, Throttle& throttle)
+{
+    auto const begin = tr_time();
+
+    auto const n_pieces = tor->pieceCount();
+    n_threads = std::clamp(n_threads, size_t{ 1U }, size_t{ std::max(n_pieces, tr_piece_index_t{ 1U }) });
+
+    tr_logAddDebugTor(tor, fmt::format("verifying torrent with {} threads...", n_threads));
+
+    auto torrent_mutex = std::mutex{};
+    auto n_pieces_done = std::atomic<tr_piece_index_t>{};
+    auto changed = std::vector<char>(n_threads);
+
+    // Give each thread a contiguous range of pieces so that its reads stay sequential.
+    auto const range_begin = [n_pieces, n_threads](size_t idx)
+    {
+        return static_cast<tr_piece_index_t>(uint64_t{ n_pieces } * idx / n_threads);
+    };
+    auto const verify_range = [&, tor](size_t idx)
+    {
+        changed[idx] = verifyPieces(
+            tor,
+            range_begin(idx),
+            range_begin(idx + 1U),
+            stop_flag,
+            throttle,
+            torrent_mutex,
+            n_pieces_done);
+    };
+
+    auto threads = std::vector<std::thread>{};
+    threads.reserve(n_threads - 1U);
+    for (size_t idx = 1U; idx < n_threads; ++idx)
+    {
+        threads.emplace_back(verify_range, idx);
+    }
+    verify_range(0U);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
     /* stopwatch */
     time_t const end = tr_time();
     tr_logAddDebugTor(
@@ -174,47 +275,65 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& s
             tor->totalSize(),
             tor->totalSize() / (1 + (end - begin))));
 
-    return changed;
+    return std::any_of(std::begin(changed), std::end(changed), [](char val) { return val != 0; });
 }
 
-void tr_verify_worker::verifyThreadFunc()
+void tr_verify_worker::verifyThreadFunc(ActiveNode* active)
 {
-    for (;;)
+    auto n_threads = size_t{};
     {
-        {
-            auto const lock = std::lock_guard(verify_mutex_);
+        auto const lock = std::lock_guard(verify_mutex_);
+        n_threads = threads_per_torrent_;
+    }
 
-            if (stop_current_)
-            {
-                stop_current_ = false;
-                stop_current_cv_.notify_one();
-            }
+    auto* const tor = active->node.torrent;
+    tr_logAddTraceTor(tor, "Verifying torrent");
+    tor->setVerifyState(TR_VERIFY_NOW);
+    auto const changed = verifyTorrent(tor, n_threads, active->stop, throttle_);
+    tor->setVerifyState(TR_VERIFY_NONE);
+    TR_ASSERT(tr_isTorrent(tor));
 
-            if (std::empty(todo_))
-            {
-                current_node_.reset();
-                verify_thread_id_.reset();
-                return;
-            }
+    if (!active->stop && changed)
+    {
+        tor->setDirty();
+    }
 
-            auto const it = std::begin(todo_);
-            current_node_ = *it;
-            todo_.erase(it);
-        }
+    callCallback(tor, active->stop);
 
-        auto* const tor = current_node_->torrent;
-        tr_logAddTraceTor(tor, "Verifying torrent");
-        tor->setVerifyState(TR_VERIFY_NOW);
-        auto const changed = verifyTorrent(tor, stop_current_);
-        tor->setVerifyState(TR_VERIFY_NONE);
-        TR_ASSERT(tr_isTorrent(tor));
+    auto const lock = std::lock_guard(verify_mutex_);
+    active_.remove_if([active](auto const& that) { return &that == active; });
+    --n_threads_;
+    maybeStartVerify();
+    verify_cv_.notify_all();
+}
 
-        if (!stop_current_ && changed)
+// Must be called with verify_mutex_ held.
+void tr_verify_worker::maybeStartVerify()
+{
+    while (!stopping_ && std::size(active_) < max_concurrent_torrents_)
+    {
+        // pick the highest-priority torrent that isn't on a device we're already reading from
+        auto const iter = std::find_if(
+            std::begin(todo_),
+            std::end(todo_),
+            [this](Node const& node)
+            {
+                return std::none_of(
+                    std::begin(active_),
+                    std::end(active_),
+                    [&node](ActiveNode const& active) { return active.node.device == node.device; });
+            });
+
+        if (iter == std::end(todo_))
         {
-            tor->setDirty();
+            return;
         }
 
-        callCallback(tor, stop_current_);
+        auto* const active = &active_.emplace_back(*iter);
+        todo_.erase(iter);
+
+        ++n_threads_;
+        std::thread(&tr_verify_worker::verifyThreadFunc, this, active).detach();
     }
 }
 
@@ -226,17 +345,15 @@ void tr_verify_worker::add(tr_torrent* tor)
     auto node = Node{};
     node.torrent = tor;
     node.current_size = tor->hasTotal();
+    if (auto const info = tr_sys_path_get_info(tor->currentDir().sv()); info)
+    {
+        node.device = info->device;
+    }
 
     auto const lock = std::lock_guard(verify_mutex_);
     tor->setVerifyState(TR_VERIFY_WAIT);
     todo_.insert(node);
-
-    if (!verify_thread_id_)
-    {
-        auto thread = std::thread(&tr_verify_worker::verifyThreadFunc, this);
-        verify_thread_id_ = thread.get_id();
-        thread.detach();
-    }
+    maybeStartVerify();
 }
 
 void tr_verify_worker::remove(tr_torrent* tor)
@@ -245,10 +362,25 @@ void tr_verify_worker::remove(tr_torrent* tor)
 
     auto lock = std::unique_lock(verify_mutex_);
 
-    if (current_node_ && current_node_->torrent == tor)
+    auto const is_active = [this, tor]()
     {
-        stop_current_ = true;
-        stop_current_cv_.wait(lock, [this]() { return !stop_current_; });
+        return std::any_of(
+            std::begin(active_),
+            std::end(active_),
+            [tor](ActiveNode const& active) { return active.node.torrent == tor; });
+    };
+
+    if (is_active())
+    {
+        for (auto& active : active_)
+        {
+            if (active.node.torrent == tor)
+            {
+                active.stop = true;
+            }
+        }
+
+        verify_cv_.wait(lock, [&is_active]() { return !is_active(); });
     }
     else
     {
@@ -267,16 +399,34 @@ void tr_verify_worker::remove(tr_torrent* tor)
     }
 }
 
+void tr_verify_worker::setThreadsPerTorrent(size_t n_threads)
+{
+    auto const lock = std::lock_guard(verify_mutex_);
+    threads_per_torrent_ = std::max(n_threads, size_t{ 1U });
+}
+
+void tr_verify_worker::setMaxConcurrentTorrents(size_t n_torrents)
+{
+    auto const lock = std::lock_guard(verify_mutex_);
+    max_concurrent_torrents_ = std::max(n_torrents, size_t{ 1U });
+    maybeStartVerify();
+}
+
+void tr_verify_worker::setBytesPerSecondLimit(uint64_t bytes_per_second)
+{
+    throttle_.setLimit(bytes_per_second);
+}
+
 tr_verify_worker::~tr_verify_worker()
 {
-    {
-        auto const lock = std::lock_guard(verify_mutex_);
-        stop_current_ = true;
-        todo_.clear();
-    }
+    auto lock = std::unique_lock(verify_mutex_);
 
-    while (verify_thread_id_.has_value())
+    stopping_ = true;
+    todo_.clear();
+    for (auto& active : active_)
     {
-        tr_wait(20ms);
+        active.stop = true;
     }
+
+    verify_cv_.wait(lock, [this]() { return n_threads_ == 0U; });
 }
@@ -10,14 +10,16 @@
 #endif
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef> // size_t
 #include <cstdint>
 #include <functional>
 #include <list>
 #include <mutex>
-#include <optional>
 #include <set>
-#include <thread>
+
+#include "transmission.h" // tr_piece_index_t
 
 struct tr_session;
 struct tr_torrent;
@@ -27,6 +29,9 @@ class tr_verify_worker
 public:
     using callback_func = std::function<void(tr_torrent*, bool aborted)>;
 
+    static auto constexpr DefaultThreadsPerTorrent = size_t{ 1U };
+    static auto constexpr DefaultMaxConcurrentTorrents = size_t{ 1U };
+
     ~tr_verify_worker();
 
     void addCallback(callback_func callback)
@@ -38,11 +43,23 @@ public:
 
     void remove(tr_torrent* tor);
 
+    // How many threads hash each torrent's pieces in parallel.
+    void setThreadsPerTorrent(size_t n_threads);
+
+    // How many torrents can be verified at once.
+    // Torrents whose data lives on the same device are never verified
+    // at the same time, since that would just make the disk thrash.
+    void setMaxConcurrentTorrents(size_t n_torrents);
+
+    // Total disk read budget shared by all verify threads. 0 means unlimited.
+    void setBytesPerSecondLimit(uint64_t bytes_per_second);
+
 private:
     struct Node
     {
         tr_torrent* torrent = nullptr;
         uint64_t current_size = 0;
+        uint64_t device = 0;
 
         [[nodiscard]] int compare(Node const& that) const;
 
@@ -52,6 +69,33 @@ private:
         }
     };
 
+    struct ActiveNode
+    {
+        explicit ActiveNode(Node const& node_in)
+            : node{ node_in }
+        {
+        }
+
+        Node node;
+        std::atomic<bool> stop = false;
+    };
+
+    // Shares a bytes-per-second budget between all the verify threads.
+    class Throttle
+    {
+    public:
+        void setLimit(uint64_t bytes_per_second);
+
+        // Blocks until `n_bytes` more bytes can be read without exceeding the limit.
+        void consume(uint64_t n_bytes);
+
+    private:
+        std::mutex mutex_;
+        std::chrono::steady_clock::time_point window_start_ = {};
+        uint64_t window_bytes_ = 0;
+        uint64_t limit_ = 0;
+    };
+
     void callCallback(tr_torrent* tor, bool aborted) const
     {
         for (auto const& callback : callbacks_)
@@ -60,17 +104,33 @@ private:
         }
     }
 
-    void verifyThreadFunc();
-    [[nodiscard]] static bool verifyTorrent(tr_torrent* tor, std::atomic<bool> const& stop_flag);
+    void maybeStartVerify();
+    void verifyThreadFunc(ActiveNode* active);
+    [[nodiscard]] static bool verifyTorrent(
+        tr_torrent* tor,
+        size_t n_threads,
+        std::atomic<bool> const& stop_flag,
+        Throttle& throttle);
+    [[nodiscard]] static bool verifyPieces(
+        tr_torrent* tor,
+        tr_piece_index_t begin,
+        tr_piece_index_t end,
+        std::atomic<bool> const& stop_flag,
+        Throttle& throttle,
+        std::mutex& torrent_mutex,
+        std::atomic<tr_piece_index_t>& n_pieces_done);
 
     std::list<callback_func> callbacks_;
     std::mutex verify_mutex_;
+    std::condition_variable verify_cv_;
 
     std::set<Node> todo_;
-    std::optional<Node> current_node_;
+    std::list<ActiveNode> active_;
 
-    std::optional<std::thread::id> verify_thread_id_;
+    Throttle throttle_;
 
-    std::atomic<bool> stop_current_ = false;
-    std::condition_variable stop_current_cv_;
+    size_t threads_per_torrent_ = DefaultThreadsPerTorrent;
+    size_t max_concurrent_torrents_ = DefaultMaxConcurrentTorrents;
+    size_t n_threads_ = 0;
+    bool stopping_ = false;
 };
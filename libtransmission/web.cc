@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <stack>
 #include <string>
 #include <thread>
@@ -209,6 +210,11 @@ public:
         queued_tasks_cv_.notify_one();
     }
 
+    [[nodiscard]] tr_web::Stats stats() const noexcept
+    {
+        return { n_requests_served_.load(), n_connections_opened_.load() };
+    }
+
     void fetch(FetchOptions&& options)
     {
         if (deadline_exists())
@@ -229,6 +235,7 @@ public:
             , options{ std::move(options_in) }
         {
             auto const parsed = tr_urlParse(options.url);
+            host_ = parsed ? parsed->host : ""sv;
             easy_ = parsed ? impl.get_easy(parsed->host) : nullptr;
 
             response.user_data = options.done_func_user_data;
@@ -266,6 +273,11 @@ public:
             return options.url;
         }
 
+        [[nodiscard]] constexpr auto const& host() const
+        {
+            return host_;
+        }
+
         [[nodiscard]] constexpr auto const& range() const
         {
             return options.range;
@@ -368,6 +380,8 @@ public:
 
         tr_web::FetchOptions options;
 
+        std::string host_;
+
         CURL* easy_;
     };
 
@@ -375,6 +389,18 @@ public:
     static auto constexpr DnsCacheTimeoutSecs = long{ 60 * 60 };
     static auto constexpr MaxRedirects = long{ 10 };
 
+    // Requests to the same host share this many connections,
+    // or a single connection if the server speaks HTTP/2
+    static auto constexpr MaxConnectionsPerHost = long{ 8 };
+
+    // More requests than this to a single host wait in `queued_tasks_`.
+    // This keeps announce storms, e.g. after a restart, from piling
+    // up behind a busy tracker in curl where their timeouts are ticking.
+    // A host that has answered over HTTP/2 or later can multiplex
+    // requests on one connection, so more of them can run at once.
+    static auto constexpr MaxRunningTasksPerHost = size_t{ MaxConnectionsPerHost };
+    static auto constexpr MaxRunningTasksPerMultiplexingHost = size_t{ 32U };
+
     bool const curl_verbose = tr_env_key_exists("TR_CURL_VERBOSE");
     bool const curl_ssl_verify = !tr_env_key_exists("TR_CURL_SSL_NO_VERIFY");
     bool const curl_proxy_ssl_verify = !tr_env_key_exists("TR_CURL_PROXY_SSL_NO_VERIFY");
@@ -565,6 +591,14 @@ public:
         (void)curl_easy_setopt(e, CURLOPT_WRITEFUNCTION, &tr_web::Impl::onDataReceived);
         (void)curl_easy_setopt(e, CURLOPT_MAXREDIRS, MaxRedirects);
 
+#if LIBCURL_VERSION_NUM >= 0x072F00 /* 7.47.0 */
+        (void)curl_easy_setopt(e, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072B00 /* 7.43.0 */
+        // wait for a connection that can multiplex rather than opening another one
+        (void)curl_easy_setopt(e, CURLOPT_PIPEWAIT, 1L);
+#endif
+
         if (auto const addrstr = task.publicAddress(); addrstr)
         {
             (void)curl_easy_setopt(e, CURLOPT_INTERFACE, addrstr->c_str());
@@ -631,10 +665,38 @@ public:
             return;
         }
 
+        if (auto host = n_running_per_host_.find(iter->host()); host != std::end(n_running_per_host_) && --host->second == 0U)
+        {
+            n_running_per_host_.erase(host);
+        }
+
         iter->done();
         running_tasks_.erase(iter);
     }
 
+    // @return true if a task was moved to `running_tasks_`
+    bool maybeStartTask(CURLM* multi, std::list<Task>::iterator task)
+    {
+        auto host = n_running_per_host_.find(task->host());
+        if (host == std::end(n_running_per_host_))
+        {
+            host = n_running_per_host_.try_emplace(task->host(), 0U).first;
+        }
+
+        auto const max_running = multiplexing_hosts_.count(task->host()) != 0U ? MaxRunningTasksPerMultiplexingHost :
+                                                                                 MaxRunningTasksPerHost;
+        if (host->second >= max_running && !deadline_reached())
+        {
+            return false;
+        }
+
+        ++host->second;
+        initEasy(*task);
+        curl_multi_add_handle(multi, task->easy());
+        running_tasks_.splice(std::end(running_tasks_), queued_tasks_, task);
+        return true;
+    }
+
     void timeout_task(Task& task)
     {
         task.response.status = 408; // request timed out
@@ -646,6 +708,12 @@ public:
     void curlThreadFunc()
     {
         auto const multi = curl_helpers::multi_unique_ptr{ curl_multi_init() };
+#if LIBCURL_VERSION_NUM >= 0x071E00 /* 7.30.0 */
+        (void)curl_multi_setopt(multi.get(), CURLMOPT_MAX_HOST_CONNECTIONS, MaxConnectionsPerHost);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072B00 /* 7.43.0 */
+        (void)curl_multi_setopt(multi.get(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
 
         auto repeats = unsigned{};
         for (;;)
@@ -662,6 +730,8 @@ public:
 
             if (deadline_exists() && is_idle())
             {
+                auto const [n_requests, n_connections] = stats();
+                tr_logAddDebug(fmt::format("served {} requests over {} new connections", n_requests, n_connections));
                 break;
             }
 
@@ -678,15 +748,11 @@ public:
                 }
 
                 // add queued tasks
-                if (!std::empty(queued_tasks_))
+                for (auto iter = std::begin(queued_tasks_); iter != std::end(queued_tasks_);)
                 {
-                    for (auto& task : queued_tasks_)
-                    {
-                        initEasy(task);
-                        curl_multi_add_handle(multi.get(), task.easy());
-                    }
-
-                    running_tasks_.splice(std::end(running_tasks_), queued_tasks_);
+                    auto const next = std::next(iter);
+                    maybeStartTask(multi.get(), iter);
+                    iter = next;
                 }
             }
 
@@ -730,8 +796,19 @@ public:
 
                     auto req_bytes_sent = long{};
                     auto total_time = double{};
+                    auto n_connects = long{};
                     curl_easy_getinfo(e, CURLINFO_REQUEST_SIZE, &req_bytes_sent);
                     curl_easy_getinfo(e, CURLINFO_TOTAL_TIME, &total_time);
+                    curl_easy_getinfo(e, CURLINFO_NUM_CONNECTS, &n_connects);
+                    ++n_requests_served_;
+                    n_connections_opened_ += static_cast<size_t>(std::max(n_connects, 0L));
+#if LIBCURL_VERSION_NUM >= 0x073200 /* 7.50.0 */
+                    if (auto http_version = long{}; curl_easy_getinfo(e, CURLINFO_HTTP_VERSION, &http_version) == CURLE_OK &&
+                        http_version >= CURL_HTTP_VERSION_2_0)
+                    {
+                        multiplexing_hosts_.emplace(task->host());
+                    }
+#endif
                     curl_easy_getinfo(e, CURLINFO_RESPONSE_CODE, &task->response.status);
                     task->response.did_connect = task->response.status > 0 || req_bytes_sent > 0;
                     task->response.did_timeout = task->response.status == 0 &&
@@ -745,12 +822,17 @@ public:
 
     curl_helpers::shared_unique_ptr const curlsh_{ curl_share_init() };
 
+    std::atomic<size_t> n_requests_served_ = {};
+    std::atomic<size_t> n_connections_opened_ = {};
+
     std::map<std::string /*host*/, std::stack<curl_helpers::easy_unique_ptr>, std::less<>> easy_pool_;
 
     std::mutex tasks_mutex_;
     std::condition_variable queued_tasks_cv_;
     std::list<Task> queued_tasks_;
     std::list<Task> running_tasks_;
+    std::map<std::string /*host*/, size_t, std::less<>> n_running_per_host_;
+    std::set<std::string /*host*/, std::less<>> multiplexing_hosts_; // only used in the curl thread
 
     CURLSH* shared()
     {
@@ -816,3 +898,8 @@ void tr_web::startShutdown(std::chrono::milliseconds deadline)
 {
     impl_->startShutdown(deadline);
 }
+
+tr_web::Stats tr_web::stats() const
+{
+    return impl_->stats();
+}
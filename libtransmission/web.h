@@ -94,6 +94,18 @@ public:
 
     void fetch(FetchOptions&& options);
 
+    struct Stats
+    {
+        // how many fetches have finished
+        size_t requests_served = 0;
+
+        // how many new connections those fetches needed to open.
+        // The difference is how many fetches reused a connection.
+        size_t connections_opened = 0;
+    };
+
+    [[nodiscard]] Stats stats() const;
+
     // Notify tr_web that it's going to be destroyed soon.
     // New fetch() tasks will be rejected, but already-running tasks
     // are left alone so that they can finish.
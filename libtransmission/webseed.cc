@@ -18,6 +18,7 @@
 #include "transmission.h"
 
 #include "bandwidth.h"
+#include "block-pool.h"
 #include "cache.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
@@ -338,7 +339,7 @@ public:
         tr_session* session,
         tr_torrent_id_t tor_id,
         tr_block_index_t block,
-        std::unique_ptr<std::vector<uint8_t>>& data,
+        tr_block_pool::Buf data,
         tr_webseed* webseed)
         : session_{ session }
         , tor_id_{ tor_id }
@@ -363,7 +364,7 @@ private:
     tr_session* const session_;
     tr_torrent_id_t const tor_id_;
     tr_block_index_t const block_;
-    std::unique_ptr<std::vector<uint8_t>> data_;
+    tr_block_pool::Buf data_;
     tr_webseed* const webseed_;
 };
 
@@ -394,10 +395,9 @@ void useFetchedBlocks(tr_webseed_task* task)
         }
         else
         {
-            auto block_buf = std::make_unique<std::vector<uint8_t>>();
-            block_buf->resize(block_size);
-            evbuffer_remove(task->content(), std::data(*block_buf), std::size(*block_buf));
-            auto* const data = new write_block_data{ session, tor->id(), task->loc.block, block_buf, webseed };
+            auto block_buf = session->blockPool().get(block_size);
+            evbuffer_remove(task->content(), std::data(block_buf), std::size(block_buf));
+            auto* const data = new write_block_data{ session, tor->id(), task->loc.block, std::move(block_buf), webseed };
             session->runInSessionThread(&write_block_data::write_block_func, data);
         }
 
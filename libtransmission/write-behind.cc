@@ -0,0 +1,390 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <iterator> // std::back_inserter(), std::next()
+#include <memory>
+#include <mutex>
+#include <numeric> // std::accumulate()
+#include <thread>
+#include <tuple> // std::tie()
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "error.h"
+#include "file.h"
+#include "tr-assert.h"
+#include "utils.h" // _()
+#include "write-behind.h"
+
+#ifdef WITH_IO_URING
+#include "io-uring.h"
+#endif
+
+namespace
+{
+
+[[nodiscard]] uint64_t spanSize(tr_write_behind::Task::Span const& span) noexcept
+{
+    return std::accumulate(
+        std::begin(span.bufs),
+        std::end(span.bufs),
+        uint64_t{},
+        [](uint64_t sum, auto const& buf) { return sum + buf.len; });
+}
+
+// Remove the first `n_bytes` bytes from `bufs`.
+void skipBytes(std::vector<tr_sys_iovec>& bufs, uint64_t n_bytes)
+{
+    auto iter = std::begin(bufs);
+    for (; iter != std::end(bufs) && n_bytes >= iter->len; ++iter)
+    {
+        n_bytes -= iter->len;
+    }
+
+    if (iter != std::end(bufs))
+    {
+        iter->base = static_cast<uint8_t*>(iter->base) + n_bytes;
+        iter->len -= n_bytes;
+    }
+
+    bufs.erase(std::begin(bufs), iter);
+}
+
+} // namespace
+
+tr_write_behind::File::~File()
+{
+    tr_sys_file_close(fd);
+}
+
+tr_write_behind::tr_write_behind(callback_func callback)
+    : callback_{ std::move(callback) }
+    , writer_thread_{ &tr_write_behind::writerThreadFunc, this }
+{
+}
+
+tr_write_behind::~tr_write_behind()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+        todo_cv_.notify_all();
+    }
+
+    writer_thread_.join();
+}
+
+bool tr_write_behind::writeAll(tr_sys_file_t fd, uint64_t offset, std::vector<tr_sys_iovec>& bufs, tr_error** error)
+{
+    while (!std::empty(bufs))
+    {
+        auto n_written = uint64_t{};
+
+        if (!tr_sys_file_write_at_v(fd, std::data(bufs), std::size(bufs), offset, &n_written, error))
+        {
+            return false;
+        }
+
+        offset += n_written;
+        skipBytes(bufs, n_written);
+    }
+
+    return true;
+}
+
+size_t tr_write_behind::taskSize(Task const& task) noexcept
+{
+    return std::accumulate(
+        std::begin(task.spans),
+        std::end(task.spans),
+        size_t{},
+        [](size_t sum, auto const& span) { return sum + spanSize(span); });
+}
+
+std::vector<tr_write_behind::Result> tr_write_behind::writeBatch(std::vector<Task>& batch, tr_io_uring* ring)
+{
+    struct Write
+    {
+        size_t task_idx;
+        Task::Span* span;
+    };
+
+    auto writes = std::vector<Write>{};
+    for (size_t i = 0, n = std::size(batch); i < n; ++i)
+    {
+        std::transform(
+            std::begin(batch[i].spans),
+            std::end(batch[i].spans),
+            std::back_inserter(writes),
+            [i](auto& span) { return Write{ i, &span }; });
+    }
+
+    // Sort the writes by file position so that neighbouring spans can be
+    // coalesced. The sort is stable, so if a block was queued twice, the
+    // newer copy is still written last.
+    std::stable_sort(
+        std::begin(writes),
+        std::end(writes),
+        [&batch](auto const& a, auto const& b)
+        {
+            return std::tie(batch[a.task_idx].tor_id, a.span->file_index, a.span->offset) <
+                std::tie(batch[b.task_idx].tor_id, b.span->file_index, b.span->offset);
+        });
+
+    // gather the spans that continue where the previous one ended
+    struct Run
+    {
+        size_t writes_begin;
+        size_t writes_end;
+        std::vector<tr_sys_iovec> bufs;
+        uint64_t n_bytes = 0;
+        uint64_t n_written = 0;
+        int err = 0;
+
+        // whether it overlaps an earlier run, e.g. a block that was queued twice.
+        // Those have to land in order so that the newer data wins.
+        bool overlaps_earlier = false;
+    };
+
+    auto runs = std::vector<Run>{};
+    auto file_end = uint64_t{};
+    for (size_t begin = 0, end = 0, n = std::size(writes); begin < n; begin = end)
+    {
+        auto const tor_id = batch[writes[begin].task_idx].tor_id;
+        auto const& first = *writes[begin].span;
+
+        auto const same_file = !std::empty(runs) && batch[writes[runs.back().writes_begin].task_idx].tor_id == tor_id &&
+            writes[runs.back().writes_begin].span->file_index == first.file_index;
+        auto& run = runs.emplace_back(Run{ begin, begin, {} });
+        run.overlaps_earlier = same_file && first.offset < file_end;
+        for (end = begin; end < n && batch[writes[end].task_idx].tor_id == tor_id &&
+             writes[end].span->file_index == first.file_index && writes[end].span->offset == first.offset + run.n_bytes;
+             ++end)
+        {
+            auto const& span = *writes[end].span;
+            run.bufs.insert(std::end(run.bufs), std::begin(span.bufs), std::end(span.bufs));
+            run.n_bytes += spanSize(span);
+        }
+
+        run.writes_end = end;
+        file_end = same_file ? std::max(file_end, first.offset + run.n_bytes) : first.offset + run.n_bytes;
+    }
+
+#ifdef WITH_IO_URING
+    // submit all the runs at once and let the kernel work on them in parallel
+    if (ring != nullptr)
+    {
+        auto ops = std::vector<tr_io_uring::Write>{};
+        ops.reserve(std::size(runs));
+        for (auto const& run : runs)
+        {
+            auto const& first = *writes[run.writes_begin].span;
+            ops.push_back({ first.file->fd, first.offset, std::data(run.bufs), std::size(run.bufs), run.overlaps_earlier });
+        }
+
+        if (ring->writev(std::data(ops), std::size(ops)))
+        {
+            for (size_t i = 0, n = std::size(runs); i < n; ++i)
+            {
+                if (auto const result = ops[i].result; result < 0)
+                {
+                    runs[i].err = static_cast<int>(-result);
+                }
+                else
+                {
+                    runs[i].n_written = static_cast<uint64_t>(result);
+                }
+            }
+        }
+    }
+#else
+    TR_ASSERT(ring == nullptr);
+#endif
+
+    auto results = std::vector<Result>(std::size(batch));
+
+    // set when a run had to be finished here, after the ring was done
+    auto rewrote_overlapped = false;
+
+    for (auto& run : runs)
+    {
+        auto const& first = *writes[run.writes_begin].span;
+
+        // If an older run that this one overlaps was just finished here,
+        // it may have landed on top of this one's data, so write it again.
+        if (!run.overlaps_earlier)
+        {
+            rewrote_overlapped = false;
+        }
+        else if (rewrote_overlapped)
+        {
+            run.n_written = 0;
+            run.err = 0;
+        }
+
+        if (run.err != 0 || run.n_written < run.n_bytes)
+        {
+            rewrote_overlapped = true;
+        }
+
+        // write whatever the ring didn't
+        tr_error* error = nullptr;
+        if (run.err != 0)
+        {
+            tr_error_set_from_errno(&error, run.err);
+        }
+        else if (run.n_written < run.n_bytes)
+        {
+            skipBytes(run.bufs, run.n_written);
+            (void)writeAll(first.file->fd, first.offset + run.n_written, run.bufs, &error);
+        }
+
+        if (error != nullptr)
+        {
+            auto const errmsg = fmt::format(
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", first.file->filename),
+                fmt::arg("error", error->message),
+                fmt::arg("error_code", error->code));
+
+            for (auto i = run.writes_begin; i < run.writes_end; ++i)
+            {
+                if (auto& result = results[writes[i].task_idx]; result.err == 0)
+                {
+                    result = Result{ error->code, errmsg };
+                }
+            }
+
+            tr_error_clear(&error);
+        }
+    }
+
+    return results;
+}
+
+void tr_write_behind::writerThreadFunc()
+{
+#ifdef WITH_IO_URING
+    auto const ring_holder = tr_io_uring::create();
+    auto* const ring = ring_holder.get();
+#else
+    tr_io_uring* const ring = nullptr;
+#endif
+
+    for (;;)
+    {
+        auto batch = std::vector<Task>{};
+
+        {
+            auto lock = std::unique_lock(mutex_);
+            todo_cv_.wait(lock, [this]() { return stopping_ || !std::empty(todo_); });
+
+            if (std::empty(todo_)) // stopping, and everything is written
+            {
+                return;
+            }
+
+            batch.swap(todo_);
+            for (auto const& task : batch)
+            {
+                in_progress_.emplace_back(task.tor_id);
+            }
+        }
+
+        auto const results = writeBatch(batch, ring);
+
+        for (size_t i = 0, n = std::size(batch); i < n; ++i)
+        {
+            callback_(batch[i].id, batch[i].tor_id, results[i].err, results[i].errmsg);
+        }
+
+        auto batch_bytes = size_t{};
+        for (auto const& task : batch)
+        {
+            batch_bytes += taskSize(task);
+        }
+
+        // close any files that no queued task is using
+        batch.clear();
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+            in_progress_.clear();
+            queued_bytes_ -= batch_bytes;
+
+            for (auto iter = std::begin(files_); iter != std::end(files_);)
+            {
+                iter = iter->second.expired() ? files_.erase(iter) : std::next(iter);
+            }
+
+            idle_cv_.notify_all();
+        }
+    }
+}
+
+void tr_write_behind::add(Task&& task)
+{
+    auto const task_size = taskSize(task);
+
+    auto const lock = std::lock_guard(mutex_);
+    queued_bytes_ += task_size;
+    todo_.emplace_back(std::move(task));
+    todo_cv_.notify_one();
+}
+
+bool tr_write_behind::isFull() const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return queued_bytes_ >= max_queued_bytes_;
+}
+
+std::shared_ptr<tr_write_behind::File> tr_write_behind::findFile(tr_torrent_id_t tor_id, tr_file_index_t file_index)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (auto const iter = files_.find(std::make_pair(tor_id, file_index)); iter != std::end(files_))
+    {
+        return iter->second.lock();
+    }
+
+    return {};
+}
+
+std::shared_ptr<tr_write_behind::File> tr_write_behind::addFile(
+    tr_torrent_id_t tor_id,
+    tr_file_index_t file_index,
+    tr_sys_file_t fd,
+    std::string filename)
+{
+    auto file = std::make_shared<File>(fd, std::move(filename));
+
+    auto const lock = std::lock_guard(mutex_);
+    files_.insert_or_assign(std::make_pair(tor_id, file_index), file);
+    return file;
+}
+
+void tr_write_behind::wait(tr_torrent_id_t tor_id)
+{
+    auto lock = std::unique_lock(mutex_);
+    idle_cv_.wait(
+        lock,
+        [this, tor_id]()
+        {
+            return std::none_of(std::begin(todo_), std::end(todo_), [tor_id](auto const& task) { return task.tor_id == tor_id; }) &&
+                std::find(std::begin(in_progress_), std::end(in_progress_), tor_id) == std::end(in_progress_);
+        });
+}
+
+void tr_write_behind::setMaxQueuedBytes(size_t max_bytes)
+{
+    auto const lock = std::lock_guard(mutex_);
+    max_queued_bytes_ = max_bytes;
+    idle_cv_.notify_all();
+}
@@ -0,0 +1,144 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility> // std::pair
+#include <vector>
+
+#include "transmission.h" // tr_file_index_t, tr_torrent_id_t
+
+#include "file.h" // tr_sys_file_t, tr_sys_iovec
+
+struct tr_error;
+class tr_io_uring;
+
+// Writes flushed cache blocks to disk on a background thread
+// so that the session thread doesn't block on slow disks.
+//
+// Like tr_piece_checker's, tasks are self-contained: each span
+// holds a reference to its own file descriptor, so the writer thread
+// never touches a tr_torrent or the open-files pool. Queued spans in
+// the same file share one descriptor. Whatever tasks are
+// queued when the writer wakes up are written as a single batch,
+// and adjacent spans in the same file are coalesced into one write.
+// Where io_uring is available, the batch's writes are submitted
+// together so that the kernel can work on them in parallel.
+class tr_write_behind
+{
+public:
+    // A file descriptor that's closed when the last span using it is done.
+    struct File
+    {
+        File(tr_sys_file_t fd_in, std::string filename_in)
+            : fd{ fd_in }
+            , filename{ std::move(filename_in) }
+        {
+        }
+
+        ~File();
+
+        File(File const&) = delete;
+        File& operator=(File const&) = delete;
+
+        tr_sys_file_t const fd;
+        std::string const filename; // for error messages
+    };
+
+    struct Task
+    {
+        struct Span
+        {
+            tr_file_index_t file_index = {};
+            std::shared_ptr<File> file;
+            uint64_t offset = 0;
+            std::vector<tr_sys_iovec> bufs;
+        };
+
+        uint64_t id = {};
+        tr_torrent_id_t tor_id = {};
+        std::vector<Span> spans;
+    };
+
+    // Called from the writer thread when a task is done.
+    // `err` is 0 on success, or an errno value on failure.
+    using callback_func = std::function<void(uint64_t task_id, tr_torrent_id_t tor_id, int err, std::string const& errmsg)>;
+
+    static auto constexpr DefaultMaxQueuedBytes = size_t{ 1024U * 1024U * 4U };
+
+    explicit tr_write_behind(callback_func callback);
+
+    // Writes any queued tasks before returning.
+    ~tr_write_behind();
+
+    tr_write_behind(tr_write_behind const&) = delete;
+    tr_write_behind& operator=(tr_write_behind const&) = delete;
+
+    // Queue a task. This never blocks; callers that can wait should
+    // check isFull() first and hold on to their data until it isn't.
+    void add(Task&& task);
+
+    // @return true if the queue has reached its byte limit,
+    // i.e. if the disk isn't keeping up with the writes
+    [[nodiscard]] bool isFull() const;
+
+    // @return the file that the torrent's queued writes to `file_index`
+    // are using, or nullptr if none are queued
+    [[nodiscard]] std::shared_ptr<File> findFile(tr_torrent_id_t tor_id, tr_file_index_t file_index);
+
+    // Take ownership of `fd` and share it with later writes to the same file.
+    [[nodiscard]] std::shared_ptr<File> addFile(
+        tr_torrent_id_t tor_id,
+        tr_file_index_t file_index,
+        tr_sys_file_t fd,
+        std::string filename);
+
+    // Wait until none of the torrent's tasks are queued or running.
+    void wait(tr_torrent_id_t tor_id);
+
+    void setMaxQueuedBytes(size_t max_bytes);
+
+    // Write all of `bufs`, retrying after short writes. `bufs` is consumed.
+    static bool writeAll(tr_sys_file_t fd, uint64_t offset, std::vector<tr_sys_iovec>& bufs, tr_error** error);
+
+private:
+    struct Result
+    {
+        int err = 0;
+        std::string errmsg;
+    };
+
+    void writerThreadFunc();
+    [[nodiscard]] static std::vector<Result> writeBatch(std::vector<Task>& batch, tr_io_uring* ring);
+    [[nodiscard]] static size_t taskSize(Task const& task) noexcept;
+
+    callback_func const callback_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable todo_cv_;
+    std::condition_variable idle_cv_;
+
+    std::vector<Task> todo_;
+    std::map<std::pair<tr_torrent_id_t, tr_file_index_t>, std::weak_ptr<File>> files_;
+    std::vector<tr_torrent_id_t> in_progress_;
+    size_t queued_bytes_ = 0;
+    size_t max_queued_bytes_ = DefaultMaxQueuedBytes;
+    bool stopping_ = false;
+
+    std::thread writer_thread_;
+};
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <array>
 #include <string_view>
+#include <vector>
 
 #define LIBTRANSMISSION_ANNOUNCER_MODULE
 
@@ -306,3 +307,113 @@ TEST_F(AnnouncerTest, parseHttpScrapeResponseMultiWithMissing)
     EXPECT_EQ(8, response.rows[2].leechers);
     EXPECT_EQ(9, response.rows[2].downloads);
 }
+
+TEST_F(AnnouncerTest, trackerBudgetAdapts)
+{
+    auto budget = tr_tracker_budget{};
+    EXPECT_EQ(tr_tracker_budget::InitialLimit, budget.limit());
+
+    // fill the budget
+    for (size_t i = 0; i < tr_tracker_budget::InitialLimit; ++i)
+    {
+        EXPECT_TRUE(budget.canSend());
+        budget.onSent();
+    }
+    EXPECT_FALSE(budget.canSend());
+    EXPECT_EQ(tr_tracker_budget::InitialLimit, budget.inFlight());
+
+    // a limit's worth of timely responses raises the limit by one
+    for (size_t i = 0; i < tr_tracker_budget::InitialLimit; ++i)
+    {
+        budget.onDone(true);
+    }
+    EXPECT_EQ(0U, budget.inFlight());
+    EXPECT_EQ(tr_tracker_budget::InitialLimit + 1U, budget.limit());
+
+    // a timeout halves it
+    budget.onSent();
+    budget.onDone(false);
+    EXPECT_EQ((tr_tracker_budget::InitialLimit + 1U) / 2U, budget.limit());
+
+    // but never below the minimum...
+    for (int i = 0; i < 10; ++i)
+    {
+        budget.onSent();
+        budget.onDone(false);
+    }
+    EXPECT_EQ(tr_tracker_budget::MinLimit, budget.limit());
+    EXPECT_TRUE(budget.canSend());
+
+    // ...or above the maximum
+    for (int i = 0; i < 10000; ++i)
+    {
+        budget.onSent();
+        budget.onDone(true);
+    }
+    EXPECT_EQ(tr_tracker_budget::MaxLimit, budget.limit());
+}
+
+TEST_F(AnnouncerTest, tierTimersPopDueTiers)
+{
+    using Key = tr_tier_timers::Key;
+    using Kind = tr_tier_timers::Kind;
+
+    auto const a = Key{ 1, 0 };
+    auto const b = Key{ 1, 1 };
+    auto const c = Key{ 2, 0 };
+
+    auto timers = tr_tier_timers{};
+    timers.schedule(c, Kind::Announce, 100);
+    timers.schedule(b, Kind::Announce, 300);
+    timers.schedule(a, Kind::Announce, 200);
+    timers.schedule(a, Kind::Scrape, 100);
+
+    // nothing is due yet
+    EXPECT_TRUE(std::empty(timers.popDue(99)));
+
+    // due tiers come out in key order, each listed once
+    EXPECT_EQ((std::vector<Key>{ a, c }), timers.popDue(100));
+    EXPECT_EQ((std::vector<Key>{ a, b }), timers.popDue(300));
+    EXPECT_EQ(0U, timers.size());
+}
+
+TEST_F(AnnouncerTest, tierTimersReschedule)
+{
+    using Key = tr_tier_timers::Key;
+    using Kind = tr_tier_timers::Kind;
+
+    auto const a = Key{ 1, 0 };
+    auto const b = Key{ 1, 1 };
+
+    auto timers = tr_tier_timers{};
+
+    // scheduling the same time again doesn't add entries,
+    // e.g. when a busy tracker turns the same tier away every upkeep
+    for (int i = 0; i < 10; ++i)
+    {
+        timers.schedule(a, Kind::Announce, 100);
+        timers.schedule(a, Kind::Scrape, 100);
+    }
+    EXPECT_EQ(2U, timers.size());
+
+    // a tier that was turned away can be retried at the same time
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_EQ(std::vector<Key>{ a }, timers.popDue(200));
+        timers.schedule(a, Kind::Announce, 100);
+    }
+    EXPECT_EQ(1U, timers.size());
+    EXPECT_EQ(std::vector<Key>{ a }, timers.popDue(200));
+
+    // moving a tier's time makes its old entry stale
+    timers.schedule(b, Kind::Announce, 100);
+    timers.schedule(b, Kind::Announce, 500);
+    EXPECT_TRUE(std::empty(timers.popDue(200)));
+    EXPECT_EQ(std::vector<Key>{ b }, timers.popDue(500));
+
+    timers.schedule(b, Kind::Announce, 500);
+    timers.schedule(b, Kind::Announce, 300);
+    EXPECT_EQ(std::vector<Key>{ b }, timers.popDue(300));
+    EXPECT_TRUE(std::empty(timers.popDue(500)));
+    EXPECT_EQ(0U, timers.size());
+}
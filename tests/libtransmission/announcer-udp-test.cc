@@ -3,9 +3,13 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <array>
 #include <cstring> // for std::memcpy()
 #include <deque>
+#include <map>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include <fmt/format.h>
@@ -427,6 +431,145 @@ TEST_F(AnnouncerUdpTest, canMultiScrape)
     expectEqual(expected_response, *response);
 }
 
+TEST_F(AnnouncerUdpTest, coalescesScrapesToSameTracker)
+{
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // queue up scrapes for 30 + 30 + 30 + 10 torrents. With the default
+    // multiscrape max of 60, they should be packed into packets of 60 and 40.
+    auto const hash_counts = std::array<int, 4>{ 30, 30, 30, 10 };
+    auto expected_responses = std::vector<tr_scrape_response>{};
+    auto responses = std::vector<std::optional<tr_scrape_response>>(std::size(hash_counts));
+    auto rows = std::map<tr_sha1_digest_t, tr_scrape_response_row>{};
+    for (size_t i = 0; i < std::size(hash_counts); ++i)
+    {
+        auto& expected = expected_responses.emplace_back();
+        expected.did_connect = true;
+        expected.did_timeout = false;
+        expected.scrape_url = DefaultScrapeUrl;
+        expected.row_count = hash_counts[i];
+        for (int row = 0; row < expected.row_count; ++row)
+        {
+            auto const n = static_cast<int>(std::size(rows));
+            expected.rows[row] = { tr_rand_obj<tr_sha1_digest_t>(), n, n + 1, n + 2, 0 };
+            rows.try_emplace(expected.rows[row].info_hash, expected.rows[row]);
+        }
+
+        announcer->scrape(
+            buildScrapeRequestFromResponse(expected),
+            [&responses, i](tr_scrape_response const& resp) { responses[i] = resp; });
+    }
+
+    auto sent = waitForAnnouncerToSendMessage(mediator);
+    auto const connection_id = sendConnectionResponse(*announcer, parseConnectionRequest(sent));
+
+    EXPECT_TRUE(libtransmission::test::waitFor(mediator.eventBase(), [&mediator]() { return std::size(mediator.sent_) >= 2U; }));
+    EXPECT_EQ(2U, std::size(mediator.sent_));
+
+    auto packet_sizes = std::vector<size_t>{};
+    while (!std::empty(mediator.sent_))
+    {
+        auto buf = libtransmission::Buffer(mediator.sent_.front().buf_);
+        mediator.sent_.pop_front();
+        auto const [transaction_id, info_hashes] = parseScrapeRequest(buf, connection_id);
+        packet_sizes.push_back(std::size(info_hashes));
+
+        // have the tracker answer every info hash in the packet
+        auto response = libtransmission::Buffer{};
+        response.add_uint32(ScrapeAction);
+        response.add_uint32(transaction_id);
+        for (auto const& info_hash : info_hashes)
+        {
+            auto const& row = rows.at(info_hash);
+            response.add_uint32(row.seeders);
+            response.add_uint32(row.downloads);
+            response.add_uint32(row.leechers);
+        }
+
+        auto arr = std::vector<uint8_t>(std::size(response));
+        response.to_buf(std::data(arr), std::size(arr));
+        EXPECT_TRUE(announcer->handleMessage(std::data(arr), std::size(arr)));
+    }
+
+    std::sort(std::begin(packet_sizes), std::end(packet_sizes));
+    EXPECT_EQ((std::vector<size_t>{ 40U, 60U }), packet_sizes);
+
+    // every request should have gotten its own rows back
+    for (size_t i = 0; i < std::size(hash_counts); ++i)
+    {
+        EXPECT_TRUE(responses[i].has_value());
+        if (responses[i])
+        {
+            expectEqual(expected_responses[i], *responses[i]);
+        }
+    }
+}
+
+TEST_F(AnnouncerUdpTest, batchesStayUnderMultiscrapeMax)
+{
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // scrape 4 x 20 torrents, honoring the tracker's current multiscrape max.
+    // @return the number of info hashes in each packet, smallest first
+    auto responses = std::vector<tr_scrape_response>{};
+    auto connection_id = std::optional<uint64_t>{};
+    auto const scrape_round = [&](int multiscrape_max, std::string_view errmsg)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            auto request = tr_scrape_request{};
+            request.scrape_url = DefaultScrapeUrl;
+            request.info_hash_count = 20;
+            request.multiscrape_max = multiscrape_max;
+            for (int j = 0; j < request.info_hash_count; ++j)
+            {
+                request.info_hash[j] = tr_rand_obj<tr_sha1_digest_t>();
+            }
+
+            announcer->scrape(request, [&responses](tr_scrape_response const& resp) { responses.emplace_back(resp); });
+        }
+
+        if (!connection_id)
+        {
+            auto sent = waitForAnnouncerToSendMessage(mediator);
+            connection_id = sendConnectionResponse(*announcer, parseConnectionRequest(sent));
+        }
+
+        EXPECT_TRUE(libtransmission::test::waitFor(mediator.eventBase(), [&mediator]() { return std::size(mediator.sent_) >= 2U; }));
+
+        auto packet_sizes = std::vector<size_t>{};
+        while (!std::empty(mediator.sent_))
+        {
+            auto buf = libtransmission::Buffer(mediator.sent_.front().buf_);
+            mediator.sent_.pop_front();
+            auto const [transaction_id, info_hashes] = parseScrapeRequest(buf, *connection_id);
+            packet_sizes.push_back(std::size(info_hashes));
+            EXPECT_TRUE(sendError(*announcer, transaction_id, errmsg));
+        }
+
+        std::sort(std::begin(packet_sizes), std::end(packet_sizes));
+        return packet_sizes;
+    };
+
+    // the tracker refuses the full 60-hash packet...
+    EXPECT_EQ((std::vector<size_t>{ 20U, 60U }), scrape_round(60, "Request-URI Too Long"sv));
+
+    // ...and each request learns how big a packet it was refused in,
+    // so that tr_announcer lowers the max once instead of once per request
+    EXPECT_EQ(4U, std::size(responses));
+    EXPECT_EQ(3, std::count_if(
+                     std::begin(responses),
+                     std::end(responses),
+                     [](auto const& resp) { return resp.row_count == 20 && resp.n_hashes_sent == 60; }));
+
+    // with the lowered max, the next round's batches are smaller
+    EXPECT_EQ((std::vector<size_t>{ 40U, 40U }), scrape_round(55, "ok"sv));
+}
+
 TEST_F(AnnouncerUdpTest, canHandleScrapeError)
 {
     // build the expected reponse
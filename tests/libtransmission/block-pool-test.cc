@@ -0,0 +1,84 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <utility>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/block-pool.h>
+
+#include "gtest/gtest.h"
+
+using BlockPoolTest = ::testing::Test;
+
+TEST_F(BlockPoolTest, reusesReturnedBuffers)
+{
+    auto pool = tr_block_pool::create();
+
+    auto buf = pool->get(tr_block_info::BlockSize);
+    EXPECT_EQ(tr_block_info::BlockSize, std::size(buf));
+    EXPECT_NE(nullptr, std::data(buf));
+    auto const* const data = std::data(buf);
+
+    // give it back...
+    buf = {};
+    EXPECT_EQ(0U, std::size(buf));
+    EXPECT_EQ(tr_block_info::BlockSize, pool->stats().pooled_bytes);
+
+    // ...and get it again, even for a smaller block in the same size class
+    buf = pool->get(tr_block_info::BlockSize - 100U);
+    EXPECT_EQ(tr_block_info::BlockSize - 100U, std::size(buf));
+    EXPECT_EQ(data, std::data(buf));
+
+    auto const stats = pool->stats();
+    EXPECT_EQ(1U, stats.allocations);
+    EXPECT_EQ(1U, stats.reuses);
+    EXPECT_EQ(0U, stats.pooled_bytes);
+}
+
+TEST_F(BlockPoolTest, sizeClassesAreSeparate)
+{
+    auto pool = tr_block_pool::create();
+
+    auto small = pool->get(1000U);
+    small = {};
+
+    auto big = pool->get(tr_block_info::BlockSize);
+    EXPECT_EQ(2U, pool->stats().allocations);
+    EXPECT_EQ(0U, pool->stats().reuses);
+}
+
+TEST_F(BlockPoolTest, respectsLimit)
+{
+    auto pool = tr_block_pool::create(tr_block_info::BlockSize);
+
+    auto a = pool->get(tr_block_info::BlockSize);
+    auto b = pool->get(tr_block_info::BlockSize);
+    a = {};
+    b = {};
+
+    auto stats = pool->stats();
+    EXPECT_EQ(tr_block_info::BlockSize, stats.pooled_bytes);
+    EXPECT_EQ(tr_block_info::BlockSize, stats.limit);
+    EXPECT_EQ(1U, stats.discards);
+
+    pool->setMaxPooledBytes(0U);
+    stats = pool->stats();
+    EXPECT_EQ(0U, stats.pooled_bytes);
+    EXPECT_EQ(0U, stats.limit);
+}
+
+TEST_F(BlockPoolTest, buffersCanOutliveThePool)
+{
+    auto pool = tr_block_pool::create();
+    auto buf = pool->get(tr_block_info::BlockSize);
+    pool.reset();
+
+    auto moved = std::move(buf);
+    EXPECT_EQ(tr_block_info::BlockSize, std::size(moved));
+    std::data(moved)[0] = 1U;
+}
@@ -3,6 +3,14 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/tr-buffer.h>
@@ -61,3 +69,99 @@ TEST_F(BufferTest, startsWithInMultiSegment)
     EXPECT_TRUE(buf->starts_with("Hello, World"sv));
     EXPECT_TRUE(buf->starts_with("Hello, World!"sv));
 }
+
+TEST_F(BufferTest, addReference)
+{
+    static auto constexpr Hello = "Hello, World!"sv;
+
+    auto n_cleanups = 0;
+    auto buf = std::make_unique<Buffer>();
+    buf->add_reference(
+        std::data(Hello),
+        std::size(Hello),
+        [](void const* /*data*/, size_t /*datalen*/, void* vn_cleanups) { ++*static_cast<int*>(vn_cleanups); },
+        &n_cleanups);
+    EXPECT_EQ(std::size(Hello), std::size(*buf));
+    EXPECT_EQ(Hello, buf->to_string());
+    EXPECT_EQ(0, n_cleanups);
+
+    buf.reset();
+    EXPECT_EQ(1, n_cleanups);
+}
+
+TEST_F(BufferTest, reserveAndCommitSpace)
+{
+    static auto constexpr Hello = "Hello, "sv;
+    static auto constexpr World = "World!"sv;
+
+    auto buf = Buffer{ Hello };
+
+    auto* const space = buf.reserve_space(std::size(World));
+    std::copy(std::begin(World), std::end(World), reinterpret_cast<char*>(space));
+    EXPECT_EQ(std::size(Hello), std::size(buf));
+
+    buf.commit_space(space, std::size(World));
+    EXPECT_EQ("Hello, World!"sv, buf.to_string());
+}
+
+TEST_F(BufferTest, forEachSpanInMultiSegment)
+{
+    auto buf = Buffer{};
+    buf.add(Buffer{ "Hello, "sv });
+    buf.add(Buffer{ "World"sv });
+    buf.add(Buffer{ "!"sv });
+
+    auto spans = std::vector<std::string>{};
+    auto const add_span = [&spans](std::byte const* span, size_t span_len)
+    {
+        spans.emplace_back(reinterpret_cast<char const*>(span), span_len);
+    };
+
+    buf.for_each_span(0U, std::size(buf), add_span);
+    EXPECT_EQ("Hello, World!"sv, std::accumulate(std::begin(spans), std::end(spans), std::string{}));
+
+    // a range that starts and ends in the middle of segments
+    spans.clear();
+    buf.for_each_span(3U, 6U, add_span);
+    EXPECT_EQ("lo, Wo"sv, std::accumulate(std::begin(spans), std::end(spans), std::string{}));
+
+    // modify the bytes in place
+    buf.for_each_span(
+        0U,
+        std::size(buf),
+        [](std::byte* span, size_t span_len)
+        {
+            std::transform(span, span + span_len, span, [](std::byte ch) { return ch == std::byte{ 'o' } ? std::byte{ '0' } : ch; });
+        });
+    EXPECT_EQ("Hell0, W0rld!"sv, buf.to_string());
+}
+
+TEST_F(BufferTest, addTransformed)
+{
+    static auto constexpr Hello = "Hello, World!"sv;
+
+    auto n_cleanups = 0;
+    auto src = Buffer{};
+    src.add(Buffer{ "> "sv });
+    src.add_reference(
+        std::data(Hello),
+        std::size(Hello),
+        [](void const* /*data*/, size_t /*datalen*/, void* vn_cleanups) { ++*static_cast<int*>(vn_cleanups); },
+        &n_cleanups);
+
+    auto const to_upper = [](std::byte const* in, std::byte* out, size_t len)
+    {
+        std::transform(in, in + len, out, [](std::byte ch) { return static_cast<std::byte>(std::toupper(static_cast<int>(ch))); });
+    };
+
+    auto dst = Buffer{ "<"sv };
+    dst.add_transformed(src, 5U, to_upper);
+    EXPECT_EQ("<> HEL"sv, dst.to_string());
+    EXPECT_EQ("lo, World!"sv, src.to_string());
+    EXPECT_EQ(0, n_cleanups);
+
+    dst.add_transformed(src, std::size(src), to_upper);
+    EXPECT_EQ("<> HELLO, WORLD!"sv, dst.to_string());
+    EXPECT_TRUE(std::empty(src));
+    EXPECT_EQ(1, n_cleanups);
+}
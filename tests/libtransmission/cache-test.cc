@@ -0,0 +1,332 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/block-pool.h>
+#include <libtransmission/cache.h>
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/inout.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-buffer.h>
+
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+auto constexpr MaxWaitMsec = 5000;
+
+using CacheTest = SessionTest;
+
+namespace
+{
+
+using Block = std::vector<uint8_t>;
+
+[[nodiscard]] std::vector<Block> randomBlocks(tr_torrent const* tor, tr_piece_index_t piece)
+{
+    auto const [begin, end] = tor->blockSpanForPiece(piece);
+    auto blocks = std::vector<Block>{};
+    for (auto block = begin; block < end; ++block)
+    {
+        auto& data = blocks.emplace_back(tor->blockSize(block));
+        tr_rand_buffer(std::data(data), std::size(data));
+    }
+    return blocks;
+}
+
+[[nodiscard]] tr_block_pool::Buf toBuf(tr_session* session, Block const& block)
+{
+    auto buf = session->blockPool().get(std::size(block));
+    std::copy(std::begin(block), std::end(block), std::data(buf));
+    return buf;
+}
+
+// the piece's checksum, computed from scratch
+[[nodiscard]] tr_sha1_digest_t hashBlocks(std::vector<Block> const& blocks)
+{
+    auto sha = tr_sha1::create();
+    for (auto const& block : blocks)
+    {
+        sha->add(std::data(block), std::size(block));
+    }
+    return sha->finish();
+}
+
+} // namespace
+
+TEST_F(CacheTest, prefetchDoesNotReadAheadByDefault)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_TRUE(tor->hasPiece(0));
+
+    auto before = Cache::Stats{};
+    auto after = Cache::Stats{};
+    auto done = false;
+
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+            before = cache.stats();
+            EXPECT_EQ(0, cache.prefetchBlock(tor, tor->pieceLoc(0), tr_block_info::BlockSize));
+            after = cache.stats();
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    // only a hint to the OS; nothing is read on the session thread
+    EXPECT_EQ(before.read_ahead_blocks, after.read_ahead_blocks);
+    EXPECT_EQ(before.bytes_cached, after.bytes_cached);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, prefetchReadsAheadTheRestOfThePiece)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_TRUE(tor->hasPiece(0));
+
+    auto const [begin, end] = tor->blockSpanForPiece(0);
+    auto const n_blocks = uint64_t{ end - begin };
+    EXPECT_LT(1U, n_blocks);
+
+    auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+    buf.fill(0xFF);
+    auto out = libtransmission::Buffer{};
+    auto before = Cache::Stats{};
+    auto after_prefetch = Cache::Stats{};
+    auto after_read = Cache::Stats{};
+    auto read_err = -1;
+    auto done = false;
+
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+            cache.setReadAheadBytes(1024U * 1024U);
+            before = cache.stats();
+
+            // the first request for the piece reads all of its blocks
+            EXPECT_EQ(0, cache.prefetchBlock(tor, tor->pieceLoc(0), tr_block_info::BlockSize));
+            after_prefetch = cache.stats();
+
+            // the next request is served from the cache
+            auto const loc = tor->blockLoc(end - 1);
+            auto const len = tor->blockSize(end - 1);
+            read_err = cache.readBlock(tor, loc, len, out, false);
+            after_read = cache.stats();
+            out.to_buf(std::data(buf), len);
+
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    EXPECT_EQ(before.read_ahead_blocks + n_blocks, after_prefetch.read_ahead_blocks);
+    EXPECT_EQ(before.read_hits, after_prefetch.read_hits);
+    EXPECT_EQ(0, read_err);
+    EXPECT_EQ(after_prefetch.read_hits + 1U, after_read.read_hits);
+    EXPECT_EQ(after_prefetch.read_misses, after_read.read_misses);
+    EXPECT_EQ(after_prefetch.read_ahead_blocks_used + 1U, after_read.read_ahead_blocks_used);
+    EXPECT_TRUE(std::all_of(std::begin(buf), std::end(buf), [](auto ch) { return ch == 0; }));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, countsWritesAndBytesPerTorrent)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+
+    auto before = Cache::Stats{};
+    auto after_write = Cache::Stats{};
+    auto after_flush = Cache::Stats{};
+    auto bytes_per_torrent = std::vector<std::pair<tr_torrent_id_t, size_t>>{};
+    auto done = false;
+
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+            before = cache.stats();
+
+            EXPECT_EQ(0, cache.writeBlock(tor->id(), 0, session_->blockPool().get(tr_block_info::BlockSize)));
+            after_write = cache.stats();
+            bytes_per_torrent = cache.bytesPerTorrent();
+
+            EXPECT_EQ(0, cache.flushTorrent(tor));
+            after_flush = cache.stats();
+
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    EXPECT_EQ(before.blocks_written + 1U, after_write.blocks_written);
+    EXPECT_LE(tr_block_info::BlockSize, after_write.bytes_cached);
+    EXPECT_LE(after_write.bytes_cached, after_write.bytes_allocated);
+    auto const expected = std::make_pair(tor->id(), size_t{ tr_block_info::BlockSize });
+    EXPECT_EQ(1U, std::count(std::begin(bytes_per_torrent), std::end(bytes_per_torrent), expected));
+
+    EXPECT_EQ(after_write.disk_writes + 1U, after_flush.disk_writes);
+    EXPECT_EQ(after_write.disk_write_bytes + tr_block_info::BlockSize, after_flush.disk_write_bytes);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, hashesBlocksThatArriveOutOfOrder)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_FALSE(tor->hasPiece(0));
+
+    auto const [begin, end] = tor->blockSpanForPiece(0);
+    EXPECT_LT(1U, end - begin);
+    auto const blocks = randomBlocks(tor, 0);
+    auto hash = std::optional<tr_sha1_digest_t>{};
+    auto done = false;
+
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+
+            // the last block first, so that none can be hashed until the first one arrives
+            for (auto block = end; block > begin; --block)
+            {
+                EXPECT_EQ(0, cache.writeBlock(tor->id(), block - 1U, toBuf(session_, blocks[block - 1U - begin])));
+            }
+
+            hash = cache.finishPieceHash(tor, 0);
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    ASSERT_TRUE(hash);
+    EXPECT_EQ(hashBlocks(blocks), *hash);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, rereadsBlocksFlushedBeforeThePieceCompletes)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_FALSE(tor->hasPiece(0));
+
+    auto const [begin, end] = tor->blockSpanForPiece(0);
+    EXPECT_LT(1U, end - begin);
+    auto const blocks = randomBlocks(tor, 0);
+    auto done = false;
+
+    // write every block but the first, and flush them to disk
+    // before the first one arrives to be hashed
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+
+            for (auto block = begin + 1U; block < end; ++block)
+            {
+                EXPECT_EQ(0, cache.writeBlock(tor->id(), block, toBuf(session_, blocks[block - begin])));
+            }
+
+            EXPECT_EQ(0, cache.flushFile(tor, 0));
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    auto hash = std::optional<tr_sha1_digest_t>{};
+    auto before = Cache::Stats{};
+    auto after = Cache::Stats{};
+    done = false;
+
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+            before = cache.stats();
+
+            EXPECT_EQ(0, cache.writeBlock(tor->id(), begin, toBuf(session_, blocks.front())));
+            hash = cache.finishPieceHash(tor, 0);
+            after = cache.stats();
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    // the flushed blocks were read back from disk, not from memory
+    EXPECT_EQ(0U, before.bytes_being_written);
+
+    // and the cache's own reads don't count as peer reads
+    EXPECT_EQ(before.read_hits, after.read_hits);
+    EXPECT_EQ(before.read_misses, after.read_misses);
+    ASSERT_TRUE(hash);
+    EXPECT_EQ(hashBlocks(blocks), *hash);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, fallsBackToHashingFromScratch)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_FALSE(tor->hasPiece(0));
+
+    // the piece's correct contents are all zeroes
+    auto const [begin, end] = tor->blockSpanForPiece(0);
+    auto blocks = randomBlocks(tor, 0);
+    for (auto& block : blocks)
+    {
+        std::fill(std::begin(block), std::end(block), 0);
+    }
+    EXPECT_EQ(tor->pieceHash(0), hashBlocks(blocks));
+
+    auto hash_before_write = std::optional<tr_sha1_digest_t>{};
+    auto hash_after_flush = std::optional<tr_sha1_digest_t>{};
+    auto passed = false;
+    auto done = false;
+
+    session_->runInSessionThread(
+        [&]()
+        {
+            auto& cache = *session_->cache;
+
+            // nothing to finish for a piece that no blocks were written to
+            hash_before_write = cache.finishPieceHash(tor, 0);
+
+            for (auto block = begin; block < end; ++block)
+            {
+                EXPECT_EQ(0, cache.writeBlock(tor->id(), block, toBuf(session_, blocks[block - begin])));
+            }
+
+            // flushing the torrent stops tracking its pieces
+            EXPECT_EQ(0, cache.flushTorrent(tor));
+            hash_after_flush = cache.finishPieceHash(tor, 0);
+
+            // so checking the piece hashes it from scratch
+            passed = tr_ioTestPiece(tor, 0);
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    EXPECT_FALSE(hash_before_write);
+    EXPECT_FALSE(hash_after_flush);
+    EXPECT_TRUE(passed);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,138 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Reports the throughput of the ciphers and digests that peers use,
+// as built against this crypto backend.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib> // std::strtoul()
+#include <memory>
+#include <string_view>
+#include <utility> // std::swap()
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "crypto-utils.h"
+#include "tr-arc4.h"
+#include "tr-sha-hw.h"
+
+using namespace std::literals;
+
+namespace
+{
+
+auto constexpr BlockSize = size_t{ 16U * 1024U };
+
+// the byte-at-a-time keystream that tr_arc4 used to have, for comparison
+class ByteByByteArc4
+{
+public:
+    ByteByByteArc4(void const* key, size_t key_length)
+    {
+        for (size_t i = 0; i < 256; ++i)
+        {
+            s_[i] = static_cast<uint8_t>(i);
+        }
+
+        for (size_t i = 0, j = 0; i < 256; ++i)
+        {
+            j = static_cast<uint8_t>(j + s_[i] + static_cast<uint8_t const*>(key)[i % key_length]);
+            std::swap(s_[i], s_[j]);
+        }
+    }
+
+    void process(void const* src_data, void* dst_data, size_t data_length)
+    {
+        for (size_t k = 0; k < data_length; ++k)
+        {
+            i_ += 1;
+            j_ += s_[i_];
+            std::swap(s_[i_], s_[j_]);
+            static_cast<uint8_t*>(dst_data)[k] = static_cast<uint8_t const*>(src_data)[k] ^
+                s_[static_cast<uint8_t>(s_[i_] + s_[j_])];
+        }
+    }
+
+private:
+    std::array<uint8_t, 256> s_ = {};
+    uint8_t i_ = 0;
+    uint8_t j_ = 0;
+};
+
+template<typename Func>
+void run(std::string_view name, size_t n_blocks, Func&& func, size_t blocks_per_call = 1U)
+{
+    auto const begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n_blocks; i += blocks_per_call)
+    {
+        func();
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    auto const n_bytes = static_cast<double>(n_blocks * BlockSize);
+    fmt::print("{:>18s}: {:9.1f} MB/s\n", name, elapsed > 0 ? n_bytes / elapsed / 1e6 : 0.0);
+}
+
+template<typename Cipher>
+void runCipher(std::string_view name, size_t n_blocks, std::vector<uint8_t>& block)
+{
+    static auto constexpr Key = "0123456789abcdef0123"sv;
+    auto cipher = Cipher{ std::data(Key), std::size(Key) };
+    run(name, n_blocks, [&]() { cipher.process(std::data(block), std::data(block), std::size(block)); });
+}
+
+template<typename Digest>
+void runDigest(std::string_view name, size_t n_blocks, std::vector<uint8_t> const& block, std::unique_ptr<Digest> digest)
+{
+    if (!digest)
+    {
+        fmt::print("{:>18s}: not supported\n", name);
+        return;
+    }
+
+    run(name, n_blocks, [&]() { digest->add(std::data(block), std::size(block)); });
+    [[maybe_unused]] auto const result = digest->finish();
+}
+
+// hash pieces of one block each, a batch at a time
+void runHashMany(std::string_view name, size_t n_blocks, std::vector<uint8_t> const& block)
+{
+    auto constexpr BatchSize = size_t{ 8U };
+    auto const input = std::string_view{ reinterpret_cast<char const*>(std::data(block)), std::size(block) };
+    auto const batch = std::vector<std::string_view>(BatchSize, input);
+    run(
+        name,
+        n_blocks,
+        [&]() { [[maybe_unused]] auto const digests = tr_sha1::hash_many(batch); },
+        BatchSize);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto const n_blocks = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000UL;
+
+    auto block = std::vector<uint8_t>(BlockSize);
+    for (size_t i = 0; i < std::size(block); ++i)
+    {
+        block[i] = static_cast<uint8_t>(i);
+    }
+
+    fmt::print("Processing {:d} blocks of {:d} bytes with the {:s} backend\n", n_blocks, BlockSize, CRYPTO_PKG);
+    runCipher<ByteByByteArc4>("RC4 (byte by byte)", n_blocks, block);
+    runCipher<tr_arc4>("RC4", n_blocks, block);
+    runDigest("SHA-1", n_blocks, block, tr_sha1::create());
+    runDigest("SHA-1 (CPU)", n_blocks, block, tr_sha_hw::create_sha1());
+    runHashMany("SHA-1 (hash_many)", n_blocks, block);
+    runDigest("SHA-256", n_blocks, block, tr_sha256::create());
+    runDigest("SHA-256 (CPU)", n_blocks, block, tr_sha_hw::create_sha256());
+
+    return 0;
+}
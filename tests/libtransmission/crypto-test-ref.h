@@ -14,6 +14,7 @@
 #define tr_base64_decode_impl tr_base64_decode_impl_
 #define tr_base64_encode tr_base64_encode_
 #define tr_base64_encode_impl tr_base64_encode_impl_
+#define tr_powm tr_powm_
 #define tr_rand_buffer tr_rand_buffer_
 #define tr_rand_buffer_crypto tr_rand_buffer_crypto_
 #define tr_rand_buffer_std tr_rand_buffer_std_
@@ -49,6 +50,7 @@
 #undef tr_base64_decode_impl
 #undef tr_base64_encode
 #undef tr_base64_encode_impl
+#undef tr_powm
 #undef tr_rand_buffer
 #undef tr_rand_buffer_crypto
 #undef tr_rand_buffer_std
@@ -79,6 +81,7 @@
 #define tr_base64_decode_impl_ tr_base64_decode_impl
 #define tr_base64_encode_ tr_base64_encode
 #define tr_base64_encode_impl_ tr_base64_encode_impl
+#define tr_powm_ tr_powm
 #define tr_rand_buffer_ tr_rand_buffer
 #define tr_rand_buffer_crypto_ tr_rand_buffer_crypto
 #define tr_rand_buffer_std_ tr_rand_buffer_std
@@ -5,18 +5,23 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <numeric>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/peer-mse.h>
 #include <libtransmission/crypto-utils.h>
+#include <libtransmission/tr-arc4.h>
+#include <libtransmission/tr-sha-hw.h>
 #include <libtransmission/utils.h>
 
 #include "crypto-test-ref.h"
@@ -66,6 +71,61 @@ TEST(Crypto, DH)
     EXPECT_NE(toString(a.secret()), toString(c.secret()));
 }
 
+TEST(Crypto, powm)
+{
+    // 4 ^ 13 mod 497 == 445
+    auto constexpr Base = std::array<uint8_t, 1>{ 4 };
+    auto constexpr Exponent = std::array<uint8_t, 1>{ 13 };
+    auto constexpr Modulus = std::array<uint8_t, 2>{ 0x01, 0xF1 };
+    auto result = std::array<uint8_t, 2>{};
+    if (!tr_powm(
+            std::data(Base),
+            std::size(Base),
+            std::data(Exponent),
+            std::size(Exponent),
+            std::data(Modulus),
+            std::size(Modulus),
+            std::data(result)))
+    {
+        GTEST_SKIP() << "this crypto backend has no bignum support";
+    }
+
+    EXPECT_EQ((std::array<uint8_t, 2>{ 0x01, 0xBD }), result);
+}
+
+TEST(Crypto, dhPool)
+{
+    auto pool = tr_message_stream_encryption::DHPool{ 4U };
+
+    // wait for the generator thread to fill the pool
+    auto const deadline = std::chrono::steady_clock::now() + 30s;
+    while (pool.stats().ready < 4U && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_EQ(4U, pool.stats().ready);
+
+    // a full pool doesn't take back keys
+    pool.recycle(tr_message_stream_encryption::DH{});
+    EXPECT_EQ(0U, pool.stats().recycled);
+
+    // a pooled key is as good as a fresh one
+    auto a = pool.take();
+    ASSERT_TRUE(a);
+    auto b = tr_message_stream_encryption::DH{};
+    a->setPeerPublicKey(b.publicKey());
+    b.setPeerPublicKey(a->publicKey());
+    EXPECT_EQ(a->secret(), b.secret());
+
+    auto c = pool.take();
+    ASSERT_TRUE(c);
+    EXPECT_NE(a->publicKey(), c->publicKey());
+
+    auto const stats = pool.stats();
+    EXPECT_EQ(2U, stats.hits);
+    EXPECT_GE(stats.generated, 4U);
+}
+
 TEST(Crypto, encryptDecrypt)
 {
     auto a_dh = tr_message_stream_encryption::DH{};
@@ -101,6 +161,43 @@ TEST(Crypto, encryptDecrypt)
     EXPECT_EQ(Input2, std::data(decrypted2)) << "Input2 " << Input2 << " decrypted2 " << std::data(decrypted2);
 }
 
+TEST(Crypto, arc4)
+{
+    // test vectors from https://en.wikipedia.org/wiki/RC4#Test_vectors
+    auto constexpr Key = "Secret"sv;
+    auto constexpr Plaintext = "Attack at dawn"sv;
+    auto constexpr Expected = std::array<uint8_t, 14>{
+        0x45, 0xA0, 0x1F, 0x64, 0x5F, 0xC3, 0x5B, 0x38, 0x35, 0x52, 0x54, 0x4B, 0x9B, 0xF5,
+    };
+
+    auto key = tr_arc4{ std::data(Key), std::size(Key) };
+    auto encrypted = std::array<uint8_t, std::size(Plaintext)>{};
+    key.process(std::data(Plaintext), std::data(encrypted), std::size(Plaintext));
+    EXPECT_EQ(Expected, encrypted);
+
+    // processing in pieces of any size, or in place, gives the same keystream
+    auto input = std::array<uint8_t, 1000>{};
+    std::iota(std::begin(input), std::end(input), uint8_t{ 0 });
+    auto whole = input;
+    auto whole_key = tr_arc4{ std::data(Key), std::size(Key) };
+    whole_key.process(std::data(whole), std::data(whole), std::size(whole));
+
+    auto pieces = std::array<uint8_t, std::size(input)>{};
+    auto pieces_key = tr_arc4{ std::data(Key), std::size(Key) };
+    for (size_t offset = 0, len = 1; offset < std::size(input); offset += len, ++len)
+    {
+        len = std::min(len, std::size(input) - offset);
+        pieces_key.process(std::data(input) + offset, std::data(pieces) + offset, len);
+    }
+    EXPECT_EQ(whole, pieces);
+
+    auto discarded_key = tr_arc4{ std::data(Key), std::size(Key) };
+    discarded_key.discard(100);
+    auto tail = std::array<uint8_t, std::size(input) - 100>{};
+    discarded_key.process(std::data(input) + 100, std::data(tail), std::size(tail));
+    EXPECT_TRUE(std::equal(std::begin(tail), std::end(tail), std::begin(whole) + 100));
+}
+
 TEST(Crypto, sha1)
 {
     auto hash1 = tr_sha1::digest("test"sv);
@@ -134,6 +231,57 @@ TEST(Crypto, sha1)
     EXPECT_EQ("a94a8fe5ccb19ba61c4c0873d391e987982fbbd3"sv, tr_sha1_to_string(hash5));
 }
 
+TEST(Crypto, sha1HashMany)
+{
+    auto data = std::vector<char>(20000U);
+    std::iota(std::begin(data), std::end(data), char{});
+
+    // lengths around the 64-byte block and padding boundaries
+    auto inputs = std::vector<std::string_view>{};
+    for (auto const len : { 0U, 1U, 55U, 56U, 63U, 64U, 65U, 1000U, 16384U, 16391U, 20000U })
+    {
+        inputs.emplace_back(std::data(data) + std::size(data) - len, len);
+    }
+
+    auto const digests = tr_sha1::hash_many(inputs);
+    ASSERT_EQ(std::size(inputs), std::size(digests));
+    for (size_t i = 0; i < std::size(inputs); ++i)
+    {
+        EXPECT_EQ(tr_sha1::digest(inputs[i]), digests[i]) << std::size(inputs[i]);
+    }
+
+    EXPECT_TRUE(std::empty(tr_sha1::hash_many({})));
+}
+
+TEST(Crypto, shaHardware)
+{
+    auto sha1 = tr_sha_hw::create_sha1();
+    auto sha256 = tr_sha_hw::create_sha256();
+    if (!sha1 || !sha256)
+    {
+        GTEST_SKIP() << "this CPU has no SHA instructions";
+    }
+
+    auto data = std::vector<char>(300U);
+    std::iota(std::begin(data), std::end(data), char{});
+
+    for (size_t len = 0; len <= std::size(data); ++len)
+    {
+        auto const input = std::string_view{ std::data(data), len };
+
+        // feed it in uneven pieces to exercise the partial-block buffering
+        for (size_t pos = 0, step = 1; pos < len; pos += step, step = step * 3U % 70U + 1U)
+        {
+            step = std::min(step, len - pos);
+            sha1->add(std::data(input) + pos, step);
+            sha256->add(std::data(input) + pos, step);
+        }
+
+        EXPECT_EQ(tr_sha1::digest(input), sha1->finish()) << len;
+        EXPECT_EQ(tr_sha256::digest(input), sha256->finish()) << len;
+    }
+}
+
 TEST(Crypto, ssha1)
 {
     struct LocalTest
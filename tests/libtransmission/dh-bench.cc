@@ -0,0 +1,102 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Reports how many encrypted-handshake key exchanges per second
+// we can afford, with and without the crypto backend's bignums
+// and with and without precomputed keys.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib> // std::strtoul()
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <math/wide_integer/uintwide_t.h>
+
+#include "crypto-utils.h"
+#include "peer-mse.h"
+
+using namespace std::literals;
+
+namespace mse = tr_message_stream_encryption;
+
+namespace
+{
+
+// the portable math that DH falls back to when the backend has no bignums
+using key_wi_t = math::wide_integer::uintwide_t<mse::DH::KeySize * 8U>;
+using private_key_wi_t = math::wide_integer::uintwide_t<mse::DH::PrivateKeySize * 8U>;
+auto const Generator = key_wi_t{ mse::DH::Generator };
+auto const Prime = key_wi_t{ mse::DH::Prime };
+
+[[nodiscard]] private_key_wi_t randomPrivateKey()
+{
+    auto ret = private_key_wi_t{};
+    for (auto const byte : mse::DH::randomPrivateKey())
+    {
+        ret <<= 8;
+        ret += static_cast<uint8_t>(byte);
+    }
+    return ret;
+}
+
+template<typename Func>
+void run(std::string_view name, size_t n, Func&& func)
+{
+    auto const begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        func();
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    fmt::print("{:>32s}: {:9.1f} /s\n", name, elapsed > 0 ? static_cast<double>(n) / elapsed : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto const n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200UL;
+
+    fmt::print("Running {:d} key exchanges with the {:s} backend\n", n, CRYPTO_PKG);
+
+    run("public keys (portable)",
+        n,
+        []() { [[maybe_unused]] auto const key = math::wide_integer::powm(Generator, randomPrivateKey(), Prime); });
+    run("public keys", n, []() { [[maybe_unused]] auto const key = mse::DH{}.publicKey(); });
+
+    auto peer = mse::DH{};
+    auto const peer_public_key = peer.publicKey();
+    run("handshakes",
+        n,
+        [&]()
+        {
+            auto dh = mse::DH{};
+            [[maybe_unused]] auto const key = dh.publicKey();
+            dh.setPeerPublicKey(peer_public_key);
+        });
+
+    // handshakes that start with a key the pool made ahead of time
+    auto pool = mse::DHPool{ n };
+    while (pool.stats().ready < n)
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    run("handshakes (precomputed keys)",
+        n,
+        [&]()
+        {
+            auto dh = pool.take().value_or(mse::DH{});
+            [[maybe_unused]] auto const key = dh.publicKey();
+            dh.setPeerPublicKey(peer_public_key);
+        });
+
+    return 0;
+}
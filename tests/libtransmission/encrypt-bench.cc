@@ -0,0 +1,108 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Compares ways of encrypting outgoing piece messages for MSE peers:
+// byte by byte through Buffer::Iterator, with pullup(), and span by span.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib> // std::strtoul()
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "tr-arc4.h"
+#include "tr-buffer.h"
+
+using namespace std::literals;
+using Buffer = libtransmission::Buffer;
+
+namespace
+{
+
+auto constexpr BlockSize = size_t{ 16U * 1024U };
+auto constexpr HeaderSize = size_t{ 13U }; // length, id, index, offset
+
+// a BitTorrent piece message whose block is referenced, like the cache does
+void makePieceMessage(Buffer& buf, std::array<uint8_t, BlockSize> const& block)
+{
+    auto header = std::array<uint8_t, HeaderSize>{};
+    buf.add(header);
+    buf.add_reference(
+        std::data(block),
+        std::size(block),
+        [](void const* /*data*/, size_t /*datalen*/, void* /*arg*/) {
+        },
+        nullptr);
+}
+
+void encryptByteByByte(tr_arc4& key, Buffer& msg, Buffer& out)
+{
+    auto const old_size = std::size(out);
+    out.add(msg.to_string()); // a private copy, since the block is shared
+    msg.clear();
+    for (auto iter = std::begin(out) + old_size, end = std::end(out); iter != end; ++iter)
+    {
+        key.process(&*iter, &*iter, 1);
+    }
+}
+
+void encryptWithPullup(tr_arc4& key, Buffer& msg, Buffer& out)
+{
+    auto [bytes, len] = msg.pullup();
+    key.process(bytes, bytes, len);
+    out.add(msg);
+}
+
+void encryptBySpan(tr_arc4& key, Buffer& msg, Buffer& out)
+{
+    out.add_transformed(
+        msg,
+        std::size(msg),
+        [&key](std::byte const* in, std::byte* span_out, size_t len) { key.process(in, span_out, len); });
+}
+
+template<typename Func>
+void run(std::string_view name, size_t n_messages, std::array<uint8_t, BlockSize> const& block, Func&& encrypt)
+{
+    static auto constexpr Key = "0123456789abcdef0123"sv;
+    auto key = tr_arc4{ std::data(Key), std::size(Key) };
+    auto out = Buffer{};
+
+    auto const begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n_messages; ++i)
+    {
+        auto msg = Buffer{};
+        makePieceMessage(msg, block);
+        encrypt(key, msg, out);
+        out.clear(); // as if it was written to the socket
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    auto const n_bytes = static_cast<double>(n_messages * (HeaderSize + BlockSize));
+    fmt::print("{:>14s}: {:9.1f} MB/s\n", name, elapsed > 0 ? n_bytes / elapsed / 1e6 : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto const n_messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000UL;
+
+    auto block = std::array<uint8_t, BlockSize>{};
+    for (size_t i = 0; i < std::size(block); ++i)
+    {
+        block[i] = static_cast<uint8_t>(i);
+    }
+
+    fmt::print("Encrypting {:d} piece messages of {:d} bytes\n", n_messages, HeaderSize + BlockSize);
+    run("byte by byte", n_messages, block, encryptByteByByte);
+    run("pullup", n_messages, block, encryptWithPullup);
+    run("span by span", n_messages, block, encryptBySpan);
+
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #ifndef _WIN32
 #include <sys/types.h>
@@ -24,6 +25,7 @@
 #include <libtransmission/file.h>
 #include <libtransmission/tr-macros.h>
 #include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
 
 #include "test-fixtures.h"
 
@@ -1217,6 +1219,71 @@ TEST_F(FileTest, fileTruncate)
     tr_sys_path_remove(path);
 }
 
+TEST_F(FileTest, fileWriteAtV)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path = tr_pathbuf{ test_dir, "/a"sv };
+    auto const fd = tr_sys_file_open(path, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600);
+
+    auto str1 = std::string{ "Hello, " };
+    auto str2 = std::string{ "World!" };
+    auto const bufs = std::array<tr_sys_iovec, 2>{ { { std::data(str1), std::size(str1) },
+                                                     { std::data(str2), std::size(str2) } } };
+
+    // write the buffers after a gap
+    tr_error* err = nullptr;
+    auto n_written = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_write_at_v(fd, std::data(bufs), std::size(bufs), 3, &n_written, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(std::size(str1) + std::size(str2), n_written);
+
+    tr_sys_file_close(fd);
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(path, contents, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ("\0\0\0Hello, World!"sv, std::string_view(std::data(contents), std::size(contents)));
+
+    // try to write to a closed file
+    EXPECT_FALSE(tr_sys_file_write_at_v(fd, std::data(bufs), std::size(bufs), 0, &n_written, &err)); // coverity[USE_AFTER_FREE]
+    EXPECT_NE(nullptr, err);
+    tr_error_clear(&err);
+
+    tr_sys_path_remove(path);
+}
+
+TEST_F(FileTest, fileReadAtV)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path = tr_pathbuf{ test_dir, "/a"sv };
+    createFileWithContents(path, "Hello, World!"sv);
+    auto const fd = tr_sys_file_open(path, TR_SYS_FILE_READ, 0);
+
+    auto str1 = std::array<char, 5>{};
+    auto str2 = std::array<char, 4>{};
+    auto const bufs = std::array<tr_sys_iovec, 2>{ { { std::data(str1), std::size(str1) },
+                                                     { std::data(str2), std::size(str2) } } };
+
+    // read into the buffers from an offset
+    tr_error* err = nullptr;
+    auto n_read = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_read_at_v(fd, std::data(bufs), std::size(bufs), 2, &n_read, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(std::size(str1) + std::size(str2), n_read);
+    EXPECT_EQ("llo, "sv, std::string_view(std::data(str1), std::size(str1)));
+    EXPECT_EQ("Worl"sv, std::string_view(std::data(str2), std::size(str2)));
+
+    // short read at the end of the file
+    EXPECT_TRUE(tr_sys_file_read_at_v(fd, std::data(bufs), std::size(bufs), 10, &n_read, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(3U, n_read);
+    EXPECT_EQ("ld!"sv, std::string_view(std::data(str1), n_read));
+
+    tr_sys_file_close(fd);
+}
+
 TEST_F(FileTest, filePreallocate)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -148,11 +148,13 @@ public:
     tr_handshake::Mediator::TorrentInfo const TorrentWeAreSeeding{ tr_sha1::digest("abcde"sv),
                                                                    tr_peerIdInit(),
                                                                    tr_torrent_id_t{ 100 },
-                                                                   true /*is_done*/ };
+                                                                   true /*is_done*/,
+                                                                   false /*is_v2*/ };
     tr_handshake::Mediator::TorrentInfo const UbuntuTorrent{ *tr_sha1_from_string("2c6b6858d61da9543d4231a71db4b1c9264b0685"sv),
                                                              tr_peerIdInit(),
                                                              tr_torrent_id_t{ 101 },
-                                                             false /*is_done*/ };
+                                                             false /*is_done*/,
+                                                             false /*is_v2*/ };
 
     auto createIncomingIo(tr_session* session)
     {
@@ -299,4 +299,48 @@ TEST_F(MakemetaTest, privateAndSourceHasDifferentInfoHash)
     EXPECT_NE(private_metainfo.infoHash(), private_source_metainfo.infoHash());
 }
 
+TEST_F(MakemetaTest, checksumThreadsAgree)
+{
+    // enough 16 KiB pieces to span several of the builder's read chunks
+    auto const top = tr_pathbuf{ sandboxDir(), "/folder"sv };
+    tr_sys_dir_create(top, TR_SYS_DIR_CREATE_PARENTS, 0700);
+    auto const files = makeRandomFiles(top, 12, 2U * 1024U * 1024U);
+    auto builder = tr_metainfo_builder{ top };
+    EXPECT_TRUE(builder.setPieceSize(16U * 1024U));
+
+    // concatenate the payloads in the order that the builder sees them
+    auto contents = std::vector<std::byte>{};
+    for (tr_file_index_t i = 0, n = builder.fileCount(); i < n; ++i)
+    {
+        auto const basename = tr_sys_path_basename(builder.path(i));
+        auto const iter = std::find_if(
+            std::begin(files),
+            std::end(files),
+            [&basename](auto const& file) { return tr_sys_path_basename(file.first) == basename; });
+        ASSERT_NE(std::end(files), iter);
+        contents.insert(std::end(contents), std::begin(iter->second), std::end(iter->second));
+    }
+    EXPECT_EQ(builder.totalSize(), std::size(contents));
+
+    auto info_hashes = std::vector<tr_sha1_digest_t>{};
+    for (size_t const n_threads : { 1U, 3U, 0U })
+    {
+        builder.setChecksumThreads(n_threads);
+        auto const metainfo = testBuilder(builder);
+        EXPECT_EQ(builder.pieceCount(), builder.checksumStatus().first);
+        info_hashes.emplace_back(metainfo.infoHash());
+
+        for (tr_piece_index_t piece = 0, n = builder.pieceCount(); piece < n; ++piece)
+        {
+            auto const offset = size_t{ piece } * builder.pieceSize();
+            auto const len = std::min(size_t{ builder.pieceSize() }, std::size(contents) - offset);
+            auto const piece_data = std::string_view{ reinterpret_cast<char const*>(std::data(contents)) + offset, len };
+            EXPECT_EQ(tr_sha1::digest(piece_data), metainfo.pieceHash(piece))
+                << "piece " << piece << " with " << n_threads << " threads";
+        }
+    }
+
+    EXPECT_EQ(info_hashes.front(), info_hashes.back());
+}
+
 } // namespace libtransmission::test
@@ -0,0 +1,157 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/merkle.h>
+
+#include "gtest/gtest.h"
+
+using namespace tr_merkle;
+
+namespace
+{
+
+[[nodiscard]] std::vector<std::byte> randomBytes(size_t n_bytes)
+{
+    auto bytes = std::vector<std::byte>(n_bytes);
+    tr_rand_buffer(std::data(bytes), std::size(bytes));
+    return bytes;
+}
+
+[[nodiscard]] std::vector<hash_t> leavesOf(std::vector<std::byte> const& bytes)
+{
+    auto leaves = std::vector<hash_t>{};
+    for (size_t offset = 0; offset < std::size(bytes); offset += BlockSize)
+    {
+        leaves.emplace_back(blockHash(std::data(bytes) + offset, std::min(size_t{ BlockSize }, std::size(bytes) - offset)));
+    }
+    return leaves;
+}
+
+} // namespace
+
+TEST(Merkle, helpers)
+{
+    EXPECT_EQ(1U, ceilPow2(0));
+    EXPECT_EQ(1U, ceilPow2(1));
+    EXPECT_EQ(4U, ceilPow2(3));
+    EXPECT_EQ(4U, ceilPow2(4));
+    EXPECT_EQ(0U, tr_merkle::log2(1));
+    EXPECT_EQ(10U, tr_merkle::log2(1024));
+    EXPECT_EQ(0U, leafCount(0));
+    EXPECT_EQ(1U, leafCount(1));
+    EXPECT_EQ(1U, leafCount(BlockSize));
+    EXPECT_EQ(2U, leafCount(BlockSize + 1U));
+}
+
+TEST(Merkle, padHash)
+{
+    EXPECT_EQ(hash_t{}, padHash(0));
+
+    auto const zeroes = std::array<std::byte, 64>{};
+    EXPECT_EQ(tr_sha256::digest(zeroes), padHash(1));
+    EXPECT_EQ(parentHash(padHash(1), padHash(1)), padHash(2));
+}
+
+TEST(Merkle, hasherMatchesLeaves)
+{
+    for (auto const n_bytes : { size_t{ 1U }, size_t{ BlockSize }, size_t{ BlockSize * 3U + 100U }, size_t{ BlockSize * 8U } })
+    {
+        auto const bytes = randomBytes(n_bytes);
+        auto const leaves = leavesOf(bytes);
+
+        // feed the hasher in awkwardly-sized pieces
+        auto hasher = Hasher{};
+        for (size_t offset = 0; offset < n_bytes; offset += 1000U)
+        {
+            hasher.add(std::data(bytes) + offset, std::min(size_t{ 1000U }, n_bytes - offset));
+        }
+        hasher.add(nullptr, 0U);
+
+        auto const width = ceilPow2(std::size(leaves));
+        EXPECT_EQ(root(leaves, width), hasher.finish()) << n_bytes;
+
+        // the hasher should be reusable after finish().
+        // A partial block isn't a leaf until finish() is called.
+        hasher.add(std::data(bytes), std::size(bytes));
+        auto const n_whole_blocks = n_bytes / BlockSize;
+        EXPECT_EQ(n_whole_blocks, std::size(hasher.leaves()));
+        EXPECT_TRUE(std::equal(std::begin(hasher.leaves()), std::end(hasher.leaves()), std::begin(leaves)));
+        EXPECT_EQ(root(leaves, width * 4U), hasher.finish(width * 4U)) << n_bytes;
+    }
+}
+
+TEST(Merkle, root)
+{
+    auto const a = blockHash("a", 1);
+    auto const b = blockHash("b", 1);
+    auto const c = blockHash("c", 1);
+
+    EXPECT_EQ(a, root({ a }, 1));
+    EXPECT_EQ(parentHash(a, b), root({ a, b }, 2));
+    EXPECT_EQ(parentHash(parentHash(a, b), parentHash(c, padHash(0))), root({ a, b, c }, 4));
+    EXPECT_EQ(parentHash(parentHash(a, padHash(0)), padHash(1)), root({ a }, 4));
+    EXPECT_EQ(padHash(3), root({}, 8));
+
+    // a layer above the leaves pads with that layer's pad hashes
+    EXPECT_EQ(parentHash(parentHash(a, b), parentHash(c, padHash(2))), root({ a, b, c }, 4, 2));
+}
+
+TEST(Merkle, unclesProveNode)
+{
+    auto const leaves = leavesOf(randomBytes(BlockSize * 11U));
+    auto const width = ceilPow2(std::size(leaves));
+    auto const expected_root = root(leaves, width);
+    auto const tree = layers(leaves, width);
+
+    for (size_t index = 0; index < std::size(leaves); ++index)
+    {
+        auto const proof = uncles(tree, 0U, 0U, index, 64U);
+        EXPECT_EQ(tr_merkle::log2(width), std::size(proof));
+
+        auto hash = leaves[index];
+        auto walk = index;
+        for (auto const& uncle : proof)
+        {
+            hash = (walk % 2U) == 0U ? parentHash(hash, uncle) : parentHash(uncle, hash);
+            walk /= 2U;
+        }
+        EXPECT_EQ(expected_root, hash) << index;
+    }
+
+    EXPECT_EQ(2U, std::size(uncles(tree, 0U, 0U, 3U, 2U)));
+
+    // a proof can start above the leaves, e.g. for a subtree of 4 leaves
+    auto const proof = uncles(tree, 0U, 2U, 1U, 64U);
+    EXPECT_EQ(tr_merkle::log2(width) - 2U, std::size(proof));
+    auto hash = root(std::vector<hash_t>(std::begin(leaves) + 4, std::begin(leaves) + 8), 4U);
+    auto walk = size_t{ 1U };
+    for (auto const& uncle : proof)
+    {
+        hash = (walk % 2U) == 0U ? parentHash(hash, uncle) : parentHash(uncle, hash);
+        walk /= 2U;
+    }
+    EXPECT_EQ(expected_root, hash);
+}
+
+TEST(Merkle, layersEndWithRoot)
+{
+    auto const leaves = leavesOf(randomBytes(BlockSize * 5U));
+    auto const tree = layers(leaves, 8U);
+
+    ASSERT_EQ(4U, std::size(tree));
+    EXPECT_EQ(leaves, tree.front());
+    EXPECT_EQ(parentLayer(leaves, 0U), tree[1]);
+    EXPECT_EQ(std::vector<hash_t>{ root(leaves, 8U) }, tree.back());
+
+    EXPECT_EQ(std::vector<hash_t>{ padHash(3) }, layers({}, 8U).back());
+}
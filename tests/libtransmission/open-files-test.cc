@@ -10,6 +10,7 @@
 
 #include <libtransmission/error.h>
 #include <libtransmission/file.h>
+#include <libtransmission/open-files.h>
 #include <libtransmission/tr-strbuf.h>
 
 #include "test-fixtures.h"
@@ -196,3 +197,73 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     EXPECT_EQ(sorted, results);
     EXPECT_GT(std::count(std::begin(results), std::end(results), true), 0);
 }
+
+TEST_F(OpenFilesTest, countsHitsMissesAndEvictions)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    static auto constexpr MaxOpenFiles = size_t{ 4U };
+    static auto constexpr NumFiles = tr_file_index_t{ 6U };
+
+    auto& open_files = session_->openFiles();
+    open_files.setMaxOpenFiles(MaxOpenFiles);
+    auto const before = open_files.stats();
+    EXPECT_EQ(MaxOpenFiles, before.limit);
+
+    for (tr_file_index_t i = 0; i < NumFiles; ++i)
+    {
+        auto filename = tr_pathbuf{ sandboxDir(), fmt::format("/file-{:d}.txt"sv, i) };
+        EXPECT_TRUE(open_files.get(TorId, i, true, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    }
+
+    // the two oldest files should have been closed to make room
+    EXPECT_FALSE(open_files.get(TorId, 0, false));
+    EXPECT_FALSE(open_files.get(TorId, 1, false));
+    EXPECT_TRUE(open_files.get(TorId, NumFiles - 1, false));
+
+    auto stats = open_files.stats();
+    EXPECT_EQ(MaxOpenFiles, stats.open);
+    EXPECT_EQ(before.misses + NumFiles, stats.misses);
+    EXPECT_EQ(before.hits + 1U, stats.hits);
+    EXPECT_EQ(before.evictions + (NumFiles - MaxOpenFiles), stats.evictions);
+
+    // shrinking the pool closes the least recently used files
+    open_files.setMaxOpenFiles(1U);
+    EXPECT_TRUE(open_files.get(TorId, NumFiles - 1, false));
+    EXPECT_FALSE(open_files.get(TorId, NumFiles - 2, false));
+    stats = open_files.stats();
+    EXPECT_EQ(1U, stats.open);
+    EXPECT_EQ(1U, stats.limit);
+}
+
+#ifndef _WIN32
+TEST_F(OpenFilesTest, sharesOneSegmentPerOpenFile)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    auto const filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
+    createFileWithContents(filename, Contents);
+
+    auto& open_files = session_->openFiles();
+
+    // no segment for a file that isn't open
+    EXPECT_EQ(nullptr, open_files.fileSegment(TorId, 0, std::size(Contents)));
+
+    // every block served from the file shares the same segment
+    EXPECT_TRUE(open_files.get(TorId, 0, false, filename, TR_PREALLOCATE_NONE, std::size(Contents)));
+    auto* const segment = open_files.fileSegment(TorId, 0, std::size(Contents));
+    EXPECT_NE(nullptr, segment);
+    EXPECT_EQ(segment, open_files.fileSegment(TorId, 0, std::size(Contents)));
+
+    // closing the file drops the pool's segment too
+    open_files.closeFile(TorId, 0);
+    EXPECT_EQ(nullptr, open_files.fileSegment(TorId, 0, std::size(Contents)));
+}
+#endif
+
+TEST_F(OpenFilesTest, autoMaxOpenFilesIsBounded)
+{
+    auto const n = tr_open_files::autoMaxOpenFiles(TR_DEFAULT_PEER_LIMIT_GLOBAL);
+    EXPECT_GE(n, tr_open_files::DefaultMaxOpenFiles);
+    EXPECT_LE(n, 4096U);
+}
@@ -6,10 +6,17 @@
 #define LIBTRANSMISSION_PEER_MODULE
 
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <set>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
+#include <libtransmission/crypto-utils.h> // tr_rand_int()
 #include <libtransmission/peer-mgr-active-requests.h>
 
 #include "gtest/gtest.h"
@@ -186,3 +193,144 @@ TEST_F(PeerMgrActiveRequestsTest, sentBefore)
     EXPECT_EQ(block_a1, items[0].first);
     EXPECT_EQ(peer_a_, items[0].second);
 }
+
+TEST_F(PeerMgrActiveRequestsTest, matchesNaiveBookkeeping)
+{
+    auto requests = ActiveRequests{};
+    auto expected = std::set<std::pair<tr_block_index_t, tr_peer*>>{};
+
+    auto const peers = std::vector<tr_peer*>{ nullptr, peer_a_, peer_b_, peer_c_ };
+    auto constexpr NBlocks = tr_block_index_t{ 64 };
+
+    auto const count_block = [&expected](tr_block_index_t block)
+    {
+        return std::count_if(
+            std::begin(expected),
+            std::end(expected),
+            [block](auto const& item) { return item.first == block; });
+    };
+    auto const count_peer = [&expected](tr_peer const* peer)
+    {
+        return std::count_if(
+            std::begin(expected),
+            std::end(expected),
+            [peer](auto const& item) { return item.second == peer; });
+    };
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        auto const block = static_cast<tr_block_index_t>(tr_rand_int(NBlocks));
+        auto* const peer = peers[tr_rand_int(std::size(peers))];
+
+        switch (tr_rand_int(8U))
+        {
+        case 0:
+            {
+                auto removed = requests.remove(peer);
+                std::sort(std::begin(removed), std::end(removed));
+                auto want = std::vector<tr_block_index_t>{};
+                for (auto iter = std::begin(expected); iter != std::end(expected);)
+                {
+                    if (iter->second == peer)
+                    {
+                        want.push_back(iter->first);
+                        iter = expected.erase(iter);
+                    }
+                    else
+                    {
+                        ++iter;
+                    }
+                }
+                std::sort(std::begin(want), std::end(want));
+                EXPECT_EQ(want, removed);
+                break;
+            }
+
+        case 1:
+            {
+                auto removed = requests.remove(block);
+                std::sort(std::begin(removed), std::end(removed));
+                auto want = std::vector<tr_peer*>{};
+                for (auto* const candidate : peers)
+                {
+                    if (expected.erase({ block, candidate }) != 0U)
+                    {
+                        want.push_back(candidate);
+                    }
+                }
+                std::sort(std::begin(want), std::end(want));
+                EXPECT_EQ(want, removed);
+                break;
+            }
+
+        case 2:
+        case 3:
+            EXPECT_EQ(expected.erase({ block, peer }) != 0U, requests.remove(block, peer));
+            break;
+
+        default:
+            EXPECT_EQ(expected.emplace(block, peer).second, requests.add(block, peer, time_t{}));
+            break;
+        }
+
+        EXPECT_EQ(std::size(expected), requests.size());
+        EXPECT_EQ(expected.count({ block, peer }) != 0U, requests.has(block, peer));
+        EXPECT_EQ(static_cast<size_t>(count_block(block)), requests.count(block));
+        EXPECT_EQ(static_cast<size_t>(count_peer(peer)), requests.count(peer));
+    }
+
+    EXPECT_EQ(std::size(expected), std::size(requests.sentBefore(1)));
+}
+
+TEST_F(PeerMgrActiveRequestsTest, scalesToLargeSwarms)
+{
+    static auto constexpr NPeers = size_t{ 500U };
+    static auto constexpr RequestsPerPeer = size_t{ 500U };
+    static auto constexpr NRounds = size_t{ 2U };
+
+    auto requests = ActiveRequests{};
+    auto peers = std::vector<tr_peer*>{};
+    for (size_t i = 0; i < NPeers; ++i)
+    {
+        peers.emplace_back(reinterpret_cast<tr_peer*>((i + 1U) * 64U));
+    }
+
+    auto n_ops = size_t{};
+    auto const begin_time = std::chrono::steady_clock::now();
+
+    for (size_t round = 0; round < NRounds; ++round)
+    {
+        // every peer gets a window of requests...
+        auto block = static_cast<tr_block_index_t>(round * NPeers * RequestsPerPeer);
+        for (auto* const peer : peers)
+        {
+            for (size_t i = 0; i < RequestsPerPeer; ++i)
+            {
+                EXPECT_TRUE(requests.add(block++, peer, static_cast<time_t>(round)));
+            }
+        }
+        n_ops += NPeers * RequestsPerPeer;
+        EXPECT_EQ(NPeers * RequestsPerPeer, requests.size());
+
+        // ...half of which arrive...
+        for (auto walk = static_cast<tr_block_index_t>(round * NPeers * RequestsPerPeer); walk < block; walk += 2U)
+        {
+            EXPECT_TRUE(requests.has(walk, peers[(walk / RequestsPerPeer) % NPeers]));
+            EXPECT_EQ(1U, std::size(requests.remove(walk)));
+        }
+        n_ops += NPeers * RequestsPerPeer;
+
+        // ...and then every peer chokes us
+        for (auto* const peer : peers)
+        {
+            EXPECT_EQ(RequestsPerPeer / 2U, std::size(requests.remove(peer)));
+        }
+        n_ops += NPeers;
+        EXPECT_EQ(0U, requests.size());
+    }
+
+    auto const elapsed = std::chrono::steady_clock::now() - begin_time;
+    RecordProperty(
+        "nanoseconds_per_op",
+        static_cast<int>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / n_ops));
+}
@@ -0,0 +1,138 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include <libtransmission/peer-mgr-candidates.h>
+
+#include "gtest/gtest.h"
+
+class PeerMgrCandidatesTest : public ::testing::Test
+{
+protected:
+    struct Atom
+    {
+        uint64_t score = {};
+        uint32_t candidate_ticket = {};
+    };
+
+    using Queue = CandidateQueue<Atom>;
+
+    static auto constexpr Score = [](Atom const& atom)
+    {
+        return atom.score;
+    };
+
+    // pop every ready atom, best first
+    static std::vector<Atom*> drain(Queue& queue)
+    {
+        auto atoms = std::vector<Atom*>{};
+        while (auto* const atom = queue.top(Score))
+        {
+            atoms.push_back(atom);
+            queue.pop();
+        }
+        return atoms;
+    }
+};
+
+TEST_F(PeerMgrCandidatesTest, promotesAtomsWhenTheyAreDue)
+{
+    auto atoms = std::array<Atom, 2>{};
+    auto queue = Queue{};
+    queue.schedule(atoms[0], 100);
+    queue.schedule(atoms[1], 200);
+
+    // nothing is ready before it's due
+    queue.promote(99, Score);
+    EXPECT_EQ(nullptr, queue.top(Score));
+
+    // atoms are ready once their due time arrives
+    queue.promote(100, Score);
+    EXPECT_EQ(std::vector<Atom*>{ &atoms[0] }, drain(queue));
+
+    queue.promote(300, Score);
+    EXPECT_EQ(std::vector<Atom*>{ &atoms[1] }, drain(queue));
+}
+
+TEST_F(PeerMgrCandidatesTest, returnsBestScoreFirst)
+{
+    auto atoms = std::array<Atom, 4>{};
+    atoms[0].score = 30;
+    atoms[1].score = 10;
+    atoms[2].score = 40;
+    atoms[3].score = 20;
+
+    auto queue = Queue{};
+    for (auto& atom : atoms)
+    {
+        queue.schedule(atom, 0);
+    }
+    queue.promote(0, Score);
+
+    EXPECT_EQ((std::vector<Atom*>{ &atoms[1], &atoms[3], &atoms[0], &atoms[2] }), drain(queue));
+}
+
+TEST_F(PeerMgrCandidatesTest, skipsStaleEntries)
+{
+    auto atoms = std::array<Atom, 2>{};
+    auto queue = Queue{};
+
+    // queueing an atom again replaces its earlier entry
+    queue.schedule(atoms[0], 10);
+    queue.schedule(atoms[1], 10);
+    queue.schedule(atoms[0], 50);
+
+    queue.promote(10, Score);
+    EXPECT_EQ(std::vector<Atom*>{ &atoms[1] }, drain(queue));
+
+    queue.promote(50, Score);
+    EXPECT_EQ(std::vector<Atom*>{ &atoms[0] }, drain(queue));
+
+    // entries that are already ready go stale too
+    queue.schedule(atoms[0], 60);
+    queue.schedule(atoms[1], 60);
+    queue.promote(60, Score);
+    queue.schedule(atoms[1], 1000);
+    EXPECT_EQ(std::vector<Atom*>{ &atoms[0] }, drain(queue));
+}
+
+TEST_F(PeerMgrCandidatesTest, rescoresAtomsWhenTheyReachTheTop)
+{
+    auto atoms = std::array<Atom, 3>{};
+    atoms[0].score = 10;
+    atoms[1].score = 20;
+    atoms[2].score = 30;
+
+    auto queue = Queue{};
+    for (auto& atom : atoms)
+    {
+        queue.schedule(atom, 0);
+    }
+    queue.promote(0, Score);
+
+    // the best atom got worse while it was waiting
+    atoms[0].score = 25;
+
+    EXPECT_EQ((std::vector<Atom*>{ &atoms[1], &atoms[0], &atoms[2] }), drain(queue));
+}
+
+TEST_F(PeerMgrCandidatesTest, clearDropsEverything)
+{
+    auto atoms = std::array<Atom, 2>{};
+    auto queue = Queue{};
+    queue.schedule(atoms[0], 0);
+    queue.promote(0, Score);
+    queue.schedule(atoms[1], 10);
+
+    queue.clear();
+    queue.promote(10, Score);
+    EXPECT_EQ(nullptr, queue.top(Score));
+}
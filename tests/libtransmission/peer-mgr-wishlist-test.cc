@@ -4,13 +4,18 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <map>
+#include <set>
 #include <type_traits>
+#include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
 
 #include <libtransmission/transmission.h>
 
+#include <libtransmission/bitfield.h>
 #include <libtransmission/peer-mgr-wishlist.h>
 
 #include "gtest/gtest.h"
@@ -24,17 +29,18 @@ protected:
         mutable std::map<tr_piece_index_t, size_t> missing_block_count_;
         mutable std::map<tr_piece_index_t, tr_block_span_t> block_span_;
         mutable std::map<tr_piece_index_t, tr_priority_t> piece_priority_;
+        mutable std::map<tr_piece_index_t, size_t> piece_replication_;
         mutable std::set<tr_block_index_t> can_request_block_;
         mutable std::set<tr_piece_index_t> can_request_piece_;
         tr_piece_index_t piece_count_ = 0;
         bool is_endgame_ = false;
 
-        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const final
+        [[nodiscard]] bool clientHasBlock(tr_block_index_t block) const final
         {
-            return can_request_block_.count(block) != 0;
+            return can_request_block_.count(block) == 0;
         }
 
-        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const final
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t piece) const final
         {
             return can_request_piece_.count(piece) != 0;
         }
@@ -68,7 +74,15 @@ protected:
         {
             return piece_priority_[piece];
         }
+
+        [[nodiscard]] size_t countPieceReplication(tr_piece_index_t piece) const final
+        {
+            return piece_replication_[piece];
+        }
     };
+
+    static constexpr auto PeerHasAllPieces = [](tr_piece_index_t /*piece*/) { return true; };
+    static constexpr auto NoActiveRequestsToPeer = [](tr_block_index_t /*block*/) { return false; };
 };
 
 TEST_F(PeerMgrWishlistTest, doesNotRequestPiecesThatCannotBeRequested)
@@ -92,7 +106,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestPiecesThatCannotBeRequested)
     }
 
     // we should only get the first piece back
-    auto spans = Wishlist{ mediator }.next(1000);
+    auto spans = Wishlist{ mediator }.next(1000, PeerHasAllPieces, NoActiveRequestsToPeer);
     ASSERT_EQ(1U, std::size(spans));
     EXPECT_EQ(mediator.block_span_[0].begin, spans[0].begin);
     EXPECT_EQ(mediator.block_span_[0].end, spans[0].end);
@@ -125,7 +139,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestBlocksThatCannotBeRequested)
 
     // even if we ask wishlist for more blocks than exist,
     // it should omit blocks 1-10 from the return set
-    auto spans = Wishlist{ mediator }.next(1000);
+    auto spans = Wishlist{ mediator }.next(1000, PeerHasAllPieces, NoActiveRequestsToPeer);
     auto requested = tr_bitfield(250);
     for (auto const& span : spans)
     {
@@ -162,7 +176,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestTooManyBlocks)
     // but we only ask for 10 blocks,
     // so that's how many we should get back
     auto const n_wanted = 10U;
-    auto const spans = Wishlist{ mediator }.next(n_wanted);
+    auto const spans = Wishlist{ mediator }.next(n_wanted, PeerHasAllPieces, NoActiveRequestsToPeer);
     auto n_got = size_t{};
     for (auto const& span : spans)
     {
@@ -206,7 +220,7 @@ TEST_F(PeerMgrWishlistTest, prefersHighPriorityPieces)
     for (int run = 0; run < num_runs; ++run)
     {
         auto const n_wanted = 10U;
-        auto spans = Wishlist{ mediator }.next(n_wanted);
+        auto spans = Wishlist{ mediator }.next(n_wanted, PeerHasAllPieces, NoActiveRequestsToPeer);
         auto n_got = size_t{};
         for (auto const& span : spans)
         {
@@ -221,6 +235,67 @@ TEST_F(PeerMgrWishlistTest, prefersHighPriorityPieces)
     }
 }
 
+TEST_F(PeerMgrWishlistTest, prefersRarePieces)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing
+    mediator.piece_count_ = 3;
+    mediator.missing_block_count_[0] = 100;
+    mediator.missing_block_count_[1] = 100;
+    mediator.missing_block_count_[2] = 100;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 300 };
+
+    // and we want everything
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // and the third piece is the rarest
+    mediator.piece_replication_[0] = 5;
+    mediator.piece_replication_[1] = 3;
+    mediator.piece_replication_[2] = 1;
+
+    // wishlist should pick the rarest piece's blocks first
+    auto const num_runs = 100;
+    for (int run = 0; run < num_runs; ++run)
+    {
+        auto const n_wanted = 10U;
+        auto spans = Wishlist{ mediator }.next(n_wanted, PeerHasAllPieces, NoActiveRequestsToPeer);
+        ASSERT_EQ(1U, std::size(spans));
+        EXPECT_EQ(200U, spans.front().begin);
+        EXPECT_EQ(210U, spans.front().end);
+    }
+
+    // but priority matters more than rarity
+    mediator.piece_priority_[0] = TR_PRI_HIGH;
+    auto spans = Wishlist{ mediator }.next(10U, PeerHasAllPieces, NoActiveRequestsToPeer);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(0U, spans.front().begin);
+    EXPECT_EQ(10U, spans.front().end);
+
+    // and a wishlist that's already built picks up changes in rarity
+    mediator.piece_priority_[0] = TR_PRI_NORMAL;
+    auto wishlist = Wishlist{ mediator };
+    spans = wishlist.next(10U, PeerHasAllPieces, NoActiveRequestsToPeer);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(200U, spans.front().begin);
+    EXPECT_EQ(210U, spans.front().end);
+    mediator.piece_replication_[1] = 0;
+    wishlist.pieceChanged(1);
+    spans = wishlist.next(10U, PeerHasAllPieces, NoActiveRequestsToPeer);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(100U, spans.front().begin);
+    EXPECT_EQ(110U, spans.front().end);
+}
+
 TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
 {
     auto mediator = MockMediator{};
@@ -252,7 +327,7 @@ TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
 
     // even if we ask wishlist to list more blocks than exist,
     // those first 150 should be omitted from the return list
-    auto spans = Wishlist{ mediator }.next(1000);
+    auto spans = Wishlist{ mediator }.next(1000, PeerHasAllPieces, NoActiveRequestsToPeer);
     auto requested = tr_bitfield(300);
     for (auto const& span : spans)
     {
@@ -265,7 +340,7 @@ TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
     // BUT during endgame it's OK to request dupes,
     // so then we _should_ see the first 150 in the list
     mediator.is_endgame_ = true;
-    spans = Wishlist{ mediator }.next(1000);
+    spans = Wishlist{ mediator }.next(1000, PeerHasAllPieces, NoActiveRequestsToPeer);
     requested = tr_bitfield(300);
     for (auto const& span : spans)
     {
@@ -315,7 +390,7 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
     auto const num_runs = 1000;
     for (int run = 0; run < num_runs; ++run)
     {
-        auto const ranges = Wishlist{ mediator }.next(10);
+        auto const ranges = Wishlist{ mediator }.next(10, PeerHasAllPieces, NoActiveRequestsToPeer);
         auto requested = tr_bitfield(300);
         for (auto const& range : ranges)
         {
@@ -331,7 +406,7 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
     // those blocks should be next in line.
     for (int run = 0; run < num_runs; ++run)
     {
-        auto const ranges = Wishlist{ mediator }.next(20);
+        auto const ranges = Wishlist{ mediator }.next(20, PeerHasAllPieces, NoActiveRequestsToPeer);
         auto requested = tr_bitfield(300);
         for (auto const& range : ranges)
         {
@@ -343,3 +418,237 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
         EXPECT_EQ(0U, requested.count(200, 300));
     }
 }
+
+TEST_F(PeerMgrWishlistTest, updatesWhenPiecesChange)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing and all wanted
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t piece = 0; piece < 3; ++piece)
+    {
+        mediator.missing_block_count_[piece] = 100;
+        mediator.block_span_[piece] = { piece * 100U, piece * 100U + 100U };
+        mediator.can_request_piece_.insert(piece);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_FALSE(std::empty(wishlist.next(10, PeerHasAllPieces, NoActiveRequestsToPeer)));
+
+    // the last piece gets most of its blocks, so it should go first
+    for (tr_block_index_t i = 200; i < 290; ++i)
+    {
+        mediator.can_request_block_.erase(i);
+    }
+    mediator.missing_block_count_[2] = 10;
+    wishlist.pieceChanged(2);
+    auto spans = wishlist.next(10, PeerHasAllPieces, NoActiveRequestsToPeer);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(290U, spans[0].begin);
+    EXPECT_EQ(300U, spans[0].end);
+
+    // then it completes, so it shouldn't be requested at all
+    for (tr_block_index_t i = 290; i < 300; ++i)
+    {
+        mediator.can_request_block_.erase(i);
+    }
+    mediator.missing_block_count_[2] = 0;
+    wishlist.pieceChanged(2);
+    spans = wishlist.next(1000, PeerHasAllPieces, NoActiveRequestsToPeer);
+    auto requested = tr_bitfield(300);
+    for (auto const& span : spans)
+    {
+        requested.setSpan(span.begin, span.end);
+    }
+    EXPECT_EQ(200U, requested.count(0, 200));
+    EXPECT_EQ(0U, requested.count(200, 300));
+
+    // and if we stop wanting the first piece, so should it
+    mediator.can_request_piece_.erase(0);
+    wishlist.invalidate();
+    spans = wishlist.next(1000, PeerHasAllPieces, NoActiveRequestsToPeer);
+    requested = tr_bitfield(300);
+    for (auto const& span : spans)
+    {
+        requested.setSpan(span.begin, span.end);
+    }
+    EXPECT_EQ(100U, requested.count());
+    EXPECT_EQ(100U, requested.count(100, 200));
+}
+
+TEST_F(PeerMgrWishlistTest, onlyRequestsWhatThePeerCanGive)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing and all wanted
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t piece = 0; piece < 3; ++piece)
+    {
+        mediator.missing_block_count_[piece] = 100;
+        mediator.block_span_[piece] = { piece * 100U, piece * 100U + 100U };
+        mediator.can_request_piece_.insert(piece);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // the peer only has the middle piece, and we've
+    // already asked it for the first half of that
+    auto const peer_has_piece = [](tr_piece_index_t piece) { return piece == 1; };
+    auto const has_active_request_to_peer = [](tr_block_index_t block) { return block < 150; };
+
+    auto const spans = Wishlist{ mediator }.next(1000, peer_has_piece, has_active_request_to_peer);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(150U, spans[0].begin);
+    EXPECT_EQ(200U, spans[0].end);
+}
+
+// A large torrent being downloaded from a lot of peers.
+// The wishlist should only look at pieces that changed between
+// calls to next(), not walk every piece for every peer.
+TEST_F(PeerMgrWishlistTest, scalesToLargeSwarms)
+{
+    static auto constexpr NPieces = tr_piece_index_t{ 100000U };
+    static auto constexpr BlocksPerPiece = tr_block_index_t{ 16U };
+    static auto constexpr NPeers = size_t{ 200U };
+    static auto constexpr NRounds = size_t{ 5U };
+    static auto constexpr BlocksPerRequest = size_t{ 32U };
+
+    struct ScaleMediator final : public Wishlist::Mediator
+    {
+        ScaleMediator()
+            : has_block_{ size_t{ NPieces } * BlocksPerPiece }
+            , missing_(NPieces, BlocksPerPiece)
+            , active_requests_(size_t{ NPieces } * BlocksPerPiece)
+            , replication_(NPieces, NPeers / 2U)
+        {
+        }
+
+        [[nodiscard]] bool clientHasBlock(tr_block_index_t block) const final
+        {
+            return has_block_.test(block);
+        }
+
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t /*piece*/) const final
+        {
+            ++n_piece_queries_;
+            return true;
+        }
+
+        [[nodiscard]] bool isEndgame() const final
+        {
+            return false;
+        }
+
+        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const final
+        {
+            return active_requests_[block];
+        }
+
+        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const final
+        {
+            ++n_piece_queries_;
+            return missing_[piece];
+        }
+
+        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const final
+        {
+            return { piece * BlocksPerPiece, (piece + 1U) * BlocksPerPiece };
+        }
+
+        [[nodiscard]] tr_piece_index_t countAllPieces() const final
+        {
+            return NPieces;
+        }
+
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t /*piece*/) const final
+        {
+            ++n_piece_queries_;
+            return TR_PRI_NORMAL;
+        }
+
+        [[nodiscard]] size_t countPieceReplication(tr_piece_index_t piece) const final
+        {
+            ++n_piece_queries_;
+            return replication_[piece];
+        }
+
+        tr_bitfield has_block_;
+        std::vector<size_t> missing_;
+        std::vector<size_t> active_requests_;
+        std::vector<size_t> replication_;
+        mutable size_t n_piece_queries_ = 0;
+    };
+
+    auto mediator = ScaleMediator{};
+    auto wishlist = Wishlist{ mediator };
+    auto n_pieces_changed = size_t{};
+    auto const begin_time = std::chrono::steady_clock::now();
+
+    for (size_t round = 0; round < NRounds; ++round)
+    {
+        // every peer asks for more blocks...
+        auto requested = std::vector<tr_block_index_t>{};
+        for (size_t peer = 0; peer < NPeers; ++peer)
+        {
+            auto const peer_has_piece = [peer](tr_piece_index_t piece) { return (piece + peer) % 3U != 0U; };
+
+            for (auto const& span : wishlist.next(BlocksPerRequest, peer_has_piece, NoActiveRequestsToPeer))
+            {
+                for (auto block = span.begin; block < span.end; ++block)
+                {
+                    ++mediator.active_requests_[block];
+                    requested.push_back(block);
+                }
+            }
+        }
+
+        // ...and then the blocks arrive
+        auto changed = std::set<tr_piece_index_t>{};
+        for (auto const block : requested)
+        {
+            --mediator.active_requests_[block];
+            mediator.has_block_.set(block);
+            --mediator.missing_[block / BlocksPerPiece];
+            changed.insert(block / BlocksPerPiece);
+        }
+
+        // ...and peers announce pieces they just got
+        for (tr_piece_index_t piece = round; piece < NPieces; piece += 97U)
+        {
+            ++mediator.replication_[piece];
+            changed.insert(piece);
+        }
+
+        EXPECT_EQ(NPeers * BlocksPerRequest, std::size(requested));
+        for (auto const piece : changed)
+        {
+            wishlist.pieceChanged(piece);
+        }
+        n_pieces_changed += std::size(changed);
+
+        // the first round builds the wishlist; after that,
+        // only the pieces that changed should be looked at
+        if (round == 0U)
+        {
+            mediator.n_piece_queries_ = 0;
+        }
+    }
+
+    // flush the last round's changes
+    EXPECT_FALSE(std::empty(wishlist.next(BlocksPerRequest, PeerHasAllPieces, NoActiveRequestsToPeer)));
+
+    auto const elapsed = std::chrono::steady_clock::now() - begin_time;
+    RecordProperty(
+        "microseconds_per_request",
+        static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / (NPeers * NRounds)));
+
+    // at most four queries per changed piece: wanted, missing blocks, priority, replication
+    EXPECT_LT(0U, mediator.n_piece_queries_);
+    EXPECT_LE(mediator.n_piece_queries_, n_pieces_changed * 4U);
+}
@@ -0,0 +1,114 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstddef> // size_t
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/piece-checker.h>
+#include <libtransmission/tr-strbuf.h>
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+class PieceCheckerTest : public libtransmission::test::SandboxedTest
+{
+protected:
+    static auto constexpr Prefix = "prefix"sv;
+
+    struct Result
+    {
+        tr_torrent_id_t tor_id = {};
+        tr_piece_index_t piece = {};
+        bool aborted = false;
+        bool pass = false;
+    };
+
+    // Write `contents` into two files, after some unrelated leading bytes
+    // in the first one, and build a task for the piece that spans them.
+    [[nodiscard]] tr_piece_checker::Task makeTask(std::string_view contents, size_t split) const
+    {
+        auto const filename1 = std::string{ tr_pathbuf{ sandboxDir(), "/file1" }.sv() };
+        auto const filename2 = std::string{ tr_pathbuf{ sandboxDir(), "/file2" }.sv() };
+        createFileWithContents(filename1, std::string{ Prefix } + std::string{ contents.substr(0, split) });
+        createFileWithContents(filename2, contents.substr(split));
+
+        auto task = tr_piece_checker::Task{};
+        task.tor_id = 1;
+        task.piece = 2;
+        task.expected = tr_sha1::digest(contents);
+        task.spans.push_back({ filename1, std::size(Prefix), split });
+        task.spans.push_back({ filename2, 0, std::size(contents) - split });
+        return task;
+    }
+
+    static Result check(tr_piece_checker::Task&& task)
+    {
+        auto promise = std::promise<Result>{};
+        auto future = promise.get_future();
+
+        auto checker = tr_piece_checker{};
+        checker.addCallback([&promise](tr_torrent_id_t tor_id, tr_piece_index_t piece, bool aborted, bool pass)
+                            { promise.set_value(Result{ tor_id, piece, aborted, pass }); });
+        checker.add(std::move(task));
+
+        EXPECT_EQ(std::future_status::ready, future.wait_for(5s));
+        return future.get();
+    }
+};
+
+TEST_F(PieceCheckerTest, passesGoodPiece)
+{
+    static auto constexpr Contents = "Hello, World! This piece spans two files."sv;
+
+    auto const result = check(makeTask(Contents, 10));
+    EXPECT_EQ(1, result.tor_id);
+    EXPECT_EQ(2U, result.piece);
+    EXPECT_FALSE(result.aborted);
+    EXPECT_TRUE(result.pass);
+}
+
+TEST_F(PieceCheckerTest, failsCorruptPiece)
+{
+    static auto constexpr Contents = "Hello, World! This piece spans two files."sv;
+
+    auto task = makeTask(Contents, 10);
+    task.expected = tr_sha1::digest("Goodbye, World!"sv);
+
+    auto const result = check(std::move(task));
+    EXPECT_FALSE(result.aborted);
+    EXPECT_FALSE(result.pass);
+}
+
+TEST_F(PieceCheckerTest, failsMissingFile)
+{
+    static auto constexpr Contents = "Hello, World! This piece spans two files."sv;
+
+    auto task = makeTask(Contents, 10);
+    task.spans.back().filename.clear();
+
+    auto const result = check(std::move(task));
+    EXPECT_FALSE(result.aborted);
+    EXPECT_FALSE(result.pass);
+}
+
+TEST_F(PieceCheckerTest, failsShortFile)
+{
+    static auto constexpr Contents = "Hello, World! This piece spans two files."sv;
+
+    auto task = makeTask(Contents, 10);
+    task.spans.back().length += 100U;
+
+    auto const result = check(std::move(task));
+    EXPECT_FALSE(result.aborted);
+    EXPECT_FALSE(result.pass);
+}
@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <libtransmission/transmission.h>
+#include <libtransmission/peer-mse.h>
 #include <libtransmission/rpcimpl.h>
 #include <libtransmission/variant.h>
 
@@ -11,6 +12,7 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <set>
 #include <string_view>
 #include <vector>
@@ -185,4 +187,106 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr, nullptr);
 }
 
+TEST_F(RpcTest, sessionStatsReportsWebStats)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+    tr_variant response;
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* web = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(args, TR_KEY_web, &web));
+
+    auto const expected = session_->webStats();
+    auto requests_served = int64_t{ -1 };
+    auto connections_opened = int64_t{ -1 };
+    EXPECT_TRUE(tr_variantDictFindInt(web, TR_KEY_requests_served, &requests_served));
+    EXPECT_TRUE(tr_variantDictFindInt(web, TR_KEY_connections_opened, &connections_opened));
+    EXPECT_EQ(static_cast<int64_t>(expected.requests_served), requests_served);
+    EXPECT_EQ(static_cast<int64_t>(expected.connections_opened), connections_opened);
+
+    tr_variantClear(&response);
+}
+
+TEST_F(RpcTest, sessionStatsReportsBlockPoolStats)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+    tr_variant response;
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* block_pool = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(args, TR_KEY_block_pool, &block_pool));
+
+    // the limit comes from the block-pool-size-kb setting
+    auto limit = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(block_pool, TR_KEY_limit, &limit));
+    EXPECT_EQ(4096 * 1024, limit);
+
+    for (auto const key : { TR_KEY_pooled_bytes, TR_KEY_allocations, TR_KEY_reuses, TR_KEY_discards })
+    {
+        auto val = int64_t{ -1 };
+        EXPECT_TRUE(tr_variantDictFindInt(block_pool, key, &val));
+        EXPECT_LE(0, val);
+    }
+
+    tr_variantClear(&response);
+}
+
+TEST_F(RpcTest, sessionStatsReportsDHPoolStats)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+    tr_variant response;
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* dh_pool = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(args, TR_KEY_dh_pool, &dh_pool));
+
+    // the pool fills up in the background, but never past its size
+    auto ready = int64_t{ -1 };
+    EXPECT_TRUE(tr_variantDictFindInt(dh_pool, TR_KEY_ready, &ready));
+    EXPECT_LE(0, ready);
+    EXPECT_GE(static_cast<int64_t>(tr_message_stream_encryption::DHPool::DefaultSize), ready);
+
+    for (auto const key : { TR_KEY_hits, TR_KEY_misses, TR_KEY_generated, TR_KEY_recycled })
+    {
+        auto val = int64_t{ -1 };
+        EXPECT_TRUE(tr_variantDictFindInt(dh_pool, key, &val));
+        EXPECT_LE(0, val);
+    }
+
+    tr_variantClear(&response);
+}
+
 } // namespace libtransmission::test
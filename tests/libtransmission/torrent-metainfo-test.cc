@@ -4,12 +4,18 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <cstddef>
+#include <string>
 #include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
 
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/crypto-utils.h>
 #include <libtransmission/error.h>
+#include <libtransmission/merkle.h>
 #include <libtransmission/torrent-metainfo.h>
 #include <libtransmission/torrent.h>
 #include <libtransmission/tr-strbuf.h>
@@ -267,4 +273,172 @@ TEST_F(TorrentMetainfoTest, parseBencOOBWrite)
     EXPECT_FALSE(tm.parseBenc(tr_base64_decode("ZGg0OmluZm9kNjpwaWVjZXMzOkFpzQ==")));
 }
 
+namespace
+{
+
+[[nodiscard]] std::string bencStr(std::string_view str)
+{
+    return fmt::format("{:d}:{:s}", std::size(str), str);
+}
+
+template<typename T>
+[[nodiscard]] std::string bencStr(T const& bytes)
+{
+    return bencStr(std::string_view{ reinterpret_cast<char const*>(std::data(bytes)), std::size(bytes) * sizeof(bytes[0]) });
+}
+
+[[nodiscard]] std::string v2FileNode(size_t size, tr_sha256_digest_t const& root)
+{
+    return fmt::format("d0:d6:lengthi{:d}e11:pieces root{:s}ee", size, bencStr(root));
+}
+
+// A BitTorrent v2 torrent with two files: "a", which is three
+// pieces long and has a piece layer, and "b", which fits in one piece.
+struct V2Fixture
+{
+    static auto constexpr PieceSize = size_t{ 32U * 1024U };
+    static auto constexpr SizeA = size_t{ 80U * 1024U };
+    static auto constexpr SizeB = size_t{ 10U * 1024U };
+
+    V2Fixture()
+    {
+        auto contents = std::vector<char>(SizeA);
+        tr_rand_buffer(std::data(contents), std::size(contents));
+        auto hasher = tr_merkle::Hasher{};
+        hasher.add(std::data(contents), std::size(contents));
+        leaves_a = hasher.leaves();
+        root_a = hasher.finish();
+        layer_a = tr_merkle::parentLayer(leaves_a, 0U);
+
+        contents.resize(SizeB);
+        hasher.add(std::data(contents), std::size(contents));
+        root_b = hasher.finish();
+    }
+
+    [[nodiscard]] std::string fileTree(size_t size_b) const
+    {
+        return fmt::format("9:file treed1:a{:s}1:b{:s}e", v2FileNode(SizeA, root_a), v2FileNode(size_b, root_b));
+    }
+
+    [[nodiscard]] std::string pieceLayers() const
+    {
+        return fmt::format("12:piece layersd{:s}{:s}e", bencStr(root_a), bencStr(layer_a));
+    }
+
+    [[nodiscard]] std::string v2Only() const
+    {
+        return fmt::format(
+            "d4:infod{:s}12:meta versioni2e4:name4:test12:piece lengthi{:d}ee{:s}e",
+            fileTree(SizeB),
+            PieceSize,
+            pieceLayers());
+    }
+
+    [[nodiscard]] std::string hybrid(size_t size_b) const
+    {
+        auto const pad_size = PieceSize * 3U - SizeA;
+        auto const files = fmt::format(
+            "5:filesld6:lengthi{:d}e4:pathl1:aeed4:attr1:p6:lengthi{:d}e4:pathl4:.pad{:s}eed6:lengthi{:d}e4:pathl1:beee",
+            SizeA,
+            pad_size,
+            bencStr(std::to_string(pad_size)),
+            SizeB);
+        auto const pieces = std::string(20U * 4U, 'x');
+        return fmt::format(
+            "d4:infod{:s}{:s}12:meta versioni2e4:name4:test12:piece lengthi{:d}e6:pieces{:s}ee{:s}e",
+            fileTree(size_b),
+            files,
+            PieceSize,
+            bencStr(pieces),
+            pieceLayers());
+    }
+
+    std::vector<tr_sha256_digest_t> leaves_a;
+    std::vector<tr_sha256_digest_t> layer_a;
+    tr_sha256_digest_t root_a = {};
+    tr_sha256_digest_t root_b = {};
+};
+
+} // namespace
+
+TEST_F(TorrentMetainfoTest, parseV2Only)
+{
+    auto const fixture = V2Fixture{};
+    auto tm = tr_torrent_metainfo{};
+    tr_error* error = nullptr;
+    EXPECT_TRUE(tm.parseBenc(fixture.v2Only(), &error)) << (error != nullptr ? error->message : "");
+    tr_error_clear(&error);
+
+    EXPECT_FALSE(tm.hasV1Metadata());
+    EXPECT_TRUE(tm.hasV2Metadata());
+
+    // "a", a padding file to align "b" to a piece boundary, and "b"
+    EXPECT_EQ(3U, tm.fileCount());
+    EXPECT_EQ("test/a"sv, tm.fileSubpath(0));
+    EXPECT_EQ(V2Fixture::PieceSize * 3U - V2Fixture::SizeA, tm.fileSize(1));
+    EXPECT_EQ("test/b"sv, tm.fileSubpath(2));
+    EXPECT_EQ(4U, tm.pieceCount());
+
+    // v2-only torrents use the truncated sha256 info hash
+    EXPECT_EQ(tm.infoHashString(), std::string_view{ tm.infoHash2String() }.substr(0, 40));
+
+    ASSERT_EQ(2U, std::size(tm.v2Files()));
+    EXPECT_EQ(fixture.root_a, tm.v2Files()[0].root);
+    ASSERT_FALSE(std::empty(tm.v2Files()[0].layers));
+    EXPECT_EQ(fixture.layer_a, tm.v2Files()[0].layers.front());
+    EXPECT_EQ(std::vector<tr_sha256_digest_t>{ fixture.root_a }, tm.v2Files()[0].layers.back());
+    EXPECT_EQ(&tm.v2Files()[1], tm.findV2File(fixture.root_b));
+
+    // the last piece of "a" is only one block long
+    auto v2_piece = tm.v2Piece(2);
+    ASSERT_TRUE(v2_piece);
+    EXPECT_EQ(V2Fixture::SizeA - V2Fixture::PieceSize * 2U, v2_piece->n_bytes);
+    EXPECT_EQ(4U, v2_piece->first_leaf);
+    EXPECT_EQ(2U, v2_piece->width);
+    EXPECT_EQ(fixture.layer_a[2], v2_piece->hash);
+
+    // "b" fits in one piece, so its piece hash is its root
+    v2_piece = tm.v2Piece(3);
+    ASSERT_TRUE(v2_piece);
+    EXPECT_EQ(V2Fixture::SizeB, v2_piece->n_bytes);
+    EXPECT_EQ(1U, v2_piece->width);
+    EXPECT_EQ(fixture.root_b, v2_piece->hash);
+}
+
+TEST_F(TorrentMetainfoTest, parseV2OnlyBadPieceLayer)
+{
+    auto fixture = V2Fixture{};
+    fixture.layer_a[1] = fixture.layer_a[0];
+
+    auto tm = tr_torrent_metainfo{};
+    tr_error* error = nullptr;
+    EXPECT_FALSE(tm.parseBenc(fixture.v2Only(), &error));
+    EXPECT_NE(nullptr, error);
+    tr_error_clear(&error);
+}
+
+TEST_F(TorrentMetainfoTest, parseHybrid)
+{
+    auto const fixture = V2Fixture{};
+    auto tm = tr_torrent_metainfo{};
+    EXPECT_TRUE(tm.parseBenc(fixture.hybrid(V2Fixture::SizeB)));
+
+    EXPECT_TRUE(tm.hasV1Metadata());
+    EXPECT_TRUE(tm.hasV2Metadata());
+    EXPECT_EQ(3U, tm.fileCount());
+    EXPECT_EQ(4U, tm.pieceCount());
+    EXPECT_NE(tm.infoHashString(), std::string_view{ tm.infoHash2String() }.substr(0, 40));
+
+    ASSERT_EQ(2U, std::size(tm.v2Files()));
+    EXPECT_EQ(0U, tm.v2Files()[0].file);
+    EXPECT_EQ(2U, tm.v2Files()[1].file);
+    EXPECT_EQ(3U, tm.v2Files()[1].first_piece);
+
+    // if the file tree doesn't match the file list, fall back to v1
+    auto fallback = tr_torrent_metainfo{};
+    EXPECT_TRUE(fallback.parseBenc(fixture.hybrid(V2Fixture::SizeB + 1U)));
+    EXPECT_TRUE(fallback.hasV1Metadata());
+    EXPECT_FALSE(fallback.hasV2Metadata());
+}
+
 } // namespace libtransmission::test
@@ -0,0 +1,354 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/net.h>
+#include <libtransmission/session.h>
+#include <libtransmission/tr-dht.h>
+
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+auto constexpr MaxWaitMsec = 5000;
+
+class UdpTest : public SessionTest
+{
+protected:
+    using Core = tr_session::tr_udp_core;
+    using Payload = std::vector<unsigned char>;
+
+    class FakeDht final : public tr_dht
+    {
+    public:
+        void addNode(tr_address const& /*address*/, tr_port /*port*/) override
+        {
+        }
+
+        void handleMessage(unsigned char const* msg, size_t msglen, sockaddr* /*from*/, socklen_t /*fromlen*/) override
+        {
+            terminated = terminated && msg[msglen] == '\0';
+            messages.emplace_back(reinterpret_cast<char const*>(msg), msglen);
+        }
+
+        std::vector<std::string> messages;
+        bool terminated = true;
+    };
+
+    [[nodiscard]] Core& core()
+    {
+        return *session_->udp_core_;
+    }
+
+    template<typename Func>
+    void runInSessionThreadAndWait(Func&& func)
+    {
+        auto done = false;
+        session_->runInSessionThread(
+            [&]()
+            {
+                func();
+                done = true;
+            });
+        EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+    }
+
+    // must be called in the session thread
+    void swapDht(std::unique_ptr<tr_dht>& dht)
+    {
+        std::swap(session_->dht_, dht);
+    }
+
+    // must be called in the session thread
+    void swapSocket4(tr_socket_t& sock)
+    {
+        std::swap(core().udp4_socket_, sock);
+    }
+
+    // must be called in the session thread
+    void onReadable(tr_socket_t sock)
+    {
+        Core::onReadable(sock, EV_READ, &core());
+    }
+
+    // Queue a packet for the IPv4 socket. The tests' sockets are connected,
+    // so the packet is sent without an address.
+    // Must be called in the session thread.
+    void queue(Payload const& payload)
+    {
+        auto const [ss, sslen] = tr_address::from_string("127.0.0.1")->to_sockaddr(tr_port::fromHost(1));
+        core().sendtoBatched(std::data(payload), std::size(payload), reinterpret_cast<sockaddr const*>(&ss), sslen);
+        core().send_queue_.back().tolen = 0;
+    }
+
+    // must be called in the session thread
+    void flush()
+    {
+        core().flush();
+    }
+
+    [[nodiscard]] auto const& sendQueue()
+    {
+        return core().send_queue_;
+    }
+
+    [[nodiscard]] auto const& sendQueueBytes()
+    {
+        return core().send_queue_bytes_;
+    }
+
+    [[nodiscard]] static std::vector<Payload> readAll(tr_socket_t sock)
+    {
+        auto payloads = std::vector<Payload>{};
+        auto buf = std::array<unsigned char, 4096>{};
+        for (;;)
+        {
+            auto const n_read = recv(sock, reinterpret_cast<char*>(std::data(buf)), std::size(buf), 0);
+            if (n_read < 0)
+            {
+                break;
+            }
+
+            payloads.emplace_back(std::data(buf), std::data(buf) + n_read);
+        }
+        return payloads;
+    }
+};
+
+TEST_F(UdpTest, readsAndDispatchesBatchesOfPackets)
+{
+    // a loopback socket for the session to read from
+    auto const loopback = *tr_address::from_string("127.0.0.1");
+    auto const reader = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(TR_BAD_SOCKET, reader);
+    auto [ss, sslen] = loopback.to_sockaddr(tr_port::fromHost(0));
+    ASSERT_EQ(0, bind(reader, reinterpret_cast<sockaddr const*>(&ss), sslen));
+    ASSERT_EQ(0, getsockname(reader, reinterpret_cast<sockaddr*>(&ss), &sslen));
+    evutil_make_socket_nonblocking(reader);
+
+    // more DHT messages than fit in one batch, mixed with UDP tracker
+    // packets that the DHT shouldn't see
+    auto const writer = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(TR_BAD_SOCKET, writer);
+    auto expected = std::vector<std::string>{};
+    auto n_sent = size_t{};
+    for (size_t i = 0; i < Core::MaxBatchSize + 8U; ++i)
+    {
+        auto const msg = fmt::format("d1:ti{:d}ee", i);
+        auto const tracker_msg = std::string{ "\0\0\0\3\0\0\0\0", 8U };
+        for (auto const& packet : { msg, tracker_msg })
+        {
+            auto const
+                rc = sendto(writer, std::data(packet), std::size(packet), 0, reinterpret_cast<sockaddr const*>(&ss), sslen);
+            ASSERT_EQ(static_cast<int>(std::size(packet)), rc);
+            ++n_sent;
+        }
+        expected.emplace_back(msg);
+    }
+    tr_net_close_socket(writer);
+
+    auto dht = std::unique_ptr<tr_dht>{ std::make_unique<FakeDht>() };
+    auto const* const fake_dht = static_cast<FakeDht const*>(dht.get());
+    auto before = Core::Stats{};
+    auto after = Core::Stats{};
+    runInSessionThreadAndWait(
+        [&]()
+        {
+            swapDht(dht);
+            before = core().stats();
+            onReadable(reader);
+            after = core().stats();
+            swapDht(dht);
+        });
+    tr_net_close_socket(reader);
+
+    EXPECT_EQ(expected, fake_dht->messages);
+    EXPECT_TRUE(fake_dht->terminated);
+    EXPECT_EQ(before.wakeups + 1U, after.wakeups);
+    EXPECT_EQ(before.packets_received + n_sent, after.packets_received);
+    EXPECT_LE(n_sent, after.max_packets_per_wakeup);
+#ifdef __linux__
+    // recvmmsg() reads the packets in full batches
+    EXPECT_EQ(before.receive_calls + (n_sent + Core::MaxBatchSize - 1U) / Core::MaxBatchSize, after.receive_calls);
+#endif
+}
+
+#ifndef _WIN32
+
+namespace
+{
+
+auto constexpr NumPackets = size_t{ 8U };
+auto constexpr PacketSize = size_t{ 2000U };
+
+// A datagram socketpair whose writer only has room for a couple of the
+// packets before sending would block.
+[[nodiscard]] std::array<tr_socket_t, 2> makeSocketPair()
+{
+    auto fds = std::array<tr_socket_t, 2>{ TR_BAD_SOCKET, TR_BAD_SOCKET };
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, std::data(fds)));
+    for (auto const fd : fds)
+    {
+        evutil_make_socket_nonblocking(fd);
+    }
+
+    auto const sndbuf = int{ 1 }; // rounded up to the smallest size allowed
+    EXPECT_EQ(0, setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)));
+    return fds;
+}
+
+[[nodiscard]] std::vector<std::vector<unsigned char>> makePayloads()
+{
+    auto payloads = std::vector<std::vector<unsigned char>>{};
+    for (size_t i = 0; i < NumPackets; ++i)
+    {
+        payloads.emplace_back(PacketSize, static_cast<unsigned char>(i + 1U));
+    }
+    return payloads;
+}
+
+} // namespace
+
+TEST_F(UdpTest, retriesPacketsThatWouldBlockInPlace)
+{
+    auto const fds = makeSocketPair();
+    auto const reader = fds[0];
+    auto const writer = fds[1];
+    auto const payloads = makePayloads();
+
+    auto before = Core::Stats{};
+    auto after_first_flush = Core::Stats{};
+    auto after = Core::Stats{};
+    auto queued_bytes = static_cast<unsigned char const*>(nullptr);
+    auto retried_bytes = static_cast<unsigned char const*>(nullptr);
+    auto retry_queue = std::decay_t<decltype(sendQueue())>{};
+    auto received = std::vector<Payload>{};
+    auto queue_is_empty = false;
+
+    runInSessionThreadAndWait(
+        [&]()
+        {
+            auto sock = writer;
+            swapSocket4(sock);
+            before = core().stats();
+
+            for (auto const& payload : payloads)
+            {
+                queue(payload);
+            }
+            queued_bytes = std::data(sendQueueBytes());
+
+            // the socket takes a couple of the packets, then would block
+            flush();
+            after_first_flush = core().stats();
+            retry_queue = sendQueue();
+            retried_bytes = std::data(sendQueueBytes());
+
+            // make room for the rest, then retry
+            received = readAll(reader);
+            auto const sndbuf = int{ 1024 * 1024 };
+            setsockopt(writer, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+            flush();
+            after = core().stats();
+            queue_is_empty = std::empty(sendQueue()) && std::empty(sendQueueBytes());
+
+            for (auto& payload : readAll(reader))
+            {
+                received.emplace_back(std::move(payload));
+            }
+
+            swapSocket4(sock);
+        });
+    tr_net_close_socket(reader);
+    tr_net_close_socket(writer);
+
+    auto const n_sent_first = after_first_flush.packets_sent - before.packets_sent;
+    EXPECT_LT(0U, n_sent_first);
+    EXPECT_LT(n_sent_first, NumPackets);
+
+    // the unsent packets are kept where they were
+    EXPECT_EQ(queued_bytes, retried_bytes);
+    ASSERT_EQ(NumPackets - n_sent_first, std::size(retry_queue));
+    for (size_t i = 0; i < std::size(retry_queue); ++i)
+    {
+        EXPECT_TRUE(retry_queue[i].retried);
+        EXPECT_EQ((n_sent_first + i) * PacketSize, retry_queue[i].offset);
+        EXPECT_EQ(PacketSize, retry_queue[i].length);
+    }
+
+    // and the retry sends them, in order
+    EXPECT_EQ(payloads, received);
+    EXPECT_EQ(before.packets_sent + NumPackets, after.packets_sent);
+    EXPECT_EQ(before.send_would_block, after.send_would_block);
+    EXPECT_EQ(before.send_errors, after.send_errors);
+    EXPECT_TRUE(queue_is_empty);
+}
+
+TEST_F(UdpTest, dropsPacketsThatStillWouldBlock)
+{
+    auto const fds = makeSocketPair();
+    auto const reader = fds[0];
+    auto const writer = fds[1];
+    auto const payloads = makePayloads();
+
+    auto before = Core::Stats{};
+    auto after = Core::Stats{};
+    auto received = std::vector<Payload>{};
+    auto queue_is_empty = false;
+
+    runInSessionThreadAndWait(
+        [&]()
+        {
+            auto sock = writer;
+            swapSocket4(sock);
+            before = core().stats();
+
+            for (auto const& payload : payloads)
+            {
+                queue(payload);
+            }
+
+            // nothing is read in between, so the retry would block too
+            flush();
+            flush();
+            after = core().stats();
+            queue_is_empty = std::empty(sendQueue()) && std::empty(sendQueueBytes());
+            received = readAll(reader);
+
+            swapSocket4(sock);
+        });
+    tr_net_close_socket(reader);
+    tr_net_close_socket(writer);
+
+    auto const n_sent = after.packets_sent - before.packets_sent;
+    EXPECT_LT(0U, n_sent);
+    EXPECT_EQ(NumPackets, n_sent + (after.send_would_block - before.send_would_block));
+    EXPECT_EQ(before.send_errors, after.send_errors);
+    EXPECT_EQ(std::vector<Payload>(std::begin(payloads), std::begin(payloads) + n_sent), received);
+    EXPECT_TRUE(queue_is_empty);
+}
+
+#endif // _WIN32
+
+} // namespace libtransmission::test
@@ -0,0 +1,69 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/torrent.h>
+#include <libtransmission/variant.h>
+
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class VerifyTest
+    : public SessionTest
+    , public ::testing::WithParamInterface<size_t>
+{
+protected:
+    void SetUp() override
+    {
+        tr_variantDictAddInt(settings(), TR_KEY_verify_threads, GetParam());
+
+        SessionTest::SetUp();
+    }
+};
+
+TEST_P(VerifyTest, verifiesCompleteTorrent)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+    EXPECT_EQ(tor->pieceCount(), tor->checked_pieces_.count());
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_P(VerifyTest, findsCorruptPiece)
+{
+    // the test zero_torrent's first piece is corrupt
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    blockingTorrentVerify(tor);
+
+    EXPECT_EQ(tor->pieceSize(), tr_torrentStat(tor)->leftUntilDone);
+    EXPECT_FALSE(tor->hasPiece(0));
+    for (tr_piece_index_t piece = 1, n = tor->pieceCount(); piece < n; ++piece)
+    {
+        EXPECT_TRUE(tor->hasPiece(piece));
+    }
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Verify,
+    VerifyTest,
+    ::testing::Values(
+        // one thread reads the whole torrent
+        size_t{ 1U },
+        // the pieces get split between threads
+        size_t{ 4U },
+        // more threads than pieces
+        size_t{ 64U }));
+
+} // namespace libtransmission::test
@@ -0,0 +1,184 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint> // uint64_t
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/write-behind.h>
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+class WriteBehindTest : public libtransmission::test::SandboxedTest
+{
+protected:
+    struct Result
+    {
+        tr_torrent_id_t tor_id = {};
+        int err = {};
+        std::string errmsg;
+    };
+
+    [[nodiscard]] tr_write_behind::callback_func callback()
+    {
+        return [this](uint64_t task_id, tr_torrent_id_t tor_id, int err, std::string const& errmsg)
+        {
+            auto const lock = std::lock_guard(mutex_);
+            results_[task_id] = Result{ tor_id, err, errmsg };
+        };
+    }
+
+    [[nodiscard]] static tr_write_behind::Task makeTask(
+        uint64_t id,
+        std::string_view filename,
+        int open_flags,
+        uint64_t offset,
+        std::string& contents)
+    {
+        auto const path = std::string{ filename };
+        auto span = tr_write_behind::Task::Span{};
+        span.file = std::make_shared<tr_write_behind::File>(tr_sys_file_open(path.c_str(), open_flags, 0600), path);
+        span.offset = offset;
+        span.bufs.push_back({ std::data(contents), std::size(contents) });
+
+        auto task = tr_write_behind::Task{};
+        task.id = id;
+        task.tor_id = 1;
+        task.spans.emplace_back(std::move(span));
+        return task;
+    }
+
+    std::mutex mutex_;
+    std::map<uint64_t, Result> results_;
+};
+
+TEST_F(WriteBehindTest, writesTasks)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/file"sv };
+    auto str1 = std::string{ "Hello, " };
+    auto str2 = std::string{ "World!" };
+
+    auto writer = tr_write_behind{ callback() };
+    writer.add(makeTask(1, filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, std::size(str1), str2));
+    writer.add(makeTask(2, filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0, str1));
+    writer.wait(1);
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        EXPECT_EQ(2U, std::size(results_));
+        for (auto const& [id, result] : results_)
+        {
+            EXPECT_EQ(1, result.tor_id);
+            EXPECT_EQ(0, result.err) << result.errmsg;
+        }
+    }
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    EXPECT_EQ("Hello, World!"sv, std::string_view(std::data(contents), std::size(contents)));
+}
+
+TEST_F(WriteBehindTest, reportsErrors)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/file"sv };
+    createFileWithContents(filename, "Hello, World!"sv);
+    auto str = std::string{ "Goodbye" };
+
+    auto writer = tr_write_behind{ callback() };
+    writer.add(makeTask(1, filename, TR_SYS_FILE_READ, 0, str));
+    writer.wait(1);
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        EXPECT_EQ(1U, std::size(results_));
+        EXPECT_NE(0, results_[1].err);
+        EXPECT_NE(std::string::npos, results_[1].errmsg.find(filename.sv()));
+    }
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    EXPECT_EQ("Hello, World!"sv, std::string_view(std::data(contents), std::size(contents)));
+}
+
+TEST_F(WriteBehindTest, finishesQueuedTasksWhenDestroyed)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/file"sv };
+    auto str = std::string{ "Hello, World!" };
+
+    {
+        auto writer = tr_write_behind{ callback() };
+        writer.add(makeTask(1, filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0, str));
+    }
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    EXPECT_EQ("Hello, World!"sv, std::string_view(std::data(contents), std::size(contents)));
+}
+
+TEST_F(WriteBehindTest, newerOverlappingWritesWin)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/file"sv };
+
+    // queue rounds of writes that overlap each other,
+    // so that some of them are likely to share a batch
+    auto strs = std::deque<std::string>{};
+    auto writer = tr_write_behind{ callback() };
+    auto id = uint64_t{};
+    for (char ch = 'a'; ch <= 'z'; ++ch)
+    {
+        writer.add(makeTask(++id, filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0, strs.emplace_back(8U, ch)));
+        writer.add(makeTask(++id, filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 2, strs.emplace_back(4U, ch - 32)));
+        writer.add(makeTask(++id, filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 3, strs.emplace_back(2U, ch)));
+    }
+    writer.wait(1);
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    EXPECT_EQ("zzZzzZzz"sv, std::string_view(std::data(contents), std::size(contents)));
+}
+
+TEST_F(WriteBehindTest, sharesOneFilePerQueuedFile)
+{
+    auto const filename = tr_pathbuf{ sandboxDir(), "/file"sv };
+    auto str = std::string{ "Hello, World!" };
+
+    auto writer = tr_write_behind{ callback() };
+    EXPECT_EQ(nullptr, writer.findFile(1, 0));
+
+    auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    auto file = writer.addFile(1, 0, fd, std::string{ filename });
+    EXPECT_EQ(file, writer.findFile(1, 0));
+    EXPECT_EQ(nullptr, writer.findFile(1, 1));
+    EXPECT_EQ(nullptr, writer.findFile(2, 0));
+
+    auto task = tr_write_behind::Task{};
+    task.id = 1;
+    task.tor_id = 1;
+    auto& span = task.spans.emplace_back();
+    span.file = std::move(file);
+    span.bufs.push_back({ std::data(str), std::size(str) });
+    writer.add(std::move(task));
+
+    // the file is closed once no queued writes are using it
+    writer.wait(1);
+    EXPECT_EQ(nullptr, writer.findFile(1, 0));
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    EXPECT_EQ("Hello, World!"sv, std::string_view(std::data(contents), std::size(contents)));
+}
@@ -6,6 +6,7 @@
 #include <array>
 #include <cstdlib> // for strtoul()
 #include <chrono>
+#include <cstddef> // for size_t
 #include <cstdint> // for uint32_t
 #include <future>
 #include <string>
@@ -35,7 +36,7 @@ char constexpr Usage[] = "Usage: transmission-create [options] <file|directory>"
 
 uint32_t constexpr KiB = 1024;
 
-auto constexpr Options = std::array<tr_option, 10>{
+auto constexpr Options = std::array<tr_option, 11>{
     { { 'p', "private", "Allow this torrent to only be used with the specified tracker(s)", "p", false, nullptr },
       { 'r', "source", "Set the source for private trackers", "r", true, "<source>" },
       { 'o', "outfile", "Save the generated .torrent to this filename", "o", true, "<file>" },
@@ -43,6 +44,7 @@ auto constexpr Options = std::array<tr_option, 10>{
       { 'c', "comment", "Add a comment", "c", true, "<comment>" },
       { 't', "tracker", "Add a tracker's announce URL", "t", true, "<url>" },
       { 'w', "webseed", "Add a webseed URL", "w", true, "<url>" },
+      { 'j', "threads", "Hash with this many threads (default: one per CPU core)", "j", true, "<count>" },
       { 'x', "anonymize", "Omit \"Creation date\" and \"Created by\" info", nullptr, false, nullptr },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
@@ -57,6 +59,7 @@ struct app_options
     std::string_view infile;
     std::string_view source;
     uint32_t piece_size = 0;
+    size_t n_threads = 0;
     bool anonymize = false;
     bool is_private = false;
     bool show_version = false;
@@ -111,6 +114,10 @@ int parseCommandLine(app_options& options, int argc, char const* const* argv)
             options.source = optarg;
             break;
 
+        case 'j':
+            options.n_threads = strtoul(optarg, nullptr, 10);
+            break;
+
         case 'x':
             options.anonymize = true;
             break;
@@ -247,6 +254,7 @@ int tr_main(int argc, char* argv[])
 
     builder.setPrivate(options.is_private);
     builder.setAnonymize(options.anonymize);
+    builder.setChecksumThreads(options.n_threads);
     builder.setWebseeds(std::move(options.webseeds));
     builder.setAnnounceList(std::move(options.trackers));
 
@@ -1943,6 +1943,155 @@ static void printSessionStats(tr_variant* top)
             fmt::print("  Ratio:      {:s}\n", strlratio(up, down));
             fmt::print("  Duration:   {:s}\n", tr_strltime(secs));
         }
+
+        if (tr_variantDictFindDict(args, TR_KEY_cache, &d))
+        {
+            auto const get_int = [d](tr_quark key)
+            {
+                auto val = int64_t{};
+                return tr_variantDictFindInt(d, key, &val) ? val : int64_t{};
+            };
+
+            auto const hits = get_int(TR_KEY_read_hits);
+            auto const misses = get_int(TR_KEY_read_misses);
+            auto const disk_writes = get_int(TR_KEY_disk_writes);
+
+            fmt::print("\nCACHE\n");
+            fmt::print(
+                "  Size:              {:s} of {:s} ({:s} allocated)\n",
+                strlmem(get_int(TR_KEY_bytes_cached)),
+                strlmem(get_int(TR_KEY_limit)),
+                strlmem(get_int(TR_KEY_bytes_allocated)));
+            fmt::print("  Being written:     {:s}\n", strlmem(get_int(TR_KEY_bytes_being_written)));
+            fmt::print(
+                "  Read hits:         {:d} of {:d} ({:s}%)\n",
+                hits,
+                hits + misses,
+                strlpercent(hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0));
+            fmt::print(
+                "  Read ahead:        {:d} blocks, {:d} used\n",
+                get_int(TR_KEY_read_ahead_blocks),
+                get_int(TR_KEY_read_ahead_blocks_used));
+            fmt::print(
+                "  Writes:            {:d} blocks in {:d} disk writes ({:s} blocks per write)\n",
+                get_int(TR_KEY_blocks_written),
+                disk_writes,
+                strlratio(get_int(TR_KEY_blocks_written), disk_writes));
+            fmt::print("  Written to disk:   {:s}\n", strlsize(get_int(TR_KEY_disk_write_bytes)));
+
+            if (tr_variant* histogram = nullptr; tr_variantDictFindList(d, TR_KEY_flush_latency_histogram, &histogram))
+            {
+                fmt::print("  Write latency:\n");
+                for (size_t i = 0, n = tr_variantListSize(histogram); i < n; ++i)
+                {
+                    auto count = int64_t{};
+                    if (!tr_variantGetInt(tr_variantListChild(histogram, i), &count))
+                    {
+                        continue;
+                    }
+
+                    if (i + 1 < n || i == 0)
+                    {
+                        fmt::print("    < {:4d} ms: {:d}\n", 1 << i, count);
+                    }
+                    else
+                    {
+                        fmt::print("    >={:4d} ms: {:d}\n", 1 << (i - 1), count);
+                    }
+                }
+            }
+
+            if (tr_variant* torrents = nullptr; tr_variantDictFindList(d, TR_KEY_torrents, &torrents))
+            {
+                for (size_t i = 0, n = tr_variantListSize(torrents); i < n; ++i)
+                {
+                    auto* const entry = tr_variantListChild(torrents, i);
+                    auto id = int64_t{};
+                    auto bytes = int64_t{};
+                    if (tr_variantDictFindInt(entry, TR_KEY_id, &id) && tr_variantDictFindInt(entry, TR_KEY_bytes, &bytes))
+                    {
+                        fmt::print("  Torrent #{:d}:       {:s}\n", id, strlmem(bytes));
+                    }
+                }
+            }
+        }
+
+        if (tr_variantDictFindDict(args, TR_KEY_block_pool, &d))
+        {
+            auto const get_int = [d](tr_quark key)
+            {
+                auto val = int64_t{};
+                return tr_variantDictFindInt(d, key, &val) ? val : int64_t{};
+            };
+
+            fmt::print("\nBLOCK POOL\n");
+            fmt::print(
+                "  Pooled:            {:s} of {:s}\n",
+                strlmem(get_int(TR_KEY_pooled_bytes)),
+                strlmem(get_int(TR_KEY_limit)));
+            fmt::print(
+                "  Buffers:           {:d} allocated, {:d} reused, {:d} discarded\n",
+                get_int(TR_KEY_allocations),
+                get_int(TR_KEY_reuses),
+                get_int(TR_KEY_discards));
+        }
+
+        if (tr_variantDictFindDict(args, TR_KEY_dh_pool, &d))
+        {
+            auto const get_int = [d](tr_quark key)
+            {
+                auto val = int64_t{};
+                return tr_variantDictFindInt(d, key, &val) ? val : int64_t{};
+            };
+
+            fmt::print("\nDH POOL\n");
+            fmt::print(
+                "  Keypairs:          {:d} ready, {:d} generated, {:d} recycled\n",
+                get_int(TR_KEY_ready),
+                get_int(TR_KEY_generated),
+                get_int(TR_KEY_recycled));
+            fmt::print("  Handshakes:        {:d} hits, {:d} misses\n", get_int(TR_KEY_hits), get_int(TR_KEY_misses));
+        }
+
+        if (tr_variantDictFindDict(args, TR_KEY_udp, &d))
+        {
+            auto const get_int = [d](tr_quark key)
+            {
+                auto val = int64_t{};
+                return tr_variantDictFindInt(d, key, &val) ? val : int64_t{};
+            };
+
+            fmt::print("\nUDP\n");
+            fmt::print(
+                "  Received:          {:d} packets in {:d} wakeups and {:d} calls (at most {:d} per wakeup)\n",
+                get_int(TR_KEY_packets_received),
+                get_int(TR_KEY_wakeups),
+                get_int(TR_KEY_receive_calls),
+                get_int(TR_KEY_max_packets_per_wakeup));
+            fmt::print(
+                "  Sent:              {:d} packets in {:d} calls\n",
+                get_int(TR_KEY_packets_sent),
+                get_int(TR_KEY_send_calls));
+            fmt::print(
+                "  Dropped:           {:d} packets while the send buffer was full, {:d} on errors\n",
+                get_int(TR_KEY_send_would_block),
+                get_int(TR_KEY_send_errors));
+        }
+
+        if (tr_variantDictFindDict(args, TR_KEY_web, &d))
+        {
+            auto const get_int = [d](tr_quark key)
+            {
+                auto val = int64_t{};
+                return tr_variantDictFindInt(d, key, &val) ? val : int64_t{};
+            };
+
+            fmt::print("\nWEB\n");
+            fmt::print(
+                "  Requests:          {:d} over {:d} new connections\n",
+                get_int(TR_KEY_requests_served),
+                get_int(TR_KEY_connections_opened));
+        }
     }
 }
 